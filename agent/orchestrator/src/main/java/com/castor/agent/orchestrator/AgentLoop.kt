@@ -4,11 +4,18 @@ import android.util.Log
 import com.castor.core.inference.InferenceEngine
 import com.castor.core.inference.context.ContextCompressor
 import com.castor.core.inference.prompt.ConversationTurn
-import com.castor.core.inference.prompt.PromptFormat
 import com.castor.core.inference.prompt.PromptFormatter
+import com.castor.core.inference.tool.ToolCall
+import com.castor.core.inference.tool.ToolCallGrammar
 import com.castor.core.inference.tool.ToolCallParser
 import com.castor.core.inference.tool.ToolRegistry
+import com.castor.core.inference.tool.ToolResult
 import com.castor.agent.orchestrator.tools.ToolInitializer
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.Deferred
+import kotlinx.coroutines.async
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.coroutineScope
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -36,16 +43,21 @@ data class AgentLoopResult(
  * 2. messages = [system, ...history, user(input)]
  * 3. for turn in 0..MAX_TURNS:
  *    a. Check context window, compress if needed
- *    b. Format messages via PromptFormatter
- *    c. response = engine.generateRaw(formattedPrompt)
- *    d. toolCalls = ToolCallParser.parse(response)
- *    e. if no tool calls: return response text (done)
- *    f. messages += assistant(response)
- *    g. for each toolCall:
- *       result = toolRegistry.dispatch(toolCall)
- *       messages += tool(result)
+ *    b. Inject the tools block into the system turn
+ *    c. response = engine.generateChat(turns) (rendered by the model's template;
+ *       turns already in the KV cache from the previous turn are not re-decoded);
+ *       <tool_call> blocks are grammar-constrained to the registered tools;
+ *       each is dispatched via toolRegistry.dispatch as soon
+ *       as its block closes (parallel-safe tools concurrently, each
+ *       under its own deadline); generation stops after the last one
+ *    d. if no tool calls: return response text (done)
+ *    e. messages += assistant(response)
+ *    f. for each toolCall, in order: messages += tool(result)
  * 4. Return last response or timeout message
  * ```
+ *
+ * After each run the compressor's rolling summary is extended in the background,
+ * so compression in step 3a is a lookup rather than an LLM call.
  */
 @Singleton
 class AgentLoop @Inject constructor(
@@ -82,11 +94,14 @@ class AgentLoop @Inject constructor(
      * Run the agent loop for a single user input.
      *
      * @param userInput The user's natural language input.
+     * @param conversationId Identifies the conversation for its rolling summary
+     *   ([ConversationManager.currentConversationId]).
      * @param conversationHistory Previous turns from [ConversationManager], if any.
      * @return An [AgentLoopResult] with the final response.
      */
     suspend fun run(
         userInput: String,
+        conversationId: String,
         conversationHistory: List<ConversationTurn> = emptyList()
     ): AgentLoopResult {
         // Step 0: Ensure all tools are registered
@@ -95,6 +110,7 @@ class AgentLoop @Inject constructor(
         // Step 1: Build system prompt and tools block
         val systemPrompt = promptBuilder.buildSystemPrompt()
         val toolsBlock = promptBuilder.getToolsBlock()
+        val toolGrammar = if (toolsBlock.isNotBlank()) toolRegistry.getToolCallGrammar() else null
 
         // Step 2: Initialize messages
         val messages = mutableListOf<ConversationTurn>()
@@ -118,12 +134,11 @@ class AgentLoop @Inject constructor(
             Log.d(TAG, "Agent turn $turn/${MAX_TURNS - 1}, messages=${messages.size}")
 
             // 3a: Check context window, compress if needed
-            val compressed = contextCompressor.compress(messages, CONTEXT_WINDOW)
+            val compressed = contextCompressor.compress(messages, conversationId, CONTEXT_WINDOW)
             val workingMessages = compressed.toMutableList()
 
-            // 3b: Format messages with tools block
-            val formattedPrompt = PromptFormatter.formatMultiTurnWithTools(
-                format = PromptFormat.CHATML,
+            // 3b: Inject tools block; the engine renders the chat template
+            val chatTurns = PromptFormatter.injectToolsBlock(
                 turns = workingMessages,
                 toolsBlock = toolsBlock.takeIf { it.isNotBlank() }
             )
@@ -135,12 +150,8 @@ class AgentLoop @Inject constructor(
                 TOOL_TEMPERATURE
             }
 
-            val response = try {
-                engine.generateRaw(
-                    formattedPrompt = formattedPrompt,
-                    maxTokens = GENERATION_MAX_TOKENS,
-                    temperature = temperature
-                )
+            val output = try {
+                generateAndDispatch(chatTurns, temperature, toolGrammar)
             } catch (e: Exception) {
                 Log.e(TAG, "Generation failed on turn $turn", e)
                 return AgentLoopResult(
@@ -150,15 +161,15 @@ class AgentLoop @Inject constructor(
                 )
             }
 
+            val response = output.response
             lastResponse = response
 
-            // 3d: Parse tool calls
-            val toolCalls = ToolCallParser.parse(response)
-
-            // 3e: If no tool calls, we're done — return the text response
-            if (toolCalls.isEmpty()) {
+            // 3d: If no tool calls, we're done — return the text response
+            if (output.executed.isEmpty()) {
                 val cleanResponse = ToolCallParser.stripToolCalls(response).trim()
                 Log.d(TAG, "No tool calls on turn $turn, returning response (${cleanResponse.length} chars)")
+                messages.add(ConversationTurn(role = "assistant", content = cleanResponse))
+                contextCompressor.onExchangeComplete(messages, conversationId, CONTEXT_WINDOW)
                 return AgentLoopResult(
                     response = cleanResponse,
                     turnsUsed = turn + 1,
@@ -166,17 +177,15 @@ class AgentLoop @Inject constructor(
                 )
             }
 
-            // 3f: Add assistant response to messages
+            // 3e: Add assistant response to messages
             messages.add(ConversationTurn(role = "assistant", content = response))
 
-            // 3g: Dispatch each tool call and add results
-            for (call in toolCalls) {
-                Log.d(TAG, "Dispatching tool: ${call.name}")
-                val result = toolRegistry.dispatch(call)
+            // 3f: Add each tool result, in the order the calls were made
+            for ((call, result) in output.executed) {
                 totalToolCalls++
 
-                val toolResponseText = ToolCallParser.formatToolResponse(call, result)
-                messages.add(ConversationTurn(role = "tool", content = toolResponseText))
+                val toolResultText = ToolCallParser.formatToolResult(call, result)
+                messages.add(ConversationTurn(role = "tool", content = toolResultText))
 
                 Log.d(TAG, "Tool ${call.name} result: success=${result.success}, " +
                     "output=${result.output.take(100)}")
@@ -185,6 +194,7 @@ class AgentLoop @Inject constructor(
 
         // Step 4: Ran out of turns
         Log.w(TAG, "Agent loop exhausted $MAX_TURNS turns")
+        contextCompressor.onExchangeComplete(messages, conversationId, CONTEXT_WINDOW)
         val cleanResponse = ToolCallParser.stripToolCalls(lastResponse).trim()
         val finalResponse = if (cleanResponse.isNotBlank()) {
             "$TIMEOUT_MSG\n\n$cleanResponse"
@@ -198,4 +208,63 @@ class AgentLoop @Inject constructor(
             toolCallsMade = totalToolCalls
         )
     }
+
+    /**
+     * Output of one agent turn: the model's text and each tool call it made,
+     * paired with its result.
+     */
+    private data class TurnOutput(
+        val response: String,
+        val executed: List<Pair<ToolCall, ToolResult>>
+    )
+
+    /**
+     * Generate one turn and dispatch its tool calls.
+     *
+     * The engine reports each `<tool_call>` the moment its block closes and stops
+     * generating after the last one, so dispatch overlaps with decoding instead of
+     * waiting for the full output. Calls to parallel-safe tools start right away and
+     * run concurrently; any other call first waits for the calls before it, so side
+     * effects happen in the order the model made them. Results are always returned
+     * in call order. Engines that do not stream tool calls (mock mode) fall back to
+     * parsing the finished output.
+     */
+    private suspend fun generateAndDispatch(
+        turns: List<ConversationTurn>,
+        temperature: Float,
+        toolGrammar: ToolCallGrammar?
+    ): TurnOutput = coroutineScope {
+        val streamedCalls = Channel<ToolCall>(Channel.UNLIMITED)
+        val dispatcher = async {
+            val pending = mutableListOf<Pair<ToolCall, Deferred<ToolResult>>>()
+            for (call in streamedCalls) {
+                Log.d(TAG, "Dispatching tool: ${call.name}")
+                pending += call to if (toolRegistry.isParallelSafe(call.name)) {
+                    async { toolRegistry.dispatch(call) }
+                } else {
+                    pending.forEach { (_, result) -> result.join() }
+                    CompletableDeferred(toolRegistry.dispatch(call))
+                }
+            }
+            pending.map { (call, result) -> call to result.await() }
+        }
+
+        val response = try {
+            engine.generateChat(
+                turns = turns,
+                maxTokens = GENERATION_MAX_TOKENS,
+                temperature = temperature,
+                onToolCall = { call -> streamedCalls.trySend(call) },
+                toolGrammar = toolGrammar
+            )
+        } finally {
+            streamedCalls.close()
+        }
+
+        val executed = dispatcher.await()
+        if (executed.isNotEmpty()) return@coroutineScope TurnOutput(response, executed)
+
+        val parsed = ToolCallParser.parse(response)
+        TurnOutput(response, parsed.zip(toolRegistry.dispatchAll(parsed)))
+    }
 }
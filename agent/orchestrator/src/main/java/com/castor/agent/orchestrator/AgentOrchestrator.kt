@@ -6,6 +6,8 @@ import com.castor.core.common.model.MediaSource
 import com.castor.core.common.model.MessageSource
 import com.castor.core.inference.InferenceEngine
 import com.castor.core.inference.ModelManager
+import com.castor.core.inference.keyword.KeywordEntry
+import com.castor.core.inference.keyword.KeywordMatcher
 import com.castor.core.inference.prompt.ConversationTurn as PromptTurn
 import javax.inject.Inject
 import javax.inject.Singleton
@@ -37,11 +39,18 @@ class AgentOrchestrator @Inject constructor(
     private val conversationManager: ConversationManager,
     private val eventBus: AgentEventBus,
     private val healthMonitor: AgentHealthMonitor,
-    private val agentLoop: AgentLoop
+    private val agentLoop: AgentLoop,
+    private val keywordMatcher: KeywordMatcher
 ) {
 
     companion object {
-        private const val CLASSIFY_MAX_TOKENS = 128
+        /** Below this probability the LLM's top intent is not trusted over keywords. */
+        private const val CLASSIFY_MIN_CONFIDENCE = 0.4f
+
+        private val INTENT_LABELS = listOf(
+            "SEND_MESSAGE", "PLAY_MEDIA", "QUEUE_MEDIA", "SET_REMINDER", "SUMMARIZE",
+            "BRIEFING", "MEDIA_CONTROL", "REMINDER_QUERY", "GENERAL_QUERY"
+        )
         private const val PROCESS_MAX_TOKENS = 256
 
         private const val ROUTER_SYSTEM_PROMPT = """You are Un-Dios, a helpful AI assistant running on the user's Android phone.
@@ -119,6 +128,39 @@ Respond with ONLY the category name (e.g., "SEND_MESSAGE"), nothing else."""
 
         private const val GENERAL_ERROR_MSG =
             "I encountered an issue processing your request. Please try again."
+
+        /** [KeywordMatcher] dictionary of the intent keyword lists. */
+        private const val INTENT_DICTIONARY = "intent"
+
+        /**
+         * Keyword fallback categories, most specific first. The weight of each
+         * category is its priority in [classifyWithKeywords].
+         */
+        private val INTENT_KEYWORDS = listOf(
+            // Briefing (very specific keywords)
+            "BRIEFING" to BRIEFING_KEYWORDS,
+            // Queue before play since "add to queue" contains no play keywords
+            "QUEUE_MEDIA" to QUEUE_KEYWORDS,
+            // Media control (pause/skip/what's playing) before play
+            "MEDIA_CONTROL" to MEDIA_CONTROL_KEYWORDS,
+            // Reminder queries before reminder creation
+            "REMINDER_QUERY" to REMINDER_QUERY_KEYWORDS,
+            "SET_REMINDER" to REMINDER_KEYWORDS,
+            "SEND_MESSAGE" to MESSAGE_KEYWORDS,
+            "SUMMARIZE" to SUMMARIZE_KEYWORDS,
+            // Play media (broad — lowest priority among specific intents)
+            "PLAY_MEDIA" to PLAY_KEYWORDS
+        )
+    }
+
+    init {
+        keywordMatcher.register(
+            INTENT_DICTIONARY,
+            INTENT_KEYWORDS.flatMapIndexed { i, (intent, keywords) ->
+                val weight = (INTENT_KEYWORDS.size - i).toFloat()
+                keywords.map { KeywordEntry(it, intent, weight) }
+            }
+        )
     }
 
     // -------------------------------------------------------------------------------------
@@ -178,6 +220,7 @@ Respond with ONLY the category name (e.g., "SEND_MESSAGE"), nothing else."""
                 }
                 val result = agentLoop.run(
                     userInput = input,
+                    conversationId = conversationManager.currentConversationId(),
                     conversationHistory = history
                 )
                 response = result.response
@@ -327,6 +370,10 @@ Respond with ONLY the category name (e.g., "SEND_MESSAGE"), nothing else."""
      * Use the LLM to classify user input into an intent category string.
      * If conversation context is available, it is prepended to help with
      * follow-up and pronoun resolution.
+     *
+     * The category names are scored in a single forward pass rather than
+     * generated; when the model is unsure (top probability below
+     * [CLASSIFY_MIN_CONFIDENCE]) the keyword classifier decides instead.
      */
     private suspend fun classifyWithLlm(input: String, contextPrompt: String): String {
         return try {
@@ -336,24 +383,16 @@ Respond with ONLY the category name (e.g., "SEND_MESSAGE"), nothing else."""
                 input
             }
 
-            val response = engine.generate(
+            val probs = engine.scoreCandidates(
                 prompt = fullPrompt,
-                systemPrompt = CLASSIFY_SYSTEM_PROMPT,
-                maxTokens = CLASSIFY_MAX_TOKENS,
-                temperature = 0.1f
-            ).trim().uppercase()
-
-            // Validate the response is a known category
-            when {
-                response.contains("SEND_MESSAGE") -> "SEND_MESSAGE"
-                response.contains("PLAY_MEDIA") -> "PLAY_MEDIA"
-                response.contains("QUEUE_MEDIA") -> "QUEUE_MEDIA"
-                response.contains("SET_REMINDER") -> "SET_REMINDER"
-                response.contains("SUMMARIZE") -> "SUMMARIZE"
-                response.contains("BRIEFING") -> "BRIEFING"
-                response.contains("MEDIA_CONTROL") -> "MEDIA_CONTROL"
-                response.contains("REMINDER_QUERY") -> "REMINDER_QUERY"
-                else -> "GENERAL_QUERY"
+                labels = INTENT_LABELS,
+                systemPrompt = CLASSIFY_SYSTEM_PROMPT
+            )
+            val best = probs.indices.maxByOrNull { probs[it] }
+            if (best == null || probs[best] < CLASSIFY_MIN_CONFIDENCE) {
+                classifyWithKeywords(input)
+            } else {
+                INTENT_LABELS[best]
             }
         } catch (e: Exception) {
             // LLM failed — fall back to keywords
@@ -367,36 +406,14 @@ Respond with ONLY the category name (e.g., "SEND_MESSAGE"), nothing else."""
 
     /**
      * Fallback keyword-based intent classification when the LLM is not available.
-     * Order matters for priority: more specific categories are checked first.
+     * When several categories match, the more specific one wins (see [INTENT_KEYWORDS]).
      */
     private fun classifyWithKeywords(input: String): String {
-        val lowered = input.lowercase()
-
-        // Briefing (check early — very specific keywords)
-        if (BRIEFING_KEYWORDS.any { lowered.contains(it) }) return "BRIEFING"
-
-        // Queue before play since "add to queue" contains no play keywords
-        if (QUEUE_KEYWORDS.any { lowered.contains(it) }) return "QUEUE_MEDIA"
-
-        // Media control (pause/skip/what's playing) before play
-        if (MEDIA_CONTROL_KEYWORDS.any { lowered.contains(it) }) return "MEDIA_CONTROL"
-
-        // Reminder queries before reminder creation
-        if (REMINDER_QUERY_KEYWORDS.any { lowered.contains(it) }) return "REMINDER_QUERY"
-
-        // Reminder creation
-        if (REMINDER_KEYWORDS.any { lowered.contains(it) }) return "SET_REMINDER"
-
-        // Messaging
-        if (MESSAGE_KEYWORDS.any { lowered.contains(it) }) return "SEND_MESSAGE"
-
-        // Summarize
-        if (SUMMARIZE_KEYWORDS.any { lowered.contains(it) }) return "SUMMARIZE"
-
-        // Play media (broad — checked last among specific intents)
-        if (PLAY_KEYWORDS.any { lowered.contains(it) }) return "PLAY_MEDIA"
-
-        return "GENERAL_QUERY"
+        // Keywords must start a word ("dm" is not in "admin") but may be a prefix ("reminders")
+        return keywordMatcher.match(input)
+            .best(INTENT_DICTIONARY) { it.atWordStart }
+            ?.category
+            ?: "GENERAL_QUERY"
     }
 
     // -------------------------------------------------------------------------------------
@@ -120,7 +120,11 @@ GREETING: [time-appropriate greeting]
 CALENDAR: [calendar summary]
 MESSAGES: [message summary]
 REMINDERS: [reminder summary]
-MEDIA: [media suggestion or "No media in queue"]"""
+MEDIA: [media suggestion or "No media in queue"]
+END"""
+
+        /** Generation ends at the END line that closes the briefing sections. */
+        private val BRIEFING_STOP = listOf("\nEND")
 
         private const val SUGGESTION_SYSTEM_PROMPT = """You are Un-Dios, a personal AI assistant.
 Based on the user's current state data, generate 1-3 brief, actionable suggestions.
@@ -404,7 +408,8 @@ Output each suggestion on its own line, prefixed with the category in brackets:
                 prompt = dataPrompt,
                 systemPrompt = BRIEFING_SYSTEM_PROMPT,
                 maxTokens = BRIEFING_MAX_TOKENS,
-                temperature = 0.5f
+                temperature = 0.5f,
+                stop = BRIEFING_STOP
             )
             parseLlmBriefing(response, media)
         } catch (_: Exception) {
@@ -64,6 +64,9 @@ class ConversationManager @Inject constructor(
         const val ROLE_USER = "user"
         const val ROLE_ASSISTANT = "assistant"
         const val ROLE_SYSTEM = "system"
+
+        /** Conversation id when no turn is stored (or the database fails). */
+        const val NO_CONVERSATION = "none"
     }
 
     // -------------------------------------------------------------------------------------
@@ -190,6 +193,19 @@ class ConversationManager @Inject constructor(
         return recent.lastOrNull { it.role == ROLE_ASSISTANT }
     }
 
+    /**
+     * Identifier of the conversation as it stands: the id of its oldest
+     * stored turn. It changes when the history is cleared, so a new
+     * conversation never picks up an old conversation's rolling summary.
+     */
+    suspend fun currentConversationId(): String {
+        return try {
+            conversationDao.getOldestConversation()?.id ?: NO_CONVERSATION
+        } catch (e: Exception) {
+            NO_CONVERSATION
+        }
+    }
+
     /**
      * Check whether there is any recent conversation context available.
      */
@@ -17,7 +17,7 @@ import javax.inject.Singleton
  * 2. **Date/Time**: Current date/time for temporal context
  * 3. **Memory**: Persistent memories from previous sessions
  * 4. **Tools**: The `<tools>` block from [ToolRegistry] (injected separately
- *    via [PromptFormatter.formatMultiTurnWithTools])
+ *    via [PromptFormatter.injectToolsBlock])
  * 5. **Behavioral instructions**: When to use tools vs. answer directly
  */
 @Singleton
@@ -45,7 +45,7 @@ You help the user with messaging, media playback, reminders, and general questio
 
     /**
      * Build the system prompt content (without tools block — that's injected
-     * by [PromptFormatter.formatMultiTurnWithTools]).
+     * by [PromptFormatter.injectToolsBlock]).
      */
     suspend fun buildSystemPrompt(): String = buildString {
         // Layer 1: Identity
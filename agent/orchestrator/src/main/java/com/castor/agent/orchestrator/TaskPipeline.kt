@@ -1,7 +1,15 @@
 package com.castor.agent.orchestrator
 
 import com.castor.core.common.model.AgentType
+import com.castor.core.inference.GenerationBatch
 import com.castor.core.inference.InferenceEngine
+import com.castor.core.inference.keyword.KeywordEntry
+import com.castor.core.inference.keyword.KeywordMatch
+import com.castor.core.inference.keyword.KeywordMatcher
+import kotlinx.coroutines.Deferred
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -60,8 +68,8 @@ data class PipelineResult(
 /**
  * Multi-step task execution engine for compound commands.
  *
- * Some user requests naturally decompose into multiple agent actions that must execute
- * in sequence with data flowing between them. For example:
+ * Some user requests naturally decompose into multiple agent actions, some of which
+ * need data from an earlier one. For example:
  *
  * - "Remind me about John's WhatsApp message tomorrow"
  *   1. MessagingAgent: find John's latest WhatsApp message
@@ -72,7 +80,9 @@ data class PipelineResult(
  *   2. ReminderAgent: set a 30-minute timer
  *
  * The pipeline supports:
- * - Sequential step execution with dependency tracking
+ * - Dependency-ordered execution: steps run as soon as the step they depend on
+ *   has finished, so independent steps (the timer and the playlist above) run
+ *   concurrently and their LLM calls are submitted to the engine as one batch
  * - Data passing between steps (output of step N becomes input to step N+1)
  * - Partial success: if a non-critical step fails, the pipeline continues
  * - LLM-powered decomposition for complex commands, with keyword fallback
@@ -88,12 +98,31 @@ class TaskPipeline @Inject constructor(
     private val engine: InferenceEngine,
     private val messagingAgent: MessagingAgent,
     private val mediaAgent: MediaAgent,
-    private val reminderAgent: ReminderAgent
+    private val reminderAgent: ReminderAgent,
+    private val keywordMatcher: KeywordMatcher
 ) {
 
     companion object {
         private const val DECOMPOSE_MAX_TOKENS = 384
 
+        /** Minimum probability for the single-agent shortcut to skip LLM decomposition. */
+        private const val SHAPE_MIN_CONFIDENCE = 0.6f
+
+        private const val MULTI_STEP_LABEL = "MULTI_STEP"
+        private val SHAPE_LABELS = listOf("MESSAGING", "MEDIA", "REMINDER", "GENERAL", MULTI_STEP_LABEL)
+
+        private const val SHAPE_SYSTEM_PROMPT = """You route commands for an Android assistant called Un-Dios.
+If the command needs several actions handled by different agents, answer MULTI_STEP.
+Otherwise answer with the one agent that handles it:
+- MESSAGING: Read, search, summarize, or send messages
+- MEDIA: Play, pause, skip, queue music/podcasts/audiobooks
+- REMINDER: Set, query, or manage reminders and timers
+- GENERAL: Answer questions, provide information, general conversation
+Respond with ONLY the label."""
+
+        /** Generation ends at the END line, or before a fifth step (the prompt allows at most four). */
+        private val DECOMPOSE_STOP = listOf("\nEND", "STEP 5:")
+
         private const val DECOMPOSE_SYSTEM_PROMPT = """You are a task decomposer for an Android assistant called Un-Dios.
 Given a compound user command, break it into sequential steps. Each step must be handled by one agent.
 
@@ -108,6 +137,7 @@ Respond in EXACTLY this format (one step per line, NO extra text):
 STEP 1: AGENT=<agent>, ACTION=<what to do>, INPUT=<key input for this step>
 STEP 2: AGENT=<agent>, ACTION=<what to do>, INPUT=<key input or PREV_OUTPUT>
 ...
+END
 
 Rules:
 - Use PREV_OUTPUT in the INPUT field when a step needs the output of the previous step
@@ -128,18 +158,64 @@ STEP 2: AGENT=REMINDER, ACTION=set timer for 30 minutes, INPUT=30 minutes
 STEP 1: AGENT=MESSAGING, ACTION=summarize unread messages, INPUT=unread messages
 STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_OUTPUT"""
 
-        // Compound command indicators: keywords/patterns suggesting multi-step tasks
-        private val COMPOUND_INDICATORS = listOf(
+        /**
+         * References to an earlier step's output. Whole words only, so "it" does
+         * not make "with" or "write" depend on the previous step.
+         */
+        private val PREVIOUS_REFERENCE = Regex(
+            """\b(?:the highlights|that info|the summary|those|that|it|the result)\b""",
+            RegexOption.IGNORE_CASE
+        )
+
+        /** [KeywordMatcher] dictionaries of the keyword lists below. */
+        private const val COMPOUND_DICTIONARY = "compound"
+        private const val AGENT_DICTIONARY = "pipeline_agent"
+
+        // Compound command indicators: keywords suggesting multi-step tasks,
+        // combined by position in [isCompoundCommand]
+        private const val CONJUNCTION = "CONJUNCTION"
+        private const val ACTION = "ACTION"
+        private const val AND = "AND"
+        private const val REMIND_ABOUT = "REMIND_ABOUT"
+        private const val MESSAGE_REF = "MESSAGE_REF"
+        private const val AND_ACTION = "AND_ACTION"
+
+        private val COMPOUND_KEYWORDS = listOf(
             // Conjunctions joining distinct actions
-            Regex("""\b(?:and then|then|and also|also|after that|afterwards)\b""", RegexOption.IGNORE_CASE),
-            // Two distinct action verbs separated by "and"
-            Regex("""(?:play|send|remind|set|summarize|text|message|queue)\b.*\band\b.*(?:play|send|remind|set|summarize|text|message|queue)\b""", RegexOption.IGNORE_CASE),
+            CONJUNCTION to listOf("and then", "then", "and also", "also", "after that", "afterwards"),
+            // Action verbs; two of them separated by "and" are two actions
+            ACTION to listOf("play", "send", "remind", "set", "summarize", "text", "message", "queue"),
+            AND to listOf("and"),
             // Cross-agent references like "remind me about X's message"
-            Regex("""remind\s+me\s+(?:about|of)\s+.+(?:message|text|chat)""", RegexOption.IGNORE_CASE),
-            // "... and set a ..." pattern
-            Regex("""\band\s+set\s+(?:a|an)\b""", RegexOption.IGNORE_CASE),
-            // "... and play ..."
-            Regex("""\band\s+play\b""", RegexOption.IGNORE_CASE)
+            REMIND_ABOUT to listOf("remind me about", "remind me of"),
+            MESSAGE_REF to listOf("message", "text", "chat"),
+            // "... and set a ...", "... and play ..."
+            AND_ACTION to listOf("and set a", "and set an", "and play")
+        )
+
+        /** Agent keywords for segments, by priority: reminders, then media, then messaging. */
+        private val AGENT_KEYWORDS = listOf(
+            AgentType.REMINDER to listOf("remind", "reminder", "alarm", "timer", "schedule", "alert me", "notify me"),
+            AgentType.MEDIA to listOf(
+                "play", "pause", "skip", "queue", "music", "song", "podcast", "spotify", "youtube", "audible", "listen"
+            ),
+            AgentType.MESSAGING to listOf(
+                "message", "text", "send", "reply", "whatsapp", "teams", "chat", "dm", "summarize", "summary", "unread"
+            )
+        )
+    }
+
+    init {
+        keywordMatcher.register(
+            COMPOUND_DICTIONARY,
+            COMPOUND_KEYWORDS.flatMap { (category, keywords) -> keywords.map { KeywordEntry(it, category) } }
+        )
+        keywordMatcher.register(
+            AGENT_DICTIONARY,
+            AGENT_KEYWORDS.flatMapIndexed { i, (type, keywords) ->
+                val weight = (AGENT_KEYWORDS.size - i).toFloat()
+                keywords.map { KeywordEntry(it, type.name, weight) }
+            }
         )
     }
 
@@ -152,7 +228,24 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
      * multiple pipeline steps rather than handled by a single agent.
      */
     fun isCompoundCommand(input: String): Boolean {
-        return COMPOUND_INDICATORS.any { it.containsMatchIn(input) }
+        val matches = keywordMatcher.match(input).of(COMPOUND_DICTIONARY)
+        fun hits(category: String, accept: (KeywordMatch) -> Boolean) =
+            matches.filter { it.category == category && accept(it) }
+
+        if (hits(CONJUNCTION) { it.isWholeWord }.isNotEmpty()) return true
+        if (hits(AND_ACTION) { it.isWholeWord }.isNotEmpty()) return true
+
+        // An action verb, then "and", then another action verb
+        val actions = hits(ACTION) { it.atWordEnd }
+        if (actions.isNotEmpty()) {
+            val firstEnd = actions.minOf { it.end }
+            val lastStart = actions.maxOf { it.start }
+            if (hits(AND) { it.isWholeWord }.any { it.start >= firstEnd && it.end <= lastStart }) return true
+        }
+
+        // "remind me about/of" followed by a reference to a message
+        val remindAbout = hits(REMIND_ABOUT) { true }.minOfOrNull { it.end } ?: return false
+        return hits(MESSAGE_REF) { true }.any { it.start > remindAbout + 1 }
     }
 
     /**
@@ -169,10 +262,15 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
     }
 
     /**
-     * Execute a pre-built pipeline of steps sequentially.
+     * Execute a pre-built pipeline of steps.
      *
-     * Steps with [PipelineStep.dependsOnStep] set will receive the output of the
-     * referenced step injected into their input data under the key "previousOutput".
+     * The steps form a DAG through [PipelineStep.dependsOnStep]: a step starts as
+     * soon as the step it depends on has finished and receives that step's output
+     * under the key "previousOutput"; steps without a dependency start right away.
+     * Independent branches therefore run concurrently, and the one-shot LLM calls
+     * of the steps that are running together are submitted as one batch through a
+     * [GenerationBatch], so the pipeline takes about as long as its longest branch.
+     * Results keep the order of [steps].
      *
      * @param steps The ordered list of steps to execute.
      * @return A [PipelineResult] with the outcome of each step and an overall summary.
@@ -186,37 +284,42 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
             )
         }
 
-        val results = mutableListOf<StepResult>()
-        var allSucceeded = true
-
-        for ((index, step) in steps.withIndex()) {
-            // Resolve dependencies: inject output from a prior step if needed
-            val resolvedInput = if (step.dependsOnStep != null) {
+        // Dependencies only point backwards, so each step's dependency is
+        // already scheduled when the step itself is
+        val dependencies = steps.mapIndexed { index, step -> step.dependsOnStep?.takeIf { it in 0 until index } }
+        val dependents = IntArray(steps.size).also { counts -> dependencies.forEach { dep -> if (dep != null) counts[dep]++ } }
+
+        // Steps without a dependency are ready at once; the rest become ready as
+        // their dependency finishes and are counted in by it
+        val batch = GenerationBatch(engine, participants = dependencies.count { it == null })
+        val results = coroutineScope {
+            val scheduled = ArrayList<Deferred<StepResult>>(steps.size)
+            for ((index, step) in steps.withIndex()) {
                 val depIndex = step.dependsOnStep
-                if (depIndex in results.indices && results[depIndex].success) {
-                    step.inputData + ("previousOutput" to results[depIndex].output)
-                } else {
-                    // Dependency failed — skip this step
-                    val failResult = StepResult(
-                        step = step,
-                        output = "",
-                        success = false,
-                        error = "Dependency on step ${depIndex + 1} failed or is out of range."
-                    )
-                    results.add(failResult)
-                    allSucceeded = false
-                    continue
+                val dependency = dependencies[index]?.let { scheduled[it] }
+                scheduled += async(batch) {
+                    val depResult = dependency?.await()
+                    batch.participate(handoff = dependents[index]) {
+                        if (depIndex == null) return@participate executeStep(step)
+
+                        // Resolve dependencies: inject output from a prior step if needed
+                        if (depResult != null && depResult.success) {
+                            executeStep(step.copy(inputData = step.inputData + ("previousOutput" to depResult.output)))
+                        } else {
+                            // Dependency failed — skip this step
+                            StepResult(
+                                step = step,
+                                output = "",
+                                success = false,
+                                error = "Dependency on step ${depIndex + 1} failed or is out of range."
+                            )
+                        }
+                    }
                 }
-            } else {
-                step.inputData
-            }
-
-            val result = executeStep(step.copy(inputData = resolvedInput))
-            results.add(result)
-            if (!result.success) {
-                allSucceeded = false
             }
+            scheduled.awaitAll()
         }
+        val allSucceeded = results.all { it.success }
 
         val summary = buildPipelineSummary(results, allSucceeded)
         return PipelineResult(
@@ -338,13 +441,36 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
     // LLM-based decomposition
     // -------------------------------------------------------------------------------------
 
+    /**
+     * Decompose with the LLM. Compound indicators ("and", "then") also fire on
+     * single commands ("play rock and roll"), so the command's shape is scored
+     * first in one forward pass; only commands the model sees as multi-step pay
+     * for the full decomposition generation.
+     */
     private suspend fun decomposeWithLlm(input: String): List<PipelineStep> {
         return try {
+            val probs = engine.scoreCandidates(
+                prompt = input,
+                labels = SHAPE_LABELS,
+                systemPrompt = SHAPE_SYSTEM_PROMPT
+            )
+            val best = probs.indices.maxByOrNull { probs[it] }
+            if (best != null && SHAPE_LABELS[best] != MULTI_STEP_LABEL && probs[best] >= SHAPE_MIN_CONFIDENCE) {
+                return listOf(
+                    PipelineStep(
+                        agentType = AgentType.valueOf(SHAPE_LABELS[best]),
+                        action = input,
+                        inputData = mapOf("input" to input)
+                    )
+                )
+            }
+
             val response = engine.generate(
                 prompt = input,
                 systemPrompt = DECOMPOSE_SYSTEM_PROMPT,
                 maxTokens = DECOMPOSE_MAX_TOKENS,
-                temperature = 0.2f
+                temperature = 0.2f,
+                stop = DECOMPOSE_STOP
             )
             parseLlmDecomposition(response)
         } catch (e: Exception) {
@@ -484,19 +610,8 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
      * Detect which agent should handle a given text segment based on keywords.
      */
     private fun detectAgentType(text: String): AgentType {
-        val lowered = text.lowercase()
-        return when {
-            // Reminder keywords
-            lowered.containsAny("remind", "reminder", "alarm", "timer", "schedule", "alert me", "notify me") ->
-                AgentType.REMINDER
-            // Media keywords
-            lowered.containsAny("play", "pause", "skip", "queue", "music", "song", "podcast", "spotify", "youtube", "audible", "listen") ->
-                AgentType.MEDIA
-            // Messaging keywords
-            lowered.containsAny("message", "text", "send", "reply", "whatsapp", "teams", "chat", "dm", "summarize", "summary", "unread") ->
-                AgentType.MESSAGING
-            else -> AgentType.GENERAL
-        }
+        val best = keywordMatcher.match(text).best(AGENT_DICTIONARY) { it.atWordStart }
+        return best?.let { AgentType.valueOf(it.category) } ?: AgentType.GENERAL
     }
 
     /**
@@ -504,8 +619,7 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
      * (e.g. "the highlights", "that", "it").
      */
     private fun segmentReferencesPrevious(text: String): Boolean {
-        val lowered = text.lowercase()
-        return lowered.containsAny("the highlights", "that info", "the summary", "those", "that", "it", "the result")
+        return PREVIOUS_REFERENCE.containsMatchIn(text)
     }
 
     // -------------------------------------------------------------------------------------
@@ -572,15 +686,4 @@ STEP 2: AGENT=MESSAGING, ACTION=compose message to Mom with summary, INPUT=PREV_
 
         return builder.toString().trim()
     }
-
-    // -------------------------------------------------------------------------------------
-    // Utility
-    // -------------------------------------------------------------------------------------
-
-    /**
-     * Extension function: check if a string contains any of the given substrings.
-     */
-    private fun String.containsAny(vararg terms: String): Boolean {
-        return terms.any { this.contains(it) }
-    }
 }
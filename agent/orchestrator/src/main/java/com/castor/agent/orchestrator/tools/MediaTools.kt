@@ -123,7 +123,8 @@ class NowPlayingTool @Inject constructor(
     override val definition = ToolDefinition(
         name = "now_playing",
         description = "Check what is currently playing.",
-        parameters = ToolParameters()
+        parameters = ToolParameters(),
+        parallelSafe = true
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
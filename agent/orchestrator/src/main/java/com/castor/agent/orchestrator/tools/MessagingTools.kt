@@ -13,6 +13,9 @@ import javax.inject.Inject
  * Wraps [MessagingAgent] methods as structured tools for the LLM.
  */
 
+/** Deadline for tools that run their own LLM generation. */
+private const val LLM_TOOL_TIMEOUT_MS = 60_000L
+
 class SendMessageTool @Inject constructor(
     private val messagingAgent: MessagingAgent
 ) : ToolHandler {
@@ -68,7 +71,8 @@ class SummarizeMessagesTool @Inject constructor(
                 "conversation" to ToolProperty("string", "Which conversation or contact to summarize (or 'all' for all recent)")
             ),
             required = emptyList()
-        )
+        ),
+        timeoutMs = LLM_TOOL_TIMEOUT_MS
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
@@ -97,7 +101,8 @@ class SmartReplyTool @Inject constructor(
                 "conversation" to ToolProperty("string", "Which conversation to generate replies for")
             ),
             required = listOf("conversation")
-        )
+        ),
+        timeoutMs = LLM_TOOL_TIMEOUT_MS
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
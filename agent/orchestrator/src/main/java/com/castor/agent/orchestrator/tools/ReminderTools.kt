@@ -68,7 +68,8 @@ class ListRemindersTool @Inject constructor(
                 "filter" to ToolProperty("string", "Time filter", listOf("today", "this_week", "all"))
             ),
             required = emptyList()
-        )
+        ),
+        parallelSafe = true
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
@@ -23,7 +23,8 @@ class GetTimeTool @Inject constructor() : ToolHandler {
     override val definition = ToolDefinition(
         name = "get_time",
         description = "Get the current date and time. Use when the user asks what time or day it is.",
-        parameters = ToolParameters()
+        parameters = ToolParameters(),
+        parallelSafe = true
     )
 
     private val dateFormat = SimpleDateFormat("EEEE, MMMM d, yyyy 'at' h:mm:ss a z", Locale.US)
@@ -45,7 +46,8 @@ class GetStatusTool @Inject constructor(
     override val definition = ToolDefinition(
         name = "get_status",
         description = "Get the system status including agent health and model info.",
-        parameters = ToolParameters()
+        parameters = ToolParameters(),
+        parallelSafe = true
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
@@ -115,7 +117,8 @@ class RecallMemoryTool @Inject constructor(
                 "search" to ToolProperty("string", "Optional search term to filter memories")
             ),
             required = emptyList()
-        )
+        ),
+        parallelSafe = true
     )
 
     override suspend fun execute(arguments: Map<String, String>): ToolResult {
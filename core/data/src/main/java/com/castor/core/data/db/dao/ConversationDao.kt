@@ -14,6 +14,9 @@ interface ConversationDao {
     @Query("SELECT * FROM conversations WHERE agentType = :agentType ORDER BY timestamp DESC LIMIT :limit")
     fun getConversationsByAgent(agentType: String, limit: Int = 20): Flow<List<ConversationEntity>>
 
+    @Query("SELECT * FROM conversations ORDER BY timestamp ASC LIMIT 1")
+    suspend fun getOldestConversation(): ConversationEntity?
+
     @Insert
     suspend fun insert(conversation: ConversationEntity)
 
@@ -92,6 +92,12 @@ dependencies {
     // Serialization
     implementation(libs.kotlinx.serialization.json)
 
-    // WorkManager (for background model downloads)
+    // WorkManager (for background model downloads and requantization)
     implementation(libs.work.runtime)
+    implementation(libs.hilt.work)
+    ksp(libs.hilt.work.compiler)
+
+    // JVM tests (RangedDownloader against a local Range server)
+    testImplementation(libs.junit)
+    testImplementation(libs.okhttp.mockwebserver)
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Multi-pattern byte matcher (Aho-Corasick) compiled to a dense DFA.
+//
+// Bytes are first mapped to equivalence classes (every byte that appears in
+// no pattern shares class 0), so the transition table is states x classes
+// rather than states x 256. Matching is one table lookup per input byte and
+// can be resumed across calls by carrying the state, which makes it suitable
+// for token streams where a pattern may straddle several pieces.
+class AhoCorasick {
+public:
+    explicit AhoCorasick(const std::vector<std::string> &patterns, bool ignore_case = false)
+        : patterns_(patterns) {
+        build_classes(ignore_case);
+        build_trie();
+        build_links();
+    }
+
+    static constexpr int ROOT = 0;
+
+    int next(int state, unsigned char c) const {
+        return delta_[(size_t)state * n_classes_ + class_of_[c]];
+    }
+
+    // Length of the longest pattern prefix ending at this state: the number
+    // of trailing input bytes that may still turn into a match.
+    int depth(int state) const { return depth_[state]; }
+
+    // Longest pattern ending at this state, or -1
+    int longest_match(int state) const {
+        if (match_[state] >= 0) return match_[state];
+        int s = out_[state];
+        return s >= 0 ? match_[s] : -1;
+    }
+
+    // Call f(pattern_index) for every pattern ending at this state
+    template <typename F>
+    void for_each_match(int state, F &&f) const {
+        if (match_[state] >= 0) f(match_[state]);
+        for (int s = out_[state]; s >= 0; s = out_[s]) f(match_[s]);
+    }
+
+    size_t pattern_count() const { return patterns_.size(); }
+    const std::string &pattern(int i) const { return patterns_[i]; }
+    size_t state_count() const { return depth_.size(); }
+
+private:
+    std::vector<std::string> patterns_;
+    uint8_t  class_of_[256] = {};
+    size_t   n_classes_ = 1;
+    std::vector<int> delta_; // states x classes, -1 while building the trie
+    std::vector<int> fail_;
+    std::vector<int> out_;   // nearest proper suffix state that ends a pattern
+    std::vector<int> match_; // pattern whose full text is this state
+    std::vector<int> depth_;
+
+    static unsigned char fold(unsigned char c) {
+        return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+    }
+
+    void build_classes(bool ignore_case) {
+        for (const auto &p : patterns_) {
+            for (unsigned char c : p) {
+                unsigned char key = ignore_case ? fold(c) : c;
+                if (class_of_[key] == 0) class_of_[key] = (uint8_t)n_classes_++;
+            }
+        }
+        if (ignore_case) {
+            for (int c = 'A'; c <= 'Z'; c++) class_of_[c] = class_of_[fold((unsigned char)c)];
+        }
+    }
+
+    int add_state(int depth) {
+        delta_.resize(delta_.size() + n_classes_, -1);
+        match_.push_back(-1);
+        depth_.push_back(depth);
+        return (int)depth_.size() - 1;
+    }
+
+    void build_trie() {
+        add_state(0);
+        for (size_t i = 0; i < patterns_.size(); i++) {
+            int s = ROOT;
+            for (unsigned char c : patterns_[i]) {
+                size_t idx = (size_t)s * n_classes_ + class_of_[c];
+                if (delta_[idx] < 0) {
+                    int t = add_state(depth_[s] + 1);
+                    delta_[idx] = t;
+                }
+                s = delta_[idx];
+            }
+            if (!patterns_[i].empty() && match_[s] < 0) match_[s] = (int)i;
+        }
+    }
+
+    // Breadth-first: fill failure links and turn missing edges into DFA edges
+    void build_links() {
+        size_t n = depth_.size();
+        fail_.assign(n, ROOT);
+        out_.assign(n, -1);
+
+        std::vector<int> queue;
+        queue.reserve(n);
+        for (size_t c = 0; c < n_classes_; c++) {
+            int &t = delta_[c];
+            if (t < 0) t = ROOT;
+            else queue.push_back(t);
+        }
+        for (size_t head = 0; head < queue.size(); head++) {
+            int s = queue[head];
+            for (size_t c = 0; c < n_classes_; c++) {
+                int &t = delta_[(size_t)s * n_classes_ + c];
+                int via_fail = delta_[(size_t)fail_[s] * n_classes_ + c];
+                if (t < 0) {
+                    t = via_fail;
+                    continue;
+                }
+                fail_[t] = via_fail;
+                out_[t]  = match_[via_fail] >= 0 ? via_fail : out_[via_fail];
+                queue.push_back(t);
+            }
+        }
+    }
+};
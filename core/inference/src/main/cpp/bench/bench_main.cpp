@@ -0,0 +1,311 @@
+// Prompt-replay benchmark for the inference engine on a Linux host.
+//
+// Replays recorded prompt sets (bench/prompts/*.json) through the same
+// engine the app uses and prints one JSON report: time to first token,
+// prefill and decode throughput, p50/p95 request latency and peak RSS per
+// set, and the engine's memory breakdown. Runs on a workstation or CI box,
+// so engine changes can be measured without a device in the loop.
+//
+//   undios-bench -m model.gguf [-c 4096] [-t 4] [-ngl 0] [--fa] [--kv f16|q8_0|q4_0]
+//                [-r 3] [--temp 0] [-o report.json] set.json [set.json ...]
+//
+// A prompt set is
+//   {"name": "...", "max_tokens": 128,
+//    "requests": [{"messages": [{"role": "system", "content": "..."}, ...]},
+//                 {"prompt": "raw completion prompt"}, ...]}
+// Requests run in order, so a multi-turn set whose message lists extend one
+// another reuses the KV cache exactly as the agent loop does on device. The
+// engine is reset before every pass over a set.
+//
+// With UNDIOS_TRACE=trace.json the engine's trace sections and counters are
+// written there as Chrome trace-event JSON (see llama_trace.h).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "llama_engine.h"
+
+using json = nlohmann::ordered_json;
+
+namespace {
+
+struct Options {
+    engine::LoadParams load;
+    int   repeats     = 3;
+    float temperature = 0.0f;
+    std::string output;
+    std::vector<std::string> sets;
+};
+
+struct Request {
+    std::vector<engine::Message> messages;
+    std::string prompt; // used when messages is empty
+};
+
+struct PromptSet {
+    std::string name;
+    int max_tokens = 128;
+    std::vector<Request> requests;
+};
+
+// One replayed request
+struct Sample {
+    double  latency_ms;
+    double  ttft_ms;
+    int     n_prompt;
+    int64_t t_prompt_us;
+    int     n_tokens;
+    int64_t t_us;
+    int     n_reused;
+    int     n_ctx_shifts;
+};
+
+void usage(const char *argv0) {
+    std::fprintf(stderr,
+        "usage: %s -m model.gguf [-c ctx] [-t threads] [-ngl layers] [--fa] [--kv f16|q8_0|q4_0]\n"
+        "          [-r repeats] [--temp t] [-o report.json] set.json [set.json ...]\n", argv0);
+}
+
+int kv_type_from_name(const std::string &name) {
+    if (name == "f16")  return 1;
+    if (name == "q4_0") return 2;
+    if (name == "q8_0") return 8;
+    return -1;
+}
+
+bool parse_args(int argc, char **argv, Options &opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *value = nullptr;
+        if (arg == "-m" && (value = next()))        opts.load.path = value;
+        else if (arg == "-c" && (value = next()))   opts.load.context_size = std::atoi(value);
+        else if (arg == "-t" && (value = next()))   opts.load.threads = std::atoi(value);
+        else if (arg == "-ngl" && (value = next())) opts.load.gpu_layers = std::atoi(value);
+        else if (arg == "-r" && (value = next()))   opts.repeats = std::max(1, std::atoi(value));
+        else if (arg == "--temp" && (value = next())) opts.temperature = (float)std::atof(value);
+        else if (arg == "-o" && (value = next()))   opts.output = value;
+        else if (arg == "--fa")                     opts.load.flash_attn = true;
+        else if (arg == "--kv" && (value = next())) {
+            opts.load.kv_type = kv_type_from_name(value);
+            if (opts.load.kv_type < 0) {
+                std::fprintf(stderr, "unknown KV cache type: %s\n", value);
+                return false;
+            }
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.sets.push_back(arg);
+        } else {
+            std::fprintf(stderr, "bad argument: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return !opts.load.path.empty() && !opts.sets.empty();
+}
+
+bool load_set(const std::string &path, PromptSet &set) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path.c_str());
+        return false;
+    }
+    try {
+        json doc = json::parse(in);
+        set.name       = doc.value("name", path);
+        set.max_tokens = doc.value("max_tokens", 128);
+        for (const auto &jreq : doc.at("requests")) {
+            Request req;
+            if (jreq.contains("messages")) {
+                for (const auto &jmsg : jreq.at("messages")) {
+                    req.messages.push_back({jmsg.at("role").get<std::string>(), jmsg.at("content").get<std::string>()});
+                }
+            } else {
+                req.prompt = jreq.at("prompt").get<std::string>();
+            }
+            set.requests.push_back(std::move(req));
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "invalid prompt set %s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    return !set.requests.empty();
+}
+
+// Peak resident set (VmHWM) in bytes
+int64_t peak_rss_bytes() {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::atoll(line.c_str() + 6) * 1024;
+    }
+    return 0;
+}
+
+// Reset VmHWM to the current RSS so the next peak is per set (Linux 4.0+;
+// silently keeps the process-wide peak where unsupported)
+void reset_peak_rss() {
+    if (FILE *f = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", f);
+        std::fclose(f);
+    }
+}
+
+// Nearest-rank percentile
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+double round2(double v) { return std::round(v * 100.0) / 100.0; }
+
+json summarize(const std::vector<Sample> &samples) {
+    std::vector<double> latency, ttft;
+    int64_t n_prompt = 0, t_prompt_us = 0, n_tokens = 0, t_us = 0, n_reused = 0, n_ctx_shifts = 0;
+    for (const auto &s : samples) {
+        latency.push_back(s.latency_ms);
+        if (s.ttft_ms > 0) ttft.push_back(s.ttft_ms);
+        n_prompt    += s.n_prompt;
+        t_prompt_us += s.t_prompt_us;
+        n_tokens    += s.n_tokens;
+        t_us        += s.t_us;
+        n_reused    += s.n_reused;
+        n_ctx_shifts += s.n_ctx_shifts;
+    }
+    json out;
+    out["requests"]         = samples.size();
+    out["ttft_ms"]          = {{"p50", round2(percentile(ttft, 50))}, {"p95", round2(percentile(ttft, 95))}};
+    out["latency_ms"]       = {{"p50", round2(percentile(latency, 50))}, {"p95", round2(percentile(latency, 95))}};
+    out["prefill_tok_s"]    = round2(t_prompt_us > 0 ? n_prompt * 1e6 / t_prompt_us : 0.0);
+    out["decode_tok_s"]     = round2(t_us > 0 ? n_tokens * 1e6 / t_us : 0.0);
+    out["prompt_tokens"]    = n_prompt;
+    out["generated_tokens"] = n_tokens;
+    out["reused_tokens"]    = n_reused;
+    out["context_shifts"]   = n_ctx_shifts;
+    return out;
+}
+
+Sample run_request(const Request &req, int max_tokens, const engine::SamplingParams &sampling) {
+    auto start = std::chrono::steady_clock::now();
+    if (req.messages.empty()) {
+        engine::generate(req.prompt, max_tokens, sampling, {});
+    } else {
+        engine::generate_chat(req.messages, max_tokens, sampling);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    const engine::GenerationStats &stats = engine::generation_stats();
+    Sample s;
+    s.latency_ms  = std::chrono::duration<double, std::milli>(end - start).count();
+    s.ttft_ms     = stats.t_first_us / 1000.0;
+    s.n_prompt    = stats.n_prompt;
+    s.t_prompt_us = stats.t_prompt_us;
+    s.n_tokens    = stats.n_tokens;
+    s.t_us        = stats.t_us;
+    s.n_reused    = stats.n_reused;
+    s.n_ctx_shifts = stats.n_ctx_shifts;
+    return s;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<PromptSet> sets;
+    for (const auto &path : opts.sets) {
+        PromptSet set;
+        if (!load_set(path, set)) return 1;
+        sets.push_back(std::move(set));
+    }
+
+    engine::init(nullptr);
+    auto load_start = std::chrono::steady_clock::now();
+    if (!engine::load_model(opts.load)) {
+        std::fprintf(stderr, "failed to load %s\n", opts.load.path.c_str());
+        engine::shutdown();
+        return 1;
+    }
+    double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+
+    engine::SamplingParams sampling;
+    sampling.temperature = opts.temperature;
+
+    json report;
+    report["model"]      = opts.load.path;
+    report["n_ctx"]      = opts.load.context_size;
+    report["threads"]    = opts.load.threads;
+    report["flash_attn"] = opts.load.flash_attn;
+    report["kv_type"]    = opts.load.kv_type;
+    report["repeats"]    = opts.repeats;
+    report["load_ms"]    = round2(load_ms);
+    report["sets"]       = json::array();
+
+    std::vector<Sample> all;
+    int64_t peak_rss = peak_rss_bytes();
+    int status = 0;
+    for (const auto &set : sets) {
+        std::vector<Sample> samples;
+        reset_peak_rss();
+        try {
+            for (int r = 0; r < opts.repeats; r++) {
+                engine::reset();
+                for (const auto &req : set.requests) samples.push_back(run_request(req, set.max_tokens, sampling));
+            }
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s: %s\n", set.name.c_str(), e.what());
+            status = 1;
+        }
+        int64_t set_peak = peak_rss_bytes();
+        peak_rss = std::max(peak_rss, set_peak);
+
+        json jset;
+        jset["name"] = set.name;
+        jset.update(summarize(samples));
+        jset["peak_rss_mb"] = round2(set_peak / 1048576.0);
+        report["sets"].push_back(jset);
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+
+    json overall = summarize(all);
+    overall["peak_rss_mb"] = round2(peak_rss / 1048576.0);
+    report["overall"] = overall;
+
+    const engine::MemoryStats mem = engine::memory_stats();
+    report["memory_mb"] = {
+        {"model_mapped", round2(mem.model_mapped_bytes / 1048576.0)},
+        {"model_anon",   round2(mem.model_anon_bytes / 1048576.0)},
+        {"model_resident", round2(mem.model_resident_bytes / 1048576.0)},
+        {"kv",           round2(mem.kv_bytes / 1048576.0)},
+        {"compute",      round2(mem.compute_bytes / 1048576.0)},
+        {"batch",        round2(mem.batch_bytes / 1048576.0)},
+    };
+
+    engine::free_model();
+    engine::shutdown();
+
+    std::string text = report.dump(2);
+    if (opts.output.empty()) {
+        std::printf("%s\n", text.c_str());
+    } else {
+        std::ofstream out(opts.output);
+        out << text << "\n";
+        if (!out) {
+            std::fprintf(stderr, "cannot write %s\n", opts.output.c_str());
+            return 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,62 @@
+#include <jni.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gguf_reader.h"
+
+extern "C" {
+
+// --- nativeReadInfo(path): Array<String>? ---
+// Metadata of a GGUF file as alternating key/value strings, or null when the
+// file cannot be read or is not GGUF. Tensor types are "TYPE:count,...".
+JNIEXPORT jobjectArray JNICALL
+Java_com_castor_core_inference_gguf_GgufReader_nativeReadInfo(
+    JNIEnv *env, jobject, jstring jpath
+) {
+    const char *path = env->GetStringUTFChars(jpath, nullptr);
+    gguf::Info info;
+    std::string error;
+    bool ok = gguf::read_info(path, info, error);
+    env->ReleaseStringUTFChars(jpath, path);
+    if (!ok) return nullptr;
+
+    std::string tensor_types;
+    for (const auto &entry : info.tensor_types) {
+        if (!tensor_types.empty()) tensor_types += ',';
+        tensor_types += entry.first + ':' + std::to_string(entry.second);
+    }
+
+    const std::vector<std::pair<const char *, std::string>> fields = {
+        {"version",          std::to_string(info.version)},
+        {"architecture",     info.architecture},
+        {"name",             info.name},
+        {"size_label",       info.size_label},
+        {"file_type",        gguf::file_type_name(info.file_type)},
+        {"parameters",       std::to_string(info.n_params)},
+        {"tensor_types",     tensor_types},
+        {"context_length",   std::to_string(info.context_length)},
+        {"embedding_length", std::to_string(info.embedding_length)},
+        {"block_count",      std::to_string(info.block_count)},
+        {"head_count",       std::to_string(info.head_count)},
+        {"head_count_kv",    std::to_string(info.head_count_kv)},
+        {"key_length",       std::to_string(info.key_length)},
+        {"value_length",     std::to_string(info.value_length)},
+        {"vocab_size",       std::to_string(info.vocab_size)},
+        {"tokenizer",        info.tokenizer},
+        {"chat_template",    info.chat_template},
+    };
+
+    jobjectArray result = env->NewObjectArray((jsize)(2 * fields.size()), env->FindClass("java/lang/String"), nullptr);
+    for (size_t i = 0; i < fields.size(); i++) {
+        jstring key   = env->NewStringUTF(fields[i].first);
+        jstring value = env->NewStringUTF(fields[i].second.c_str());
+        env->SetObjectArrayElement(result, (jsize)(2 * i), key);
+        env->SetObjectArrayElement(result, (jsize)(2 * i + 1), value);
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(value);
+    }
+    return result;
+}
+
+} // extern "C"
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Metadata-only GGUF reader.
+//
+// Reads the header, the key/value section and the tensor infos (names,
+// shapes and types), never the tensor data, and without the cost of
+// llama_model_load_from_file. Large arrays such as the tokenizer vocabulary
+// are skipped by length rather than parsed. Reads go through a small
+// buffer with pread, so a multi-GB file costs a few hundred KB of I/O.
+namespace gguf {
+
+struct Info {
+    uint32_t    version = 0;
+    std::string architecture;
+    std::string name;
+    std::string size_label;
+    int32_t     file_type = -1;        // general.file_type (llama_ftype)
+    uint64_t    n_params  = 0;         // sum of tensor element counts
+    std::map<std::string, int> tensor_types; // ggml type name -> tensor count
+    uint32_t    context_length   = 0;  // <arch>.context_length
+    uint32_t    embedding_length = 0;  // <arch>.embedding_length
+    uint32_t    block_count      = 0;  // <arch>.block_count
+    uint32_t    head_count       = 0;  // <arch>.attention.head_count
+    uint32_t    head_count_kv    = 0;  // <arch>.attention.head_count_kv
+    uint32_t    key_length       = 0;  // <arch>.attention.key_length (per-head width of K)
+    uint32_t    value_length     = 0;  // <arch>.attention.value_length (per-head width of V)
+    uint32_t    vocab_size       = 0;  // length of tokenizer.ggml.tokens
+    std::string tokenizer;             // tokenizer.ggml.model
+    std::string chat_template;         // tokenizer.chat_template
+};
+
+// Name of a llama_ftype as used in GGUF file names ("Q4_K_M"), or ""
+inline const char *file_type_name(int32_t ftype) {
+    switch (ftype) {
+        case 0:  return "F32";
+        case 1:  return "F16";
+        case 2:  return "Q4_0";
+        case 3:  return "Q4_1";
+        case 7:  return "Q8_0";
+        case 8:  return "Q5_0";
+        case 9:  return "Q5_1";
+        case 10: return "Q2_K";
+        case 11: return "Q3_K_S";
+        case 12: return "Q3_K_M";
+        case 13: return "Q3_K_L";
+        case 14: return "Q4_K_S";
+        case 15: return "Q4_K_M";
+        case 16: return "Q5_K_S";
+        case 17: return "Q5_K_M";
+        case 18: return "Q6_K";
+        case 19: return "IQ2_XXS";
+        case 20: return "IQ2_XS";
+        case 21: return "Q2_K_S";
+        case 22: return "IQ3_XS";
+        case 23: return "IQ3_XXS";
+        case 24: return "IQ1_S";
+        case 25: return "IQ4_NL";
+        case 26: return "IQ3_S";
+        case 27: return "IQ3_M";
+        case 28: return "IQ2_S";
+        case 29: return "IQ2_M";
+        case 30: return "IQ4_XS";
+        case 31: return "IQ1_M";
+        case 32: return "BF16";
+        case 36: return "TQ1_0";
+        case 37: return "TQ2_0";
+        default: return "";
+    }
+}
+
+// Name of a ggml_type, or "" for unknown types
+inline const char *tensor_type_name(uint32_t type) {
+    static const char *const NAMES[] = {
+        "F32", "F16", "Q4_0", "Q4_1", "", "", "Q5_0", "Q5_1", "Q8_0", "Q8_1",
+        "Q2_K", "Q3_K", "Q4_K", "Q5_K", "Q6_K", "Q8_K", "IQ2_XXS", "IQ2_XS", "IQ3_XXS", "IQ1_S",
+        "IQ4_NL", "IQ3_S", "IQ2_S", "IQ4_XS", "I8", "I16", "I32", "I64", "F64", "IQ1_M",
+        "BF16", "", "", "", "TQ1_0", "TQ2_0",
+    };
+    return type < sizeof(NAMES) / sizeof(*NAMES) ? NAMES[type] : "";
+}
+
+namespace detail {
+
+class Reader {
+public:
+    explicit Reader(int fd) : fd_(fd), buf_(64 * 1024) {}
+
+    bool read(void *dst, size_t n) {
+        auto *out = static_cast<char *>(dst);
+        while (n > 0) {
+            if (pos_ == len_ && !fill()) return false;
+            size_t k = std::min(n, len_ - pos_);
+            std::memcpy(out, buf_.data() + pos_, k);
+            pos_ += k;
+            out  += k;
+            n    -= k;
+        }
+        return true;
+    }
+
+    bool skip(uint64_t n) {
+        if (n <= len_ - pos_) {
+            pos_ += (size_t)n;
+            return true;
+        }
+        base_ += pos_ + n;
+        pos_ = len_ = 0;
+        return true;
+    }
+
+    template <typename T>
+    bool get(T &value) { return read(&value, sizeof(T)); }
+
+    bool get_string(std::string &s, uint64_t max_len = 1u << 24) {
+        uint64_t len;
+        if (!get(len) || len > max_len) return false;
+        s.resize((size_t)len);
+        return read(&s[0], (size_t)len);
+    }
+
+    bool skip_string() {
+        uint64_t len;
+        return get(len) && skip(len);
+    }
+
+private:
+    int fd_;
+    std::vector<char> buf_;
+    uint64_t base_ = 0; // file offset of buf_[0]
+    size_t pos_ = 0;
+    size_t len_ = 0;
+
+    bool fill() {
+        base_ += len_;
+        pos_ = len_ = 0;
+        ssize_t n = pread(fd_, buf_.data(), buf_.size(), (off_t)base_);
+        if (n <= 0) return false;
+        len_ = (size_t)n;
+        return true;
+    }
+};
+
+enum ValueType : uint32_t {
+    UINT8 = 0, INT8 = 1, UINT16 = 2, INT16 = 3, UINT32 = 4, INT32 = 5, FLOAT32 = 6,
+    BOOL = 7, STRING = 8, ARRAY = 9, UINT64 = 10, INT64 = 11, FLOAT64 = 12,
+};
+
+inline size_t scalar_size(uint32_t type) {
+    switch (type) {
+        case UINT8: case INT8: case BOOL:       return 1;
+        case UINT16: case INT16:                return 2;
+        case UINT32: case INT32: case FLOAT32:  return 4;
+        case UINT64: case INT64: case FLOAT64:  return 8;
+        default:                                return 0;
+    }
+}
+
+// Integer value of a scalar KV, for the handful of keys we keep
+inline bool read_integer(Reader &r, uint32_t type, uint64_t &out) {
+    switch (type) {
+        case UINT8:  { uint8_t v;  if (!r.get(v)) return false; out = v; return true; }
+        case UINT16: { uint16_t v; if (!r.get(v)) return false; out = v; return true; }
+        case UINT32: { uint32_t v; if (!r.get(v)) return false; out = v; return true; }
+        case INT32:  { int32_t v;  if (!r.get(v)) return false; out = (uint64_t)(v < 0 ? 0 : v); return true; }
+        case UINT64: { uint64_t v; if (!r.get(v)) return false; out = v; return true; }
+        case INT64:  { int64_t v;  if (!r.get(v)) return false; out = (uint64_t)(v < 0 ? 0 : v); return true; }
+        default:     return false;
+    }
+}
+
+// Skip a value; for arrays, length receives the element count
+inline bool skip_value(Reader &r, uint32_t type, uint64_t *length = nullptr) {
+    if (type == STRING) return r.skip_string();
+    if (type == ARRAY) {
+        uint32_t item_type;
+        uint64_t n;
+        if (!r.get(item_type) || !r.get(n)) return false;
+        if (length) *length = n;
+        if (item_type == STRING) {
+            for (uint64_t i = 0; i < n; i++) {
+                if (!r.skip_string()) return false;
+            }
+            return true;
+        }
+        size_t size = scalar_size(item_type);
+        return size > 0 && r.skip(n * size);
+    }
+    size_t size = scalar_size(type);
+    return size > 0 && r.skip(size);
+}
+
+inline bool ends_with(const std::string &s, const char *suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+} // namespace detail
+
+// Read the metadata of the GGUF file at path. On failure returns false and
+// sets error.
+inline bool read_info(const char *path, Info &info, std::string &error) {
+    using namespace detail;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "cannot open file";
+        return false;
+    }
+    struct Closer { int fd; ~Closer() { close(fd); } } closer{fd};
+    Reader r(fd);
+
+    char magic[4];
+    uint64_t n_tensors, n_kv;
+    if (!r.read(magic, 4) || std::memcmp(magic, "GGUF", 4) != 0) {
+        error = "not a GGUF file";
+        return false;
+    }
+    if (!r.get(info.version) || info.version < 2 || info.version > 3) {
+        error = "unsupported GGUF version";
+        return false;
+    }
+    if (!r.get(n_tensors) || !r.get(n_kv) || n_tensors > (1u << 24) || n_kv > (1u << 20)) {
+        error = "corrupt header";
+        return false;
+    }
+
+    // Per-architecture keys are matched by suffix, since general.architecture
+    // is not guaranteed to come first
+    std::map<std::string, uint64_t> arch_values;
+    std::string key;
+    for (uint64_t i = 0; i < n_kv; i++) {
+        uint32_t type;
+        if (!r.get_string(key, 1 << 16) || !r.get(type)) {
+            error = "corrupt metadata";
+            return false;
+        }
+        bool ok;
+        uint64_t value = 0;
+        if (type == STRING && key == "general.architecture") ok = r.get_string(info.architecture);
+        else if (type == STRING && key == "general.name") ok = r.get_string(info.name);
+        else if (type == STRING && key == "general.size_label") ok = r.get_string(info.size_label);
+        else if (type == STRING && key == "tokenizer.ggml.model") ok = r.get_string(info.tokenizer);
+        else if (type == STRING && key == "tokenizer.chat_template") ok = r.get_string(info.chat_template);
+        else if (key == "general.file_type" && read_integer(r, type, value)) {
+            info.file_type = (int32_t)value;
+            ok = true;
+        } else if ((ends_with(key, ".context_length") || ends_with(key, ".embedding_length") ||
+                    ends_with(key, ".block_count") || ends_with(key, ".head_count") ||
+                    ends_with(key, ".head_count_kv") || ends_with(key, ".key_length") ||
+                    ends_with(key, ".value_length")) && scalar_size(type) > 0) {
+            ok = read_integer(r, type, value) || skip_value(r, type);
+            arch_values[key] = value;
+        } else if (type == ARRAY && key == "tokenizer.ggml.tokens") {
+            ok = skip_value(r, type, &value);
+            info.vocab_size = (uint32_t)value;
+        } else {
+            ok = skip_value(r, type);
+        }
+        if (!ok) {
+            error = "corrupt metadata";
+            return false;
+        }
+    }
+
+    if (!info.architecture.empty()) {
+        info.context_length   = (uint32_t)arch_values[info.architecture + ".context_length"];
+        info.embedding_length = (uint32_t)arch_values[info.architecture + ".embedding_length"];
+        info.block_count      = (uint32_t)arch_values[info.architecture + ".block_count"];
+        info.head_count       = (uint32_t)arch_values[info.architecture + ".attention.head_count"];
+        info.head_count_kv    = (uint32_t)arch_values[info.architecture + ".attention.head_count_kv"];
+        info.key_length       = (uint32_t)arch_values[info.architecture + ".attention.key_length"];
+        info.value_length     = (uint32_t)arch_values[info.architecture + ".attention.value_length"];
+    }
+
+    // Tensor infos: name, shape, type, data offset
+    for (uint64_t i = 0; i < n_tensors; i++) {
+        uint32_t n_dims, type;
+        uint64_t n_elements = 1, dim, offset;
+        if (!r.skip_string() || !r.get(n_dims) || n_dims > 4) {
+            error = "corrupt tensor info";
+            return false;
+        }
+        for (uint32_t d = 0; d < n_dims; d++) {
+            if (!r.get(dim)) {
+                error = "corrupt tensor info";
+                return false;
+            }
+            n_elements *= dim;
+        }
+        if (!r.get(type) || !r.get(offset)) {
+            error = "corrupt tensor info";
+            return false;
+        }
+        info.n_params += n_elements;
+        const char *name = tensor_type_name(type);
+        info.tensor_types[*name ? name : "type" + std::to_string(type)]++;
+    }
+    return true;
+}
+
+} // namespace gguf
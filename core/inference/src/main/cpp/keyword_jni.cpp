@@ -0,0 +1,179 @@
+#include <jni.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "aho_corasick.h"
+
+// -------------------------------------------------------------------------
+// Keyword matcher shared by the routing components (KeywordMatcher.kt)
+//
+// Every registered dictionary is compiled into one case-insensitive
+// automaton, so classifying an input is a single pass over its bytes no
+// matter how many dictionaries or keywords there are. Categories and
+// weights stay on the Kotlin side; native code only reports where each
+// entry matched and whether the match sits on word boundaries.
+// -------------------------------------------------------------------------
+
+namespace {
+
+struct Dictionary {
+    std::string name;
+    std::vector<std::string> patterns;
+};
+
+// A keyword may appear in several dictionaries (or twice in one), but the
+// automaton keeps a single index per distinct pattern: owners[p] lists every
+// (dictionary, entry) it stands for.
+struct Compiled {
+    std::unique_ptr<AhoCorasick> automaton;
+    std::vector<std::vector<std::pair<int, int>>> owners;
+};
+
+std::mutex g_mutex;
+std::vector<Dictionary> g_dicts;
+std::shared_ptr<const Compiled> g_compiled;
+
+constexpr int FLAG_WORD_START = 1;
+constexpr int FLAG_WORD_END   = 2;
+
+std::string lower_ascii(std::string s) {
+    for (char &c : s) {
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+    }
+    return s;
+}
+
+// Non-ASCII bytes count as word characters so accented words are not split
+bool is_word_byte(unsigned char c) {
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+std::shared_ptr<const Compiled> compile(const std::vector<Dictionary> &dicts) {
+    auto compiled = std::make_shared<Compiled>();
+    std::vector<std::string> patterns;
+    std::unordered_map<std::string, int> index;
+
+    for (size_t d = 0; d < dicts.size(); d++) {
+        for (size_t e = 0; e < dicts[d].patterns.size(); e++) {
+            const std::string &p = dicts[d].patterns[e];
+            if (p.empty()) continue;
+            auto it = index.find(p);
+            if (it == index.end()) {
+                it = index.emplace(p, (int)patterns.size()).first;
+                patterns.push_back(p);
+                compiled->owners.emplace_back();
+            }
+            compiled->owners[it->second].emplace_back((int)d, (int)e);
+        }
+    }
+    if (!patterns.empty()) {
+        compiled->automaton = std::make_unique<AhoCorasick>(patterns, /* ignore_case */ true);
+    }
+    return compiled;
+}
+
+std::string to_string(JNIEnv *env, jstring jstr) {
+    const char *chars = env->GetStringUTFChars(jstr, nullptr);
+    std::string s(chars);
+    env->ReleaseStringUTFChars(jstr, chars);
+    return s;
+}
+
+} // namespace
+
+extern "C" {
+
+// --- nativeRegister(dictionary, patterns[]): Int ---
+// Adds or replaces a dictionary and recompiles the automaton. Returns the
+// dictionary's id, which is stable for its name.
+JNIEXPORT jint JNICALL
+Java_com_castor_core_inference_keyword_KeywordMatcher_nativeRegister(
+    JNIEnv *env, jobject, jstring jname, jobjectArray jpatterns
+) {
+    Dictionary dict;
+    dict.name = to_string(env, jname);
+    jsize n = env->GetArrayLength(jpatterns);
+    dict.patterns.reserve(n);
+    for (jsize i = 0; i < n; i++) {
+        auto jp = (jstring)env->GetObjectArrayElement(jpatterns, i);
+        dict.patterns.push_back(lower_ascii(to_string(env, jp)));
+        env->DeleteLocalRef(jp);
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    int id = -1;
+    for (size_t d = 0; d < g_dicts.size(); d++) {
+        if (g_dicts[d].name == dict.name) id = (int)d;
+    }
+    if (id < 0) {
+        id = (int)g_dicts.size();
+        g_dicts.push_back(std::move(dict));
+    } else {
+        g_dicts[id] = std::move(dict);
+    }
+    g_compiled = compile(g_dicts);
+    return id;
+}
+
+// --- nativeMatch(text): IntArray ---
+// Every match of every dictionary, in order of where it ends, flattened as
+// [dictionary, entry, start, end, flags] with offsets in UTF-16 chars.
+JNIEXPORT jintArray JNICALL
+Java_com_castor_core_inference_keyword_KeywordMatcher_nativeMatch(
+    JNIEnv *env, jobject, jstring jtext
+) {
+    std::shared_ptr<const Compiled> compiled;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        compiled = g_compiled;
+    }
+
+    std::vector<jint> out;
+    if (compiled && compiled->automaton) {
+        const AhoCorasick &ac = *compiled->automaton;
+        // Modified UTF-8 from the JVM encodes each UTF-16 unit separately, so
+        // counting non-continuation bytes yields Java char offsets.
+        std::string text = to_string(env, jtext);
+        std::vector<int> char_at(text.size() + 1, 0);
+        int chars = 0;
+        int state = AhoCorasick::ROOT;
+
+        for (size_t i = 0; i < text.size(); i++) {
+            auto c = (unsigned char)text[i];
+            char_at[i] = chars;
+            if ((c & 0xC0) != 0x80) chars++;
+            state = ac.next(state, c);
+
+            ac.for_each_match(state, [&](int p) {
+                size_t end   = i + 1;
+                size_t start = end - ac.pattern(p).size();
+                int flags = 0;
+                if (start == 0 || !is_word_byte((unsigned char)text[start - 1])) flags |= FLAG_WORD_START;
+                if (end == text.size() || !is_word_byte((unsigned char)text[end])) flags |= FLAG_WORD_END;
+                for (const auto &owner : compiled->owners[p]) {
+                    out.push_back(owner.first);
+                    out.push_back(owner.second);
+                    out.push_back((jint)start);
+                    out.push_back((jint)end);
+                    out.push_back(flags);
+                }
+            });
+        }
+        char_at[text.size()] = chars;
+
+        // Byte offsets -> char offsets
+        for (size_t k = 0; k < out.size(); k += 5) {
+            out[k + 2] = char_at[out[k + 2]];
+            out[k + 3] = char_at[out[k + 3]];
+        }
+    }
+
+    jintArray result = env->NewIntArray((jsize)out.size());
+    if (!out.empty()) env->SetIntArrayRegion(result, 0, (jsize)out.size(), out.data());
+    return result;
+}
+
+} // extern "C"
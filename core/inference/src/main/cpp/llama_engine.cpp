@@ -0,0 +1,2045 @@
+#include "llama_engine.h"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "chat.h"
+#include "llama.h"
+#include "sampling.h"
+
+#include "aho_corasick.h"
+#include "llama_log.h"
+#include "llama_trace.h"
+#include "tool_call_parser.h"
+
+using engine::GenerationStats;
+using engine::MemoryStats;
+using engine::TokenConfidence;
+using engine::BatchRequest;
+using engine::MAX_SEQS;
+
+// Sequence of generate_background. Batches and label scoring use the lower
+// ids, and only while no background generation is running.
+static constexpr llama_seq_id BACKGROUND_SEQ = MAX_SEQS - 1;
+
+// -------------------------------------------------------------------------
+// Global state
+// -------------------------------------------------------------------------
+static llama_model   *g_model   = nullptr;
+static llama_context *g_context = nullptr;
+static llama_batch    g_batch;
+static common_chat_templates_ptr g_chat_templates;
+static common_sampler *g_sampler = nullptr; // the current request's, see init_sampler
+
+static int g_context_size = 4096;
+static int g_batch_size   = 512;
+
+// Chat state
+// g_chat_msgs are the session's messages, in the order their tokens were
+// appended to the KV cache; g_msg_end_pos[i] is the position right after
+// message i. Only the first g_kv_valid_msgs messages are still intact in the
+// KV cache (a context shift discards the middle of the conversation).
+static std::vector<common_chat_msg> g_chat_msgs;
+static std::vector<llama_pos> g_msg_end_pos;
+static size_t    g_kv_valid_msgs = 0;
+static llama_pos g_system_pos  = 0;
+static llama_pos g_current_pos = 0;
+static llama_tokens g_pending_tokens; // rendered but not yet decoded
+static llama_tokens g_kv_tokens;      // tokens of seq 0 in the KV cache, by position
+static llama_pos g_turn_start_pos = 0; // where the assistant turn being generated starts
+
+// Generation state
+static llama_pos   g_stop_pos = 0;
+static std::string g_cached_chars;
+static std::ostringstream g_assistant_ss;
+
+// Chat template state
+struct CachedMessage {
+    std::string  role;
+    std::string  content;
+    llama_tokens tokens;
+};
+static bool         g_chat_jinja = true;
+static std::string  g_gen_prefix;
+static llama_tokens g_gen_prefix_tokens;
+static std::vector<CachedMessage> g_msg_cache;
+
+// Speculative decoding: a smaller model with a compatible vocabulary drafts
+// tokens that the main model verifies in one batch. g_draft_tokens mirrors
+// seq 0 of the draft KV cache; it is synced with g_kv_tokens before drafting.
+static llama_model   *g_draft_model = nullptr;
+static llama_context *g_draft_ctx   = nullptr;
+static llama_batch    g_draft_batch;
+static llama_tokens   g_draft_tokens;
+
+static constexpr int   SPEC_DRAFT_MIN   = 2;
+static constexpr int   SPEC_DRAFT_MAX   = 16;
+static constexpr float SPEC_DRAFT_P_MIN = 0.6f; // draft stops below this confidence
+static int g_spec_n_draft = 4;                   // adapted from the acceptance rate
+
+// Prompt lookup: without a draft model, drafts are copied from earlier in the
+// context wherever the last few tokens already occurred (summaries, quotes,
+// repeated argument values). Matched n-grams are NGRAM_MIN..NGRAM_MAX long.
+static constexpr int NGRAM_MIN = 2;
+static constexpr int NGRAM_MAX = 4;
+static int g_lookup_n_draft = 8;
+
+// Counters for the last generation and the confidence of each token it
+// emitted, with the output offset the token's text starts at;
+// g_request_start is when the request began, for time-to-first-text
+static GenerationStats g_gen_stats;
+static std::vector<TokenConfidence> g_token_conf;
+static std::vector<size_t> g_token_conf_start;
+static std::chrono::steady_clock::time_point g_request_start;
+
+// Backend buffers llama.cpp allocated for a model and its context, from the
+// sizes it logs while loading (there is no public API for them)
+struct BufferSizes {
+    uint64_t model_mapped = 0;
+    uint64_t model_anon   = 0;
+    uint64_t kv      = 0;
+    uint64_t compute = 0; // compute graphs and the logits output buffer
+
+    uint64_t total() const { return model_mapped + model_anon + kv + compute; }
+};
+static BufferSizes  g_buffers;
+static BufferSizes  g_draft_buffers;
+static BufferSizes *g_buffer_capture = nullptr; // set while a model loads
+static std::string  g_model_path;
+static bool         g_model_mmap = true;
+
+// Collects the buffer sizes logged while it is in scope into `sizes`
+struct BufferCapture {
+    explicit BufferCapture(BufferSizes &sizes) { sizes = BufferSizes(); g_buffer_capture = &sizes; }
+    ~BufferCapture() { g_buffer_capture = nullptr; }
+};
+
+// Highest process anonymous RSS sampled during the current request
+static uint64_t g_request_peak_anon = 0;
+
+static int64_t us_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds the time until it goes out of scope to one of the g_gen_stats timers
+struct ScopedTimer {
+    int64_t &total;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ~ScopedTimer() { total += us_since(start); }
+};
+
+// "...: CPU_Mapped model buffer size =   942.43 MiB" and the like, as logged
+// by llama.cpp's model loader, KV cache and context
+static void capture_buffer_size(const char *text, BufferSizes &sizes) {
+    static const char marker[] = " buffer size = ";
+    const char *at = std::strstr(text, marker);
+    if (!at) return;
+    uint64_t bytes = (uint64_t)(std::atof(at + sizeof(marker) - 1) * 1024.0 * 1024.0);
+
+    std::string head(text, at);
+    auto ends_with = [&](const char *suffix) {
+        size_t n = std::strlen(suffix);
+        return head.size() >= n && head.compare(head.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(" model")) {
+        (head.find("_Mapped") != std::string::npos ? sizes.model_mapped : sizes.model_anon) += bytes;
+    } else if (ends_with(" KV") || ends_with(" RS")) {
+        sizes.kv += bytes;
+    } else if (ends_with(" compute") || ends_with(" output")) {
+        sizes.compute += bytes;
+    }
+}
+
+// llama.cpp's log: to llama_log.h (information at debug level), and scanned
+// for buffer sizes while a model loads
+static void on_llama_log(ggml_log_level level, const char *text, void *) {
+    if (g_buffer_capture) capture_buffer_size(text, *g_buffer_capture);
+    int len = (int)std::strlen(text);
+    if (len > 0 && text[len - 1] == '\n') len--;
+    switch (level) {
+        case GGML_LOG_LEVEL_ERROR: LOGe("%.*s", len, text); break;
+        case GGML_LOG_LEVEL_WARN:  LOGw("%.*s", len, text); break;
+        case GGML_LOG_LEVEL_INFO:  LOGd("%.*s", len, text); break;
+        default: break; // debug output and continuation dots
+    }
+}
+
+// Process anonymous RSS: resident minus file-backed and shared pages
+static uint64_t anon_rss_bytes() {
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0, shared = 0;
+    int n = std::fscanf(f, "%lu %lu %lu", &size, &resident, &shared);
+    std::fclose(f);
+    if (n != 3 || resident < shared) return 0;
+    return (uint64_t)(resident - shared) * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static void sample_peak_anon() {
+    g_request_peak_anon = std::max(g_request_peak_anon, anon_rss_bytes());
+}
+
+// Bytes of the file at `path` in the page cache, i.e. mapped weights that
+// are resident or can be faulted in without I/O. Maps the file without
+// touching it; mincore reports the file's cached pages because the app
+// owns its model files.
+static uint64_t file_resident_bytes(const std::string &path, uint64_t &file_bytes) {
+    file_bytes = 0;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    uint64_t resident = 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        file_bytes = (uint64_t)st.st_size;
+        void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+            std::vector<unsigned char> pages((file_bytes + page - 1) / page);
+            if (mincore(addr, (size_t)st.st_size, pages.data()) == 0) {
+                for (unsigned char p : pages) resident += p & 1;
+            }
+            munmap(addr, (size_t)st.st_size);
+            resident = std::min(resident * page, file_bytes);
+        }
+    }
+    close(fd);
+    return resident;
+}
+
+// Host memory of llama_batch_init(n_tokens, 0, n_seq_max)
+static uint64_t batch_bytes(int n_tokens, int n_seq_max) {
+    uint64_t per_token = sizeof(llama_token) + sizeof(llama_pos) + sizeof(int32_t) + sizeof(llama_seq_id *) +
+                         sizeof(int8_t) + (uint64_t)n_seq_max * sizeof(llama_seq_id);
+    return (uint64_t)n_tokens * per_token + sizeof(llama_seq_id *);
+}
+
+// Counters after a decode step of a generation that started at t_start
+static void trace_step(int n_batch, std::chrono::steady_clock::time_point t_start) {
+    if (!undios_trace::enabled()) return;
+    TRACE_COUNTER("batch_tokens", n_batch);
+    TRACE_COUNTER("kv_cells", g_current_pos);
+    TRACE_COUNTER("decode_tok_s", g_gen_stats.n_tokens * 1000000LL / std::max<int64_t>(1, us_since(t_start)));
+}
+
+// Positions of the token n-grams in g_kv_tokens, for prompt lookup. Each
+// n-gram maps to the position right after its latest occurrence. The index
+// is extended incrementally as tokens are decoded; entries left stale by a
+// rollback are caught by re-checking the tokens on lookup.
+struct NgramIndex {
+    std::unordered_map<uint64_t, int32_t> next_pos[NGRAM_MAX - NGRAM_MIN + 1];
+    size_t n_indexed = 0; // n-grams ending before this position are indexed
+
+    static uint64_t key(const llama_token *tokens, int n) {
+        uint64_t h = 1469598103934665603ULL;
+        for (int i = 0; i < n; i++) h = (h ^ (uint32_t)tokens[i]) * 1099511628211ULL;
+        return h;
+    }
+
+    void clear() {
+        for (auto &m : next_pos) m.clear();
+        n_indexed = 0;
+    }
+
+    // Tokens from `pos` on changed: re-index them on the next update
+    void truncate(size_t pos) { n_indexed = std::min(n_indexed, pos); }
+
+    // Index n-grams whose continuation is known: those ending before the last token
+    void update(const llama_tokens &tokens) {
+        if (tokens.size() < n_indexed) clear();
+        for (size_t end = std::max(n_indexed, (size_t)NGRAM_MIN); end < tokens.size(); end++) {
+            for (int n = NGRAM_MIN; n <= NGRAM_MAX && (size_t)n <= end; n++) {
+                next_pos[n - NGRAM_MIN][key(&tokens[end - n], n)] = (int32_t)end;
+            }
+        }
+        n_indexed = std::max(n_indexed, tokens.size());
+    }
+
+    // Continuation of the longest indexed n-gram that ends the context
+    // (`tokens` followed by `id_last`), up to n_max tokens
+    llama_tokens lookup(const llama_tokens &tokens, llama_token id_last, int n_max) const {
+        llama_tokens tail(tokens.end() - std::min(tokens.size(), (size_t)NGRAM_MAX - 1), tokens.end());
+        tail.push_back(id_last);
+
+        for (int n = std::min((int)tail.size(), NGRAM_MAX); n >= NGRAM_MIN; n--) {
+            const llama_token *query = tail.data() + tail.size() - n;
+            const auto &m = next_pos[n - NGRAM_MIN];
+            auto it = m.find(key(query, n));
+            if (it == m.end()) continue;
+
+            size_t pos = (size_t)it->second;
+            if (pos > tokens.size() || !std::equal(query, query + n, tokens.begin() + (pos - n))) continue;
+            size_t end = std::min(tokens.size(), pos + (size_t)n_max);
+            if (end > pos) return llama_tokens(tokens.begin() + pos, tokens.begin() + end);
+        }
+        return {};
+    }
+};
+static NgramIndex g_ngram_index;
+
+// -------------------------------------------------------------------------
+// Helpers
+// -------------------------------------------------------------------------
+static void reset_chat_state(bool clear_kv = true) {
+    g_chat_msgs.clear();
+    g_msg_end_pos.clear();
+    g_pending_tokens.clear();
+    g_kv_valid_msgs = 0;
+    g_system_pos  = 0;
+    g_current_pos = 0;
+    if (clear_kv) {
+        g_kv_tokens.clear();
+        g_ngram_index.clear();
+        if (g_context) llama_memory_clear(llama_get_memory(g_context), false);
+    }
+}
+
+// Drop everything from `pos` on from seq 0 of the KV cache
+static void kv_rollback(llama_pos pos) {
+    llama_memory_seq_rm(llama_get_memory(g_context), 0, pos, -1);
+    g_current_pos = pos;
+    g_kv_tokens.resize(pos);
+    g_ngram_index.truncate(pos);
+}
+
+static void reset_gen_state() {
+    g_stop_pos = 0;
+    g_cached_chars.clear();
+    g_assistant_ss.str("");
+}
+
+static void shift_context() {
+    TRACE_SCOPE("shift_context");
+    int n_discard = (g_current_pos - g_system_pos) / 2;
+    LOGi("Shifting context: discarding %d tokens", n_discard);
+    g_gen_stats.n_ctx_shifts++;
+    llama_memory_seq_rm(llama_get_memory(g_context), 0, g_system_pos, g_system_pos + n_discard);
+    llama_memory_seq_add(llama_get_memory(g_context), 0, g_system_pos + n_discard, g_current_pos, -n_discard);
+    g_kv_tokens.erase(g_kv_tokens.begin() + g_system_pos, g_kv_tokens.begin() + g_system_pos + n_discard);
+    g_ngram_index.clear();
+    g_current_pos -= n_discard;
+    g_stop_pos    -= n_discard;
+    g_turn_start_pos = std::max(g_system_pos, g_turn_start_pos - n_discard);
+
+    // Only the system prompt survives a shift intact
+    g_kv_valid_msgs = std::min(g_kv_valid_msgs, (size_t)(g_system_pos > 0 ? 1 : 0));
+}
+
+// Decode tokens at g_current_pos in batches, advancing g_current_pos.
+static int decode_batched(
+    llama_context *ctx, llama_batch &batch,
+    const llama_tokens &tokens, bool logit_last = false
+) {
+    for (int i = 0; i < (int)tokens.size(); i += g_batch_size) {
+        int cur = std::min((int)tokens.size() - i, g_batch_size);
+        TRACE_SCOPE("decode_batched");
+        TRACE_COUNTER("batch_tokens", cur);
+        common_batch_clear(batch);
+
+        if (g_current_pos + cur >= g_context_size - 4) {
+            shift_context();
+        }
+
+        for (int j = 0; j < cur; j++) {
+            bool want_logit = logit_last && (i + j == (int)tokens.size() - 1);
+            common_batch_add(batch, tokens[i + j], g_current_pos + j, {0}, want_logit);
+        }
+
+        if (llama_decode(ctx, batch) != 0) {
+            LOGe("llama_decode failed");
+            return 1;
+        }
+        g_kv_tokens.insert(g_kv_tokens.end(), tokens.begin() + i, tokens.begin() + i + cur);
+        g_current_pos += cur;
+        TRACE_COUNTER("kv_cells", g_current_pos);
+    }
+    return 0;
+}
+
+// Render a single message with the model's own chat template, as the delta
+// it adds on top of the messages already in `past`.
+static std::string chat_format_message(
+    const std::vector<common_chat_msg> &past, const common_chat_msg &msg, bool add_ass
+) {
+    return common_chat_format_single(g_chat_templates.get(), past, msg, add_ass, g_chat_jinja);
+}
+
+// Probe the template once per model: decide between Jinja and the built-in
+// templates, and cache the tokens of the assistant generation prefix.
+static void init_chat_template() {
+    g_msg_cache.clear();
+    g_gen_prefix.clear();
+    g_gen_prefix_tokens.clear();
+
+    common_chat_msg probe;
+    probe.role    = "user";
+    probe.content = "x";
+
+    std::string with_prefix, without_prefix;
+    for (bool jinja : {true, false}) {
+        g_chat_jinja = jinja;
+        try {
+            with_prefix    = chat_format_message({}, probe, true);
+            without_prefix = chat_format_message({}, probe, false);
+            break;
+        } catch (const std::exception &e) {
+            LOGw("Chat template render failed (jinja=%d): %s", jinja, e.what());
+            with_prefix.clear();
+            without_prefix.clear();
+        }
+    }
+
+    if (with_prefix.size() > without_prefix.size() &&
+        with_prefix.compare(0, without_prefix.size(), without_prefix) == 0) {
+        g_gen_prefix = with_prefix.substr(without_prefix.size());
+        g_gen_prefix_tokens = common_tokenize(g_context, g_gen_prefix, false, true);
+    }
+    LOGi("Chat template ready (jinja=%d, gen prefix=%d tokens)",
+         g_chat_jinja, (int)g_gen_prefix_tokens.size());
+}
+
+// common_tokenize for request text, timed as the request's tokenization
+static llama_tokens tokenize_timed(const std::string &text, bool add_special, bool parse_special) {
+    ScopedTimer timer{g_gen_stats.t_tokenize_us};
+    TRACE_SCOPE("tokenize");
+    return common_tokenize(g_context, text, add_special, parse_special);
+}
+
+// Tokens of message `msg` rendered after the session's current messages.
+// Messages that match the cache at the same index (same role and content,
+// same history) reuse their tokens, so rebuilding or extending a
+// conversation only tokenizes the turns that changed.
+static const llama_tokens &message_tokens(const common_chat_msg &msg) {
+    size_t idx = g_chat_msgs.size();
+    if (idx < g_msg_cache.size() &&
+        g_msg_cache[idx].role == msg.role && g_msg_cache[idx].content == msg.content) {
+        return g_msg_cache[idx].tokens;
+    }
+
+    g_msg_cache.resize(idx);
+    std::string rendered = chat_format_message(g_chat_msgs, msg, false);
+    g_msg_cache.push_back({msg.role, msg.content, tokenize_timed(rendered, idx == 0, true)});
+    return g_msg_cache.back().tokens;
+}
+
+// Append a message to the session. Its tokens are queued and decoded in one
+// batch with any other pending tokens by the next session_continue().
+static void session_append(const common_chat_msg &msg) {
+    const llama_tokens &tokens = message_tokens(msg);
+    g_pending_tokens.insert(g_pending_tokens.end(), tokens.begin(), tokens.end());
+
+    llama_pos end_pos = g_current_pos + (llama_pos)g_pending_tokens.size();
+    if (g_chat_msgs.empty() && msg.role == "system") g_system_pos = end_pos;
+
+    bool intact = g_kv_valid_msgs == g_chat_msgs.size();
+    g_chat_msgs.push_back(msg);
+    g_msg_end_pos.push_back(end_pos);
+    if (intact) g_kv_valid_msgs = g_chat_msgs.size();
+}
+
+// Drop every session message from index `keep` on, rolling the KV cache back
+// to the end of message keep - 1.
+static void session_truncate(size_t keep) {
+    if (keep >= g_chat_msgs.size()) return;
+    if (keep == 0) {
+        reset_chat_state();
+        return;
+    }
+
+    llama_pos end_pos = g_msg_end_pos[keep - 1];
+    if (end_pos <= g_current_pos) {
+        kv_rollback(end_pos);
+        g_pending_tokens.clear();
+    } else {
+        g_pending_tokens.resize(end_pos - g_current_pos);
+    }
+    g_chat_msgs.resize(keep);
+    g_msg_end_pos.resize(keep);
+    g_kv_valid_msgs = std::min(g_kv_valid_msgs, keep);
+}
+
+// Record the text just generated as the assistant's message. Its sampled
+// tokens stay in the KV cache; only the template's closing tokens (e.g.
+// "<|im_end|>\n") are queued. If the template renders the message
+// differently from what was sampled, the turn is re-queued as rendered.
+static void session_close_assistant(const std::string &content) {
+    common_chat_msg msg;
+    msg.role    = "assistant";
+    msg.content = content;
+
+    std::string rendered = chat_format_message(g_chat_msgs, msg, false);
+    std::string sampled  = g_gen_prefix + content;
+
+    llama_tokens tail;
+    if (rendered.compare(0, sampled.size(), sampled) == 0) {
+        tail = tokenize_timed(rendered.substr(sampled.size()), false, true);
+    } else {
+        LOGd("Assistant turn re-rendered by template, re-queueing");
+        kv_rollback(g_turn_start_pos);
+        tail = tokenize_timed(rendered, false, true);
+    }
+    g_pending_tokens.insert(g_pending_tokens.end(), tail.begin(), tail.end());
+
+    bool intact = g_kv_valid_msgs == g_chat_msgs.size();
+    g_msg_cache.resize(g_chat_msgs.size());
+    g_chat_msgs.push_back(msg);
+    g_msg_end_pos.push_back(g_current_pos + (llama_pos)g_pending_tokens.size());
+    if (intact) g_kv_valid_msgs = g_chat_msgs.size();
+}
+
+// Parameters a sampler was built with; an identical request reuses it (after
+// a reset) so a tool call grammar is compiled once, not per generation.
+struct SamplerKey {
+    float temp = -1.0f, top_p = 0.0f;
+    int   top_k = 0;
+    float repeat_penalty = 0.0f;
+    uint32_t seed = LLAMA_DEFAULT_SEED;
+    std::string grammar;
+
+    bool operator==(const SamplerKey &o) const {
+        return temp == o.temp && top_p == o.top_p && top_k == o.top_k &&
+               repeat_penalty == o.repeat_penalty && seed == o.seed && grammar == o.grammar;
+    }
+};
+
+struct SamplerSlot {
+    common_sampler *smpl = nullptr;
+    SamplerKey      key;
+    bool            has_grammar = false;
+
+    void release() {
+        if (smpl) common_sampler_free(smpl);
+        *this = SamplerSlot();
+    }
+};
+
+// common_sampler owns its grammar and its sampling chain together, so
+// requests with a tool call grammar get a slot of their own: a summary or
+// scoring request in between, with other parameters, replaces only the
+// plain sampler and the compiled grammar survives it.
+static SamplerSlot g_plain_sampler;
+static SamplerSlot g_grammar_sampler;
+
+// Point g_sampler at a sampler for these parameters. A non-empty GBNF
+// `grammar` is applied lazily, from the first <tool_call> on. Returns whether
+// the grammar is active.
+static bool init_sampler(float temperature, float top_p, int top_k, float repeat_penalty,
+                         uint32_t seed = LLAMA_DEFAULT_SEED, const std::string &grammar = "") {
+    SamplerKey key{temperature, top_p, top_k, repeat_penalty, seed, grammar};
+    SamplerSlot &slot = grammar.empty() ? g_plain_sampler : g_grammar_sampler;
+    if (slot.smpl && key == slot.key) {
+        common_sampler_reset(slot.smpl);
+        g_sampler = slot.smpl;
+        return slot.has_grammar;
+    }
+
+    slot.release();
+    common_params_sampling sparams;
+    sparams.temp           = temperature;
+    sparams.top_p          = top_p;
+    sparams.top_k          = top_k;
+    sparams.penalty_repeat = repeat_penalty;
+    sparams.seed           = seed;
+    if (!grammar.empty()) {
+        sparams.grammar      = grammar;
+        sparams.grammar_lazy = true;
+        sparams.grammar_triggers.push_back({COMMON_GRAMMAR_TRIGGER_TYPE_WORD, "<tool_call>"});
+    }
+    slot.smpl = common_sampler_init(g_model, sparams);
+    slot.has_grammar = slot.smpl && !grammar.empty();
+
+    if (!slot.smpl && !grammar.empty()) {
+        LOGe("Failed to compile tool call grammar, sampling unconstrained");
+        sparams.grammar.clear();
+        sparams.grammar_lazy = false;
+        sparams.grammar_triggers.clear();
+        slot.smpl = common_sampler_init(g_model, sparams);
+    } else if (slot.has_grammar) {
+        LOGi("Compiled tool call grammar (%d bytes)", (int)grammar.size());
+    }
+    slot.key  = key;
+    g_sampler = slot.smpl;
+    return slot.has_grammar;
+}
+
+// Length of the UTF-8 sequence a lead byte starts, 0 if it is not a lead byte
+static int utf8_seq_len(unsigned char c) {
+    if ((c & 0x80) == 0x00) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 0;
+}
+
+// Bytes at the end of s[0, end) that start a multi-byte sequence whose
+// remaining bytes have not been generated yet
+static size_t utf8_incomplete_tail(const std::string &s, size_t end) {
+    for (size_t k = 1; k <= 3 && k <= end; k++) {
+        unsigned char c = (unsigned char)s[end - k];
+        if ((c & 0xC0) == 0x80) continue;
+        int n = utf8_seq_len(c);
+        return n > (int)k ? k : 0;
+    }
+    return 0;
+}
+
+// Replace each byte that is not part of a well-formed sequence with '?'.
+// Keeps the length, so offsets into the output (stop matches) stay valid.
+static void repair_utf8(std::string &s) {
+    for (size_t i = 0; i < s.size();) {
+        int n = utf8_seq_len((unsigned char)s[i]);
+        bool ok = n > 0 && i + n <= s.size();
+        for (int j = 1; ok && j < n; j++) ok = ((unsigned char)s[i + j] & 0xC0) == 0x80;
+        if (ok && s[i] != '\0') {
+            i += n;
+        } else {
+            s[i++] = '?';
+        }
+    }
+}
+
+// Text a tool call grammar leaves no choice about, computed from the scaffold
+// built by ToolCallGrammar (one line per tool: name, required keys, and
+// whether optional keys follow). Covers the call prefix, the rest of a tool
+// name once its prefix is unique, the keys of the required arguments in
+// order, and the closing tags once the last required argument is done.
+struct ToolCallForcer {
+    static constexpr const char *NAME_OPEN  = "\n{\"name\": \"";
+    static constexpr const char *ARGS_OPEN  = "\", \"arguments\": {";
+    static constexpr const char *KEY_SEP    = ", ";
+    static constexpr const char *CALL_CLOSE = "}}\n</tool_call>";
+
+    struct Tool {
+        std::string name;
+        std::vector<std::string> keys;
+        bool open = false;
+    };
+
+    std::string      spec;
+    std::vector<Tool> tools;
+
+    void parse(const std::string &scaffold) {
+        if (scaffold == spec) return;
+        spec = scaffold;
+        tools.clear();
+
+        std::istringstream lines(scaffold);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t t1 = line.find('\t');
+            size_t t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+            if (t2 == std::string::npos) continue;
+
+            Tool tool;
+            tool.name = line.substr(0, t1);
+            tool.open = line.compare(t2 + 1, std::string::npos, "1") == 0;
+            std::istringstream keys(line.substr(t1 + 1, t2 - t1 - 1));
+            std::string key;
+            while (std::getline(keys, key, ',')) {
+                if (!key.empty()) tool.keys.push_back(key);
+            }
+            tools.push_back(std::move(tool));
+        }
+    }
+
+    // Forced continuation of the block body text[begin..], or "" when the
+    // model has a choice (or the text has left the scaffold).
+    std::string forced(const std::string &text, size_t begin) const {
+        if (tools.empty()) return "";
+        size_t pos = begin;
+        std::string rest;
+
+        if (!match(text, pos, NAME_OPEN, rest)) return rest;
+
+        size_t quote = text.find('"', pos);
+        if (quote == std::string::npos) {
+            const Tool *only = nullptr;
+            for (const auto &tool : tools) {
+                if (tool.name.compare(0, text.size() - pos, text, pos, std::string::npos) != 0) continue;
+                if (only) return "";
+                only = &tool;
+            }
+            if (!only) return "";
+            return only->name.substr(text.size() - pos) + key_literal(*only, 0);
+        }
+
+        const Tool *tool = nullptr;
+        for (const auto &t : tools) {
+            if (t.name.compare(0, std::string::npos, text, pos, quote - pos) == 0) { tool = &t; break; }
+        }
+        if (!tool) return "";
+        pos = quote;
+
+        for (size_t i = 0; i < tool->keys.size(); i++) {
+            if (!match(text, pos, key_literal(*tool, i), rest)) return rest;
+            pos = value_end(text, pos);
+            if (pos == std::string::npos) return "";
+        }
+        if (tool->keys.empty()) {
+            match(text, pos, key_literal(*tool, 0), rest);
+        } else if (!tool->open) {
+            match(text, pos, CALL_CLOSE, rest);
+        }
+        return rest;
+    }
+
+private:
+    // Literal preceding required key i (or the empty arguments after the name)
+    static std::string key_literal(const Tool &tool, size_t i) {
+        if (tool.keys.empty()) return std::string(ARGS_OPEN) + (tool.open ? "" : CALL_CLOSE);
+        std::string key = "\"" + tool.keys[i] + "\": ";
+        return i == 0 ? ARGS_OPEN + key : KEY_SEP + key;
+    }
+
+    // Advance past `literal`. When the text ends inside it, `rest` receives
+    // the missing part; on a mismatch `rest` is empty.
+    static bool match(const std::string &text, size_t &pos, const std::string &literal, std::string &rest) {
+        size_t n = std::min(text.size() - pos, literal.size());
+        rest.clear();
+        if (text.compare(pos, n, literal, 0, n) != 0) return false;
+        if (n < literal.size()) {
+            rest = literal.substr(n);
+            return false;
+        }
+        pos += n;
+        return true;
+    }
+
+    // End of the JSON value starting at pos, or npos while it is incomplete
+    static size_t value_end(const std::string &text, size_t pos) {
+        if (pos >= text.size()) return std::string::npos;
+        int  depth     = 0;
+        bool in_string = false;
+        for (size_t i = pos; i < text.size(); i++) {
+            char c = text[i];
+            if (in_string) {
+                if (c == '\\') i++;
+                else if (c == '"') {
+                    in_string = false;
+                    if (depth == 0) return i + 1;
+                }
+            } else if (c == '"') {
+                in_string = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (depth == 0) return i;
+                if (--depth == 0) return i + 1;
+            } else if (depth == 0 && (c == ',' || c == ' ' || c == '\n')) {
+                return i;
+            }
+        }
+        return std::string::npos;
+    }
+};
+
+static ToolCallForcer g_tool_forcer;
+
+// Per-request stop strings, matched incrementally over the detokenized
+// stream so a stop string split across tokens is still caught.
+struct StopMatcher {
+    std::vector<std::string>     patterns;
+    std::unique_ptr<AhoCorasick> automaton;
+    int    state  = AhoCorasick::ROOT;
+    size_t offset = 0; // bytes fed since reset()
+
+    // Start a new generation; the automaton is rebuilt only when the stop
+    // strings differ from the previous request.
+    void reset(const std::vector<std::string> &stop) {
+        if (stop != patterns || (!automaton && !stop.empty())) {
+            patterns = stop;
+            automaton = patterns.empty() ? nullptr : std::make_unique<AhoCorasick>(patterns);
+        }
+        state  = AhoCorasick::ROOT;
+        offset = 0;
+    }
+
+    bool active() const { return automaton != nullptr; }
+
+    // Feed the next piece. Returns the offset at which the first stop string
+    // starts, or npos.
+    size_t feed(const std::string &piece) {
+        if (!automaton) {
+            offset += piece.size();
+            return std::string::npos;
+        }
+        for (unsigned char c : piece) {
+            state = automaton->next(state, c);
+            offset++;
+            int m = automaton->longest_match(state);
+            if (m >= 0) return offset - automaton->pattern(m).size();
+        }
+        return std::string::npos;
+    }
+
+    // Trailing bytes that could still be the start of a stop string
+    size_t pending() const { return automaton ? (size_t)automaton->depth(state) : 0; }
+};
+
+static StopMatcher g_stop_matcher;
+
+// Forwards output to a TextFn (e.g. a Java LlamaStreamCallback) as it is generated
+struct StreamSink {
+    const engine::TextFn &on_text;
+    size_t emitted = 0;
+    bool   failed  = false;
+
+    // Send text[emitted, end), short of a character cut by `end`. Returns
+    // false once the receiver has asked to stop.
+    bool flush(const std::string &text, size_t end) {
+        if (failed) return false;
+        end -= utf8_incomplete_tail(text, end);
+        if (end <= emitted) return true;
+        std::string chunk = text.substr(emitted, end - emitted);
+
+        emitted = end;
+        ScopedTimer timer{g_gen_stats.t_callback_us};
+        TRACE_SCOPE("on_text");
+        if (!on_text(chunk)) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+};
+static StreamSink *g_stream_sink = nullptr;
+
+// Append a generated piece to the output, holding back an incomplete UTF-8
+// sequence at its end; invalid bytes are replaced. Returns true when generation should end: a stop string
+// completed (the output is then cut where it starts) or the stream sink failed.
+//
+// While streaming, text that may still be the start of a stop string is
+// held back from the sink until it is either harmless or cut off.
+static bool append_output(const std::string &piece, StopMatcher *stop) {
+    if (g_gen_stats.t_first_us == 0) {
+        g_gen_stats.t_first_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - g_request_start).count();
+    }
+    if (stop) {
+        size_t at = stop->feed(piece);
+        if (at != std::string::npos) {
+            std::string text = g_assistant_ss.str() + g_cached_chars + piece;
+            text.resize(at);
+            text.resize(at - utf8_incomplete_tail(text, at));
+            repair_utf8(text);
+            g_cached_chars.clear();
+            g_assistant_ss.str(text);
+            g_assistant_ss.seekp(0, std::ios_base::end);
+            LOGd("Stop string matched at %d", (int)at);
+            if (g_stream_sink) g_stream_sink->flush(text, text.size());
+            return true;
+        }
+    }
+
+    g_cached_chars += piece;
+    size_t ready = g_cached_chars.size() - utf8_incomplete_tail(g_cached_chars, g_cached_chars.size());
+    if (ready > 0) {
+        std::string text = g_cached_chars.substr(0, ready);
+        repair_utf8(text);
+        g_assistant_ss << text;
+        g_cached_chars.erase(0, ready);
+    }
+    if (g_stream_sink) {
+        std::string text = g_assistant_ss.str();
+        size_t held = stop ? std::min(stop->pending(), text.size()) : 0;
+        if (!g_stream_sink->flush(text, text.size() - held)) return true;
+    }
+    return false;
+}
+
+// Confidence of token `id` sampled from logits row `idx` of `ctx`
+static TokenConfidence confidence_of(llama_context *ctx, const llama_model *model, int idx, llama_token id) {
+    const float *logits = llama_get_logits_ith(ctx, idx);
+    if (!logits) return {0.0f, 0.0f};
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+
+    float max_l = logits[0];
+    for (int t = 1; t < n_vocab; t++) max_l = std::max(max_l, logits[t]);
+    double z = 0.0, weighted = 0.0;
+    for (int t = 0; t < n_vocab; t++) {
+        double d = (double)(logits[t] - max_l);
+        double e = std::exp(d);
+        z += e;
+        weighted += e * d;
+    }
+    double log_z = std::log(z);
+    return {(float)(logits[id] - max_l - log_z), (float)(log_z - weighted / z)};
+}
+
+static TokenConfidence confidence_of(int idx, llama_token id) { return confidence_of(g_context, g_model, idx, id); }
+
+// Drop the confidence of tokens whose text starts at or after `len`, which
+// is no longer part of the output
+static void trim_confidence(size_t len) {
+    while (!g_token_conf_start.empty() && g_token_conf_start.back() >= len) {
+        g_token_conf_start.pop_back();
+        g_token_conf.pop_back();
+    }
+}
+
+// Append a token's text to the output (see append_output) and record its
+// confidence, followed by {0, 0} for `n_forced` grammar-forced tokens whose
+// text `piece` also holds. When generation stops on a stop string, the
+// confidence of every token the stop string cut away is dropped too, so
+// token_confidence() covers exactly the tokens in the output.
+static bool emit_output(const std::string &piece, StopMatcher *stop, TokenConfidence conf, int n_forced = 0) {
+    const size_t start = (size_t)g_assistant_ss.tellp() + g_cached_chars.size();
+    g_token_conf.push_back(conf);
+    g_token_conf_start.push_back(start);
+    for (int i = 0; i < n_forced; i++) {
+        g_token_conf.push_back({0.0f, 0.0f});
+        g_token_conf_start.push_back(start);
+    }
+    if (!append_output(piece, stop)) return false;
+    trim_confidence((size_t)g_assistant_ss.tellp() + g_cached_chars.size());
+    return true;
+}
+
+// Proposes up to n_max tokens to follow `id_last`, which is about to be
+// decoded at g_current_pos.
+using DraftFn = std::function<llama_tokens(llama_token id_last, int n_max)>;
+
+// Bring the draft KV cache in line with the main one: keep the common
+// prefix, decode the rest. Tokens past the end of the main cache are kept
+// when all of it matches (an answer from generate_draft, see draft_from_model).
+static bool draft_sync() {
+    size_t keep = 0;
+    while (keep < g_draft_tokens.size() && keep < g_kv_tokens.size() &&
+           g_draft_tokens[keep] == g_kv_tokens[keep]) keep++;
+    if (keep == g_kv_tokens.size()) return true;
+    llama_memory_seq_rm(llama_get_memory(g_draft_ctx), 0, (llama_pos)keep, -1);
+    g_draft_tokens.resize(keep);
+
+    for (size_t i = keep; i < g_kv_tokens.size(); i += g_batch_size) {
+        size_t end = std::min(g_kv_tokens.size(), i + g_batch_size);
+        common_batch_clear(g_draft_batch);
+        for (size_t j = i; j < end; j++) {
+            common_batch_add(g_draft_batch, g_kv_tokens[j], (llama_pos)j, {0}, false);
+        }
+        if (llama_decode(g_draft_ctx, g_draft_batch) != 0) {
+            LOGe("Draft decode failed while syncing");
+            return false;
+        }
+        g_draft_tokens.insert(g_draft_tokens.end(), g_kv_tokens.begin() + i, g_kv_tokens.begin() + end);
+    }
+    return true;
+}
+
+// Greedy draft from the draft model, stopping early once it is unsure. When
+// the draft cache already continues with `id_last` (the draft model's own
+// answer to the same prompt), that continuation is proposed as is.
+static llama_tokens draft_from_model(llama_token id_last, int n_max) {
+    llama_tokens draft;
+    if (!draft_sync()) return draft;
+
+    const size_t n_kv = g_kv_tokens.size();
+    if (g_draft_tokens.size() > n_kv) {
+        if (g_draft_tokens[n_kv] == id_last) {
+            size_t end = std::min(g_draft_tokens.size(), n_kv + 1 + (size_t)n_max);
+            return llama_tokens(g_draft_tokens.begin() + n_kv + 1, g_draft_tokens.begin() + end);
+        }
+        llama_memory_seq_rm(llama_get_memory(g_draft_ctx), 0, (llama_pos)n_kv, -1);
+        g_draft_tokens.resize(n_kv);
+    }
+
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(g_draft_model));
+    llama_token cur = id_last;
+    for (int i = 0; i < n_max; i++) {
+        common_batch_clear(g_draft_batch);
+        common_batch_add(g_draft_batch, cur, (llama_pos)g_draft_tokens.size(), {0}, true);
+        if (llama_decode(g_draft_ctx, g_draft_batch) != 0) break;
+        g_draft_tokens.push_back(cur);
+
+        const float *logits = llama_get_logits_ith(g_draft_ctx, -1);
+        int best = 0;
+        for (int t = 1; t < n_vocab; t++) if (logits[t] > logits[best]) best = t;
+        double sum = 0.0;
+        for (int t = 0; t < n_vocab; t++) sum += std::exp((double)(logits[t] - logits[best]));
+        if (1.0 / sum < SPEC_DRAFT_P_MIN) break;
+
+        draft.push_back(best);
+        cur = best;
+    }
+    return draft;
+}
+
+// Draft by copying what followed the same n-gram earlier in the context
+static llama_tokens draft_from_context(llama_token id_last, int n_max) {
+    g_ngram_index.update(g_kv_tokens);
+    return g_ngram_index.lookup(g_kv_tokens, id_last, n_max);
+}
+
+// Speculative variant of generate_text (no tool call handling). Each round
+// decodes the last sampled token together with a draft, samples the main
+// model at every draft position, and keeps the draft up to the first
+// mismatch plus the main model's own next token. The draft length adapts:
+// it grows while drafts are fully accepted and shrinks when most are rejected.
+// `n_draft` is the drafter's current length and is updated in place.
+static std::string generate_speculative(int max_tokens, StopMatcher *stop,
+                                        const DraftFn &draft_fn, int &n_draft) {
+    const llama_vocab *vocab = llama_model_get_vocab(g_model);
+    const auto t_start = std::chrono::steady_clock::now();
+    g_stop_pos = g_current_pos + max_tokens;
+
+    llama_token id;
+    TokenConfidence conf;
+    {
+        ScopedTimer timer{g_gen_stats.t_sample_us};
+        TRACE_SCOPE("sample");
+        id = common_sampler_sample(g_sampler, g_context, -1);
+        common_sampler_accept(g_sampler, id, true);
+        conf = confidence_of(-1, id);
+    }
+
+    std::vector<TokenConfidence> confs;
+    while (g_current_pos < g_stop_pos) {
+        if (llama_vocab_is_eog(vocab, id)) break;
+        if (emit_output(common_token_to_piece(g_context, id), stop, conf)) break;
+        g_gen_stats.n_tokens++;
+
+        int n_max = std::min({n_draft, (int)(g_stop_pos - g_current_pos) - 1, g_batch_size - 1});
+        if (g_current_pos + 1 + n_max >= g_context_size - 4) shift_context();
+        llama_tokens draft;
+        if (n_max > 0) {
+            TRACE_SCOPE("draft");
+            draft = draft_fn(id, n_max);
+        }
+
+        common_batch_clear(g_batch);
+        common_batch_add(g_batch, id, g_current_pos, {0}, true);
+        for (size_t i = 0; i < draft.size(); i++) {
+            common_batch_add(g_batch, draft[i], g_current_pos + 1 + (llama_pos)i, {0}, true);
+        }
+        {
+            TRACE_SCOPE("decode");
+            if (llama_decode(g_context, g_batch) != 0) {
+                LOGe("Decode failed during generation at pos %d", g_current_pos);
+                break;
+            }
+        }
+
+        llama_tokens ids;
+        {
+            ScopedTimer timer{g_gen_stats.t_sample_us};
+            TRACE_SCOPE("sample");
+            ids = common_sampler_sample_and_accept_n(g_sampler, g_context, draft);
+            confs.clear();
+            for (size_t i = 0; i < ids.size(); i++) confs.push_back(confidence_of((int)i, ids[i]));
+        }
+        size_t n_accepted = ids.size() - 1;
+        g_gen_stats.n_drafted  += (int)draft.size();
+        g_gen_stats.n_accepted += (int)n_accepted;
+
+        // Keep the sampled token and the accepted part of the draft
+        g_kv_tokens.push_back(id);
+        g_kv_tokens.insert(g_kv_tokens.end(), draft.begin(), draft.begin() + n_accepted);
+        g_current_pos += 1 + (llama_pos)n_accepted;
+        llama_memory_seq_rm(llama_get_memory(g_context), 0, g_current_pos, -1);
+
+        if (!draft.empty()) {
+            if (n_accepted == draft.size()) {
+                n_draft = std::min(SPEC_DRAFT_MAX, n_draft + 2);
+            } else if (n_accepted * 2 < draft.size()) {
+                n_draft = std::max(SPEC_DRAFT_MIN, n_draft - 1);
+            }
+        }
+
+        // Output the accepted draft tokens; they are already in the KV cache
+        bool done = false;
+        for (size_t i = 0; i < n_accepted && !done; i++) {
+            llama_pos pos = g_current_pos - (llama_pos)n_accepted + (llama_pos)i;
+            if (llama_vocab_is_eog(vocab, ids[i]) ||
+                emit_output(common_token_to_piece(g_context, ids[i]), stop, confs[i])) {
+                kv_rollback(pos);
+                done = true;
+            } else {
+                g_gen_stats.n_tokens++;
+            }
+        }
+        trace_step((int)draft.size() + 1, t_start);
+        if (done) break;
+        id   = ids.back();
+        conf = confs.back();
+    }
+
+    g_gen_stats.n_draft = n_draft;
+    std::string output = g_assistant_ss.str();
+    LOGi("Generated %d chars (speculative: %d/%d drafted tokens accepted, next k=%d)",
+         (int)output.size(), g_gen_stats.n_accepted, g_gen_stats.n_drafted, n_draft);
+    return output;
+}
+
+// One token at a time; see generate_text.
+static std::string generate_sequential(int max_tokens, const engine::ToolCallFn *on_tool_call,
+                                       const ToolCallForcer *forcer, StopMatcher *stop) {
+    ToolCallStreamParser watcher;
+    std::vector<ToolCallStreamParser::Call> calls;
+    llama_pos   close_pos = -1;
+    std::string close_text;
+    int         n_forced  = 0;
+
+    // Feed text to the parser and report each completed call
+    auto watch = [&](const std::string &piece, bool &closed) {
+        calls.clear();
+        auto action = watcher.feed(piece, calls);
+        if (action == ToolCallStreamParser::CLOSED) closed = true;
+        ScopedTimer timer{g_gen_stats.t_callback_us};
+        TRACE_SCOPE("on_tool_call");
+        for (const auto &call : calls) (*on_tool_call)(call.name, call.arguments);
+        return action;
+    };
+
+    const auto t_start = std::chrono::steady_clock::now();
+    g_stop_pos = g_current_pos + max_tokens;
+    llama_tokens step;
+    while (g_current_pos < g_stop_pos) {
+        if (g_current_pos >= g_context_size - 4) shift_context();
+
+        llama_token id;
+        TokenConfidence conf;
+        {
+            ScopedTimer timer{g_gen_stats.t_sample_us};
+            TRACE_SCOPE("sample");
+            id = common_sampler_sample(g_sampler, g_context, -1);
+            common_sampler_accept(g_sampler, id, true);
+            conf = confidence_of(-1, id);
+        }
+
+        if (llama_vocab_is_eog(llama_model_get_vocab(g_model), id)) break;
+
+        std::string piece = common_token_to_piece(g_context, id);
+        const size_t piece_start = watcher.text.size();
+        bool closed = false;
+        if (on_tool_call && watch(piece, closed) == ToolCallStreamParser::STOP) {
+            LOGd("Tool call complete, stopping generation");
+            kv_rollback(close_pos);
+            g_cached_chars.clear();
+            g_assistant_ss.str(close_text);
+            g_assistant_ss.seekp(0, std::ios_base::end);
+            trim_confidence(close_text.size());
+            break;
+        }
+
+        step.assign(1, id);
+        if (forcer && watcher.in_block()) {
+            std::string forced = forcer->forced(watcher.text, watcher.block_start);
+            auto tokens = forced.empty() ? llama_tokens() : tokenize_timed(forced, false, true);
+            if (!tokens.empty() &&
+                (int)tokens.size() < g_batch_size &&
+                g_current_pos + 1 + (llama_pos)tokens.size() < std::min(g_stop_pos, (llama_pos)g_context_size - 4)) {
+                std::string forced_text;
+                for (llama_token t : tokens) {
+                    try {
+                        common_sampler_accept(g_sampler, t, true);
+                    } catch (const std::exception &e) {
+                        // The grammar's stacks are undefined after a failed accept
+                        LOGe("Grammar rejected forced token: %s", e.what());
+                        common_sampler_reset(g_sampler);
+                        throw;
+                    }
+                    step.push_back(t);
+                    forced_text += common_token_to_piece(g_context, t);
+                }
+                n_forced += (int)step.size() - 1;
+                piece += forced_text;
+                watch(forced_text, closed);
+            }
+        }
+        // Text after a close tag in the same piece is not part of the answer,
+        // unless it starts another block
+        if (closed && !watcher.in_block()) {
+            size_t end = watcher.close_end - piece_start;
+            if (piece.find('<', end) == std::string::npos) piece.resize(end);
+        }
+
+        // Forced tokens score {0, 0}: the model had no choice, so they neither
+        // lower the score nor misalign it with the output
+        if (emit_output(piece, stop, conf, (int)step.size() - 1)) break;
+
+        common_batch_clear(g_batch);
+        for (size_t i = 0; i < step.size(); i++) {
+            common_batch_add(g_batch, step[i], g_current_pos + (llama_pos)i, {0}, i + 1 == step.size());
+        }
+        {
+            TRACE_SCOPE("decode");
+            if (llama_decode(g_context, g_batch) != 0) {
+                LOGe("Decode failed during generation at pos %d", g_current_pos);
+                break;
+            }
+        }
+        g_kv_tokens.insert(g_kv_tokens.end(), step.begin(), step.end());
+        g_current_pos += (llama_pos)step.size();
+        g_gen_stats.n_tokens += (int)step.size();
+        trace_step((int)step.size(), t_start);
+
+        if (closed) {
+            close_pos  = g_current_pos;
+            close_text = g_assistant_ss.str();
+        }
+    }
+
+    std::string output = g_assistant_ss.str();
+    LOGi("Generated %d chars (%d tokens forced by grammar)", (int)output.size(), n_forced);
+    return output;
+}
+
+// Complete `tokens` with the draft model alone (see engine::generate_draft).
+// The draft KV cache keeps its common prefix with `tokens`; the prompt and
+// the sampled tokens stay in it afterwards.
+static std::string draft_generate_text(const llama_tokens &tokens, int max_tokens,
+                                       common_sampler *sampler, StopMatcher *stop) {
+    // Keep at most all but the last prompt token, which is decoded for its logits
+    size_t keep = 0;
+    while (keep < g_draft_tokens.size() && keep + 1 < tokens.size() && g_draft_tokens[keep] == tokens[keep]) keep++;
+    llama_memory_seq_rm(llama_get_memory(g_draft_ctx), 0, (llama_pos)keep, -1);
+    g_draft_tokens.resize(keep);
+    g_gen_stats.n_reused = (int)keep;
+
+    {
+        TRACE_SCOPE("prefill");
+        ScopedTimer timer{g_gen_stats.t_prompt_us};
+        for (size_t i = keep; i < tokens.size(); i += g_batch_size) {
+            size_t end = std::min(tokens.size(), i + g_batch_size);
+            common_batch_clear(g_draft_batch);
+            for (size_t j = i; j < end; j++) {
+                common_batch_add(g_draft_batch, tokens[j], (llama_pos)j, {0}, j + 1 == tokens.size());
+            }
+            if (llama_decode(g_draft_ctx, g_draft_batch) != 0) {
+                g_draft_tokens.clear();
+                llama_memory_clear(llama_get_memory(g_draft_ctx), false);
+                throw std::runtime_error("Failed to process prompt");
+            }
+            g_draft_tokens.insert(g_draft_tokens.end(), tokens.begin() + i, tokens.begin() + end);
+        }
+        g_gen_stats.n_prompt = (int)(tokens.size() - keep);
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(g_draft_model);
+    const auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < max_tokens && (int)g_draft_tokens.size() < g_context_size - 4; i++) {
+        llama_token id;
+        TokenConfidence conf;
+        {
+            ScopedTimer timer{g_gen_stats.t_sample_us};
+            TRACE_SCOPE("sample");
+            id = common_sampler_sample(sampler, g_draft_ctx, -1);
+            common_sampler_accept(sampler, id, true);
+            conf = confidence_of(g_draft_ctx, g_draft_model, -1, id);
+        }
+        if (llama_vocab_is_eog(vocab, id)) break;
+        if (emit_output(common_token_to_piece(g_draft_ctx, id), stop, conf)) break;
+        g_gen_stats.n_tokens++;
+
+        common_batch_clear(g_draft_batch);
+        common_batch_add(g_draft_batch, id, (llama_pos)g_draft_tokens.size(), {0}, true);
+        {
+            TRACE_SCOPE("decode");
+            if (llama_decode(g_draft_ctx, g_draft_batch) != 0) {
+                LOGe("Draft decode failed during generation at pos %d", (int)g_draft_tokens.size());
+                break;
+            }
+        }
+        g_draft_tokens.push_back(id);
+    }
+    g_gen_stats.t_us = us_since(t_start);
+    sample_peak_anon();
+    return g_assistant_ss.str();
+}
+
+// Sample up to max_tokens from the current context (prompt already decoded
+// with logits on its last token). Returns valid UTF-8 for JNI; a trailing
+// incomplete multi-byte sequence is dropped.
+//
+// With `on_tool_call`, each completed <tool_call> block is reported right
+// away and generation stops after the last one; tokens sampled past the
+// final block are rolled back out of the KV cache.
+//
+// Without tool calls decoding is speculative: drafts come from the draft
+// model when one is loaded, otherwise from n-gram lookup in the context.
+//
+// With `forcer` (tool call grammar active), text the grammar fully determines
+// inside a block is accepted into the sampler and decoded in the same batch
+// as the sampled token instead of being sampled one token at a time.
+//
+// With `stop`, generation ends at the first stop string, which is trimmed
+// from the output together with anything after it.
+//
+// Statistics accumulate on top of begin_request() and decode_prompt().
+static std::string generate_text(int max_tokens, const engine::ToolCallFn *on_tool_call = nullptr,
+                                 const ToolCallForcer *forcer = nullptr, StopMatcher *stop = nullptr) {
+    auto t_start = std::chrono::steady_clock::now();
+
+    std::string output;
+    if (on_tool_call || forcer) {
+        output = generate_sequential(max_tokens, on_tool_call, forcer, stop);
+    } else if (g_draft_ctx) {
+        output = generate_speculative(max_tokens, stop, draft_from_model, g_spec_n_draft);
+    } else {
+        output = generate_speculative(max_tokens, stop, draft_from_context, g_lookup_n_draft);
+    }
+
+    g_gen_stats.t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - t_start).count();
+    sample_peak_anon();
+    return output;
+}
+
+// Start timing a request: clears the statistics of the previous one
+static void begin_request() {
+    g_gen_stats = GenerationStats();
+    g_token_conf.clear();
+    g_token_conf_start.clear();
+    g_request_start = std::chrono::steady_clock::now();
+    llama_perf_context_reset(g_context);
+    g_request_peak_anon = anon_rss_bytes();
+}
+
+// Decode prompt tokens at g_current_pos with logits on the last one,
+// recording them as the request's prefill
+static int decode_prompt(const llama_tokens &tokens) {
+    TRACE_SCOPE("prefill");
+    auto t_start = std::chrono::steady_clock::now();
+    int ret = decode_batched(g_context, g_batch, tokens, true);
+    sample_peak_anon();
+    g_gen_stats.n_prompt   += (int)tokens.size();
+    g_gen_stats.t_prompt_us += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - t_start).count();
+    return ret;
+}
+
+// Generate the next assistant turn of the session: decode everything queued
+// plus the generation prefix, sample, and keep the result in the session.
+static std::string session_continue(int max_tokens, const engine::ToolCallFn *on_tool_call = nullptr,
+                                    const ToolCallForcer *forcer = nullptr) {
+    reset_gen_state();
+    g_turn_start_pos = g_current_pos + (llama_pos)g_pending_tokens.size();
+    g_pending_tokens.insert(g_pending_tokens.end(), g_gen_prefix_tokens.begin(), g_gen_prefix_tokens.end());
+
+    llama_tokens pending;
+    pending.swap(g_pending_tokens);
+    g_gen_stats.n_reused = g_current_pos;
+    if (decode_prompt(pending) != 0) {
+        reset_chat_state();
+        throw std::runtime_error("Failed to process prompt");
+    }
+
+    std::string output = generate_text(max_tokens, on_tool_call, forcer);
+    session_close_assistant(output);
+    return output;
+}
+
+// Log-probability of each token in `tokens` under one row of logits
+static void logprobs_from_logits(const float *logits, int n_vocab,
+                                 const llama_tokens &tokens, std::vector<double> &out) {
+    float max_logit = logits[0];
+    for (int i = 1; i < n_vocab; i++) max_logit = std::max(max_logit, logits[i]);
+    double sum = 0.0;
+    for (int i = 0; i < n_vocab; i++) sum += std::exp((double)(logits[i] - max_logit));
+    double lse = max_logit + std::log(sum);
+
+    out.clear();
+    for (llama_token t : tokens) out.push_back(logits[t] - lse);
+}
+
+// Tokens of `label` as the model would produce them right after `prompt`.
+// BPE merges across the boundary (a leading space, a newline), so the label
+// is tokenized together with the end of the prompt and the prompt's own
+// tokens are stripped. A label that merges into the prompt's last token
+// cannot be scored on top of the decoded prompt and is tokenized on its own.
+static llama_tokens label_tokens_after(const llama_tokens &prompt, const std::string &label, bool special) {
+    const size_t n_tail = std::min<size_t>(prompt.size(), 16);
+    std::string tail;
+    for (size_t i = prompt.size() - n_tail; i < prompt.size(); i++) tail += common_token_to_piece(g_context, prompt[i]);
+
+    llama_tokens tail_tokens = common_tokenize(g_context, tail, false, special);
+    llama_tokens joined = common_tokenize(g_context, tail + label, false, special);
+    if (joined.size() > tail_tokens.size() && std::equal(tail_tokens.begin(), tail_tokens.end(), joined.begin())) {
+        return llama_tokens(joined.begin() + tail_tokens.size(), joined.end());
+    }
+    return common_tokenize(g_context, label, false, false);
+}
+
+// Probability distribution over `labels` as continuations of `prompt`.
+//
+// The prompt is decoded once (a prefix shared with the previous call is kept
+// in the KV cache). Each label is then scored by its total log-likelihood:
+// the first token from the prompt's last logits, the rest from a single batch
+// in which every label is its own sequence branching off the prompt.
+static std::vector<float> score_labels(const std::string &prompt, const std::vector<std::string> &labels) {
+    llama_memory_t mem = llama_get_memory(g_context);
+    const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(g_model));
+
+    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
+    llama_tokens tokens = common_tokenize(g_context, prompt, has_tmpl, has_tmpl);
+    int max_prompt = g_context_size - 64;
+    if ((int)tokens.size() > max_prompt) tokens.erase(tokens.begin(), tokens.end() - max_prompt);
+    if (tokens.empty()) throw std::runtime_error("Empty prompt");
+
+    // Reuse whatever prefix of the prompt is already in the KV cache (e.g. the
+    // system prompt of the previous scoring call). The last token is always
+    // decoded for its logits.
+    size_t keep = 0;
+    while (keep < g_kv_tokens.size() && keep + 1 < tokens.size() && g_kv_tokens[keep] == tokens[keep]) keep++;
+    reset_chat_state(false);
+    reset_gen_state();
+    kv_rollback((llama_pos)keep);
+    LOGd("Scoring: reusing %d/%d prompt tokens", (int)keep, (int)tokens.size());
+
+    if (decode_batched(g_context, g_batch, llama_tokens(tokens.begin() + keep, tokens.end()), true) != 0) {
+        reset_chat_state();
+        throw std::runtime_error("Failed to process prompt");
+    }
+    const llama_pos n_prompt = g_current_pos;
+
+    std::vector<llama_tokens> label_tokens;
+    llama_tokens first_tokens;
+    for (const auto &label : labels) {
+        label_tokens.push_back(label_tokens_after(tokens, label, has_tmpl));
+        if (label_tokens.back().empty()) throw std::runtime_error("Empty label");
+        first_tokens.push_back(label_tokens.back()[0]);
+    }
+
+    std::vector<double> logprob;
+    logprobs_from_logits(llama_get_logits_ith(g_context, -1), n_vocab, first_tokens, logprob);
+
+    // Remaining label tokens, in chunks of up to MAX_SEQS - 1 labels
+    std::vector<double> row;
+    for (size_t begin = 0; begin < labels.size(); ) {
+        common_batch_clear(g_batch);
+        std::vector<std::pair<size_t, int>> chunk; // label, batch index of its first token
+        size_t end = begin;
+        for (; end < labels.size() && (int)chunk.size() < MAX_SEQS - 1; end++) {
+            const auto &lt = label_tokens[end];
+            if (lt.size() < 2) continue;
+            if (g_batch.n_tokens + (int)lt.size() - 1 > g_batch_size ||
+                n_prompt + (llama_pos)lt.size() >= g_context_size) {
+                if (chunk.empty()) throw std::runtime_error("Label too long to score");
+                break;
+            }
+            llama_seq_id seq = (llama_seq_id)chunk.size() + 1;
+            llama_memory_seq_cp(mem, 0, seq, -1, -1);
+            chunk.emplace_back(end, g_batch.n_tokens);
+            for (size_t j = 0; j + 1 < lt.size(); j++) {
+                common_batch_add(g_batch, lt[j], n_prompt + (llama_pos)j, {seq}, true);
+            }
+        }
+
+        if (!chunk.empty()) {
+            if (llama_decode(g_context, g_batch) != 0) {
+                reset_chat_state();
+                throw std::runtime_error("Failed to decode labels");
+            }
+            for (const auto &[label, first] : chunk) {
+                const auto &lt = label_tokens[label];
+                for (size_t j = 1; j < lt.size(); j++) {
+                    logprobs_from_logits(llama_get_logits_ith(g_context, first + (int)j - 1), n_vocab,
+                                         llama_tokens{lt[j]}, row);
+                    logprob[label] += row[0];
+                }
+            }
+            for (int s = 1; s <= (int)chunk.size(); s++) llama_memory_seq_rm(mem, s, -1, -1);
+        }
+        begin = end;
+    }
+
+    // Softmax over the label log-likelihoods
+    double max_lp = *std::max_element(logprob.begin(), logprob.end());
+    double total = 0.0;
+    for (double lp : logprob) total += std::exp(lp - max_lp);
+    std::vector<float> probs;
+    for (double lp : logprob) probs.push_back((float)(std::exp(lp - max_lp) / total));
+    return probs;
+}
+
+// Generate completions for several independent prompts in one decode loop.
+// Each prompt gets its own sequence and sampler; every step decodes the next
+// token of all unfinished sequences in a single batch, so n prompts cost
+// roughly one prompt's worth of weight reads per step. The token prefix the
+// prompts share (e.g. a system prompt) is decoded once and copied. Returns
+// false without touching the KV cache when the prompts and their token
+// budgets do not fit in the context together.
+static bool run_batch(const std::vector<BatchRequest> &requests, float top_p, int top_k,
+                      float repeat_penalty, uint32_t seed, std::vector<std::string> &outputs) {
+    const size_t n = requests.size();
+    if (n == 0 || n > (size_t)MAX_SEQS) return false;
+    begin_request();
+
+    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
+    std::vector<llama_tokens> prompts;
+    for (const auto &r : requests) {
+        prompts.push_back(tokenize_timed(r.prompt, has_tmpl, has_tmpl));
+        if (prompts.back().empty()) return false;
+    }
+
+    // Shared prefix, leaving at least one token per prompt to produce logits
+    size_t n_prefix = prompts[0].size() - 1;
+    for (size_t s = 1; s < n; s++) {
+        size_t k = 0;
+        while (k < n_prefix && k + 1 < prompts[s].size() && prompts[s][k] == prompts[0][k]) k++;
+        n_prefix = k;
+    }
+    size_t n_cells = n_prefix;
+    for (size_t s = 0; s < n; s++) n_cells += prompts[s].size() - n_prefix + requests[s].max_tokens;
+    if (n_cells > (size_t)g_context_size - 4) {
+        LOGw("Batch of %d prompts needs %d cells, context has %d", (int)n, (int)n_cells, g_context_size);
+        return false;
+    }
+
+    reset_chat_state();
+    reset_gen_state();
+    llama_memory_t mem = llama_get_memory(g_context);
+
+    struct Seq {
+        common_sampler *smpl = nullptr;
+        llama_pos   pos      = 0;
+        llama_token next     = 0;
+        int         n_gen    = 0;
+        int         i_batch  = -1;
+        bool        done     = false;
+        std::string text;
+    };
+    std::vector<Seq> seqs(n);
+    auto free_samplers = [&]() {
+        for (auto &sq : seqs) if (sq.smpl) common_sampler_free(sq.smpl);
+    };
+
+    bool ok = decode_batched(g_context, g_batch, llama_tokens(prompts[0].begin(), prompts[0].begin() + n_prefix)) == 0;
+    for (size_t s = 1; ok && s < n && n_prefix > 0; s++) llama_memory_seq_cp(mem, 0, (llama_seq_id)s, -1, -1);
+
+    // Rest of each prompt, then its first token straight from its own logits
+    for (size_t s = 0; ok && s < n; s++) {
+        common_params_sampling sparams;
+        sparams.temp           = requests[s].temperature;
+        sparams.top_p          = top_p;
+        sparams.top_k          = top_k;
+        sparams.penalty_repeat = repeat_penalty;
+        // A fixed seed still gives every sequence its own stream
+        sparams.seed           = seed == LLAMA_DEFAULT_SEED ? seed : seed + (uint32_t)s;
+        seqs[s].smpl = common_sampler_init(g_model, sparams);
+        seqs[s].pos  = (llama_pos)n_prefix;
+        if (!seqs[s].smpl) { ok = false; break; }
+
+        const llama_tokens &p = prompts[s];
+        for (size_t i = n_prefix; ok && i < p.size(); i += g_batch_size) {
+            size_t end = std::min(p.size(), i + g_batch_size);
+            TRACE_SCOPE("decode_batched");
+            TRACE_COUNTER("batch_tokens", end - i);
+            common_batch_clear(g_batch);
+            for (size_t j = i; j < end; j++) {
+                common_batch_add(g_batch, p[j], seqs[s].pos++, {(llama_seq_id)s}, j + 1 == p.size());
+            }
+            ok = llama_decode(g_context, g_batch) == 0;
+        }
+        if (!ok) break;
+        ScopedTimer timer{g_gen_stats.t_sample_us};
+        seqs[s].next = common_sampler_sample(seqs[s].smpl, g_context, -1);
+        common_sampler_accept(seqs[s].smpl, seqs[s].next, true);
+    }
+    if (!ok) {
+        LOGe("Failed to process batch prompts");
+        free_samplers();
+        reset_chat_state();
+        return false;
+    }
+    auto t_start = std::chrono::steady_clock::now();
+    g_gen_stats.n_prompt = (int)n_prefix;
+    for (const auto &p : prompts) g_gen_stats.n_prompt += (int)(p.size() - n_prefix);
+    g_gen_stats.t_prompt_us = std::chrono::duration_cast<std::chrono::microseconds>(t_start - g_request_start).count();
+
+    const llama_vocab *vocab = llama_model_get_vocab(g_model);
+    while (true) {
+        common_batch_clear(g_batch);
+        for (size_t s = 0; s < n; s++) {
+            Seq &sq = seqs[s];
+            if (sq.done) continue;
+            if (llama_vocab_is_eog(vocab, sq.next) || sq.n_gen >= requests[s].max_tokens) {
+                sq.done = true;
+                continue;
+            }
+            sq.text += common_token_to_piece(g_context, sq.next);
+            sq.n_gen++;
+            sq.i_batch = g_batch.n_tokens;
+            common_batch_add(g_batch, sq.next, sq.pos++, {(llama_seq_id)s}, true);
+        }
+        if (g_batch.n_tokens == 0) break;
+        {
+            TRACE_SCOPE("decode");
+            if (llama_decode(g_context, g_batch) != 0) {
+                LOGe("Decode failed during batch generation");
+                break;
+            }
+        }
+        {
+            ScopedTimer timer{g_gen_stats.t_sample_us};
+            TRACE_SCOPE("sample");
+            for (auto &sq : seqs) {
+                if (sq.done) continue;
+                sq.next = common_sampler_sample(sq.smpl, g_context, sq.i_batch);
+                common_sampler_accept(sq.smpl, sq.next, true);
+            }
+        }
+        if (undios_trace::enabled()) {
+            int n_gen = 0;
+            llama_pos n_cells = (llama_pos)n_prefix;
+            for (const auto &sq : seqs) {
+                n_gen   += sq.n_gen;
+                n_cells += sq.pos - (llama_pos)n_prefix;
+            }
+            TRACE_COUNTER("batch_tokens", g_batch.n_tokens);
+            TRACE_COUNTER("kv_cells", n_cells);
+            TRACE_COUNTER("decode_tok_s", n_gen * 1000000LL / std::max<int64_t>(1, us_since(t_start)));
+        }
+    }
+
+    sample_peak_anon();
+    outputs.clear();
+    for (auto &sq : seqs) {
+        sq.text.resize(sq.text.size() - utf8_incomplete_tail(sq.text, sq.text.size()));
+        repair_utf8(sq.text);
+        outputs.push_back(std::move(sq.text));
+        g_gen_stats.n_tokens += sq.n_gen;
+    }
+    free_samplers();
+    reset_chat_state();
+
+    g_gen_stats.t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - t_start).count();
+    LOGi("Batch generated %d tokens for %d prompts (%d prefix tokens shared)",
+         g_gen_stats.n_tokens, (int)n, (int)n_prefix);
+    return true;
+}
+
+static void free_draft() {
+    if (g_draft_ctx) {
+        llama_batch_free(g_draft_batch);
+        llama_free(g_draft_ctx);
+        g_draft_ctx = nullptr;
+    }
+    if (g_draft_model) { llama_model_free(g_draft_model); g_draft_model = nullptr; }
+    g_draft_tokens.clear();
+    g_draft_buffers = BufferSizes();
+}
+
+// Whether drafts from `draft` can be verified by `target` token for token:
+// same tokenizer type and special tokens, and the same text for every token
+// id both vocabularies have (sizes may differ by padding).
+static bool vocab_compatible(const llama_model *target, const llama_model *draft) {
+    const llama_vocab *vt = llama_model_get_vocab(target);
+    const llama_vocab *vd = llama_model_get_vocab(draft);
+
+    if (llama_vocab_type(vt) != llama_vocab_type(vd)) return false;
+    if (llama_vocab_bos(vt) != llama_vocab_bos(vd) || llama_vocab_eos(vt) != llama_vocab_eos(vd)) return false;
+
+    int n_tgt = llama_vocab_n_tokens(vt);
+    int n_dft = llama_vocab_n_tokens(vd);
+    if (std::abs(n_tgt - n_dft) > 128) return false;
+
+    for (int i = 0; i < std::min(n_tgt, n_dft); i++) {
+        if (std::strcmp(llama_vocab_get_text(vt, i), llama_vocab_get_text(vd, i)) != 0) return false;
+    }
+    return true;
+}
+
+// -------------------------------------------------------------------------
+// Public API (llama_engine.h)
+// -------------------------------------------------------------------------
+namespace engine {
+
+void init(const char *backend_dir) {
+    llama_log_set(on_llama_log, nullptr);
+    if (backend_dir) {
+        LOGi("Loading backends from %s", backend_dir);
+        ggml_backend_load_all_from_path(backend_dir);
+    } else {
+        ggml_backend_load_all();
+    }
+    llama_backend_init();
+    LOGi("Backend initialized");
+}
+
+void shutdown() {
+    llama_backend_free();
+    undios_trace::flush();
+    LOGi("Backend shut down");
+}
+
+bool load_model(const LoadParams &params) {
+    TRACE_SCOPE("load_model");
+    LOGi("Loading model: %s (ctx=%d, threads=%d, gpu=%d, kv=%d)",
+         params.path.c_str(), params.context_size, params.threads, params.gpu_layers, params.kv_type);
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = params.gpu_layers;
+    mparams.use_mmap = params.use_mmap;
+    BufferCapture capture(g_buffers);
+
+    llama_model *model = llama_model_load_from_file(params.path.c_str(), mparams);
+    if (!model) {
+        LOGe("Failed to load model");
+        return false;
+    }
+
+    g_model = model;
+    g_model_path = params.path;
+    g_model_mmap = params.use_mmap;
+    g_context_size = params.context_size;
+    g_batch_size = 512;
+
+    // Create context
+    int n_threads = std::max(2, std::min(params.threads, (int)sysconf(_SC_NPROCESSORS_ONLN) - 2));
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx     = params.context_size;
+    cparams.n_batch   = g_batch_size;
+    cparams.n_ubatch  = g_batch_size;
+    cparams.n_threads = n_threads;
+    cparams.n_threads_batch = n_threads;
+    cparams.flash_attn_type = params.flash_attn ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+    cparams.type_k     = params.flash_attn ? (ggml_type)params.kv_type : GGML_TYPE_F16;
+    cparams.type_v     = cparams.type_k;
+    cparams.n_seq_max  = MAX_SEQS;
+    cparams.kv_unified = true;
+
+    g_context = llama_init_from_model(model, cparams);
+    if (!g_context) {
+        LOGe("Failed to create context");
+        llama_model_free(model);
+        g_model = nullptr;
+        return false;
+    }
+
+    g_batch = llama_batch_init(g_batch_size, 0, 1);
+    g_chat_templates = common_chat_templates_init(model, "");
+    init_chat_template();
+
+    // Default sampler
+    common_params_sampling sparams;
+    sparams.temp = 0.7f;
+    g_plain_sampler.smpl = common_sampler_init(model, sparams);
+    g_sampler = g_plain_sampler.smpl;
+
+    reset_chat_state();
+    reset_gen_state();
+
+    LOGi("Model loaded successfully");
+    return true;
+}
+
+void free_model() {
+    reset_chat_state(false);
+    reset_gen_state();
+    free_draft();
+
+    g_plain_sampler.release();
+    g_grammar_sampler.release();
+    g_sampler = nullptr;
+    g_msg_cache.clear();
+    g_gen_prefix_tokens.clear();
+    g_chat_templates.reset();
+    if (g_context) { llama_batch_free(g_batch); llama_free(g_context); g_context = nullptr; }
+    if (g_model)   { llama_model_free(g_model); g_model = nullptr; }
+    g_buffers = BufferSizes();
+    g_model_path.clear();
+
+    LOGi("Model unloaded");
+}
+
+bool is_loaded() { return g_model && g_context; }
+
+bool load_draft_model(const std::string &path, int threads) {
+    if (!is_loaded()) return false;
+    free_draft();
+
+    llama_model_params mparams = llama_model_default_params();
+    mparams.n_gpu_layers = 0;
+    BufferCapture capture(g_draft_buffers);
+    llama_model *draft = llama_model_load_from_file(path.c_str(), mparams);
+    if (!draft) {
+        LOGe("Failed to load draft model: %s", path.c_str());
+        return false;
+    }
+    if (!vocab_compatible(g_model, draft)) {
+        LOGw("Draft model vocabulary is incompatible, speculative decoding disabled");
+        llama_model_free(draft);
+        return false;
+    }
+
+    int n_threads = std::max(2, std::min(threads, (int)sysconf(_SC_NPROCESSORS_ONLN) - 2));
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx     = g_context_size;
+    cparams.n_batch   = g_batch_size;
+    cparams.n_ubatch  = g_batch_size;
+    cparams.n_threads = n_threads;
+    cparams.n_threads_batch = n_threads;
+
+    g_draft_ctx = llama_init_from_model(draft, cparams);
+    if (!g_draft_ctx) {
+        LOGe("Failed to create draft context");
+        llama_model_free(draft);
+        return false;
+    }
+    g_draft_model  = draft;
+    g_draft_batch  = llama_batch_init(g_batch_size, 0, 1);
+    g_spec_n_draft = 4;
+    LOGi("Draft model loaded: %s", path.c_str());
+    return true;
+}
+
+void free_draft_model() {
+    free_draft();
+    LOGi("Draft model unloaded");
+}
+
+const GenerationStats &generation_stats() {
+    // llama.cpp's own counters, reset by begin_request()
+    if (g_context) {
+        llama_perf_context_data perf = llama_perf_context(g_context);
+        g_gen_stats.n_p_eval    = perf.n_p_eval;
+        g_gen_stats.t_p_eval_us = (int64_t)(perf.t_p_eval_ms * 1000.0);
+        g_gen_stats.n_eval      = perf.n_eval;
+        g_gen_stats.t_eval_us   = (int64_t)(perf.t_eval_ms * 1000.0);
+    }
+    return g_gen_stats;
+}
+
+MemoryStats memory_stats() {
+    MemoryStats m;
+    if (!g_model || !g_context) return m;
+
+    m.model_mapped_bytes = g_buffers.model_mapped;
+    m.model_anon_bytes   = g_buffers.model_anon;
+    if (m.model_mapped_bytes + m.model_anon_bytes == 0) {
+        // Not reported by this llama.cpp version: all weights, in one kind of buffer
+        (g_model_mmap ? m.model_mapped_bytes : m.model_anon_bytes) = llama_model_size(g_model);
+    }
+    m.model_resident_bytes = file_resident_bytes(g_model_path, m.model_file_bytes);
+
+    m.kv_bytes = g_buffers.kv;
+    m.kv_cells = (int)llama_n_ctx(g_context);
+    llama_memory_t mem = llama_get_memory(g_context);
+    int used = 0;
+    for (int s = 0; s < MAX_SEQS; s++) {
+        llama_pos pos_max = llama_memory_seq_pos_max(mem, s);
+        if (pos_max >= 0) used += pos_max - llama_memory_seq_pos_min(mem, s) + 1;
+    }
+    m.kv_cells_used = std::min(used, m.kv_cells);
+
+    m.compute_bytes = g_buffers.compute;
+    m.batch_bytes   = batch_bytes(g_batch_size, 1) + (g_draft_ctx ? batch_bytes(g_batch_size, 1) : 0);
+    m.draft_bytes   = g_draft_buffers.total();
+    m.anon_rss_bytes = anon_rss_bytes();
+    m.request_peak_anon_bytes = g_request_peak_anon;
+    return m;
+}
+
+const std::vector<TokenConfidence> &token_confidence() { return g_token_conf; }
+
+std::string generate(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                     const std::vector<std::string> &stop, const TextFn &on_text) {
+    TRACE_SCOPE("generate");
+    // Reset state for new generation
+    begin_request();
+    reset_chat_state();
+    reset_gen_state();
+
+    // Reconfigure sampler with requested params
+    init_sampler(sampling.temperature, sampling.top_p, sampling.top_k, sampling.repeat_penalty, sampling.seed);
+
+    // Tokenize the full prompt
+    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
+    auto tokens = tokenize_timed(prompt, has_tmpl, has_tmpl);
+
+    // Truncate if too long, keeping at least half the context for the prompt
+    // when max_tokens alone exceeds it (the context shifts during generation)
+    int max_prompt = std::max(g_context_size / 2, g_context_size - max_tokens - 4);
+    if ((int)tokens.size() > max_prompt) {
+        tokens.resize(max_prompt);
+        LOGw("Prompt truncated to %d tokens", max_prompt);
+    }
+
+    // Decode prompt
+    if (decode_prompt(tokens) != 0) throw std::runtime_error("Failed to process prompt");
+
+    g_stop_matcher.reset(stop);
+    StopMatcher *matcher = g_stop_matcher.active() ? &g_stop_matcher : nullptr;
+    if (!on_text) return generate_text(max_tokens, nullptr, nullptr, matcher);
+
+    StreamSink sink{on_text};
+    g_stream_sink = &sink;
+    generate_text(max_tokens, nullptr, nullptr, matcher);
+    g_stream_sink = nullptr;
+
+    // Flush text held back for a stop string that never completed
+    std::string output = g_assistant_ss.str();
+    sink.flush(output, output.size());
+    return output;
+}
+
+std::string generate_draft(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                           const std::vector<std::string> &stop) {
+    TRACE_SCOPE("generate_draft");
+    if (!g_draft_ctx) throw std::runtime_error("No draft model loaded");
+    begin_request();
+    reset_gen_state();
+
+    common_params_sampling sparams;
+    sparams.temp           = sampling.temperature;
+    sparams.top_p          = sampling.top_p;
+    sparams.top_k          = sampling.top_k;
+    sparams.penalty_repeat = sampling.repeat_penalty;
+    sparams.seed           = sampling.seed;
+    std::unique_ptr<common_sampler, void (*)(common_sampler *)> sampler(
+        common_sampler_init(g_draft_model, sparams), common_sampler_free);
+    if (!sampler) throw std::runtime_error("Failed to create draft sampler");
+
+    // Tokenized and truncated exactly as generate() does, so a following
+    // generate() of the same prompt finds it in the draft cache
+    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
+    auto tokens = tokenize_timed(prompt, has_tmpl, has_tmpl);
+    int max_prompt = std::max(g_context_size / 2, g_context_size - max_tokens - 4);
+    if ((int)tokens.size() > max_prompt) tokens.resize(max_prompt);
+
+    g_stop_matcher.reset(stop);
+    return draft_generate_text(tokens, max_tokens, sampler.get(),
+                               g_stop_matcher.active() ? &g_stop_matcher : nullptr);
+}
+
+bool has_draft_model() { return g_draft_ctx != nullptr; }
+
+bool generate_background(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                         const std::function<bool()> &yield, std::string &output) {
+    TRACE_SCOPE("generate_background");
+    if (yield()) return false;
+
+    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
+    llama_tokens tokens = common_tokenize(g_context, prompt, has_tmpl, has_tmpl);
+    if (tokens.empty()) return false;
+    // The KV cache is unified: the conversation's cells count against it too
+    if (g_current_pos + (llama_pos)tokens.size() + max_tokens > g_context_size - 4) {
+        LOGw("Background prompt of %d tokens does not fit next to the conversation (%d)",
+             (int)tokens.size(), g_current_pos);
+        return false;
+    }
+
+    common_params_sampling sparams;
+    sparams.temp           = sampling.temperature;
+    sparams.top_p          = sampling.top_p;
+    sparams.top_k          = sampling.top_k;
+    sparams.penalty_repeat = sampling.repeat_penalty;
+    sparams.seed           = sampling.seed;
+    std::unique_ptr<common_sampler, void (*)(common_sampler *)> sampler(
+        common_sampler_init(g_model, sparams), common_sampler_free);
+    if (!sampler) return false;
+
+    // Drop the sequence however generation ends
+    struct DropSeq {
+        llama_memory_t mem;
+        ~DropSeq() { llama_memory_seq_rm(mem, BACKGROUND_SEQ, -1, -1); }
+    } drop_seq{llama_get_memory(g_context)};
+
+    llama_pos pos = 0;
+    for (size_t i = 0; i < tokens.size(); i += g_batch_size) {
+        if (yield()) return false;
+        size_t end = std::min(tokens.size(), i + g_batch_size);
+        common_batch_clear(g_batch);
+        for (size_t j = i; j < end; j++) {
+            common_batch_add(g_batch, tokens[j], pos++, {BACKGROUND_SEQ}, j + 1 == tokens.size());
+        }
+        if (llama_decode(g_context, g_batch) != 0) return false;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(g_model);
+    std::string text;
+    for (int n = 0; n < max_tokens; n++) {
+        llama_token id = common_sampler_sample(sampler.get(), g_context, -1);
+        common_sampler_accept(sampler.get(), id, true);
+        if (llama_vocab_is_eog(vocab, id)) break;
+        text += common_token_to_piece(g_context, id);
+        if (n + 1 == max_tokens) break;
+        if (yield()) {
+            LOGd("Background generation yielded after %d tokens", n + 1);
+            return false;
+        }
+
+        common_batch_clear(g_batch);
+        common_batch_add(g_batch, id, pos++, {BACKGROUND_SEQ}, true);
+        if (llama_decode(g_context, g_batch) != 0) return false;
+    }
+
+    text.resize(text.size() - utf8_incomplete_tail(text, text.size()));
+    repair_utf8(text);
+    output = std::move(text);
+    return true;
+}
+
+bool generate_batch(const std::vector<BatchRequest> &requests, const SamplingParams &sampling,
+                    std::vector<std::string> &outputs) {
+    TRACE_SCOPE("generate_batch");
+    return run_batch(requests, sampling.top_p, sampling.top_k, sampling.repeat_penalty, sampling.seed, outputs);
+}
+
+std::string generate_chat(const std::vector<Message> &messages, int max_tokens, const SamplingParams &sampling,
+                          const ToolCallFn &on_tool_call, const std::string &grammar, const std::string &scaffold) {
+    TRACE_SCOPE("generate_chat");
+    begin_request();
+    std::vector<common_chat_msg> msgs(messages.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        msgs[i].role    = messages[i].role;
+        msgs[i].content = messages[i].content;
+    }
+
+    bool constrained = init_sampler(sampling.temperature, sampling.top_p, sampling.top_k,
+                                    sampling.repeat_penalty, sampling.seed, grammar);
+    if (constrained && !scaffold.empty()) g_tool_forcer.parse(scaffold);
+    const ToolCallForcer *forcer = constrained && on_tool_call && !scaffold.empty() ? &g_tool_forcer : nullptr;
+
+    // Keep the longest prefix of the session that is unchanged and still
+    // intact in the KV cache; only the turns after it are decoded.
+    size_t keep = 0;
+    while (keep < msgs.size() && keep < g_kv_valid_msgs &&
+           g_chat_msgs[keep].role == msgs[keep].role &&
+           g_chat_msgs[keep].content == msgs[keep].content) {
+        keep++;
+    }
+    session_truncate(keep);
+    LOGd("Chat sync: reusing %d/%d messages from KV cache", (int)keep, (int)msgs.size());
+
+    try {
+        for (size_t i = keep; i < msgs.size(); i++) session_append(msgs[i]);
+        return session_continue(max_tokens, on_tool_call ? &on_tool_call : nullptr, forcer);
+    } catch (...) {
+        reset_chat_state();
+        throw;
+    }
+}
+
+void reset() {
+    reset_chat_state();
+    reset_gen_state();
+    g_msg_cache.clear();
+}
+
+std::vector<float> score_candidates(const std::string &prompt, const std::vector<std::string> &labels) {
+    TRACE_SCOPE("score_candidates");
+    return score_labels(prompt, labels);
+}
+
+std::vector<int32_t> tokenize(const std::string &text) {
+    if (!g_context) return {};
+    auto tokens = common_tokenize(g_context, text, false, false);
+    return std::vector<int32_t>(tokens.begin(), tokens.end());
+}
+
+} // namespace engine
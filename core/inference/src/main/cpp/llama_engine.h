@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Inference engine behind LlamaCppEngine: one loaded model with its KV
+// cache, chat session, samplers and speculative decoding state.
+//
+// The engine is plain C++ over llama.cpp with no JNI or Android dependency,
+// so the same code runs in the app (through llama_jni.cpp) and on a Linux
+// host (bench/). It keeps global state and is not thread-safe; callers
+// serialize access (LlamaCppEngine holds a mutex around every native call).
+namespace engine {
+
+// Sequences in the KV cache. score_candidates keeps the prompt in seq 0 and
+// branches one sequence per label off it (sharing its cells in the unified
+// KV cache); generate_batch gives each prompt its own sequence.
+constexpr int MAX_SEQS = 16;
+
+struct LoadParams {
+    std::string path;
+    int  context_size = 4096;
+    int  threads      = 4;
+    int  gpu_layers   = 0;
+    bool use_mmap     = true;
+    bool flash_attn   = false;
+    int  kv_type      = 1; // ggml_type of the KV cache; quantized types need flash_attn
+};
+
+struct SamplingParams {
+    float    temperature    = 0.7f;
+    float    top_p          = 0.9f;
+    int      top_k          = 40;
+    float    repeat_penalty = 1.1f;
+    uint32_t seed           = 0xFFFFFFFF; // LLAMA_DEFAULT_SEED: a random seed per request
+};
+
+struct Message {
+    std::string role;
+    std::string content;
+};
+
+// Counters and timings of the last request
+struct GenerationStats {
+    int     n_tokens    = 0;
+    int     n_drafted   = 0;
+    int     n_accepted  = 0;
+    int     n_draft     = 0; // draft length at the end, 0 when not speculative
+    int64_t t_us        = 0; // sampling and decoding after the prompt
+    int     n_prompt    = 0; // prompt tokens decoded (excludes tokens reused from the KV cache)
+    int64_t t_prompt_us = 0;
+    int64_t t_first_us  = 0; // from the start of the request to the first output text
+    int     n_reused    = 0; // prompt tokens reused from the KV cache
+    int     n_ctx_shifts  = 0;
+    int64_t t_tokenize_us = 0;
+    int64_t t_sample_us   = 0; // sampler chains and per-token confidence, part of t_us
+    int64_t t_callback_us = 0; // on_text and on_tool_call, part of t_us
+
+    // llama_perf_context: ggml compute of prompt batches and of generation
+    // batches (one per decode step, so n_eval < n_tokens when drafts are accepted)
+    int     n_p_eval    = 0;
+    int64_t t_p_eval_us = 0;
+    int     n_eval      = 0;
+    int64_t t_eval_us   = 0;
+};
+
+// Memory of the loaded model and its context. Buffer sizes are the ones
+// llama.cpp reports as it allocates them; 0 when not reported.
+struct MemoryStats {
+    uint64_t model_mapped_bytes   = 0; // weights in buffers over the mmapped file (evictable)
+    uint64_t model_anon_bytes     = 0; // weights copied or repacked into anonymous memory
+    uint64_t model_file_bytes     = 0;
+    uint64_t model_resident_bytes = 0; // pages of the model file in the page cache (mincore)
+    uint64_t kv_bytes             = 0;
+    int      kv_cells_used        = 0; // positions held, counted per sequence
+    int      kv_cells             = 0;
+    uint64_t compute_bytes        = 0; // compute graphs and the logits output buffer
+    uint64_t batch_bytes          = 0; // host arrays of the llama_batch allocations
+    uint64_t draft_bytes          = 0; // all buffers of the draft model and its context
+    uint64_t anon_rss_bytes       = 0; // process anonymous RSS now
+    uint64_t request_peak_anon_bytes = 0; // highest anonymous RSS sampled during the last request
+};
+
+// Log-probability and entropy (nats) of a sampled token under the model's
+// unmodified distribution. Tokens forced by a tool call grammar score 0/0.
+struct TokenConfidence {
+    float logprob;
+    float entropy;
+};
+
+struct BatchRequest {
+    std::string prompt;
+    int         max_tokens;
+    float       temperature;
+};
+
+// Receives output text as it is generated; returning false stops generation
+using TextFn = std::function<bool(const std::string &text)>;
+
+// Receives each tool call as soon as its JSON object closes
+using ToolCallFn = std::function<void(const std::string &name, const std::string &arguments)>;
+
+// Load backends from backend_dir (the app's native library directory), or
+// the default search path when null, and initialize llama.cpp.
+void init(const char *backend_dir);
+void shutdown();
+
+bool load_model(const LoadParams &params);
+void free_model();
+bool is_loaded();
+
+// Load a smaller model to draft tokens for speculative decoding. Rejected
+// (generation stays non-speculative) when its vocabulary does not match.
+bool load_draft_model(const std::string &path, int threads);
+void free_draft_model();
+
+// Statistics of the last generate, generate_batch or generate_chat, and the
+// confidence of each token in its output (not of tokens a stop cut away)
+const GenerationStats &generation_stats();
+const std::vector<TokenConfidence> &token_confidence();
+
+// Memory breakdown of the loaded model. Reads the model file's page cache
+// residency, so it costs a few milliseconds on a large model.
+MemoryStats memory_stats();
+
+// Complete a raw prompt. Generation ends at the first of `stop`, which is cut
+// from the output. With on_text, output is streamed as it is produced (text
+// that may be the start of a stop string is held back until it is not).
+// Throws std::runtime_error when the prompt cannot be decoded.
+std::string generate(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                     const std::vector<std::string> &stop, const TextFn &on_text = nullptr);
+
+// Complete a raw prompt with the draft model alone, e.g. as the cheap first
+// attempt of a cascade; token_confidence() then scores the draft model's
+// tokens. The prompt and answer stay in the draft KV cache, so a following
+// generate() of the same prompt does not decode the prompt in the draft
+// model again and is offered the answer as its first drafts. Throws
+// std::runtime_error without a draft model or when the prompt cannot be decoded.
+std::string generate_draft(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                           const std::vector<std::string> &stop);
+bool has_draft_model();
+
+// Complete a raw prompt in a KV sequence of its own, for background work such
+// as a rolling summary: the conversation in the KV cache, and the prefix the
+// next request would reuse from it, are left as they are. `yield` is polled
+// before the prompt and between tokens; once it returns true generation stops
+// and false is returned, as it is when the prompt and max_tokens do not fit in
+// the context next to the conversation. Statistics are not updated.
+bool generate_background(const std::string &prompt, int max_tokens, const SamplingParams &sampling,
+                         const std::function<bool()> &yield, std::string &output);
+
+// Generate completions for several independent prompts in one decode loop.
+// Returns false when the prompts and their token budgets do not fit in the
+// context together; the caller then generates them one by one.
+bool generate_batch(const std::vector<BatchRequest> &requests, const SamplingParams &sampling,
+                    std::vector<std::string> &outputs);
+
+// Next assistant turn for `messages`. The longest unchanged prefix of the
+// previous conversation is reused from the KV cache. With a tool call
+// grammar (GBNF) sampling is constrained inside <tool_call> blocks; with
+// on_tool_call each call is reported as soon as it closes and generation
+// stops after the last one. `scaffold` (ToolCallGrammar) lets text the
+// grammar fully determines be decoded without sampling. Throws
+// std::runtime_error on failure.
+std::string generate_chat(const std::vector<Message> &messages, int max_tokens, const SamplingParams &sampling,
+                          const ToolCallFn &on_tool_call = nullptr,
+                          const std::string &grammar = "", const std::string &scaffold = "");
+
+// Drop the session, the KV cache and cached prompt renders so the next
+// request starts cold (the benchmark calls this between replays).
+void reset();
+
+// Probability distribution over `labels` as continuations of `prompt`.
+// Throws std::runtime_error on failure.
+std::vector<float> score_candidates(const std::string &prompt, const std::vector<std::string> &labels);
+
+std::vector<int32_t> tokenize(const std::string &text);
+
+} // namespace engine
@@ -1,112 +1,48 @@
-#include <android/log.h>
 #include <jni.h>
+#include <atomic>
 #include <string>
 #include <vector>
-#include <sstream>
-#include <cmath>
-#include <unistd.h>
 
-#include "common.h"
-#include "chat.h"
-#include "llama.h"
-#include "sampling.h"
+#include "llama_engine.h"
+#include "llama_log.h"
+#include "llama_trace.h"
 
-#define TAG "UnDios-LLM"
-#define LOGi(...) __android_log_print(ANDROID_LOG_INFO,  TAG, __VA_ARGS__)
-#define LOGe(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
-#define LOGw(...) __android_log_print(ANDROID_LOG_WARN,  TAG, __VA_ARGS__)
-#define LOGd(...) __android_log_print(ANDROID_LOG_DEBUG, TAG, __VA_ARGS__)
+// JNI glue for LlamaCppEngine: converts arguments and results and forwards
+// to the engine (llama_engine.h), which holds all inference state.
 
-// -------------------------------------------------------------------------
-// Global state
-// -------------------------------------------------------------------------
-static llama_model   *g_model   = nullptr;
-static llama_context *g_context = nullptr;
-static llama_batch    g_batch;
-static common_chat_templates_ptr g_chat_templates;
-static common_sampler *g_sampler = nullptr;
-
-static int g_context_size = 4096;
-static int g_batch_size   = 512;
-
-// Chat state
-static std::vector<common_chat_msg> g_chat_msgs;
-static llama_pos g_system_pos  = 0;
-static llama_pos g_current_pos = 0;
-
-// Generation state
-static llama_pos   g_stop_pos = 0;
-static std::string g_cached_chars;
-static std::ostringstream g_assistant_ss;
-
-// -------------------------------------------------------------------------
-// Helpers
-// -------------------------------------------------------------------------
-static void reset_chat_state(bool clear_kv = true) {
-    g_chat_msgs.clear();
-    g_system_pos  = 0;
-    g_current_pos = 0;
-    if (clear_kv && g_context)
-        llama_memory_clear(llama_get_memory(g_context), false);
+static std::string to_std_string(JNIEnv *env, jstring jstr) {
+    const char *chars = env->GetStringUTFChars(jstr, nullptr);
+    std::string str(chars);
+    env->ReleaseStringUTFChars(jstr, chars);
+    return str;
 }
 
-static void reset_gen_state() {
-    g_stop_pos = 0;
-    g_cached_chars.clear();
-    g_assistant_ss.str("");
-}
-
-static void shift_context() {
-    int n_discard = (g_current_pos - g_system_pos) / 2;
-    LOGi("Shifting context: discarding %d tokens", n_discard);
-    llama_memory_seq_rm(llama_get_memory(g_context), 0, g_system_pos, g_system_pos + n_discard);
-    llama_memory_seq_add(llama_get_memory(g_context), 0, g_system_pos + n_discard, g_current_pos, -n_discard);
-    g_current_pos -= n_discard;
-}
-
-static int decode_batched(
-    llama_context *ctx, llama_batch &batch,
-    const llama_tokens &tokens, llama_pos start,
-    bool logit_last = false
-) {
-    for (int i = 0; i < (int)tokens.size(); i += g_batch_size) {
-        int cur = std::min((int)tokens.size() - i, g_batch_size);
-        common_batch_clear(batch);
-
-        if (start + i + cur >= g_context_size - 4) {
-            shift_context();
-        }
-
-        for (int j = 0; j < cur; j++) {
-            bool want_logit = logit_last && (i + j == (int)tokens.size() - 1);
-            common_batch_add(batch, tokens[i + j], start + i + j, {0}, want_logit);
-        }
-
-        if (llama_decode(ctx, batch) != 0) {
-            LOGe("llama_decode failed");
-            return 1;
-        }
+// Strings of a Java String[] (null-safe); empty ones are dropped unless keep_empty
+static std::vector<std::string> to_string_vector(JNIEnv *env, jobjectArray jarr, bool keep_empty = false) {
+    std::vector<std::string> out;
+    if (!jarr) return out;
+    int n = env->GetArrayLength(jarr);
+    out.reserve(n);
+    for (int i = 0; i < n; i++) {
+        auto jstr = (jstring)env->GetObjectArrayElement(jarr, i);
+        std::string str = jstr ? to_std_string(env, jstr) : std::string();
+        if (keep_empty || !str.empty()) out.push_back(std::move(str));
+        env->DeleteLocalRef(jstr);
     }
-    return 0;
+    return out;
 }
 
-static bool is_valid_utf8(const char *s) {
-    if (!s) return true;
-    const unsigned char *b = (const unsigned char *)s;
-    while (*b) {
-        int n;
-        if      ((*b & 0x80) == 0x00) n = 1;
-        else if ((*b & 0xE0) == 0xC0) n = 2;
-        else if ((*b & 0xF0) == 0xE0) n = 3;
-        else if ((*b & 0xF8) == 0xF0) n = 4;
-        else return false;
-        b++;
-        for (int i = 1; i < n; i++) {
-            if ((*b & 0xC0) != 0x80) return false;
-            b++;
-        }
-    }
-    return true;
+// Requests waiting for the engine (nativeSetRequestWaiting); while there are
+// any, background generation yields to them
+static std::atomic<int> g_requests_waiting{0};
+
+static engine::SamplingParams sampling_params(jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty) {
+    engine::SamplingParams params;
+    params.temperature    = temperature;
+    params.top_p          = topP;
+    params.top_k          = topK;
+    params.repeat_penalty = repeatPenalty;
+    return params;
 }
 
 // -------------------------------------------------------------------------
@@ -119,71 +55,27 @@ JNIEXPORT void JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeInit(
     JNIEnv *env, jobject, jstring jLibDir
 ) {
-    const char *libDir = env->GetStringUTFChars(jLibDir, nullptr);
-    LOGi("Loading backends from %s", libDir);
-    ggml_backend_load_all_from_path(libDir);
-    env->ReleaseStringUTFChars(jLibDir, libDir);
-    llama_backend_init();
-    LOGi("Backend initialized");
+    engine::init(to_std_string(env, jLibDir).c_str());
 }
 
-// --- nativeLoadModel(path, contextSize, threads, gpuLayers, useMmap, flashAttention): Long ---
+// --- nativeLoadModel(path, contextSize, threads, gpuLayers, useMmap, flashAttention, kvType): Long ---
+// kvType is the ggml_type of the KV cache; quantized types need flash attention.
 JNIEXPORT jlong JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeLoadModel(
     JNIEnv *env, jobject,
     jstring jpath, jint contextSize, jint threads,
-    jint gpuLayers, jboolean useMmap, jboolean flashAttention
+    jint gpuLayers, jboolean useMmap, jboolean flashAttention, jint kvType
 ) {
-    const char *path = env->GetStringUTFChars(jpath, nullptr);
-    LOGi("Loading model: %s (ctx=%d, threads=%d, gpu=%d)", path, contextSize, threads, gpuLayers);
-
-    llama_model_params mparams = llama_model_default_params();
-    mparams.n_gpu_layers = gpuLayers;
-    mparams.use_mmap = useMmap;
-
-    llama_model *model = llama_model_load_from_file(path, mparams);
-    env->ReleaseStringUTFChars(jpath, path);
-
-    if (!model) {
-        LOGe("Failed to load model");
-        return 0;
-    }
-
-    g_model = model;
-    g_context_size = contextSize;
-    g_batch_size = 512;
-
-    // Create context
-    int n_threads = std::max(2, std::min(threads, (int)sysconf(_SC_NPROCESSORS_ONLN) - 2));
-    llama_context_params cparams = llama_context_default_params();
-    cparams.n_ctx     = contextSize;
-    cparams.n_batch   = g_batch_size;
-    cparams.n_ubatch  = g_batch_size;
-    cparams.n_threads = n_threads;
-    cparams.n_threads_batch = n_threads;
-    cparams.flash_attn_type = flashAttention ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
-
-    g_context = llama_init_from_model(model, cparams);
-    if (!g_context) {
-        LOGe("Failed to create context");
-        llama_model_free(model);
-        g_model = nullptr;
-        return 0;
-    }
-
-    g_batch = llama_batch_init(g_batch_size, 0, 1);
-    g_chat_templates = common_chat_templates_init(model, "");
-
-    // Default sampler
-    common_params_sampling sparams;
-    sparams.temp = 0.7f;
-    g_sampler = common_sampler_init(model, sparams);
-
-    reset_chat_state();
-    reset_gen_state();
-
-    LOGi("Model loaded successfully");
-    return (jlong)(intptr_t)model;
+    engine::LoadParams params;
+    params.path         = to_std_string(env, jpath);
+    params.context_size = contextSize;
+    params.threads      = threads;
+    params.gpu_layers   = gpuLayers;
+    params.use_mmap     = useMmap;
+    params.flash_attn   = flashAttention;
+    params.kv_type      = kvType;
+    // The handle only has to be non-zero; all state lives in the engine
+    return engine::load_model(params) ? 1 : 0;
 }
 
 // --- nativeFreeModel(handle: Long) ---
@@ -191,136 +83,311 @@ JNIEXPORT void JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeFreeModel(
     JNIEnv *, jobject, jlong handle
 ) {
-    reset_chat_state(false);
-    reset_gen_state();
+    engine::free_model();
+}
+
+// --- nativeLoadDraftModel(handle, path, threads): Boolean ---
+// Load a smaller model to draft tokens for speculative decoding. Rejected
+// (generation stays non-speculative) when its vocabulary does not match.
+JNIEXPORT jboolean JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeLoadDraftModel(
+    JNIEnv *env, jobject, jlong handle, jstring jpath, jint threads
+) {
+    return engine::load_draft_model(to_std_string(env, jpath), threads) ? JNI_TRUE : JNI_FALSE;
+}
+
+// --- nativeFreeDraftModel(handle) ---
+JNIEXPORT void JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeFreeDraftModel(
+    JNIEnv *, jobject, jlong handle
+) {
+    engine::free_draft_model();
+}
+
+// --- nativeGetGenerationStats(handle): FloatArray ---
+// [generated tokens, generation ms, drafted tokens, accepted tokens, current draft length,
+//  prompt tokens, prefill ms, reused prompt tokens, first text ms, tokenize ms, sampler ms,
+//  callback ms, context shifts, perf prompt evals, perf prompt eval ms, perf evals, perf eval ms]
+JNIEXPORT jfloatArray JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGetGenerationStats(
+    JNIEnv *env, jobject, jlong handle
+) {
+    const engine::GenerationStats &gen = engine::generation_stats();
+    float stats[] = {
+        (float)gen.n_tokens,
+        (float)gen.t_us / 1000.0f,
+        (float)gen.n_drafted,
+        (float)gen.n_accepted,
+        (float)gen.n_draft,
+        (float)gen.n_prompt,
+        (float)gen.t_prompt_us / 1000.0f,
+        (float)gen.n_reused,
+        (float)gen.t_first_us / 1000.0f,
+        (float)gen.t_tokenize_us / 1000.0f,
+        (float)gen.t_sample_us / 1000.0f,
+        (float)gen.t_callback_us / 1000.0f,
+        (float)gen.n_ctx_shifts,
+        (float)gen.n_p_eval,
+        (float)gen.t_p_eval_us / 1000.0f,
+        (float)gen.n_eval,
+        (float)gen.t_eval_us / 1000.0f,
+    };
+    const jsize n = (jsize)(sizeof(stats) / sizeof(stats[0]));
+    jfloatArray result = env->NewFloatArray(n);
+    if (result) env->SetFloatArrayRegion(result, 0, n, stats);
+    return result;
+}
 
-    if (g_sampler) { common_sampler_free(g_sampler); g_sampler = nullptr; }
-    g_chat_templates.reset();
-    llama_batch_free(g_batch);
-    if (g_context) { llama_free(g_context); g_context = nullptr; }
-    if (g_model)   { llama_model_free(g_model); g_model = nullptr; }
+// --- nativeMemoryStats(handle): LongArray ---
+// [model mapped bytes, model anonymous bytes, model file bytes, model resident bytes,
+//  KV bytes, KV cells used, KV cells, compute bytes, batch bytes, draft bytes,
+//  anonymous RSS, peak anonymous RSS of the last request]
+JNIEXPORT jlongArray JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeMemoryStats(
+    JNIEnv *env, jobject, jlong handle
+) {
+    const engine::MemoryStats mem = engine::memory_stats();
+    const jlong stats[] = {
+        (jlong)mem.model_mapped_bytes,
+        (jlong)mem.model_anon_bytes,
+        (jlong)mem.model_file_bytes,
+        (jlong)mem.model_resident_bytes,
+        (jlong)mem.kv_bytes,
+        (jlong)mem.kv_cells_used,
+        (jlong)mem.kv_cells,
+        (jlong)mem.compute_bytes,
+        (jlong)mem.batch_bytes,
+        (jlong)mem.draft_bytes,
+        (jlong)mem.anon_rss_bytes,
+        (jlong)mem.request_peak_anon_bytes,
+    };
+    const jsize n = (jsize)(sizeof(stats) / sizeof(stats[0]));
+    jlongArray result = env->NewLongArray(n);
+    if (result) env->SetLongArrayRegion(result, 0, n, stats);
+    return result;
+}
 
-    LOGi("Model unloaded");
+// --- nativeGetTokenConfidence(handle): FloatArray ---
+// [logprob, entropy] per sampled token of the last generation, flattened
+JNIEXPORT jfloatArray JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGetTokenConfidence(
+    JNIEnv *env, jobject, jlong handle
+) {
+    const auto &conf = engine::token_confidence();
+    jsize n = (jsize)conf.size() * 2;
+    jfloatArray result = env->NewFloatArray(n);
+    if (result && n > 0) {
+        env->SetFloatArrayRegion(result, 0, n, reinterpret_cast<const jfloat *>(conf.data()));
+    }
+    return result;
 }
 
-// --- nativeGenerate(handle, prompt, maxTokens, temperature, topP, topK, repeatPenalty): String ---
+// --- nativeGenerate(handle, prompt, maxTokens, temperature, topP, topK, repeatPenalty, stop): String ---
 JNIEXPORT jstring JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerate(
     JNIEnv *env, jobject,
     jlong handle, jstring jprompt, jint maxTokens,
-    jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty
+    jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty,
+    jobjectArray jstop
 ) {
-    if (!g_model || !g_context) {
+    if (!engine::is_loaded()) {
         return env->NewStringUTF("[Error: Model not loaded]");
     }
 
-    const char *prompt = env->GetStringUTFChars(jprompt, nullptr);
-    std::string prompt_str(prompt);
-    env->ReleaseStringUTFChars(jprompt, prompt);
-
-    // Reset state for new generation
-    reset_chat_state();
-    reset_gen_state();
-
-    // Reconfigure sampler with requested params
-    if (g_sampler) common_sampler_free(g_sampler);
-    common_params_sampling sparams;
-    sparams.temp           = temperature;
-    sparams.top_p          = topP;
-    sparams.top_k          = topK;
-    sparams.penalty_repeat = repeatPenalty;
-    g_sampler = common_sampler_init(g_model, sparams);
-
-    // Tokenize the full prompt
-    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
-    auto tokens = common_tokenize(g_context, prompt_str, has_tmpl, has_tmpl);
-
-    // Truncate if too long
-    int max_prompt = g_context_size - maxTokens - 4;
-    if ((int)tokens.size() > max_prompt) {
-        tokens.resize(max_prompt);
-        LOGw("Prompt truncated to %d tokens", max_prompt);
+    try {
+        std::string output = engine::generate(
+            to_std_string(env, jprompt), maxTokens,
+            sampling_params(temperature, topP, topK, repeatPenalty), to_string_vector(env, jstop));
+        return env->NewStringUTF(output.c_str());
+    } catch (const std::exception &e) {
+        LOGe("Generation failed: %s", e.what());
+        return env->NewStringUTF("[Error: Failed to process prompt]");
     }
+}
 
-    // Decode prompt
-    if (decode_batched(g_context, g_batch, tokens, 0, true) != 0) {
-        return env->NewStringUTF("[Error: Failed to process prompt]");
+// --- nativeGenerateDraft(handle, prompt, maxTokens, temperature, topP, topK, repeatPenalty, stop): String? ---
+// Null without a draft model or when the prompt cannot be decoded.
+JNIEXPORT jstring JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateDraft(
+    JNIEnv *env, jobject,
+    jlong handle, jstring jprompt, jint maxTokens,
+    jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty,
+    jobjectArray jstop
+) {
+    if (!engine::is_loaded() || !engine::has_draft_model()) return nullptr;
+
+    try {
+        std::string output = engine::generate_draft(
+            to_std_string(env, jprompt), maxTokens,
+            sampling_params(temperature, topP, topK, repeatPenalty), to_string_vector(env, jstop));
+        return env->NewStringUTF(output.c_str());
+    } catch (const std::exception &e) {
+        LOGe("Draft generation failed: %s", e.what());
+        return nullptr;
     }
-    g_current_pos = (int)tokens.size();
+}
+
+// --- nativeGenerateBackground(handle, prompt, maxTokens, temperature, topP, topK, repeatPenalty): String? ---
+// Null when a request preempted it or the prompt does not fit next to the conversation.
+JNIEXPORT jstring JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateBackground(
+    JNIEnv *env, jobject,
+    jlong handle, jstring jprompt, jint maxTokens,
+    jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty
+) {
+    if (!engine::is_loaded()) return nullptr;
 
-    // Generate tokens
-    std::ostringstream result;
-    for (int i = 0; i < maxTokens; i++) {
-        if (g_current_pos >= g_context_size - 4) shift_context();
+    std::string output;
+    bool done = engine::generate_background(
+        to_std_string(env, jprompt), maxTokens, sampling_params(temperature, topP, topK, repeatPenalty),
+        [] { return g_requests_waiting.load(std::memory_order_relaxed) > 0; }, output);
+    return done ? env->NewStringUTF(output.c_str()) : nullptr;
+}
 
-        llama_token id = common_sampler_sample(g_sampler, g_context, -1);
-        common_sampler_accept(g_sampler, id, true);
+// --- nativeSetRequestWaiting(waiting): called around waiting for the engine lock ---
+JNIEXPORT void JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeSetRequestWaiting(
+    JNIEnv *, jobject, jboolean waiting
+) {
+    g_requests_waiting.fetch_add(waiting ? 1 : -1, std::memory_order_relaxed);
+}
 
-        if (llama_vocab_is_eog(llama_model_get_vocab(g_model), id)) break;
+// --- nativeGenerateBatch(handle, prompts, maxTokens[], temperatures[], topP, topK, repeatPenalty): Array<String>? ---
+// Null when the batch does not fit in the context; the caller generates one by one.
+JNIEXPORT jobjectArray JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateBatch(
+    JNIEnv *env, jobject,
+    jlong handle, jobjectArray jprompts, jintArray jmaxTokens, jfloatArray jtemperatures,
+    jfloat topP, jint topK, jfloat repeatPenalty
+) {
+    if (!engine::is_loaded()) return nullptr;
+
+    // Keep empty prompts so the results stay aligned with the request arrays
+    std::vector<std::string> prompts = to_string_vector(env, jprompts, /*keep_empty=*/true);
+    jsize n = (jsize)prompts.size();
+    if (env->GetArrayLength(jmaxTokens) != n || env->GetArrayLength(jtemperatures) != n) return nullptr;
+
+    std::vector<jint>   max_tokens(n);
+    std::vector<jfloat> temperatures(n);
+    env->GetIntArrayRegion(jmaxTokens, 0, n, max_tokens.data());
+    env->GetFloatArrayRegion(jtemperatures, 0, n, temperatures.data());
+
+    std::vector<engine::BatchRequest> requests;
+    for (jsize i = 0; i < n; i++) requests.push_back({prompts[i], max_tokens[i], temperatures[i]});
+
+    std::vector<std::string> outputs;
+    if (!engine::generate_batch(requests, sampling_params(0.0f, topP, topK, repeatPenalty), outputs)) return nullptr;
+
+    jobjectArray result = env->NewObjectArray(n, env->FindClass("java/lang/String"), nullptr);
+    if (!result) return nullptr;
+    for (jsize i = 0; i < n; i++) {
+        jstring str = env->NewStringUTF(outputs[i].c_str());
+        env->SetObjectArrayElement(result, i, str);
+        env->DeleteLocalRef(str);
+    }
+    return result;
+}
 
-        std::string piece = common_token_to_piece(g_context, id);
-        result << piece;
+// --- nativeGenerateChat(handle, roles, contents, maxTokens, temp, topP, topK, repeatPenalty,
+//                        toolCallback?, toolGrammar?, toolScaffold?): String ---
+JNIEXPORT jstring JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateChat(
+    JNIEnv *env, jobject,
+    jlong handle, jobjectArray jroles, jobjectArray jcontents, jint maxTokens,
+    jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty,
+    jobject toolCallback, jstring jgrammar, jstring jscaffold
+) {
+    if (!engine::is_loaded()) {
+        return env->NewStringUTF("[Error: Model not loaded]");
+    }
 
-        common_batch_clear(g_batch);
-        common_batch_add(g_batch, id, g_current_pos, {0}, true);
-        if (llama_decode(g_context, g_batch) != 0) {
-            LOGe("Decode failed during generation at token %d", i);
-            break;
-        }
-        g_current_pos++;
+    int n_msgs = env->GetArrayLength(jroles);
+    if (n_msgs == 0 || env->GetArrayLength(jcontents) != n_msgs) {
+        return env->NewStringUTF("[Error: Invalid chat turns]");
     }
 
-    std::string output = result.str();
-    LOGi("Generated %d chars", (int)output.size());
+    std::vector<engine::Message> msgs(n_msgs);
+    for (int i = 0; i < n_msgs; i++) {
+        auto jrole    = (jstring)env->GetObjectArrayElement(jroles, i);
+        auto jcontent = (jstring)env->GetObjectArrayElement(jcontents, i);
+        msgs[i].role    = to_std_string(env, jrole);
+        msgs[i].content = to_std_string(env, jcontent);
+        env->DeleteLocalRef(jrole);
+        env->DeleteLocalRef(jcontent);
+    }
 
-    // Validate UTF-8 before passing to JNI (truncate incomplete trailing bytes)
-    if (!is_valid_utf8(output.c_str())) {
-        // Trim trailing incomplete UTF-8 sequence
-        while (!output.empty() && (output.back() & 0xC0) == 0x80) {
-            output.pop_back();
-        }
-        if (!output.empty() && (output.back() & 0x80) != 0) {
-            output.pop_back(); // Remove the incomplete lead byte
+    // Java callback receiving each tool call as soon as its JSON object closes
+    engine::ToolCallFn on_tool_call;
+    if (toolCallback) {
+        jclass callbackClass = env->GetObjectClass(toolCallback);
+        jmethodID method = env->GetMethodID(callbackClass, "onToolCall", "(Ljava/lang/String;Ljava/lang/String;)V");
+        if (!method) {
+            LOGe("Could not find onToolCall callback method");
+            return env->NewStringUTF("[Error: Invalid tool call callback]");
         }
+        on_tool_call = [env, toolCallback, method](const std::string &name, const std::string &arguments) {
+            TRACE_SCOPE("jni_onToolCall");
+            jstring jname = env->NewStringUTF(name.c_str());
+            jstring jargs = env->NewStringUTF(arguments.c_str());
+            env->CallVoidMethod(toolCallback, method, jname, jargs);
+            env->DeleteLocalRef(jname);
+            env->DeleteLocalRef(jargs);
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                LOGw("Tool call callback threw exception");
+            }
+        };
+    }
+
+    try {
+        std::string output = engine::generate_chat(
+            msgs, maxTokens, sampling_params(temperature, topP, topK, repeatPenalty), on_tool_call,
+            jgrammar ? to_std_string(env, jgrammar) : "", jscaffold ? to_std_string(env, jscaffold) : "");
+        return env->NewStringUTF(output.c_str());
+    } catch (const std::exception &e) {
+        LOGe("Chat generation failed: %s", e.what());
+        return env->NewStringUTF("[Error: Failed to process chat]");
+    }
+}
+
+// --- nativeScoreCandidates(handle, prompt, labels): FloatArray ---
+JNIEXPORT jfloatArray JNICALL
+Java_com_castor_core_inference_llama_LlamaCppEngine_nativeScoreCandidates(
+    JNIEnv *env, jobject, jlong handle, jstring jprompt, jobjectArray jlabels
+) {
+    if (!engine::is_loaded()) return nullptr;
+
+    std::vector<std::string> labels;
+    int n_labels = env->GetArrayLength(jlabels);
+    for (int i = 0; i < n_labels; i++) {
+        auto jlabel = (jstring)env->GetObjectArrayElement(jlabels, i);
+        labels.push_back(to_std_string(env, jlabel));
+        env->DeleteLocalRef(jlabel);
+    }
+    if (labels.empty()) return env->NewFloatArray(0);
+
+    std::vector<float> probs;
+    try {
+        probs = engine::score_candidates(to_std_string(env, jprompt), labels);
+    } catch (const std::exception &e) {
+        LOGe("Label scoring failed: %s", e.what());
+        return nullptr;
     }
 
-    return env->NewStringUTF(output.c_str());
+    jfloatArray result = env->NewFloatArray((jsize)probs.size());
+    if (result) env->SetFloatArrayRegion(result, 0, (jsize)probs.size(), probs.data());
+    return result;
 }
 
-// --- nativeGenerateStream(handle, prompt, maxTokens, temp, topP, topK, repeatPenalty, callback) ---
+// --- nativeGenerateStream(handle, prompt, maxTokens, temp, topP, topK, repeatPenalty, stop, callback) ---
 JNIEXPORT void JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateStream(
     JNIEnv *env, jobject,
     jlong handle, jstring jprompt, jint maxTokens,
     jfloat temperature, jfloat topP, jint topK, jfloat repeatPenalty,
-    jobject callback
+    jobjectArray jstop, jobject callback
 ) {
-    if (!g_model || !g_context) return;
-
-    const char *prompt = env->GetStringUTFChars(jprompt, nullptr);
-    std::string prompt_str(prompt);
-    env->ReleaseStringUTFChars(jprompt, prompt);
-
-    // Reset and configure
-    reset_chat_state();
-    reset_gen_state();
-
-    if (g_sampler) common_sampler_free(g_sampler);
-    common_params_sampling sparams;
-    sparams.temp           = temperature;
-    sparams.top_p          = topP;
-    sparams.top_k          = topK;
-    sparams.penalty_repeat = repeatPenalty;
-    g_sampler = common_sampler_init(g_model, sparams);
-
-    bool has_tmpl = common_chat_templates_was_explicit(g_chat_templates.get());
-    auto tokens = common_tokenize(g_context, prompt_str, has_tmpl, has_tmpl);
-
-    int max_prompt = g_context_size - maxTokens - 4;
-    if ((int)tokens.size() > max_prompt) tokens.resize(max_prompt);
-
-    if (decode_batched(g_context, g_batch, tokens, 0, true) != 0) return;
-    g_current_pos = (int)tokens.size();
+    if (!engine::is_loaded()) return;
 
     // Get callback method
     jclass callbackClass = env->GetObjectClass(callback);
@@ -330,35 +397,26 @@ Java_com_castor_core_inference_llama_LlamaCppEngine_nativeGenerateStream(
         return;
     }
 
-    std::string cached;
-    for (int i = 0; i < maxTokens; i++) {
-        if (g_current_pos >= g_context_size - 4) shift_context();
-
-        llama_token id = common_sampler_sample(g_sampler, g_context, -1);
-        common_sampler_accept(g_sampler, id, true);
-
-        if (llama_vocab_is_eog(llama_model_get_vocab(g_model), id)) break;
-
-        cached += common_token_to_piece(g_context, id);
-
-        if (is_valid_utf8(cached.c_str())) {
-            jstring jtoken = env->NewStringUTF(cached.c_str());
-            env->CallVoidMethod(callback, onToken, jtoken);
-            env->DeleteLocalRef(jtoken);
-            cached.clear();
-
-            // Check if the Java callback threw an exception
-            if (env->ExceptionCheck()) {
-                env->ExceptionClear();
-                LOGw("Java callback threw exception, stopping generation");
-                break;
-            }
+    // Forwards output to the Java LlamaStreamCallback; stops once it throws
+    engine::TextFn on_text = [env, callback, onToken](const std::string &text) {
+        TRACE_SCOPE("jni_onToken");
+        jstring jtoken = env->NewStringUTF(text.c_str());
+        env->CallVoidMethod(callback, onToken, jtoken);
+        env->DeleteLocalRef(jtoken);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            LOGw("Java callback threw exception, stopping generation");
+            return false;
         }
-
-        common_batch_clear(g_batch);
-        common_batch_add(g_batch, id, g_current_pos, {0}, true);
-        if (llama_decode(g_context, g_batch) != 0) break;
-        g_current_pos++;
+        return true;
+    };
+
+    try {
+        engine::generate(to_std_string(env, jprompt), maxTokens,
+                         sampling_params(temperature, topP, topK, repeatPenalty),
+                         to_string_vector(env, jstop), on_text);
+    } catch (const std::exception &e) {
+        LOGe("Streaming generation failed: %s", e.what());
     }
 }
 
@@ -367,16 +425,10 @@ JNIEXPORT jintArray JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeTokenize(
     JNIEnv *env, jobject, jlong handle, jstring jtext
 ) {
-    if (!g_context) {
-        return env->NewIntArray(0);
-    }
-
-    const char *text = env->GetStringUTFChars(jtext, nullptr);
-    auto tokens = common_tokenize(g_context, std::string(text), false, false);
-    env->ReleaseStringUTFChars(jtext, text);
+    std::vector<int32_t> tokens = engine::tokenize(to_std_string(env, jtext));
 
     jintArray result = env->NewIntArray((int)tokens.size());
-    if (result) {
+    if (result && !tokens.empty()) {
         std::vector<jint> jtokens(tokens.begin(), tokens.end());
         env->SetIntArrayRegion(result, 0, (int)jtokens.size(), jtokens.data());
     }
@@ -388,8 +440,7 @@ JNIEXPORT void JNICALL
 Java_com_castor_core_inference_llama_LlamaCppEngine_nativeShutdown(
     JNIEnv *, jobject
 ) {
-    llama_backend_free();
-    LOGi("Backend shut down");
+    engine::shutdown();
 }
 
 } // extern "C"
@@ -0,0 +1,48 @@
+#pragma once
+
+// Logging shim: logcat on Android, stderr elsewhere (host builds of the
+// engine and the benchmark). Set UNDIOS_LOG_LEVEL=0..3 (error..debug) on the
+// host to change verbosity; the default keeps warnings and errors.
+
+#define TAG "UnDios-LLM"
+
+#if defined(__ANDROID__)
+
+#include <android/log.h>
+
+#define LOGi(...) __android_log_print(ANDROID_LOG_INFO,  TAG, __VA_ARGS__)
+#define LOGe(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+#define LOGw(...) __android_log_print(ANDROID_LOG_WARN,  TAG, __VA_ARGS__)
+#define LOGd(...) __android_log_print(ANDROID_LOG_DEBUG, TAG, __VA_ARGS__)
+
+#else
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace undios_log {
+
+enum Level { ERROR = 0, WARN = 1, INFO = 2, DEBUG = 3 };
+
+inline int threshold() {
+    static const int level = [] {
+        const char *env = std::getenv("UNDIOS_LOG_LEVEL");
+        return env ? std::atoi(env) : WARN;
+    }();
+    return level;
+}
+
+} // namespace undios_log
+
+#define UNDIOS_LOG_(level, letter, fmt, ...) \
+    do { \
+        if ((level) <= undios_log::threshold()) \
+            std::fprintf(stderr, letter "/" TAG ": " fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define LOGi(fmt, ...) UNDIOS_LOG_(undios_log::INFO,  "I", fmt, ##__VA_ARGS__)
+#define LOGe(fmt, ...) UNDIOS_LOG_(undios_log::ERROR, "E", fmt, ##__VA_ARGS__)
+#define LOGw(fmt, ...) UNDIOS_LOG_(undios_log::WARN,  "W", fmt, ##__VA_ARGS__)
+#define LOGd(fmt, ...) UNDIOS_LOG_(undios_log::DEBUG, "D", fmt, ##__VA_ARGS__)
+
+#endif
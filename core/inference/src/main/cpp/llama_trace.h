@@ -0,0 +1,176 @@
+#pragma once
+
+// Tracing shim: scoped sections and counters for system traces.
+//
+// On Android they go to ATrace, so inference shows up in Perfetto and
+// systrace next to the app's own sections whenever the app is traced. On
+// other hosts (the benchmark, the engine test) they are buffered and written
+// as Chrome trace-event JSON to the file named by UNDIOS_TRACE when the
+// process exits or the engine shuts down; open it in ui.perfetto.dev.
+//
+// With tracing off each macro costs one well-predicted branch
+// (ATrace_isEnabled() on Android, a cached getenv on the host) and counter
+// values are not even computed. Names must be string literals.
+//
+//   TRACE_SCOPE("decode");                 // section until the end of the scope
+//   TRACE_COUNTER("kv_cells", n_used);     // value on a counter track
+
+#include <cstdint>
+
+#if defined(__ANDROID__)
+
+#include <android/trace.h>
+
+namespace undios_trace {
+
+inline bool enabled() { return ATrace_isEnabled(); }
+
+inline void counter(const char *name, int64_t value) { ATrace_setCounter(name, value); }
+
+inline void flush() {}
+
+class Scope {
+public:
+    explicit Scope(const char *name) : active_(ATrace_isEnabled()) {
+        if (active_) ATrace_beginSection(name);
+    }
+    ~Scope() {
+        if (active_) ATrace_endSection();
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    bool active_;
+};
+
+} // namespace undios_trace
+
+#else
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace undios_trace {
+
+// Events of the process, written as one JSON document by flush()
+class Writer {
+public:
+    // Events beyond this are dropped (about 32 MB of buffer)
+    static constexpr size_t MAX_EVENTS = 1 << 20;
+
+    explicit Writer(const char *path) : path_(path), origin_(std::chrono::steady_clock::now()) {
+        events_.reserve(4096);
+    }
+
+    int64_t now_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin_).count();
+    }
+
+    void complete(const char *name, int64_t ts, int64_t dur) { add({name, 'X', ts, dur, thread_id()}); }
+    void counter(const char *name, int64_t value)            { add({name, 'C', now_us(), value, 0}); }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FILE *f = std::fopen(path_.c_str(), "w");
+        if (!f) return;
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+        for (size_t i = 0; i < events_.size(); i++) {
+            const Event &e = events_[i];
+            if (e.phase == 'X') {
+                std::fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}",
+                             e.name, e.tid, (long long)e.ts, (long long)e.value);
+            } else {
+                std::fprintf(f, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{\"value\":%lld}}",
+                             e.name, (long long)e.ts, (long long)e.value);
+            }
+            std::fputs(i + 1 < events_.size() ? ",\n" : "\n", f);
+        }
+        std::fputs("]}\n", f);
+        std::fclose(f);
+    }
+
+private:
+    struct Event {
+        const char *name;
+        char        phase;
+        int64_t     ts;
+        int64_t     value; // duration of a section, value of a counter
+        uint32_t    tid;
+    };
+
+    void add(const Event &e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (events_.size() < MAX_EVENTS) events_.push_back(e);
+    }
+
+    // Small sequential ids, so each thread gets its own track
+    static uint32_t thread_id() {
+        static std::atomic<uint32_t> next{1};
+        thread_local uint32_t id = next++;
+        return id;
+    }
+
+    std::string path_;
+    std::chrono::steady_clock::time_point origin_;
+    std::mutex mutex_;
+    std::vector<Event> events_;
+};
+
+// The process's writer, or null when UNDIOS_TRACE is not set
+inline Writer *writer() {
+    static Writer *w = [] () -> Writer * {
+        const char *path = std::getenv("UNDIOS_TRACE");
+        if (!path || !*path) return nullptr;
+        static Writer instance(path);
+        std::atexit([] { instance.flush(); });
+        return &instance;
+    }();
+    return w;
+}
+
+inline bool enabled() { return writer() != nullptr; }
+
+inline void counter(const char *name, int64_t value) {
+    if (Writer *w = writer()) w->counter(name, value);
+}
+
+inline void flush() {
+    if (Writer *w = writer()) w->flush();
+}
+
+class Scope {
+public:
+    explicit Scope(const char *name) : writer_(writer()), name_(name) {
+        if (writer_) start_ = writer_->now_us();
+    }
+    ~Scope() {
+        if (writer_) writer_->complete(name_, start_, writer_->now_us() - start_);
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    Writer     *writer_;
+    const char *name_;
+    int64_t     start_ = 0;
+};
+
+} // namespace undios_trace
+
+#endif
+
+#define UNDIOS_TRACE_CONCAT_(a, b) a##b
+#define UNDIOS_TRACE_CONCAT(a, b) UNDIOS_TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) undios_trace::Scope UNDIOS_TRACE_CONCAT(undios_trace_scope_, __LINE__)(name)
+
+#define TRACE_COUNTER(name, value) \
+    do { \
+        if (undios_trace::enabled()) undios_trace::counter(name, (int64_t)(value)); \
+    } while (0)
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Pre-load memory planner.
+//
+// Predicts what a model costs once loaded -- weights, KV cache, compute
+// buffers and fixed runtime allocations, plus a draft model loaded next to
+// it -- from its GGUF shape, and picks
+// the largest context and KV cache type that fit in a share of the memory
+// that is available. Pure arithmetic with no llama.cpp dependency, so it
+// runs before anything is allocated.
+namespace memplan {
+
+// ggml_type values of the KV cache types the planner considers
+enum KvType : int {
+    KV_F16  = 1,
+    KV_Q4_0 = 2,
+    KV_Q8_0 = 8,
+};
+
+// Bytes per KV element, as a fraction to keep block overhead exact
+inline void kv_element_size(int type, uint64_t &num, uint64_t &den) {
+    switch (type) {
+        case KV_Q8_0: num = 34; den = 32; return; // 32 int8 + f16 scale
+        case KV_Q4_0: num = 18; den = 32; return; // 32 nibbles + f16 scale
+        default:      num = 2;  den = 1;  return;
+    }
+}
+
+struct Model {
+    uint64_t weight_bytes = 0; // size of the GGUF file
+    uint32_t n_layer   = 0;
+    uint32_t n_embd    = 0;
+    uint32_t n_head    = 0;
+    uint32_t n_head_kv = 0;    // 0 = same as n_head
+    uint32_t n_embd_head_k = 0; // per-head K width; 0 = n_embd / n_head
+    uint32_t n_embd_head_v = 0; // per-head V width; 0 = n_embd / n_head
+    uint32_t n_vocab   = 0;    // 0 = unknown
+    uint32_t n_ctx_train = 0;  // 0 = unknown
+};
+
+struct Request {
+    uint64_t available_bytes = 0; // memory the system reports as available
+    double   headroom  = 0.8;     // share of available_bytes the model may use
+    uint32_t min_ctx   = 512;
+    uint32_t max_ctx   = 8192;
+    uint32_t n_ubatch  = 512;
+    uint32_t n_seq     = 1;       // parallel sequences, each with its own logits row
+    bool     flash_attn = false;  // quantized V cache needs flash attention
+    // Measured over predicted KV and compute buffers of an earlier load of
+    // the same model (engine::memory_stats), applied to the predictions
+    double   kv_scale      = 1.0;
+    double   compute_scale = 1.0;
+    // Draft model loaded next to this one for speculative decoding, or null.
+    // It gets a context of the same size with an F16 cache and one sequence.
+    const Model *draft = nullptr;
+};
+
+struct Plan {
+    bool     fits    = false;
+    uint32_t n_ctx   = 0;
+    int      kv_type = KV_F16;
+    uint64_t weight_bytes  = 0;
+    uint64_t kv_bytes      = 0;
+    uint64_t compute_bytes = 0;
+    uint64_t fixed_bytes   = 0;
+    uint64_t draft_bytes   = 0; // everything of Request::draft
+    uint64_t budget_bytes  = 0;
+
+    uint64_t total_bytes() const { return weight_bytes + kv_bytes + compute_bytes + fixed_bytes + draft_bytes; }
+};
+
+// Context sizes are planned in steps of this many tokens
+constexpr uint32_t CTX_STEP = 256;
+
+// Allocator, threads, sampler and chat-template state regardless of model
+constexpr uint64_t RUNTIME_BASE_BYTES = 64ull << 20;
+
+namespace detail {
+
+inline uint64_t scaled(uint64_t bytes, double scale) { return (uint64_t)(bytes * scale + 0.5); }
+
+// Width of one layer's keys (or values) for one token. Models whose head
+// size is not n_embd / n_head (e.g. Gemma, Qwen3) declare it per tensor.
+inline uint64_t kv_width(const Model &m, uint32_t n_embd_head) {
+    uint32_t n_head_kv = m.n_head_kv ? m.n_head_kv : m.n_head;
+    if (n_embd_head != 0 && n_head_kv != 0) return (uint64_t)n_embd_head * n_head_kv;
+    if (m.n_head == 0 || m.n_head_kv == 0) return m.n_embd;
+    return (uint64_t)m.n_embd / m.n_head * m.n_head_kv;
+}
+
+// KV cache for n_ctx tokens: keys and values for every layer
+inline uint64_t kv_bytes(const Model &m, int type, uint64_t n_ctx) {
+    uint64_t num, den;
+    kv_element_size(type, num, den);
+    uint64_t width = kv_width(m, m.n_embd_head_k) + kv_width(m, m.n_embd_head_v);
+    return (uint64_t)m.n_layer * width * n_ctx * num / den;
+}
+
+// Compute buffer terms that do not depend on the context: f32 activations
+// of one micro-batch (residual, norms and the FFN intermediate, which is
+// several times the embedding width) and one logits row per sequence
+inline uint64_t compute_fixed(const Model &m, const Request &r) {
+    uint64_t vocab = m.n_vocab ? m.n_vocab : 32000;
+    return (uint64_t)r.n_ubatch * m.n_embd * 12 * 4 + (uint64_t)std::max<uint32_t>(r.n_seq, 1) * vocab * 4;
+}
+
+// Compute buffer per token of context: without flash attention the KQ
+// scores of a micro-batch against the whole context are materialized (f32)
+inline uint64_t compute_per_token(const Model &m, const Request &r) {
+    if (r.flash_attn) return 0;
+    return (uint64_t)r.n_ubatch * std::max<uint32_t>(m.n_head, 1) * 4;
+}
+
+// The draft model's request: one sequence, uncalibrated
+inline Request draft_request(const Request &r) {
+    Request d = r;
+    d.n_seq = 1;
+    d.kv_scale = d.compute_scale = 1.0;
+    d.draft = nullptr;
+    return d;
+}
+
+// Draft weights, F16 KV cache, compute buffers and vocabulary for n_ctx tokens
+inline uint64_t draft_bytes(const Request &r, uint64_t n_ctx) {
+    if (!r.draft) return 0;
+    const Model &d = *r.draft;
+    Request dr = draft_request(r);
+    return d.weight_bytes + kv_bytes(d, KV_F16, n_ctx) + compute_fixed(d, dr) +
+           compute_per_token(d, dr) * n_ctx + (uint64_t)d.n_vocab * 64;
+}
+
+inline uint64_t draft_per_token(const Request &r) {
+    if (!r.draft) return 0;
+    return kv_bytes(*r.draft, KV_F16, CTX_STEP) / CTX_STEP + compute_per_token(*r.draft, draft_request(r));
+}
+
+inline Plan plan_for(const Model &m, const Request &r, int type, uint64_t n_ctx) {
+    Plan p;
+    p.n_ctx = (uint32_t)n_ctx;
+    p.kv_type = type;
+    p.weight_bytes  = m.weight_bytes;
+    p.kv_bytes      = scaled(kv_bytes(m, type, n_ctx), r.kv_scale);
+    p.compute_bytes = scaled(compute_fixed(m, r) + compute_per_token(m, r) * n_ctx, r.compute_scale);
+    p.fixed_bytes   = RUNTIME_BASE_BYTES + (uint64_t)m.n_vocab * 64; // vocab and merges
+    p.draft_bytes   = draft_bytes(r, n_ctx);
+    p.budget_bytes  = (uint64_t)(r.available_bytes * r.headroom);
+    p.fits = p.total_bytes() <= p.budget_bytes;
+    return p;
+}
+
+// Largest context (a multiple of CTX_STEP within [min_ctx, ceiling]) that
+// fits with the given KV type, or 0 if even min_ctx does not fit
+inline uint64_t largest_ctx(const Model &m, const Request &r, int type, uint64_t ceiling) {
+    Plan base = plan_for(m, r, type, 0);
+    if (base.total_bytes() >= base.budget_bytes) return 0;
+    uint64_t per_token = scaled(kv_bytes(m, type, CTX_STEP) / CTX_STEP, r.kv_scale) +
+                         scaled(compute_per_token(m, r), r.compute_scale) + draft_per_token(r);
+    uint64_t n_ctx = per_token ? (base.budget_bytes - base.total_bytes()) / per_token : ceiling;
+    n_ctx = std::min(n_ctx, ceiling) / CTX_STEP * CTX_STEP;
+    // Integer rounding of per_token can overshoot by a step
+    while (n_ctx >= r.min_ctx && !plan_for(m, r, type, n_ctx).fits) n_ctx -= CTX_STEP;
+    return n_ctx >= r.min_ctx ? n_ctx : 0;
+}
+
+} // namespace detail
+
+// The largest context that fits, with the most precise KV type that reaches
+// it. F16 is kept whenever it reaches the full ceiling (max_ctx capped by the
+// trained context); otherwise the type giving the largest context wins, ties
+// going to the more precise type. When nothing fits, the plan is min_ctx with
+// the smallest KV type and fits = false.
+inline Plan plan(const Model &m, const Request &r) {
+    uint64_t ceiling = r.max_ctx;
+    if (m.n_ctx_train > 0) ceiling = std::min<uint64_t>(ceiling, m.n_ctx_train);
+    ceiling = std::max<uint64_t>(ceiling, r.min_ctx);
+
+    const int types[] = {KV_F16, KV_Q8_0, KV_Q4_0};
+    const int n_types = r.flash_attn ? 3 : 1;
+
+    int best_type = -1;
+    uint64_t best_ctx = 0;
+    for (int i = 0; i < n_types; i++) {
+        uint64_t n_ctx = detail::largest_ctx(m, r, types[i], ceiling);
+        if (n_ctx > best_ctx) {
+            best_ctx = n_ctx;
+            best_type = types[i];
+        }
+        if (best_ctx >= ceiling / CTX_STEP * CTX_STEP && best_ctx > 0) break;
+    }
+
+    if (best_type < 0) return detail::plan_for(m, r, types[n_types - 1], r.min_ctx);
+    return detail::plan_for(m, r, best_type, best_ctx);
+}
+
+} // namespace memplan
@@ -0,0 +1,70 @@
+#include <jni.h>
+
+#include "memory_plan.h"
+
+extern "C" {
+
+// --- nativePlan(...): LongArray ---
+// [fits, contextSize, kvType, weightBytes, kvBytes, computeBytes, fixedBytes, budgetBytes, draftBytes]
+// The draft* arguments describe a draft model to reserve room for; draftWeightBytes = 0 for none.
+JNIEXPORT jlongArray JNICALL
+Java_com_castor_core_inference_memory_MemoryPlanner_nativePlan(
+    JNIEnv *env, jobject,
+    jlong weightBytes, jint layers, jint embedding, jint heads, jint headsKv, jint keyLength, jint valueLength,
+    jint vocab, jint trainedContext,
+    jlong availableBytes, jdouble headroom, jint minContext, jint maxContext, jint microBatch, jint sequences,
+    jboolean flashAttention, jdouble kvScale, jdouble computeScale,
+    jlong draftWeightBytes, jint draftLayers, jint draftEmbedding, jint draftHeads, jint draftHeadsKv,
+    jint draftKeyLength, jint draftValueLength, jint draftVocab
+) {
+    memplan::Model model;
+    model.weight_bytes = (uint64_t)weightBytes;
+    model.n_layer      = (uint32_t)layers;
+    model.n_embd       = (uint32_t)embedding;
+    model.n_head       = (uint32_t)heads;
+    model.n_head_kv    = (uint32_t)headsKv;
+    model.n_embd_head_k = (uint32_t)keyLength;
+    model.n_embd_head_v = (uint32_t)valueLength;
+    model.n_vocab      = (uint32_t)vocab;
+    model.n_ctx_train  = (uint32_t)trainedContext;
+
+    memplan::Model draft;
+    draft.weight_bytes  = (uint64_t)draftWeightBytes;
+    draft.n_layer       = (uint32_t)draftLayers;
+    draft.n_embd        = (uint32_t)draftEmbedding;
+    draft.n_head        = (uint32_t)draftHeads;
+    draft.n_head_kv     = (uint32_t)draftHeadsKv;
+    draft.n_embd_head_k = (uint32_t)draftKeyLength;
+    draft.n_embd_head_v = (uint32_t)draftValueLength;
+    draft.n_vocab       = (uint32_t)draftVocab;
+
+    memplan::Request request;
+    request.available_bytes = (uint64_t)availableBytes;
+    request.headroom   = headroom;
+    request.min_ctx    = (uint32_t)minContext;
+    request.max_ctx    = (uint32_t)maxContext;
+    request.n_ubatch   = (uint32_t)microBatch;
+    request.n_seq      = (uint32_t)sequences;
+    request.flash_attn = flashAttention;
+    request.kv_scale      = kvScale;
+    request.compute_scale = computeScale;
+    if (draftWeightBytes > 0) request.draft = &draft;
+
+    memplan::Plan plan = memplan::plan(model, request);
+    const jlong out[] = {
+        plan.fits ? 1 : 0,
+        plan.n_ctx,
+        plan.kv_type,
+        (jlong)plan.weight_bytes,
+        (jlong)plan.kv_bytes,
+        (jlong)plan.compute_bytes,
+        (jlong)plan.fixed_bytes,
+        (jlong)plan.budget_bytes,
+        (jlong)plan.draft_bytes,
+    };
+    jlongArray result = env->NewLongArray(sizeof(out) / sizeof(*out));
+    env->SetLongArrayRegion(result, 0, sizeof(out) / sizeof(*out), out);
+    return result;
+}
+
+} // extern "C"
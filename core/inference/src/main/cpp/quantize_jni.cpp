@@ -0,0 +1,118 @@
+#include <jni.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "common.h"
+#include "llama.h"
+
+// Requantization of downloaded models to fit a RAM budget, and the
+// perplexity measurement that shows what it cost.
+
+namespace {
+
+int default_threads(jint threads) {
+    if (threads > 0) return threads;
+    return std::max(2, (int)sysconf(_SC_NPROCESSORS_ONLN) - 2);
+}
+
+// Perplexity of text under the model in ctx, in the style of llama-perplexity:
+// the text is cut into windows of n_ctx tokens and only the second half of
+// each window is scored, so every scored token has at least n_ctx/2 tokens
+// of context. Returns NaN if the text is shorter than one window.
+double perplexity(llama_context *ctx, const std::vector<llama_token> &tokens, int n_ctx, int max_windows) {
+    const llama_vocab *vocab = llama_model_get_vocab(llama_get_model(ctx));
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const int windows = std::min((int)(tokens.size() / n_ctx), max_windows);
+    const int first   = n_ctx / 2;
+
+    llama_batch batch = llama_batch_init(n_ctx, 0, 1);
+    double nll = 0.0;
+    int scored = 0;
+    for (int w = 0; w < windows; w++) {
+        llama_memory_clear(llama_get_memory(ctx), true);
+        common_batch_clear(batch);
+        const llama_token *window = tokens.data() + (size_t)w * n_ctx;
+        for (int i = 0; i < n_ctx; i++) {
+            // Logits at i predict token i + 1
+            common_batch_add(batch, window[i], i, {0}, i >= first - 1 && i < n_ctx - 1);
+        }
+        if (llama_decode(ctx, batch) != 0) break;
+
+        for (int i = first - 1; i < n_ctx - 1; i++) {
+            const float *logits = llama_get_logits_ith(ctx, i);
+            float max_logit = *std::max_element(logits, logits + n_vocab);
+            double sum = 0.0;
+            for (int v = 0; v < n_vocab; v++) sum += std::exp((double)(logits[v] - max_logit));
+            nll += std::log(sum) + max_logit - logits[window[i + 1]];
+            scored++;
+        }
+    }
+    llama_batch_free(batch);
+    return scored > 0 ? std::exp(nll / scored) : NAN;
+}
+
+} // namespace
+
+extern "C" {
+
+// --- nativeRequantize(src, dst, ftype, threads): Boolean ---
+JNIEXPORT jboolean JNICALL
+Java_com_castor_core_inference_quantize_ModelRequantizer_nativeRequantize(
+    JNIEnv *env, jobject, jstring jsrc, jstring jdst, jint ftype, jint threads
+) {
+    const char *src = env->GetStringUTFChars(jsrc, nullptr);
+    const char *dst = env->GetStringUTFChars(jdst, nullptr);
+
+    llama_model_quantize_params params = llama_model_quantize_default_params();
+    params.ftype            = (llama_ftype)ftype;
+    params.nthread          = default_threads(threads);
+    params.allow_requantize = true;
+
+    uint32_t rc = llama_model_quantize(src, dst, &params);
+
+    env->ReleaseStringUTFChars(jsrc, src);
+    env->ReleaseStringUTFChars(jdst, dst);
+    return rc == 0;
+}
+
+// --- nativePerplexity(path, text, contextSize, maxWindows, threads): Float ---
+// Loads the model memory-mapped with its own small context, independent of
+// the engine's loaded model. NaN if the model cannot be loaded.
+JNIEXPORT jfloat JNICALL
+Java_com_castor_core_inference_quantize_ModelRequantizer_nativePerplexity(
+    JNIEnv *env, jobject, jstring jpath, jstring jtext, jint contextSize, jint maxWindows, jint threads
+) {
+    const char *path = env->GetStringUTFChars(jpath, nullptr);
+    llama_model_params mparams = llama_model_default_params();
+    mparams.use_mmap = true;
+    llama_model *model = llama_model_load_from_file(path, mparams);
+    env->ReleaseStringUTFChars(jpath, path);
+    if (!model) return NAN;
+
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx           = contextSize;
+    cparams.n_batch         = contextSize;
+    cparams.n_ubatch        = contextSize;
+    cparams.n_threads       = default_threads(threads);
+    cparams.n_threads_batch = cparams.n_threads;
+    llama_context *ctx = llama_init_from_model(model, cparams);
+    if (!ctx) {
+        llama_model_free(model);
+        return NAN;
+    }
+
+    const char *chars = env->GetStringUTFChars(jtext, nullptr);
+    std::vector<llama_token> tokens = common_tokenize(ctx, chars, true);
+    env->ReleaseStringUTFChars(jtext, chars);
+
+    double ppl = perplexity(ctx, tokens, contextSize, maxWindows);
+
+    llama_free(ctx);
+    llama_model_free(model);
+    return (jfloat)ppl;
+}
+
+} // extern "C"
@@ -0,0 +1,361 @@
+// Regression test of the engine over the synthetic model from make_tiny_gguf.
+//
+// Drives the engine through its public entry points (load, tokenize,
+// generate, streaming, context shift, draft generation) with greedy or
+// fixed-seed sampling and checks that outputs are deterministic. Fails when a
+// repeated run differs.
+//
+//   undios-engine-test tiny.gguf [perf_baseline.json]
+//
+// With a baseline it also measures prefill and decode throughput and heap
+// allocations per generated token. Two checks do not depend on the host and
+// always run: the repeated measurement runs must produce the same greedy
+// output, and allocations per token must stay under the baseline's
+// max_allocs_per_token. The recorded figures are compared as well: the test
+// fails when the greedy output changes, throughput drops by more than the
+// baseline's tolerance, or allocations grow by more than theirs. A figure
+// missing from the baseline is reported and not compared.
+//
+// Timings are only comparable on the host and build type the baseline was
+// recorded with (a Release build on the Linux CI box). Record the baseline
+// there, and again after an intended change, with
+//   UNDIOS_PERF_UPDATE_BASELINE=1 ctest -R engine_perf
+// and commit perf_baseline.json.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "llama_engine.h"
+
+using json = nlohmann::ordered_json;
+
+// Every operator new in the process, the engine and llama.cpp included
+static std::atomic<uint64_t> g_allocs{0};
+
+void *operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr int CONTEXT_SIZE = 256;
+constexpr int THREADS      = 2;
+constexpr int PERF_TOKENS  = 96;
+constexpr int PERF_REPEATS = 5;
+
+// Used when the baseline has no max_allocs_per_token
+constexpr double MAX_ALLOCS_PER_TOKEN = 256.0;
+
+const char *PROMPT = "the quick brown fox jumps over the lazy dog";
+
+int g_failures = 0;
+
+#define CHECK(cond, ...) do {                                            \
+        if (!(cond)) {                                                   \
+            std::fprintf(stderr, "%s:%d: FAILED: %s: ", __FILE__, __LINE__, #cond); \
+            std::fprintf(stderr, __VA_ARGS__);                           \
+            std::fputc('\n', stderr);                                    \
+            g_failures++;                                                \
+        }                                                                \
+    } while (0)
+
+engine::SamplingParams greedy() {
+    engine::SamplingParams sampling;
+    sampling.temperature = 0.0f;
+    return sampling;
+}
+
+engine::SamplingParams seeded(uint32_t seed) {
+    engine::SamplingParams sampling;
+    sampling.temperature = 0.8f;
+    sampling.seed        = seed;
+    return sampling;
+}
+
+// FNV-1a, to keep an output in the baseline without its text
+std::string hash_text(const std::string &text) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : text) h = (h ^ c) * 1099511628211ull;
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+std::string test_tokenize() {
+    auto a = engine::tokenize(PROMPT);
+    auto b = engine::tokenize(PROMPT);
+    CHECK(!a.empty(), "no tokens");
+    CHECK(a == b, "tokenization differs between calls");
+    CHECK(engine::tokenize("").empty(), "empty text gave tokens");
+    return std::to_string(a.size());
+}
+
+std::string test_generate() {
+    const int max_tokens = 48;
+    engine::reset();
+    std::string cold = engine::generate(PROMPT, max_tokens, greedy(), {});
+    CHECK(engine::generation_stats().n_tokens == max_tokens, "generated %d of %d tokens",
+          engine::generation_stats().n_tokens, max_tokens);
+    CHECK(!cold.empty(), "empty output");
+
+    // Same prompt again: served from the cached prefix, same output
+    std::string warm = engine::generate(PROMPT, max_tokens, greedy(), {});
+    CHECK(warm == cold, "greedy output changed on the second run:\n  %s\n  %s", cold.c_str(), warm.c_str());
+
+    std::string s1 = engine::generate(PROMPT, max_tokens, seeded(1234), {});
+    engine::reset();
+    std::string s2 = engine::generate(PROMPT, max_tokens, seeded(1234), {});
+    CHECK(s1 == s2, "seeded output differs:\n  %s\n  %s", s1.c_str(), s2.c_str());
+    return cold;
+}
+
+void test_stream(const std::string &expected) {
+    std::string streamed;
+    int chunks = 0;
+    engine::reset();
+    std::string out = engine::generate(PROMPT, 48, greedy(), {}, [&](const std::string &text) {
+        streamed += text;
+        chunks++;
+        return true;
+    });
+    CHECK(chunks > 0, "nothing streamed");
+    CHECK(streamed == out, "streamed text differs from the returned output");
+    CHECK(out == expected, "streaming changed the output");
+
+    // Returning false stops generation
+    int stopped_chunks = 0;
+    engine::generate(PROMPT, 48, greedy(), {}, [&](const std::string &) { return ++stopped_chunks < 2; });
+    CHECK(stopped_chunks == 2, "generation went on after the callback returned false (%d chunks)", stopped_chunks);
+}
+
+void test_context_shift() {
+    // More tokens than the context holds
+    const int max_tokens = CONTEXT_SIZE * 2;
+    engine::reset();
+    std::string a = engine::generate(PROMPT, max_tokens, greedy(), {});
+    const engine::GenerationStats stats = engine::generation_stats();
+    CHECK(stats.n_ctx_shifts > 0, "context did not shift");
+    CHECK(stats.n_tokens == max_tokens, "generated %d of %d tokens across shifts", stats.n_tokens, max_tokens);
+
+    engine::reset();
+    std::string b = engine::generate(PROMPT, max_tokens, greedy(), {});
+    CHECK(a == b, "output across context shifts is not deterministic");
+}
+
+// The cascade gates on token_confidence() of a draft answer, so it must cover
+// exactly the tokens of the returned text. Stop on the text of the draft's
+// (k+1)-th token: the answer is then the first k tokens, and so must be the
+// confidence.
+void test_draft_confidence(const char *model_path) {
+    CHECK(engine::load_draft_model(model_path, THREADS), "the model was rejected as its own draft");
+    if (!engine::has_draft_model()) return;
+
+    const int max_tokens = 24;
+    engine::reset();
+    const std::string full = engine::generate_draft(PROMPT, max_tokens, greedy(), {});
+    const std::vector<engine::TokenConfidence> full_conf = engine::token_confidence();
+    CHECK((int)full_conf.size() == max_tokens, "%d confidence entries for %d tokens", (int)full_conf.size(), max_tokens);
+
+    bool tested = false;
+    for (int k = 4; k < max_tokens && !tested; k++) {
+        std::string head = engine::generate_draft(PROMPT, k, greedy(), {});
+        std::string longer = engine::generate_draft(PROMPT, k + 1, greedy(), {});
+        if (longer.compare(0, head.size(), head) != 0) continue;
+        std::string next = longer.substr(head.size());
+        if (next.empty() || longer.find(next) != head.size()) continue;
+        tested = true;
+
+        std::string stopped = engine::generate_draft(PROMPT, max_tokens, greedy(), {next});
+        const std::vector<engine::TokenConfidence> &conf = engine::token_confidence();
+        CHECK(stopped == head, "stopping on \"%s\" gave \"%s\", not \"%s\"", next.c_str(), stopped.c_str(), head.c_str());
+        CHECK((int)conf.size() == k, "%d confidence entries for the %d tokens before the stop", (int)conf.size(), k);
+        for (size_t i = 0; i < conf.size() && i < full_conf.size(); i++) {
+            CHECK(conf[i].logprob == full_conf[i].logprob, "confidence of token %d differs from the unstopped run", (int)i);
+        }
+    }
+    CHECK(tested, "no draft token was usable as a stop string");
+    engine::free_draft_model();
+}
+
+struct Perf {
+    double prefill_tok_s    = 0.0;
+    double decode_tok_s     = 0.0;
+    double allocs_per_token = 0.0;
+};
+
+// Best of PERF_REPEATS cold runs, which is steadier than the mean on a
+// shared machine; allocations are counted over all runs. Every run must
+// produce the warm-up's greedy output.
+Perf measure() {
+    std::string prompt;
+    for (int i = 0; i < 4; i++) prompt += std::string(PROMPT) + ". ";
+
+    engine::reset();
+    const std::string expected = engine::generate(prompt, PERF_TOKENS, greedy(), {}); // warm-up
+
+    Perf perf;
+    uint64_t allocs = 0;
+    int64_t tokens = 0;
+    for (int r = 0; r < PERF_REPEATS; r++) {
+        engine::reset();
+        uint64_t before = g_allocs.load();
+        std::string output = engine::generate(prompt, PERF_TOKENS, greedy(), {});
+        allocs += g_allocs.load() - before;
+        CHECK(output == expected, "perf run %d differs from the warm-up: \"%s\" vs \"%s\"", r, output.c_str(), expected.c_str());
+
+        const engine::GenerationStats &stats = engine::generation_stats();
+        tokens += stats.n_tokens;
+        if (stats.t_prompt_us > 0) perf.prefill_tok_s = std::max(perf.prefill_tok_s, stats.n_prompt * 1e6 / stats.t_prompt_us);
+        if (stats.t_us > 0)        perf.decode_tok_s  = std::max(perf.decode_tok_s, stats.n_tokens * 1e6 / stats.t_us);
+    }
+    perf.allocs_per_token = tokens > 0 ? (double)allocs / tokens : 0.0;
+    return perf;
+}
+
+json load_baseline(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) return json::object();
+    try {
+        return json::parse(in);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "invalid baseline %s: %s\n", path.c_str(), e.what());
+        g_failures++;
+        return json::object();
+    }
+}
+
+double tolerance(const json &baseline, const char *key, double fallback) {
+    if (baseline.contains("tolerance") && baseline["tolerance"].contains(key)) return baseline["tolerance"][key].get<double>();
+    return fallback;
+}
+
+// Higher is better for throughput, lower for allocations
+void check_min(const json &baseline, const char *key, double value) {
+    if (!baseline.contains(key) || baseline[key].is_null()) {
+        std::printf("  %-18s %10.2f  (no baseline)\n", key, value);
+        return;
+    }
+    double base = baseline[key].get<double>();
+    double floor = base * (1.0 - tolerance(baseline, key, 0.2));
+    std::printf("  %-18s %10.2f  baseline %.2f, min %.2f\n", key, value, base, floor);
+    CHECK(value >= floor, "%s regressed: %.2f < %.2f", key, value, floor);
+}
+
+void check_max(const json &baseline, const char *key, double value) {
+    if (!baseline.contains(key) || baseline[key].is_null()) {
+        std::printf("  %-18s %10.2f  (no baseline)\n", key, value);
+        return;
+    }
+    double base = baseline[key].get<double>();
+    double ceiling = base * (1.0 + tolerance(baseline, key, 0.1)) + 0.5;
+    std::printf("  %-18s %10.2f  baseline %.2f, max %.2f\n", key, value, base, ceiling);
+    CHECK(value <= ceiling, "%s regressed: %.2f > %.2f", key, value, ceiling);
+}
+
+double round2(double v) { return (double)(int64_t)(v * 100.0 + 0.5) / 100.0; }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        std::fprintf(stderr, "usage: %s model.gguf [baseline.json]\n", argv[0]);
+        return 2;
+    }
+    const bool with_perf = argc == 3;
+    const std::string baseline_path = with_perf ? argv[2] : "";
+    const char *update = std::getenv("UNDIOS_PERF_UPDATE_BASELINE");
+    const bool update_baseline = update && std::string(update) == "1";
+
+    engine::init(nullptr);
+    engine::LoadParams load;
+    load.path         = argv[1];
+    load.context_size = CONTEXT_SIZE;
+    load.threads      = THREADS;
+    if (!engine::load_model(load)) {
+        std::fprintf(stderr, "failed to load %s\n", argv[1]);
+        engine::shutdown();
+        return 1;
+    }
+
+    json baseline = with_perf ? load_baseline(baseline_path) : json::object();
+    std::string output;
+    Perf perf;
+    try {
+        std::printf("tokenize: %s tokens\n", test_tokenize().c_str());
+        output = test_generate();
+        test_stream(output);
+        test_context_shift();
+        test_draft_confidence(argv[1]);
+        if (with_perf) perf = measure();
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "FAILED: %s\n", e.what());
+        g_failures++;
+    }
+    engine::free_model();
+    engine::shutdown();
+
+    if (!with_perf) {
+        if (g_failures > 0) {
+            std::fprintf(stderr, "%d failure(s)\n", g_failures);
+            return 1;
+        }
+        std::printf("ok\n");
+        return 0;
+    }
+
+    const std::string output_hash = hash_text(output);
+    std::printf("perf (ctx %d, %d threads, %d tokens, best of %d):\n", CONTEXT_SIZE, THREADS, PERF_TOKENS, PERF_REPEATS);
+
+    if (update_baseline) {
+        if (g_failures > 0) {
+            std::fprintf(stderr, "not updating the baseline: %d failure(s)\n", g_failures);
+            return 1;
+        }
+        json updated;
+        updated["tolerance"]        = baseline.value("tolerance", json{{"prefill_tok_s", 0.2}, {"decode_tok_s", 0.2}, {"allocs_per_token", 0.1}});
+        updated["max_allocs_per_token"] = baseline.value("max_allocs_per_token", MAX_ALLOCS_PER_TOKEN);
+        updated["output_hash"]      = output_hash;
+        updated["prefill_tok_s"]    = round2(perf.prefill_tok_s);
+        updated["decode_tok_s"]     = round2(perf.decode_tok_s);
+        updated["allocs_per_token"] = round2(perf.allocs_per_token);
+        std::ofstream out(baseline_path);
+        out << updated.dump(2) << "\n";
+        if (!out) {
+            std::fprintf(stderr, "cannot write %s\n", baseline_path.c_str());
+            return 1;
+        }
+        std::printf("baseline written to %s\n", baseline_path.c_str());
+        return 0;
+    }
+
+    if (baseline.contains("output_hash") && !baseline["output_hash"].is_null()) {
+        CHECK(baseline["output_hash"].get<std::string>() == output_hash,
+              "greedy output changed (hash %s, baseline %s): %s", output_hash.c_str(),
+              baseline["output_hash"].get<std::string>().c_str(), output.c_str());
+    }
+    check_min(baseline, "prefill_tok_s", perf.prefill_tok_s);
+    check_min(baseline, "decode_tok_s", perf.decode_tok_s);
+    check_max(baseline, "allocs_per_token", perf.allocs_per_token);
+    const double max_allocs = baseline.value("max_allocs_per_token", MAX_ALLOCS_PER_TOKEN);
+    CHECK(perf.allocs_per_token <= max_allocs, "%.2f allocations per token, limit %.2f", perf.allocs_per_token, max_allocs);
+
+    if (g_failures > 0) {
+        std::fprintf(stderr, "%d failure(s)\n", g_failures);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
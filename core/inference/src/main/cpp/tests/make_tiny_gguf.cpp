@@ -0,0 +1,219 @@
+// Writes a tiny random-weight llama model as GGUF for the engine tests.
+//
+// Two layers, 64-wide embeddings and a ~340 token SentencePiece vocabulary
+// (control tokens, byte fallback, lowercase letters and a few word pieces),
+// all F32. Weights come from a fixed seed, so every build writes the same
+// file and the model's outputs can be compared across runs. The output rows
+// of control and byte tokens are zero: sampling favours the text pieces,
+// and end of sequence is never the most likely token, so a generation always
+// runs to max_tokens.
+//
+//   undios-make-tiny-gguf out.gguf
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t N_EMBD    = 64;
+constexpr uint32_t N_HEAD    = 4;
+constexpr uint32_t N_HEAD_KV = 2;
+constexpr uint32_t N_FF      = 128;
+constexpr uint32_t N_LAYER   = 2;
+constexpr uint32_t N_CTX     = 2048;
+constexpr uint32_t ALIGNMENT = 32;
+
+// GGUF value types
+enum : uint32_t { T_UINT32 = 4, T_INT32 = 5, T_FLOAT32 = 6, T_BOOL = 7, T_STRING = 8, T_ARRAY = 9 };
+
+// llama_token_type
+enum : int32_t { TOK_NORMAL = 1, TOK_UNKNOWN = 2, TOK_CONTROL = 3, TOK_BYTE = 6 };
+
+struct Vocab {
+    std::vector<std::string> tokens;
+    std::vector<float>       scores;
+    std::vector<int32_t>     types;
+
+    void add(const std::string &text, float score, int32_t type) {
+        tokens.push_back(text);
+        scores.push_back(score);
+        types.push_back(type);
+    }
+};
+
+struct Tensor {
+    std::string        name;
+    std::vector<uint64_t> ne; // ne[0] is the contiguous dimension
+    std::vector<float> data;
+};
+
+class Writer {
+public:
+    explicit Writer(FILE *f) : f_(f) {}
+
+    void raw(const void *p, size_t n) { if (std::fwrite(p, 1, n, f_) != n) ok_ = false; pos_ += n; }
+    void u32(uint32_t v) { raw(&v, 4); }
+    void i32(int32_t v)  { raw(&v, 4); }
+    void u64(uint64_t v) { raw(&v, 8); }
+    void f32(float v)    { raw(&v, 4); }
+    void str(const std::string &s) { u64(s.size()); raw(s.data(), s.size()); }
+    void pad() { static const char zeros[ALIGNMENT] = {}; raw(zeros, (ALIGNMENT - pos_ % ALIGNMENT) % ALIGNMENT); }
+
+    void kv_u32(const std::string &key, uint32_t v) { str(key); u32(T_UINT32); u32(v); }
+    void kv_f32(const std::string &key, float v)    { str(key); u32(T_FLOAT32); f32(v); }
+    void kv_bool(const std::string &key, bool v)    { str(key); u32(T_BOOL); uint8_t b = v; raw(&b, 1); }
+    void kv_str(const std::string &key, const std::string &v) { str(key); u32(T_STRING); str(v); }
+
+    bool ok() const { return ok_; }
+
+private:
+    FILE    *f_;
+    uint64_t pos_ = 0;
+    bool     ok_  = true;
+};
+
+Vocab make_vocab() {
+    Vocab v;
+    v.add("<unk>", 0.0f, TOK_UNKNOWN);
+    v.add("<s>",   0.0f, TOK_CONTROL);
+    v.add("</s>",  0.0f, TOK_CONTROL);
+    for (int b = 0; b < 256; b++) {
+        char name[8];
+        std::snprintf(name, sizeof(name), "<0x%02X>", b);
+        v.add(name, 0.0f, TOK_BYTE);
+    }
+
+    // SentencePiece merges the pair whose piece scores highest, so longer
+    // pieces score higher
+    const std::string space = "\xE2\x96\x81"; // U+2581, SentencePiece's word boundary
+    v.add(space, -1.0f, TOK_NORMAL);
+    for (char c = 'a'; c <= 'z'; c++) v.add(std::string(1, c), -2.0f, TOK_NORMAL);
+    for (char c : std::string(".,'?!-:0123456789")) v.add(std::string(1, c), -3.0f, TOK_NORMAL);
+    for (char c = 'a'; c <= 'z'; c++) v.add(space + c, -1.5f, TOK_NORMAL);
+    for (const char *piece : {"th", "he", "in", "er", "an", "re", "on", "at", "en", "nd", "st", "es", "or", "ing"}) {
+        v.add(piece, -1.0f + 0.1f * std::string(piece).size(), TOK_NORMAL);
+    }
+    for (const char *word : {"the", "and", "of", "to", "quick", "brown", "fox", "over", "lazy", "dog",
+                             "model", "token", "cache", "context", "memory", "phone"}) {
+        v.add(space + word, -0.5f + 0.1f * std::string(word).size(), TOK_NORMAL);
+    }
+    return v;
+}
+
+std::vector<Tensor> make_tensors(uint32_t n_vocab, uint32_t n_special) {
+    std::mt19937 rng(20240611u);
+    auto random = [&](const std::string &name, uint64_t ne0, uint64_t ne1, float stddev) {
+        std::normal_distribution<float> dist(0.0f, stddev);
+        Tensor t{name, {ne0, ne1}, std::vector<float>(ne0 * ne1)};
+        for (float &x : t.data) x = dist(rng);
+        return t;
+    };
+    auto ones = [](const std::string &name, uint64_t ne0) {
+        return Tensor{name, {ne0}, std::vector<float>(ne0, 1.0f)};
+    };
+
+    const uint32_t n_embd_kv = N_EMBD / N_HEAD * N_HEAD_KV;
+    std::vector<Tensor> tensors;
+    tensors.push_back(random("token_embd.weight", N_EMBD, n_vocab, 0.5f));
+    tensors.push_back(ones("output_norm.weight", N_EMBD));
+    Tensor output = random("output.weight", N_EMBD, n_vocab, 0.5f);
+    std::fill(output.data.begin(), output.data.begin() + (size_t)n_special * N_EMBD, 0.0f);
+    tensors.push_back(std::move(output));
+
+    for (uint32_t il = 0; il < N_LAYER; il++) {
+        const std::string blk = "blk." + std::to_string(il) + ".";
+        tensors.push_back(ones(blk + "attn_norm.weight", N_EMBD));
+        tensors.push_back(random(blk + "attn_q.weight", N_EMBD, N_EMBD, 0.1f));
+        tensors.push_back(random(blk + "attn_k.weight", N_EMBD, n_embd_kv, 0.1f));
+        tensors.push_back(random(blk + "attn_v.weight", N_EMBD, n_embd_kv, 0.1f));
+        tensors.push_back(random(blk + "attn_output.weight", N_EMBD, N_EMBD, 0.1f));
+        tensors.push_back(ones(blk + "ffn_norm.weight", N_EMBD));
+        tensors.push_back(random(blk + "ffn_gate.weight", N_EMBD, N_FF, 0.1f));
+        tensors.push_back(random(blk + "ffn_up.weight", N_EMBD, N_FF, 0.1f));
+        tensors.push_back(random(blk + "ffn_down.weight", N_FF, N_EMBD, 0.1f));
+    }
+    return tensors;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s out.gguf\n", argv[0]);
+        return 2;
+    }
+
+    const Vocab vocab = make_vocab();
+    const uint32_t n_vocab = (uint32_t)vocab.tokens.size();
+    const std::vector<Tensor> tensors = make_tensors(n_vocab, 3 + 256);
+
+    FILE *f = std::fopen(argv[1], "wb");
+    if (!f) {
+        std::fprintf(stderr, "cannot write %s\n", argv[1]);
+        return 1;
+    }
+    Writer w(f);
+
+    const uint64_t n_kv = 21;
+    w.raw("GGUF", 4);
+    w.u32(3);
+    w.u64(tensors.size());
+    w.u64(n_kv);
+
+    w.kv_str("general.architecture", "llama");
+    w.kv_str("general.name", "undios-tiny-test");
+    w.kv_u32("general.file_type", 0); // LLAMA_FTYPE_ALL_F32
+    w.kv_u32("general.alignment", ALIGNMENT);
+    w.kv_u32("llama.context_length", N_CTX);
+    w.kv_u32("llama.embedding_length", N_EMBD);
+    w.kv_u32("llama.block_count", N_LAYER);
+    w.kv_u32("llama.feed_forward_length", N_FF);
+    w.kv_u32("llama.attention.head_count", N_HEAD);
+    w.kv_u32("llama.attention.head_count_kv", N_HEAD_KV);
+    w.kv_u32("llama.rope.dimension_count", N_EMBD / N_HEAD);
+    w.kv_f32("llama.attention.layer_norm_rms_epsilon", 1e-5f);
+    w.kv_u32("llama.vocab_size", n_vocab);
+
+    w.kv_str("tokenizer.ggml.model", "llama");
+    w.str("tokenizer.ggml.tokens");
+    w.u32(T_ARRAY); w.u32(T_STRING); w.u64(n_vocab);
+    for (const auto &t : vocab.tokens) w.str(t);
+    w.str("tokenizer.ggml.scores");
+    w.u32(T_ARRAY); w.u32(T_FLOAT32); w.u64(n_vocab);
+    for (float s : vocab.scores) w.f32(s);
+    w.str("tokenizer.ggml.token_type");
+    w.u32(T_ARRAY); w.u32(T_INT32); w.u64(n_vocab);
+    for (int32_t t : vocab.types) w.i32(t);
+    w.kv_u32("tokenizer.ggml.unknown_token_id", 0);
+    w.kv_u32("tokenizer.ggml.bos_token_id", 1);
+    w.kv_u32("tokenizer.ggml.eos_token_id", 2);
+    w.kv_bool("tokenizer.ggml.add_bos_token", true);
+
+    // Tensor infos; offsets are relative to the aligned start of the data
+    uint64_t offset = 0;
+    for (const auto &t : tensors) {
+        w.str(t.name);
+        w.u32((uint32_t)t.ne.size());
+        for (uint64_t d : t.ne) w.u64(d);
+        w.u32(0); // GGML_TYPE_F32
+        w.u64(offset);
+        offset += (t.data.size() * sizeof(float) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+    w.pad();
+    for (const auto &t : tensors) {
+        w.raw(t.data.data(), t.data.size() * sizeof(float));
+        w.pad();
+    }
+
+    bool ok = w.ok();
+    if (std::fclose(f) != 0) ok = false;
+    if (!ok) {
+        std::fprintf(stderr, "failed writing %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
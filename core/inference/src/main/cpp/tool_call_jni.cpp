@@ -0,0 +1,43 @@
+#include <jni.h>
+#include <string>
+#include <vector>
+
+#include "tool_call_parser.h"
+
+extern "C" {
+
+// --- nativeParse(text): Array<String> ---
+// One pass of ToolCallStreamParser over a finished output: the text outside
+// tool call blocks, then the name and raw arguments JSON of each call.
+JNIEXPORT jobjectArray JNICALL
+Java_com_castor_core_inference_tool_ToolCallParser_nativeParse(
+    JNIEnv *env, jobject, jstring jtext
+) {
+    const char *chars = env->GetStringUTFChars(jtext, nullptr);
+    std::string text(chars);
+    env->ReleaseStringUTFChars(jtext, chars);
+
+    ToolCallStreamParser parser;
+    parser.stop_after_calls = false;
+    std::vector<ToolCallStreamParser::Call> calls;
+    parser.feed(text, calls);
+    parser.finish();
+
+    std::vector<const std::string *> fields;
+    fields.reserve(1 + 2 * calls.size());
+    fields.push_back(&parser.visible);
+    for (const auto &call : calls) {
+        fields.push_back(&call.name);
+        fields.push_back(&call.arguments);
+    }
+
+    jobjectArray result = env->NewObjectArray((jsize)fields.size(), env->FindClass("java/lang/String"), nullptr);
+    for (size_t i = 0; i < fields.size(); i++) {
+        jstring str = env->NewStringUTF(fields[i]->c_str());
+        env->SetObjectArrayElement(result, (jsize)i, str);
+        env->DeleteLocalRef(str);
+    }
+    return result;
+}
+
+} // extern "C"
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Incremental parser for <tool_call> blocks, fed text as it is decoded.
+//
+// Tag framing and the JSON body are tracked by one byte-at-a-time state
+// machine, so every byte is looked at once however the output is split into
+// pieces. A call is complete the moment its top-level JSON object closes:
+// its "name" is decoded and its "arguments" object is kept as raw JSON text.
+// The close tag only marks where the block ends. Braces and tags inside JSON
+// strings are not mistaken for structure.
+//
+// Once a block has closed, feeding anything other than whitespace or the
+// start of another block asks the caller to stop generating, unless
+// stop_after_calls is cleared (parsing a finished output).
+class ToolCallStreamParser {
+public:
+    static constexpr const char *OPEN  = "<tool_call>";
+    static constexpr const char *CLOSE = "</tool_call>";
+
+    struct Call {
+        std::string name;
+        std::string arguments; // raw JSON object
+    };
+
+    enum Action { CONTINUE, CLOSED, STOP };
+
+    std::string text;                           // everything fed so far
+    std::string visible;                        // text outside blocks (see finish)
+    size_t block_start = std::string::npos;     // body start of the open block
+    size_t close_end   = std::string::npos;     // just past the last close tag
+    bool stop_after_calls = true;
+
+    // Feed the next piece of text; calls completed by it are appended to
+    // `completed`. Returns CLOSED when a close tag completed in this piece.
+    Action feed(const std::string &piece, std::vector<Call> &completed) {
+        if (stop_) return STOP;
+        bool closed = false;
+        for (char c : piece) {
+            size_t i = text.size();
+            text += c;
+            if (!step(c, i, closed, completed)) {
+                stop_ = true;
+                break;
+            }
+        }
+        if (closed) return CLOSED;   // a stop in the same piece is reported next time
+        return stop_ ? STOP : CONTINUE;
+    }
+
+    bool in_block() const { return block_start != std::string::npos; }
+
+    // Flush a partial open tag, and keep an unterminated block as plain text
+    // unless its call already completed
+    void finish() {
+        if (in_block()) {
+            if (state_ != DONE) visible += text.substr(raw_start_);
+            block_start = std::string::npos;
+        } else {
+            visible.append(OPEN, tag_pos_);
+        }
+        tag_pos_ = 0;
+    }
+
+private:
+    enum State {
+        TEXT,      // outside any block
+        AFTER,     // outside, after a block has closed
+        BODY,      // in a block, before the JSON object
+        JSON,      // in the top-level object
+        DONE,      // object closed, waiting for the close tag
+        SKIP,      // malformed body, waiting for the close tag
+    };
+
+    State  state_   = TEXT;
+    size_t tag_pos_ = 0;     // bytes of OPEN (outside) or CLOSE (inside) matched
+    size_t raw_start_ = 0;   // offset of the open tag of the current block
+    bool   stop_    = false;
+
+    // JSON state
+    int         depth_  = 0;
+    bool        in_str_ = false;
+    bool        escape_ = false;
+    bool        want_key_ = true;   // at depth 1: next string is a key
+    std::string key_;               // current key at depth 1
+    std::string str_;               // decoded string being captured
+    bool        capture_ = false;
+    size_t      args_start_ = std::string::npos;
+    Call        call_;
+    bool        has_args_ = false;
+
+    bool stopping() const { return state_ == AFTER && stop_after_calls; }
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    // Returns false when generation should stop
+    bool step(char c, size_t i, bool &closed, std::vector<Call> &completed) {
+        if (state_ == TEXT || state_ == AFTER) return step_outside(c, i);
+
+        if (state_ == JSON && in_str_) {
+            step_string(c);
+            return true;
+        }
+        // Close tag; outside JSON strings '<' can only start one
+        if (tag_pos_ > 0 || c == '<') {
+            if (c == CLOSE[tag_pos_]) {
+                if (++tag_pos_ == strlen(CLOSE)) {
+                    tag_pos_    = 0;
+                    block_start = std::string::npos;
+                    close_end   = i + 1;
+                    state_      = AFTER;
+                    closed      = true;
+                }
+                return true;
+            }
+            tag_pos_ = 0;
+            state_   = SKIP;
+            if (c == '<') tag_pos_ = 1;
+            return true;
+        }
+
+        switch (state_) {
+            case BODY:
+                if (c == '{') begin_object();
+                else if (!is_space(c)) state_ = SKIP;
+                break;
+            case JSON:
+                step_json(c, i, completed);
+                break;
+            case DONE:
+                if (!is_space(c)) state_ = SKIP;
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool step_outside(char c, size_t i) {
+        if (tag_pos_ > 0 || c == '<') {
+            if (c == OPEN[tag_pos_]) {
+                if (tag_pos_++ == 0) raw_start_ = i;
+                if (tag_pos_ == strlen(OPEN)) {
+                    tag_pos_    = 0;
+                    block_start = i + 1;
+                    state_      = BODY;
+                }
+                return true;
+            }
+            // Not a tag after all
+            if (stopping()) return false;
+            visible.append(OPEN, tag_pos_);
+            tag_pos_ = 0;
+            if (c == '<') {
+                raw_start_ = i;
+                tag_pos_   = 1;
+                return true;
+            }
+        }
+        if (stopping()) return is_space(c);
+        visible += c;
+        return true;
+    }
+
+    void begin_object() {
+        state_    = JSON;
+        depth_    = 1;
+        in_str_   = false;
+        escape_   = false;
+        want_key_ = true;
+        key_.clear();
+        args_start_ = std::string::npos;
+        call_     = Call();
+        has_args_ = false;
+    }
+
+    void step_json(char c, size_t i, std::vector<Call> &completed) {
+        switch (c) {
+            case '"':
+                in_str_  = true;
+                capture_ = depth_ == 1 && (want_key_ || key_ == "name");
+                str_.clear();
+                break;
+            case '{':
+            case '[':
+                if (depth_ == 1 && !want_key_ && key_ == "arguments" && c == '{') args_start_ = i;
+                depth_++;
+                break;
+            case '}':
+            case ']':
+                depth_--;
+                if (depth_ == 1 && args_start_ != std::string::npos) {
+                    call_.arguments = text.substr(args_start_, i + 1 - args_start_);
+                    args_start_ = std::string::npos;
+                    has_args_   = true;
+                }
+                if (depth_ == 0) {
+                    state_ = DONE;
+                    if (!call_.name.empty()) {
+                        if (!has_args_) call_.arguments = "{}";
+                        completed.push_back(std::move(call_));
+                    }
+                }
+                break;
+            case ':':
+                if (depth_ == 1) want_key_ = false;
+                break;
+            case ',':
+                if (depth_ == 1) {
+                    want_key_ = true;
+                    key_.clear();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void step_string(char c) {
+        if (escape_) {
+            escape_ = false;
+            if (capture_) {
+                switch (c) {
+                    case 'n': str_ += '\n'; break;
+                    case 't': str_ += '\t'; break;
+                    case 'r': str_ += '\r'; break;
+                    case 'b': str_ += '\b'; break;
+                    case 'f': str_ += '\f'; break;
+                    case 'u': str_ += "\\u"; break; // kept verbatim, digits follow
+                    default:  str_ += c;    break; // \" \\ \/
+                }
+            }
+            return;
+        }
+        if (c == '\\') {
+            escape_ = true;
+            return;
+        }
+        if (c != '"') {
+            if (capture_) str_ += c;
+            return;
+        }
+        in_str_ = false;
+        if (!capture_) return;
+        if (want_key_) key_ = str_;
+        else if (key_ == "name") call_.name = str_;
+    }
+};
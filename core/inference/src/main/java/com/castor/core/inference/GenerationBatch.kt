@@ -0,0 +1,107 @@
+package com.castor.core.inference
+
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CompletableDeferred
+import kotlin.coroutines.AbstractCoroutineContextElement
+import kotlin.coroutines.CoroutineContext
+
+/**
+ * One generation of an [InferenceEngine.generateBatch] call.
+ */
+data class GenerationRequest(
+    val prompt: String,
+    val systemPrompt: String = "",
+    val maxTokens: Int = 512,
+    val temperature: Float = 0.7f
+)
+
+/**
+ * Collects the one-shot generations of concurrent tasks, such as the ready
+ * steps of a TaskPipeline, and submits them to [engine] together as one
+ * [InferenceEngine.generateBatch] call.
+ *
+ * Each task is a participant. Participants are counted up front: [participants]
+ * when the batch is created, plus the `handoff` of [participate] for tasks that
+ * become ready when another one finishes. A [InferenceEngine.generate] call
+ * without stop strings made inside [participate] is held until every counted
+ * participant is either waiting for a generation or done. The held requests
+ * then run as one batch, which costs about as much as the longest of them.
+ *
+ * Install the batch in the participants' coroutine context; the engines look
+ * it up with `coroutineContext[GenerationBatch]`.
+ */
+class GenerationBatch(
+    private val engine: InferenceEngine,
+    participants: Int
+) : AbstractCoroutineContextElement(GenerationBatch) {
+
+    companion object Key : CoroutineContext.Key<GenerationBatch>
+
+    private class Pending(val request: GenerationRequest) {
+        val result = CompletableDeferred<String>()
+    }
+
+    private val lock = Any()
+
+    /** Counted participants that are neither waiting for a generation nor done. */
+    private var running = participants
+    private var flushing = false
+    private val pending = ArrayList<Pending>()
+
+    /**
+     * Run one counted participant's [block]. When it finishes, [handoff] new
+     * participants (e.g. the tasks that depend on it) are counted in its place.
+     */
+    suspend fun <T> participate(handoff: Int = 0, block: suspend () -> T): T {
+        try {
+            return block()
+        } finally {
+            val ready = synchronized(lock) {
+                running += handoff - 1
+                takeReady()
+            }
+            if (ready != null) flush(ready)
+        }
+    }
+
+    /** Hold [request] for the next batch and return its result. */
+    suspend fun generate(request: GenerationRequest): String {
+        val queued = Pending(request)
+        val ready = synchronized(lock) {
+            pending += queued
+            running--
+            takeReady()
+        }
+        if (ready != null) flush(ready)
+        return queued.result.await()
+    }
+
+    /** The held requests, once no participant can add to them (caller holds [lock]). */
+    private fun takeReady(): List<Pending>? {
+        if (running > 0 || flushing || pending.isEmpty()) return null
+        flushing = true
+        return ArrayList(pending).also { pending.clear() }
+    }
+
+    /** Run [batch]; a failure is delivered to the participants that waited for it. */
+    private suspend fun flush(batch: List<Pending>) {
+        val outputs = try {
+            engine.generateBatch(batch.map { it.request })
+        } catch (e: Throwable) {
+            finishFlush(batch)
+            batch.forEach { it.result.completeExceptionally(e) }
+            if (e is CancellationException) throw e
+            return
+        }
+        finishFlush(batch)
+        batch.forEachIndexed { i, queued -> queued.result.complete(outputs[i]) }
+    }
+
+    /** The flushed participants run again (they may hold new requests back). */
+    private fun finishFlush(batch: List<Pending>) {
+        synchronized(lock) {
+            flushing = false
+            running += batch.size
+        }
+    }
+}
@@ -21,6 +21,7 @@ import com.castor.core.inference.prompt.PromptFormat
  * @param topP Nucleus sampling threshold (smaller = more focused)
  * @param topK Top-K sampling limit (smaller = more focused)
  * @param flashAttention Whether to enable flash attention (supported by Qwen2.5)
+ * @param kvCacheType Element type of the KV cache; quantized types only apply with [flashAttention]
  */
 data class InferenceConfig(
     val modelPath: String,
@@ -34,5 +35,22 @@ data class InferenceConfig(
     val repeatPenalty: Float = 1.1f,
     val topP: Float = 0.9f,
     val topK: Int = 40,
-    val flashAttention: Boolean = true
+    val flashAttention: Boolean = true,
+    val kvCacheType: KvCacheType = KvCacheType.F16
 )
+
+/**
+ * Element type of the KV cache. Quantized caches hold a longer context in
+ * the same memory at a small cost in accuracy.
+ *
+ * @param ggmlType The matching `ggml_type` value passed to llama.cpp
+ */
+enum class KvCacheType(val ggmlType: Int) {
+    F16(1),
+    Q8_0(8),
+    Q4_0(2);
+
+    companion object {
+        fun fromGgmlType(type: Int): KvCacheType = entries.firstOrNull { it.ggmlType == type } ?: F16
+    }
+}
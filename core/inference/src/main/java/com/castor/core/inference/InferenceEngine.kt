@@ -1,5 +1,8 @@
 package com.castor.core.inference
 
+import com.castor.core.inference.prompt.ConversationTurn
+import com.castor.core.inference.tool.ToolCall
+import com.castor.core.inference.tool.ToolCallGrammar
 import kotlinx.coroutines.flow.Flow
 
 interface InferenceEngine {
@@ -9,18 +12,41 @@ interface InferenceEngine {
     suspend fun loadModel(modelPath: String)
     suspend fun unloadModel()
 
+    /**
+     * Generate a response to [prompt].
+     *
+     * Generation ends early at the first occurrence of any [stop] string; the
+     * stop string and anything after it are not part of the result. Structured
+     * output callers use this to avoid decoding text they would discard.
+     */
     suspend fun generate(
         prompt: String,
         systemPrompt: String = "",
         maxTokens: Int = 512,
-        temperature: Float = 0.7f
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
     ): String
 
+    /**
+     * Generate responses to several independent [requests] together. Engines
+     * that can decode them as one batch advance all of them with every decode
+     * step, so the call costs about as much as the longest generation instead
+     * of the sum. See [GenerationBatch] for batching concurrent callers.
+     *
+     * @return One response per request, in the order of [requests]
+     */
+    suspend fun generateBatch(requests: List<GenerationRequest>): List<String>
+
+    /**
+     * Stream a response to [prompt]. With [stop], text that may be the start
+     * of a stop string is held back until it is known not to be one.
+     */
     fun generateStream(
         prompt: String,
         systemPrompt: String = "",
         maxTokens: Int = 512,
-        temperature: Float = 0.7f
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
     ): Flow<String>
 
     /**
@@ -34,14 +60,76 @@ interface InferenceEngine {
      * @param formattedPrompt The fully formatted prompt string (with special tokens)
      * @param maxTokens Maximum tokens to generate
      * @param temperature Sampling temperature
+     * @param stop Strings that end generation; trimmed from the result
      * @return The generated text
      */
     suspend fun generateRaw(
         formattedPrompt: String,
         maxTokens: Int = 512,
-        temperature: Float = 0.7f
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
+    ): String
+
+    /**
+     * Generate a response from structured conversation turns.
+     *
+     * Unlike [generateRaw], the engine renders the turns itself using the loaded
+     * model's own chat template, so callers do not need to know the prompt format.
+     * Turns with role "tool" carry a tool result and are wrapped by the template.
+     *
+     * When [onToolCall] is given, engines that decode incrementally report each
+     * `<tool_call>` block as soon as it closes and stop generating once the model
+     * moves on from its tool calls. The returned text then ends at the last block.
+     * A [toolGrammar] constrains those blocks to the registered tool schemas.
+     *
+     * @param turns The ordered conversation (system, user, assistant, tool)
+     * @param maxTokens Maximum tokens to generate
+     * @param temperature Sampling temperature
+     * @param onToolCall Receives each tool call while generation is still running
+     * @param toolGrammar Grammar for `<tool_call>` blocks, or null for unconstrained output
+     * @return The generated assistant text
+     */
+    suspend fun generateChat(
+        turns: List<ConversationTurn>,
+        maxTokens: Int = 512,
+        temperature: Float = 0.7f,
+        onToolCall: ((ToolCall) -> Unit)? = null,
+        toolGrammar: ToolCallGrammar? = null
     ): String
 
+    /**
+     * Generate for background work, such as a rolling conversation summary,
+     * without disturbing the conversation the engine keeps cached for the
+     * next [generateChat]. Any other request preempts it.
+     *
+     * @return The generated text, or null when it was preempted or could not run
+     */
+    suspend fun generateBackground(
+        prompt: String,
+        systemPrompt: String = "",
+        maxTokens: Int = 512,
+        temperature: Float = 0.7f
+    ): String?
+
+    /**
+     * Score a fixed set of candidate answers instead of sampling one.
+     *
+     * The prompt is prefilled once and each label's log-likelihood as the
+     * start of the assistant reply is computed in a single extra forward pass,
+     * with no sampling loop. Returns a probability distribution aligned with
+     * [labels], usable directly as a confidence score.
+     *
+     * @param prompt The user input to classify
+     * @param labels Candidate answers, e.g. intent names
+     * @param systemPrompt Instructions describing the labels
+     * @return Probabilities summing to 1, in the order of [labels]
+     */
+    suspend fun scoreCandidates(
+        prompt: String,
+        labels: List<String>,
+        systemPrompt: String = ""
+    ): List<Float>
+
     suspend fun tokenize(text: String): List<Int>
     suspend fun getTokenCount(text: String): Int
 }
@@ -1,13 +1,24 @@
 package com.castor.core.inference
 
 import android.content.Context
+import com.castor.core.inference.gguf.GgufInfo
+import com.castor.core.inference.gguf.ModelIndex
 import com.castor.core.inference.llama.LlamaCppEngine
+import com.castor.core.inference.llama.NativeMemoryStats
+import com.castor.core.inference.memory.MemoryPlanner
 import com.castor.core.inference.prompt.ModelFamily
 import com.castor.core.inference.prompt.PromptFormat
 import com.castor.core.inference.prompt.PromptFormatter
+import com.castor.core.inference.telemetry.RequestTelemetry
+import com.castor.core.inference.telemetry.TelemetrySnapshot
 import dagger.hilt.android.qualifiers.ApplicationContext
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.launch
 import java.io.File
 import javax.inject.Inject
 import javax.inject.Singleton
@@ -17,6 +28,8 @@ import javax.inject.Singleton
  *
  * Provides human-readable information for the model selection UI,
  * including the detected model family, prompt format, and file size.
+ * Family, format, quantization and size come from the GGUF header when it
+ * could be read ([gguf]), and from the filename otherwise.
  *
  * @param file The GGUF file on device
  * @param name Human-readable model name derived from the filename
@@ -25,6 +38,7 @@ import javax.inject.Singleton
  * @param fileSizeBytes File size in bytes
  * @param quantization Detected quantization level (e.g. "Q4_K_M")
  * @param parameterCount Detected parameter count (e.g. "3B") or null if unknown
+ * @param gguf Facts read from the GGUF header, or null if it could not be read
  */
 data class LocalModelInfo(
     val file: File,
@@ -33,8 +47,15 @@ data class LocalModelInfo(
     val promptFormat: PromptFormat,
     val fileSizeBytes: Long,
     val quantization: String?,
-    val parameterCount: String?
-)
+    val parameterCount: String?,
+    val gguf: GgufInfo? = null
+) {
+    /** Parameter count in billions: exact from the header, else parsed from [parameterCount]; 0 if unknown. */
+    val parameterBillions: Double
+        get() = gguf?.takeIf { it.parameterCount > 0 }?.let { it.parameterCount / 1e9 }
+            ?: parameterCount?.uppercase()?.removeSuffix("B")?.trim()?.toDoubleOrNull()
+            ?: 0.0
+}
 
 /**
  * Manages on-device GGUF model files: discovery, loading, and metadata.
@@ -48,11 +69,52 @@ data class LocalModelInfo(
 @Singleton
 class ModelManager @Inject constructor(
     @ApplicationContext private val context: Context,
-    private val engine: LlamaCppEngine
+    private val engine: LlamaCppEngine,
+    private val modelIndex: ModelIndex,
+    private val memoryPlanner: MemoryPlanner
 ) {
     private val _modelState = MutableStateFlow<ModelState>(ModelState.NotLoaded)
     val modelState: StateFlow<ModelState> = _modelState
 
+    private val scope = CoroutineScope(SupervisorJob() + Dispatchers.Default)
+
+    private val telemetry = RequestTelemetry()
+    private val _requestTelemetry = MutableStateFlow(TelemetrySnapshot())
+
+    /**
+     * Rolling latency and throughput histograms of the requests served by
+     * the loaded model (queue wait, prefill, decode, sampler, callbacks).
+     * Reset whenever a model is loaded.
+     */
+    val requestTelemetry: StateFlow<TelemetrySnapshot> = _requestTelemetry.asStateFlow()
+
+    private val _memoryStats = MutableStateFlow<NativeMemoryStats?>(null)
+    @Volatile private var memoryStatsAt = 0L
+
+    /**
+     * Native memory of the loaded model (weights mapped versus anonymous,
+     * KV cache, compute buffers, request peak), refreshed after loads and at
+     * most every [MEMORY_REFRESH_MS] as requests complete.
+     */
+    val memoryStats: StateFlow<NativeMemoryStats?> = _memoryStats.asStateFlow()
+
+    init {
+        scope.launch {
+            engine.requestStats.collect { stats ->
+                _requestTelemetry.value = telemetry.record(stats)
+                if (System.currentTimeMillis() - memoryStatsAt >= MEMORY_REFRESH_MS) refreshMemoryStats()
+            }
+        }
+    }
+
+    private suspend fun refreshMemoryStats(): NativeMemoryStats? {
+        memoryStatsAt = System.currentTimeMillis()
+        val stats = engine.memoryStats()
+        _memoryStats.value = stats
+        if (stats != null) memoryPlanner.observe(stats)
+        return stats
+    }
+
     val modelsDir: File get() = File(context.filesDir, "models").apply { mkdirs() }
 
     /**
@@ -64,12 +126,14 @@ class ModelManager @Inject constructor(
     /**
      * Get detailed metadata for all available local models.
      *
-     * Metadata is derived from the filename using heuristic parsing.
+     * Metadata is read from each file's GGUF header through [ModelIndex], so
+     * unchanged files cost only a stat; filename heuristics fill the gaps.
      * Models are sorted with Qwen2.5 models first, then by file size descending.
      */
     fun getAvailableModelInfo(): List<LocalModelInfo> {
-        return getAvailableModels().map { file ->
-            buildModelInfo(file)
+        val headers = modelIndex.infoFor(getAvailableModels())
+        return headers.map { (file, gguf) ->
+            buildModelInfo(file, gguf)
         }.sortedWith(
             compareByDescending<LocalModelInfo> { it.family == ModelFamily.QWEN25 }
                 .thenByDescending { it.fileSizeBytes }
@@ -83,7 +147,7 @@ class ModelManager @Inject constructor(
         val state = _modelState.value
         if (state !is ModelState.Loaded) return null
         val file = File(modelsDir, state.modelName)
-        return if (file.exists()) buildModelInfo(file) else null
+        return if (file.exists()) buildModelInfo(file, modelIndex.info(file)) else null
     }
 
     /**
@@ -92,13 +156,57 @@ class ModelManager @Inject constructor(
     suspend fun loadModel(modelFile: File) {
         _modelState.value = ModelState.Loading(modelFile.name)
         try {
-            engine.loadModel(modelFile.absolutePath)
+            loadPlanned(modelFile)
             _modelState.value = ModelState.Loaded(modelFile.name)
         } catch (e: Exception) {
             _modelState.value = ModelState.Error(e.message ?: "Failed to load model")
         }
     }
 
+    /**
+     * Load [modelFile] into the engine with
+     * the context size and KV cache type [MemoryPlanner] predicts will fit,
+     * and report the predicted against the measured resident set. Does not
+     * touch [modelState]; used by [loadModel] and for tier swaps.
+     *
+     * @param draft Model the caller will attach as a speculative draft; the
+     *   plan leaves room for it, or for the model alone when both do not fit
+     * @return Whether the plan left room for [draft] (true without a plan,
+     *   in which case [draftFits] decides); false means do not load it
+     * @throws RuntimeException if the engine fails to load the model
+     */
+    suspend fun loadPlanned(modelFile: File, draft: File? = null): Boolean {
+        // Plan against the memory the current model leaves behind
+        if (engine.isLoaded) engine.unloadModel()
+
+        telemetry.reset(modelFile.name)
+        _requestTelemetry.value = telemetry.snapshot()
+        _memoryStats.value = null
+
+        val defaults = engine.defaultConfigFor(modelFile.absolutePath)
+        var plan = memoryPlanner.plan(modelFile, defaults.flashAttention, draft)
+        if (plan == null) {
+            engine.loadModelWithConfig(defaults)
+            refreshMemoryStats()
+            return true
+        }
+        // Without room for both, plan for the model alone and skip the draft
+        val roomForDraft = draft != null && plan.fits
+        if (draft != null && !plan.fits) plan = memoryPlanner.plan(modelFile, defaults.flashAttention) ?: plan
+
+        val before = memoryPlanner.residentSet()
+        engine.loadModelWithConfig(defaults.copy(contextSize = plan.contextSize, kvCacheType = plan.kvCacheType))
+        val after = memoryPlanner.residentSet()
+        memoryPlanner.report(modelFile.name, plan, before, after, refreshMemoryStats())
+        return roomForDraft
+    }
+
+    /**
+     * Whether [draft] still fits next to the loaded model, at its context
+     * size, in the memory available now.
+     */
+    fun draftFits(draft: File): Boolean = memoryPlanner.draftFits(draft, engine.contextSize)
+
     /**
      * Load the best available model, preferring Qwen2.5 models.
      *
@@ -120,11 +228,12 @@ class ModelManager @Inject constructor(
             return
         }
 
-        // Prefer Qwen2.5 3B, then Qwen2.5 1.5B, then any Qwen2.5, then any model
+        // Prefer Qwen2.5 3B, then Qwen2.5 1.5B, then any Qwen2.5, then any model.
+        // Sizes are ranges since header counts are exact (3.09B, 1.54B).
         val preferred = models.firstOrNull {
-            it.family == ModelFamily.QWEN25 && it.parameterCount == "3B"
+            it.family == ModelFamily.QWEN25 && it.parameterBillions in 2.5..3.5
         } ?: models.firstOrNull {
-            it.family == ModelFamily.QWEN25 && it.parameterCount == "1.5B"
+            it.family == ModelFamily.QWEN25 && it.parameterBillions in 1.2..2.0
         } ?: models.firstOrNull {
             it.family == ModelFamily.QWEN25
         } ?: models.first()
@@ -137,35 +246,38 @@ class ModelManager @Inject constructor(
      */
     suspend fun unloadModel() {
         engine.unloadModel()
+        _memoryStats.value = null
         _modelState.value = ModelState.NotLoaded
     }
 
     /**
-     * Build model metadata from a GGUF filename using heuristic parsing.
+     * Build model metadata from the GGUF header facts in [gguf] where present,
+     * falling back to heuristic parsing of the filename.
      *
      * Parses common naming conventions like:
      * - `qwen2.5-3b-instruct-q4_k_m.gguf`
      * - `Phi-3-mini-4k-instruct-q4.gguf`
      * - `Meta-Llama-3-8B-Instruct-Q5_K_M.gguf`
      */
-    private fun buildModelInfo(file: File): LocalModelInfo {
+    private fun buildModelInfo(file: File, gguf: GgufInfo?): LocalModelInfo {
         val filename = file.nameWithoutExtension
         val lower = filename.lowercase()
-        val family = PromptFormatter.detectFamilyFromFilename(filename)
-        val promptFormat = PromptFormatter.detectFromFilename(filename)
+        val family = gguf?.family?.takeIf { it != ModelFamily.GENERIC }
+            ?: PromptFormatter.detectFamilyFromFilename(filename)
+        val promptFormat = gguf?.promptFormat ?: PromptFormatter.detectFromFilename(filename)
 
         // Extract quantization from filename (e.g. "q4_k_m", "q5_0", "q8_0")
         val quantRegex = Regex("""[qQ](\d+)([_-][kK]_?[mMsSlL])?""")
         val quantMatch = quantRegex.find(lower)
-        val quantization = quantMatch?.value?.uppercase()
+        val quantization = gguf?.fileType ?: quantMatch?.value?.uppercase()
 
         // Extract parameter count (e.g. "3b", "1.5b", "7b")
         val paramRegex = Regex("""(\d+\.?\d*)[bB]""")
         val paramMatch = paramRegex.find(lower)
-        val parameterCount = paramMatch?.let {
+        val parameterCount = gguf?.sizeLabel ?: paramMatch?.let {
             val num = it.groupValues[1]
             "${num}B"
-        }
+        } ?: gguf?.takeIf { it.parameterCount > 0 }?.parameterLabel
 
         // Build a clean display name
         val displayName = when (family) {
@@ -183,7 +295,8 @@ class ModelManager @Inject constructor(
             promptFormat = promptFormat,
             fileSizeBytes = file.length(),
             quantization = quantization,
-            parameterCount = parameterCount
+            parameterCount = parameterCount,
+            gguf = gguf
         )
     }
 
@@ -191,6 +304,9 @@ class ModelManager @Inject constructor(
      * Format a byte count into a human-readable string (e.g. "2.1 GB").
      */
     companion object {
+        /** Minimum interval between native memory reads driven by requests. */
+        private const val MEMORY_REFRESH_MS = 1_000L
+
         fun formatFileSize(bytes: Long): String {
             return when {
                 bytes >= 1_073_741_824L -> "%.1f GB".format(bytes / 1_073_741_824.0)
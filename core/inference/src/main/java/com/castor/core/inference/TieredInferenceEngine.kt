@@ -2,6 +2,10 @@ package com.castor.core.inference
 
 import android.util.Log
 import com.castor.core.inference.llama.LlamaCppEngine
+import com.castor.core.inference.prompt.ConversationTurn
+import com.castor.core.inference.tool.ToolCall
+import com.castor.core.inference.tool.ToolCallGrammar
+import kotlinx.coroutines.currentCoroutineContext
 import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.flow
 import javax.inject.Inject
@@ -82,15 +86,19 @@ class TieredInferenceEngine @Inject constructor(
      * Generate a response with automatic tiered model routing.
      *
      * Flow:
-     * 1. The [TieredModelRouter] classifies the prompt's complexity.
-     * 2. The router selects the appropriate tier (FAST or COMPLEX).
-     * 3. The router ensures the correct model is loaded (swapping if needed).
-     * 4. The underlying [LlamaCppEngine] performs the actual generation.
+     * 1. The [TieredModelRouter] selects a tier (FAST or COMPLEX): with both tiers
+     *    available the FAST model answers first and low-confidence answers are
+     *    escalated to COMPLEX; otherwise the prompt's complexity decides.
+     * 2. The router ensures the correct model is loaded (swapping if needed).
+     * 3. The underlying [LlamaCppEngine] performs the actual generation.
      *
      * If the router cannot load any model (e.g. no models on device), this
      * falls back to calling the engine directly, which will throw an
      * [IllegalStateException] if no model is loaded.
      *
+     * Inside a [GenerationBatch] a call without stop strings joins the batch
+     * instead and is routed with it by [generateBatch].
+     *
      * @param prompt The user's input prompt
      * @param systemPrompt Optional system-level instructions
      * @param maxTokens Maximum number of tokens to generate
@@ -101,8 +109,13 @@ class TieredInferenceEngine @Inject constructor(
         prompt: String,
         systemPrompt: String,
         maxTokens: Int,
-        temperature: Float
+        temperature: Float,
+        stop: List<String>
     ): String {
+        val batch = currentCoroutineContext()[GenerationBatch]
+        if (batch != null && stop.isEmpty()) {
+            return batch.generate(GenerationRequest(prompt, systemPrompt, maxTokens, temperature))
+        }
         return try {
             // Let the router handle complexity classification, tier selection,
             // model loading, and generation
@@ -110,7 +123,8 @@ class TieredInferenceEngine @Inject constructor(
                 prompt = prompt,
                 systemPrompt = systemPrompt,
                 maxTokens = maxTokens,
-                temperature = temperature
+                temperature = temperature,
+                stop = stop
             )
         } catch (e: IllegalStateException) {
             // Router could not find any models — fall through to engine
@@ -120,9 +134,27 @@ class TieredInferenceEngine @Inject constructor(
                 prompt = prompt,
                 systemPrompt = systemPrompt,
                 maxTokens = maxTokens,
-                temperature = temperature
+                temperature = temperature,
+                stop = stop
+            )
+        }
+    }
+
+    /**
+     * Generate a batch on one model: the tier of the most complex prompt. The
+     * requests share every decode step, so they cannot be split across tiers,
+     * and the confidence cascade does not apply.
+     */
+    override suspend fun generateBatch(requests: List<GenerationRequest>): List<String> {
+        if (requests.isEmpty()) return emptyList()
+        try {
+            router.ensureModelForTier(
+                requests.maxOf { router.selectTier(router.classifyComplexity(it.prompt)) }
             )
+        } catch (e: IllegalStateException) {
+            Log.w(TAG, "Router failed to prepare model for batch, using current: ${e.message}")
         }
+        return llamaEngine.generateBatch(requests)
     }
 
     /**
@@ -142,7 +174,8 @@ class TieredInferenceEngine @Inject constructor(
         prompt: String,
         systemPrompt: String,
         maxTokens: Int,
-        temperature: Float
+        temperature: Float,
+        stop: List<String>
     ): Flow<String> = flow {
         // Route and prepare the model before streaming starts.
         // This is a suspend call wrapped in a flow builder so that the caller
@@ -160,7 +193,8 @@ class TieredInferenceEngine @Inject constructor(
             prompt = prompt,
             systemPrompt = systemPrompt,
             maxTokens = maxTokens,
-            temperature = temperature
+            temperature = temperature,
+            stop = stop
         ).collect { token ->
             emit(token)
         }
@@ -178,9 +212,50 @@ class TieredInferenceEngine @Inject constructor(
     override suspend fun generateRaw(
         formattedPrompt: String,
         maxTokens: Int,
-        temperature: Float
+        temperature: Float,
+        stop: List<String>
+    ): String {
+        return llamaEngine.generateRaw(formattedPrompt, maxTokens, temperature, stop)
+    }
+
+    /**
+     * Generate from structured turns using the loaded model's chat template.
+     * Bypasses tiered routing like [generateRaw]: the AgentLoop keeps one model
+     * for the whole multi-turn exchange.
+     */
+    override suspend fun generateChat(
+        turns: List<ConversationTurn>,
+        maxTokens: Int,
+        temperature: Float,
+        onToolCall: ((ToolCall) -> Unit)?,
+        toolGrammar: ToolCallGrammar?
     ): String {
-        return llamaEngine.generateRaw(formattedPrompt, maxTokens, temperature)
+        return llamaEngine.generateChat(turns, maxTokens, temperature, onToolCall, toolGrammar)
+    }
+
+    /**
+     * Background generation on whichever model is loaded. Skips tier routing so
+     * it never swaps out the model the conversation is using.
+     */
+    override suspend fun generateBackground(
+        prompt: String,
+        systemPrompt: String,
+        maxTokens: Int,
+        temperature: Float
+    ): String? {
+        return llamaEngine.generateBackground(prompt, systemPrompt, maxTokens, temperature)
+    }
+
+    /**
+     * Score labels with whichever model is loaded. Like [generateRaw] this skips
+     * tier routing: classification happens before the request's tier is known.
+     */
+    override suspend fun scoreCandidates(
+        prompt: String,
+        labels: List<String>,
+        systemPrompt: String
+    ): List<Float> {
+        return llamaEngine.scoreCandidates(prompt, labels, systemPrompt)
     }
 
     // -------------------------------------------------------------------------------------
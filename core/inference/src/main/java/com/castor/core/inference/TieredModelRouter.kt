@@ -1,6 +1,12 @@
 package com.castor.core.inference
 
 import android.util.Log
+import com.castor.core.inference.cascade.CascadeLog
+import com.castor.core.inference.cascade.CascadeRecord
+import com.castor.core.inference.cascade.CascadeTuner
+import com.castor.core.inference.keyword.KeywordEntry
+import com.castor.core.inference.keyword.KeywordMatch
+import com.castor.core.inference.keyword.KeywordMatcher
 import com.castor.core.inference.llama.LlamaCppEngine
 import com.castor.core.inference.prompt.ModelFamily
 import kotlinx.coroutines.flow.MutableStateFlow
@@ -8,6 +14,7 @@ import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
 import kotlinx.coroutines.sync.Mutex
 import kotlinx.coroutines.sync.withLock
+import java.io.File
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -50,16 +57,25 @@ enum class TaskComplexity {
  * for lower latency, while complex tasks use the larger model for higher quality.
  * If only one model is available on-device, it serves both tiers.
  *
- * Complexity classification uses keyword heuristics and input length — no LLM call
- * is needed to decide which model to invoke. This avoids circular dependencies and
- * keeps routing latency near zero.
+ * When both tiers have distinct models, [routeAndGenerate] runs a cascade instead.
+ * The complex model stays loaded with the fast model attached as its speculative
+ * draft, so neither is swapped out: the draft answers first, and the complex model
+ * answers in place only when the draft's confidence score (geometric mean token
+ * probability) falls below [cascadeThreshold]. The escalated generation reuses the
+ * draft's decoded prompt and starts from its answer as the speculative draft.
+ * [CascadeTuner] tunes the threshold offline.
+ *
+ * Otherwise, and for streaming, complexity classification uses keyword heuristics
+ * and input length — no LLM call is needed to decide which model to invoke.
  *
  * All model loading and inference happens on-device. No data leaves the phone.
  */
 @Singleton
 class TieredModelRouter @Inject constructor(
     private val modelManager: ModelManager,
-    private val engine: LlamaCppEngine
+    private val engine: LlamaCppEngine,
+    private val cascadeLog: CascadeLog,
+    private val keywordMatcher: KeywordMatcher
 ) {
 
     companion object {
@@ -77,6 +93,12 @@ class TieredModelRouter @Inject constructor(
          */
         private const val COMPLEX_MODEL_PARAM_THRESHOLD = 5.0
 
+        /** Default FAST confidence score below which the cascade escalates. */
+        const val DEFAULT_CASCADE_THRESHOLD = 0.6f
+
+        /** [KeywordMatcher] dictionary of the keyword lists below. */
+        private const val COMPLEXITY_DICTIONARY = "complexity"
+
         // ---------------------------------------------------------------------------------
         // Keyword lists for heuristic complexity classification
         // ---------------------------------------------------------------------------------
@@ -115,7 +137,7 @@ class TieredModelRouter @Inject constructor(
             "what is", "what are", "define"
         )
 
-        /** Keywords that signal a SIMPLE task (checked first for fast-path). */
+        /** Keywords that signal a SIMPLE task (also the long-input fast-path). */
         private val SIMPLE_KEYWORDS = listOf(
             "play", "pause", "stop", "skip", "next", "previous",
             "volume", "mute", "unmute",
@@ -142,6 +164,22 @@ class TieredModelRouter @Inject constructor(
     /** Mutex to serialize model loading operations (only one load at a time). */
     private val loadMutex = Mutex()
 
+    /** COMPLEX model whose draft was rejected (incompatible vocabulary); not retried. */
+    private var draftRejectedFor: File? = null
+
+    /**
+     * When true and both tiers have distinct models, the FAST model is loaded
+     * alongside the COMPLEX model as a draft for speculative decoding. Takes
+     * effect on the next COMPLEX model load.
+     */
+    @Volatile var speculativeDecodingEnabled: Boolean = true
+
+    /** Whether [routeAndGenerate] cascades FAST -> COMPLEX when both tiers exist. */
+    @Volatile var cascadeEnabled: Boolean = true
+
+    /** FAST confidence score below which the cascade escalates to COMPLEX. */
+    @Volatile var cascadeThreshold: Float = DEFAULT_CASCADE_THRESHOLD
+
     private val _currentTier = MutableStateFlow<ModelTier?>(null)
 
     /**
@@ -159,6 +197,16 @@ class TieredModelRouter @Inject constructor(
      */
     val availableTiers: StateFlow<Map<ModelTier, LocalModelInfo?>> = _availableTiers.asStateFlow()
 
+    init {
+        // Weights encode the rule order of [classifyComplexity]: COMPLEX beats MODERATE beats SIMPLE
+        keywordMatcher.register(
+            COMPLEXITY_DICTIONARY,
+            COMPLEX_KEYWORDS.map { KeywordEntry(it, TaskComplexity.COMPLEX.name, 3f) } +
+                MODERATE_KEYWORDS.map { KeywordEntry(it, TaskComplexity.MODERATE.name, 2f) } +
+                SIMPLE_KEYWORDS.map { KeywordEntry(it, TaskComplexity.SIMPLE.name, 1f) }
+        )
+    }
+
     // -------------------------------------------------------------------------------------
     // Public API
     // -------------------------------------------------------------------------------------
@@ -190,36 +238,27 @@ class TieredModelRouter @Inject constructor(
      * 5. Default -> [TaskComplexity.SIMPLE]
      */
     fun classifyComplexity(input: String): TaskComplexity {
-        val lowered = input.lowercase().trim()
+        val trimmed = input.trim()
+        val matches = keywordMatcher.match(trimmed)
 
         // Rule 1: Long inputs are likely complex
-        if (lowered.length > LONG_INPUT_THRESHOLD) {
+        if (trimmed.length > LONG_INPUT_THRESHOLD) {
             // Even long inputs can be simple if they match simple keywords exactly at the start
-            val startsSimple = SIMPLE_KEYWORDS.any { keyword ->
-                lowered.startsWith(keyword)
+            val startsSimple = matches.of(COMPLEXITY_DICTIONARY).any { match ->
+                match.start == 0 && match.category == TaskComplexity.SIMPLE.name
             }
             if (!startsSimple) {
-                Log.d(TAG, "Classified as COMPLEX (length=${lowered.length})")
+                Log.d(TAG, "Classified as COMPLEX (length=${trimmed.length})")
                 return TaskComplexity.COMPLEX
             }
         }
 
-        // Rule 2: Check for COMPLEX keywords (word-boundary matching)
-        if (COMPLEX_KEYWORDS.any { keyword -> containsWord(lowered, keyword) }) {
-            Log.d(TAG, "Classified as COMPLEX (keyword match)")
-            return TaskComplexity.COMPLEX
-        }
-
-        // Rule 3: Check for MODERATE keywords
-        if (MODERATE_KEYWORDS.any { keyword -> containsWord(lowered, keyword) }) {
-            Log.d(TAG, "Classified as MODERATE (keyword match)")
-            return TaskComplexity.MODERATE
-        }
-
-        // Rule 4: Check for SIMPLE keywords (explicit confirmation)
-        if (SIMPLE_KEYWORDS.any { keyword -> containsWord(lowered, keyword) }) {
-            Log.d(TAG, "Classified as SIMPLE (keyword match)")
-            return TaskComplexity.SIMPLE
+        // Rules 2-4: the highest-priority keyword found (word-boundary matching)
+        val best = matches.best(COMPLEXITY_DICTIONARY, ::isKeywordHit)
+        if (best != null) {
+            val complexity = TaskComplexity.valueOf(best.category)
+            Log.d(TAG, "Classified as $complexity (keyword match)")
+            return complexity
         }
 
         // Rule 5: Default to SIMPLE for unrecognized short inputs
@@ -278,22 +317,32 @@ class TieredModelRouter @Inject constructor(
             // Already loaded — just update the tier state
             _currentTier.value = tier
             Log.d(TAG, "Model $targetFileName already loaded for tier $tier")
+            if (tier == ModelTier.COMPLEX && engine.draftModelName == null) loadDraftModel(targetModel)
             return@withLock
         }
 
-        // Need to swap models
+        // Need to swap models; the plan reserves room for the draft the COMPLEX tier gets
         Log.d(TAG, "Loading model $targetFileName for tier $tier")
-        if (engine.isLoaded) {
-            engine.unloadModel()
-        }
-        engine.loadModel(targetModel.file.absolutePath)
+        val draft = if (tier == ModelTier.COMPLEX) draftFor(targetModel) else null
+        val roomForDraft = modelManager.loadPlanned(targetModel.file, draft?.file)
         _currentTier.value = tier
         Log.d(TAG, "Model $targetFileName loaded successfully for tier $tier")
+
+        if (draft != null) {
+            if (roomForDraft) loadDraftModel(targetModel)
+            else Log.w(TAG, "No memory for draft ${draft.name} next to ${targetModel.name}; decoding without it")
+        }
     }
 
     /**
-     * End-to-end convenience method: classify input, select tier, ensure the right
-     * model is loaded, and generate a response.
+     * End-to-end convenience method: select a tier, ensure the right model is
+     * loaded, and generate a response.
+     *
+     * When both tiers have distinct models this runs the confidence cascade:
+     * the FAST model answers first as the COMPLEX model's draft, and the same
+     * prompt is re-run on the COMPLEX model only if the FAST answer scores below
+     * [cascadeThreshold]. Otherwise, or when the FAST model cannot be attached
+     * as a draft, the tier is chosen by [classifyComplexity].
      *
      * This is the primary entry point for code that wants tiered inference without
      * manually managing model loading. The [AgentOrchestrator] or UI layer can call
@@ -303,55 +352,28 @@ class TieredModelRouter @Inject constructor(
      * @param systemPrompt Optional system-level instructions
      * @param maxTokens Maximum number of tokens to generate
      * @param temperature Sampling temperature (higher = more creative)
+     * @param stop Strings that end generation; trimmed from the result
      * @return The generated response text
      */
     suspend fun routeAndGenerate(
         prompt: String,
         systemPrompt: String = "",
         maxTokens: Int = 512,
-        temperature: Float = 0.7f
-    ): String {
-        val complexity = classifyComplexity(prompt)
-        val tier = selectTier(complexity)
-
-        Log.d(TAG, "Routing: complexity=$complexity, tier=$tier")
-
-        ensureModelForTier(tier)
-
-        return engine.generate(
-            prompt = prompt,
-            systemPrompt = systemPrompt,
-            maxTokens = maxTokens,
-            temperature = temperature
-        )
-    }
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
+    ): String = route(prompt, systemPrompt, maxTokens, temperature, stop).second
 
     /**
-     * Like [routeAndGenerate] but returns the selected tier along with the response,
+     * Like [routeAndGenerate] but returns the tier that produced the response,
      * useful for UI badges or logging.
      */
     suspend fun routeAndGenerateWithMetadata(
         prompt: String,
         systemPrompt: String = "",
         maxTokens: Int = 512,
-        temperature: Float = 0.7f
-    ): Pair<ModelTier, String> {
-        val complexity = classifyComplexity(prompt)
-        val tier = selectTier(complexity)
-
-        Log.d(TAG, "Routing (with metadata): complexity=$complexity, tier=$tier")
-
-        ensureModelForTier(tier)
-
-        val response = engine.generate(
-            prompt = prompt,
-            systemPrompt = systemPrompt,
-            maxTokens = maxTokens,
-            temperature = temperature
-        )
-
-        return tier to response
-    }
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
+    ): Pair<ModelTier, String> = route(prompt, systemPrompt, maxTokens, temperature, stop)
 
     /**
      * Select the appropriate tier for a prompt and ensure the model is loaded,
@@ -367,6 +389,74 @@ class TieredModelRouter @Inject constructor(
         return tier
     }
 
+    // -------------------------------------------------------------------------------------
+    // Internal: routing
+    // -------------------------------------------------------------------------------------
+
+    private suspend fun route(
+        prompt: String,
+        systemPrompt: String,
+        maxTokens: Int,
+        temperature: Float,
+        stop: List<String>
+    ): Pair<ModelTier, String> {
+        if (fastModel == null && complexModel == null) {
+            refreshAvailableModels()
+        }
+        val fast = fastModel
+        val complex = complexModel
+        if (!cascadeEnabled || fast == null || complex == null || fast.file == complex.file) {
+            return routeByComplexity(prompt, systemPrompt, maxTokens, temperature, stop)
+        }
+
+        // Both tiers stay loaded: COMPLEX as the main model, FAST as its draft
+        ensureModelForTier(ModelTier.COMPLEX)
+        var start = System.nanoTime()
+        val fastResult = engine.generateDraftScored(prompt, systemPrompt, maxTokens, temperature, stop)
+            ?: return routeByComplexity(prompt, systemPrompt, maxTokens, temperature, stop)
+        val fastMs = (System.nanoTime() - start) / 1_000_000
+        val score = fastResult.confidence.score
+
+        if (score >= cascadeThreshold) {
+            Log.d(TAG, "Cascade: FAST answer accepted (confidence=%.3f)".format(score))
+            cascadeLog.append(
+                CascadeRecord(prompt, systemPrompt, maxTokens, score, fastResult.confidence.meanEntropy, fastMs, null)
+            )
+            return ModelTier.FAST to fastResult.text
+        }
+
+        Log.d(TAG, "Cascade: escalating to COMPLEX (confidence=%.3f < %.3f)".format(score, cascadeThreshold))
+        start = System.nanoTime()
+        val complexText = engine.generate(prompt, systemPrompt, maxTokens, temperature, stop)
+        val complexMs = (System.nanoTime() - start) / 1_000_000
+        cascadeLog.append(
+            CascadeRecord(prompt, systemPrompt, maxTokens, score, fastResult.confidence.meanEntropy, fastMs, complexMs)
+        )
+        return ModelTier.COMPLEX to complexText
+    }
+
+    /** Route by [classifyComplexity] alone, loading the selected tier's model. */
+    private suspend fun routeByComplexity(
+        prompt: String,
+        systemPrompt: String,
+        maxTokens: Int,
+        temperature: Float,
+        stop: List<String>
+    ): Pair<ModelTier, String> {
+        val complexity = classifyComplexity(prompt)
+        val tier = selectTier(complexity)
+        Log.d(TAG, "Routing: complexity=$complexity, tier=$tier")
+
+        ensureModelForTier(tier)
+        return tier to engine.generate(
+            prompt = prompt,
+            systemPrompt = systemPrompt,
+            maxTokens = maxTokens,
+            temperature = temperature,
+            stop = stop
+        )
+    }
+
     // -------------------------------------------------------------------------------------
     // Internal: tier assignment logic
     // -------------------------------------------------------------------------------------
@@ -390,19 +480,19 @@ class TieredModelRouter @Inject constructor(
         }
 
         val (largeModels, smallModels) = models.partition { model ->
-            parseParamCount(model.parameterCount) >= COMPLEX_MODEL_PARAM_THRESHOLD
+            model.parameterBillions >= COMPLEX_MODEL_PARAM_THRESHOLD
         }
 
         // Assign FAST tier: prefer smallest Qwen2.5, then smallest overall
         fastModel = smallModels.sortedWith(
             compareByDescending<LocalModelInfo> { it.family == ModelFamily.QWEN25 }
-                .thenBy { parseParamCount(it.parameterCount) }
+                .thenBy { it.parameterBillions }
         ).firstOrNull()
 
         // Assign COMPLEX tier: prefer largest Qwen2.5, then largest overall
         complexModel = largeModels.sortedWith(
             compareByDescending<LocalModelInfo> { it.family == ModelFamily.QWEN25 }
-                .thenByDescending { parseParamCount(it.parameterCount) }
+                .thenByDescending { it.parameterBillions }
         ).firstOrNull()
 
         // If no small models, use the large model for FAST too
@@ -429,31 +519,41 @@ class TieredModelRouter @Inject constructor(
         }
     }
 
+    /** The model to attach as [target]'s speculative draft, or null for none. */
+    private fun draftFor(target: LocalModelInfo): LocalModelInfo? {
+        val draft = fastModel ?: return null
+        if (!speculativeDecodingEnabled || draft.file == target.file || draftRejectedFor == target.file) return null
+        return draft
+    }
+
     /**
-     * Check if a keyword appears in the input as a whole word or phrase,
-     * not merely as a substring of a longer word. Multi-word keywords
-     * (e.g. "step by step") use plain contains since they are already specific.
+     * Attach the FAST model as a speculative draft for the just-loaded COMPLEX
+     * model, if it fits in the memory left next to it. Models from different
+     * families are rejected natively because their vocabularies differ;
+     * decoding then stays non-speculative.
      */
-    private fun containsWord(input: String, keyword: String): Boolean {
-        if (keyword.contains(' ') || keyword.contains('-')) {
-            // Multi-word phrases are specific enough
-            return input.contains(keyword)
+    private suspend fun loadDraftModel(target: LocalModelInfo) {
+        val draft = draftFor(target) ?: return
+        if (!modelManager.draftFits(draft.file)) {
+            Log.w(TAG, "No memory for draft ${draft.name} next to ${target.name}; decoding without it")
+            return
+        }
+
+        if (engine.loadDraftModel(draft.file.absolutePath)) {
+            Log.d(TAG, "Speculative decoding: ${draft.name} drafts for ${target.name}")
+        } else {
+            draftRejectedFor = target.file
+            Log.w(TAG, "Draft model ${draft.name} is not compatible with ${target.name}")
         }
-        // Single-word: check word boundaries
-        val idx = input.indexOf(keyword)
-        if (idx < 0) return false
-        val before = if (idx > 0) input[idx - 1] else ' '
-        val after = if (idx + keyword.length < input.length) input[idx + keyword.length] else ' '
-        return !before.isLetterOrDigit() && !after.isLetterOrDigit()
     }
 
     /**
-     * Parse a parameter count string like "3B", "1.5B", "7B" into a numeric
-     * value in billions. Returns 0.0 if the string is null or unparseable.
+     * Whether a keyword match counts: single words must appear as whole words,
+     * not merely as a substring of a longer word. Multi-word keywords
+     * (e.g. "step by step") may appear anywhere since they are already specific.
      */
-    private fun parseParamCount(paramCount: String?): Double {
-        if (paramCount == null) return 0.0
-        val cleaned = paramCount.uppercase().removeSuffix("B").trim()
-        return cleaned.toDoubleOrNull() ?: 0.0
+    private fun isKeywordHit(match: KeywordMatch): Boolean {
+        val keyword = match.entry.pattern
+        return keyword.contains(' ') || keyword.contains('-') || match.isWholeWord
     }
 }
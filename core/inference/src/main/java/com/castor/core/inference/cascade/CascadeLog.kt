@@ -0,0 +1,99 @@
+package com.castor.core.inference.cascade
+
+import android.content.Context
+import android.util.Log
+import dagger.hilt.android.qualifiers.ApplicationContext
+import org.json.JSONObject
+import java.io.File
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * One request routed through the FAST -> COMPLEX cascade.
+ *
+ * @param prompt The user prompt, replayed by [CascadeTuner]
+ * @param systemPrompt The system prompt it was generated with
+ * @param maxTokens Token budget of the request
+ * @param fastScore Confidence score of the FAST answer (see `GenerationConfidence.score`)
+ * @param fastEntropy Mean per-token entropy of the FAST answer
+ * @param fastMs Wall time of the FAST generation
+ * @param complexMs Wall time of the COMPLEX generation, or null if not escalated
+ */
+data class CascadeRecord(
+    val prompt: String,
+    val systemPrompt: String,
+    val maxTokens: Int,
+    val fastScore: Float,
+    val fastEntropy: Float,
+    val fastMs: Long,
+    val complexMs: Long?
+) {
+    val escalated: Boolean get() = complexMs != null
+}
+
+/**
+ * Append-only log of cascade decisions in `filesDir/cascade_log.jsonl`, the
+ * input of [CascadeTuner].
+ *
+ * Logging stores user prompts and is therefore off until [enabled] is set
+ * (e.g. from a developer setting). The file never leaves the device and is
+ * restarted once it grows past [MAX_BYTES].
+ */
+@Singleton
+class CascadeLog @Inject constructor(
+    @ApplicationContext private val context: Context
+) {
+    companion object {
+        private const val TAG = "CascadeLog"
+        private const val MAX_BYTES = 4L * 1024 * 1024
+    }
+
+    @Volatile var enabled: Boolean = false
+
+    private val file: File get() = File(context.filesDir, "cascade_log.jsonl")
+
+    @Synchronized
+    fun append(record: CascadeRecord) {
+        if (!enabled) return
+        try {
+            if (file.length() > MAX_BYTES) file.delete()
+            val json = JSONObject()
+                .put("prompt", record.prompt)
+                .put("systemPrompt", record.systemPrompt)
+                .put("maxTokens", record.maxTokens)
+                .put("fastScore", record.fastScore.toDouble())
+                .put("fastEntropy", record.fastEntropy.toDouble())
+                .put("fastMs", record.fastMs)
+                .put("complexMs", record.complexMs ?: JSONObject.NULL)
+            file.appendText(json.toString() + "\n")
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to log cascade record: ${e.message}")
+        }
+    }
+
+    @Synchronized
+    fun read(): List<CascadeRecord> {
+        if (!file.exists()) return emptyList()
+        return file.readLines().mapNotNull { line ->
+            try {
+                val json = JSONObject(line)
+                CascadeRecord(
+                    prompt = json.getString("prompt"),
+                    systemPrompt = json.optString("systemPrompt"),
+                    maxTokens = json.getInt("maxTokens"),
+                    fastScore = json.getDouble("fastScore").toFloat(),
+                    fastEntropy = json.optDouble("fastEntropy", 0.0).toFloat(),
+                    fastMs = json.getLong("fastMs"),
+                    complexMs = if (json.isNull("complexMs")) null else json.getLong("complexMs")
+                )
+            } catch (e: Exception) {
+                null
+            }
+        }
+    }
+
+    @Synchronized
+    fun clear() {
+        file.delete()
+    }
+}
@@ -0,0 +1,172 @@
+package com.castor.core.inference.cascade
+
+import android.util.Log
+import com.castor.core.inference.ModelTier
+import com.castor.core.inference.TieredModelRouter
+import com.castor.core.inference.llama.LlamaCppEngine
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * A logged prompt answered by both tiers.
+ *
+ * @param fastScore Confidence score of the FAST answer
+ * @param fastMs Wall time of the FAST generation
+ * @param complexMs Wall time of the COMPLEX generation
+ * @param fastAgrees Whether the FAST answer is as good as the COMPLEX one
+ */
+data class CascadeSample(
+    val fastScore: Float,
+    val fastMs: Long,
+    val complexMs: Long,
+    val fastAgrees: Boolean
+)
+
+/**
+ * Outcome of a threshold sweep.
+ *
+ * @param threshold Confidence below which the cascade escalates to COMPLEX
+ * @param meanLatencyMs Mean latency of the cascade at [threshold]
+ * @param complexOnlyLatencyMs Mean latency of always using COMPLEX
+ * @param quality Fraction of answers as good as COMPLEX-only at [threshold]
+ * @param escalationRate Fraction of requests escalated at [threshold]
+ */
+data class CascadeTuning(
+    val threshold: Float,
+    val meanLatencyMs: Double,
+    val complexOnlyLatencyMs: Double,
+    val quality: Double,
+    val escalationRate: Double,
+    val sampleCount: Int
+)
+
+/**
+ * Offline harness for the cascade threshold of [TieredModelRouter].
+ *
+ * [replay] runs the prompts recorded in [CascadeLog] through both tiers with
+ * greedy decoding, the way the live cascade does: FAST as the COMPLEX model's
+ * draft, and each escalation right after its FAST answer. [tune] then picks
+ * the threshold with the lowest mean latency whose quality stays within
+ * `minQuality` of COMPLEX-only. A FAST answer counts as good as the COMPLEX
+ * one when their word overlap (F1) reaches [AGREEMENT_MIN]; this is a proxy,
+ * not a judgement of correctness.
+ *
+ * Replay generates every prompt twice, so it is meant for idle time
+ * (charging, developer settings), not the request path.
+ */
+@Singleton
+class CascadeTuner @Inject constructor(
+    private val router: TieredModelRouter,
+    private val engine: LlamaCppEngine,
+    private val cascadeLog: CascadeLog
+) {
+    companion object {
+        private const val TAG = "CascadeTuner"
+        const val AGREEMENT_MIN = 0.5
+    }
+
+    /** Replay, tune, and apply the tuned threshold to the router. */
+    suspend fun run(minQuality: Double = 0.95): CascadeTuning? {
+        val samples = replay()
+        if (samples.isEmpty()) return null
+        return tune(samples, minQuality).also { tuning ->
+            Log.d(TAG, "Tuned cascade: $tuning")
+            router.cascadeThreshold = tuning.threshold
+        }
+    }
+
+    suspend fun replay(records: List<CascadeRecord> = cascadeLog.read()): List<CascadeSample> {
+        if (records.isEmpty()) return emptyList()
+
+        router.ensureModelForTier(ModelTier.COMPLEX)
+        return records.map { record ->
+            val (fast, fastMs) = timed {
+                engine.generateDraftScored(record.prompt, record.systemPrompt, record.maxTokens, 0f)
+            }
+            if (fast == null) {
+                Log.w(TAG, "FAST model is not attached as a draft; nothing to replay")
+                return emptyList()
+            }
+            val (complex, complexMs) = timed {
+                engine.generateScored(record.prompt, record.systemPrompt, record.maxTokens, 0f)
+            }
+            CascadeSample(
+                fastScore = fast.confidence.score,
+                fastMs = fastMs,
+                complexMs = complexMs,
+                fastAgrees = agreement(fast.text, complex.text) >= AGREEMENT_MIN
+            )
+        }
+    }
+
+    /**
+     * Sweep every distinct FAST score as a threshold (plus "always escalate")
+     * and return the fastest one whose quality is at least [minQuality].
+     */
+    fun tune(samples: List<CascadeSample>, minQuality: Double = 0.95): CascadeTuning {
+        require(samples.isNotEmpty()) { "No samples to tune on" }
+
+        val candidates = samples.map { it.fastScore }.distinct().sorted() + Float.MAX_VALUE
+        val complexOnly = samples.map { it.complexMs }.average()
+
+        return candidates
+            .map { threshold -> evaluate(samples, threshold, complexOnly) }
+            .filter { it.quality >= minQuality }
+            .minBy { it.meanLatencyMs }
+    }
+
+    private fun evaluate(samples: List<CascadeSample>, threshold: Float, complexOnly: Double): CascadeTuning {
+        var latency = 0.0
+        var good = 0
+        var escalated = 0
+        for (s in samples) {
+            if (s.fastScore >= threshold) {
+                latency += s.fastMs
+                if (s.fastAgrees) good++
+            } else {
+                latency += s.fastMs + s.complexMs
+                good++
+                escalated++
+            }
+        }
+        val n = samples.size.toDouble()
+        return CascadeTuning(
+            threshold = threshold,
+            meanLatencyMs = latency / n,
+            complexOnlyLatencyMs = complexOnly,
+            quality = good / n,
+            escalationRate = escalated / n,
+            sampleCount = samples.size
+        )
+    }
+
+    private suspend inline fun <T> timed(generate: () -> T): Pair<T, Long> {
+        val start = System.nanoTime()
+        val result = generate()
+        return result to (System.nanoTime() - start) / 1_000_000
+    }
+
+    /** Word-level F1 overlap between two answers. */
+    private fun agreement(a: String, b: String): Double {
+        val wa = words(a)
+        val wb = words(b)
+        if (wa.isEmpty() || wb.isEmpty()) return if (wa.isEmpty() && wb.isEmpty()) 1.0 else 0.0
+
+        val counts = wb.groupingBy { it }.eachCount().toMutableMap()
+        var overlap = 0
+        for (w in wa) {
+            val c = counts[w] ?: 0
+            if (c > 0) {
+                overlap++
+                counts[w] = c - 1
+            }
+        }
+        if (overlap == 0) return 0.0
+        val precision = overlap.toDouble() / wa.size
+        val recall = overlap.toDouble() / wb.size
+        return 2 * precision * recall / (precision + recall)
+    }
+
+    private fun words(text: String): List<String> =
+        text.lowercase().split(Regex("[^\\p{L}\\p{N}]+")).filter { it.isNotEmpty() }
+}
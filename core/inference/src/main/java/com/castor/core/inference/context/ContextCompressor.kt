@@ -3,6 +3,12 @@ package com.castor.core.inference.context
 import android.util.Log
 import com.castor.core.inference.InferenceEngine
 import com.castor.core.inference.prompt.ConversationTurn
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -11,15 +17,23 @@ import javax.inject.Singleton
  *
  * Ported from Hermes Agent's `context_compressor.py`. Strategy:
  * 1. **Protect** the first turn (system prompt) and last N turns (recent context).
- * 2. **Summarize** the middle turns using the on-device LLM.
- * 3. **Fallback** to simple truncation if LLM is not loaded.
+ * 2. **Replace** the middle turns with the conversation's rolling summary.
+ * 3. **Fallback** to simple truncation for middle turns the summary does not cover yet.
+ *
+ * The rolling summary is maintained off the critical path: after each exchange
+ * ([onExchangeComplete]) a background job extends the persisted summary with the
+ * turns added since it was last written, once the conversation is large enough to
+ * need it soon. It runs through [InferenceEngine.generateBackground], so the
+ * conversation stays in the KV cache and a user request preempts it. [compress]
+ * itself never runs the LLM; it is a lookup in [SummaryStore] plus a splice.
  *
  * This is critical for Qwen2.5-3B's 4096-token context window — without
  * compression, multi-turn conversations overflow after ~3 exchanges with tools.
  */
 @Singleton
 class ContextCompressor @Inject constructor(
-    private val engine: InferenceEngine
+    private val engine: InferenceEngine,
+    private val summaryStore: SummaryStore
 ) {
 
     companion object {
@@ -37,12 +51,25 @@ class ContextCompressor @Inject constructor(
         /** Trigger compression when estimated tokens exceed this fraction of context. */
         const val COMPRESSION_THRESHOLD = 0.80f
 
+        /** Keep the rolling summary up to date once a conversation exceeds this fraction. */
+        private const val SUMMARY_UPDATE_THRESHOLD = 0.50f
+
+        /** Wait this long after an exchange before summarizing, so follow-ups go first. */
+        private const val SUMMARY_UPDATE_DELAY_MS = 3_000L
+
         private const val SUMMARY_SYSTEM_PROMPT =
             "Summarize the following conversation turns concisely. " +
             "Preserve key facts, decisions, and tool results. " +
+            "If a summary so far is given, extend it with the new turns. " +
             "Output only the summary, no preamble."
     }
 
+    private val scope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
+
+    /** Pending background update; cancelled by a newer exchange before it starts generating. */
+    @Volatile private var pendingUpdate: Job? = null
+    @Volatile private var updating = false
+
     /**
      * Estimate the token count for a list of conversation turns.
      *
@@ -65,12 +92,17 @@ class ContextCompressor @Inject constructor(
     /**
      * Compress conversation turns if they exceed the token budget.
      *
+     * The middle turns are replaced by the rolling summary of [conversationId];
+     * middle turns newer than the summary are reduced to a truncated preview.
+     *
      * @param turns The full conversation (system + user/assistant/tool turns).
+     * @param conversationId Which conversation's rolling summary to use.
      * @param maxContextTokens The model's context window size (e.g. 4096).
      * @return Compressed turn list that fits within the budget.
      */
     suspend fun compress(
         turns: List<ConversationTurn>,
+        conversationId: String,
         maxContextTokens: Int = 4096
     ): List<ConversationTurn> {
         val estimated = estimateTokens(turns)
@@ -95,8 +127,14 @@ class ContextCompressor @Inject constructor(
             return turns
         }
 
-        // Summarize middle turns
-        val summary = summarizeTurns(middleTurns)
+        // Splice in the rolling summary; preview whatever it does not cover yet
+        val match = summaryStore.lookup(conversationId, middleTurns.map(SummaryStore::turnKey))
+        val uncovered = middleTurns.drop(match?.coveredTurns ?: 0)
+        val summary = listOfNotNull(
+            match?.summary?.summary,
+            uncovered.takeIf { it.isNotEmpty() }?.let(::truncateSummary)
+        ).joinToString("\n")
+        Log.d(TAG, "Spliced summary covering ${match?.coveredTurns ?: 0}/${middleTurns.size} middle turns")
 
         // Rebuild the turn list
         return buildList {
@@ -110,28 +148,87 @@ class ContextCompressor @Inject constructor(
     }
 
     /**
-     * Summarize a list of conversation turns into a compact text.
+     * Schedule a background update of the rolling summary after an exchange.
+     *
+     * The update waits [SUMMARY_UPDATE_DELAY_MS] and is superseded by a newer
+     * exchange until it starts generating, so it runs when the user is idle.
+     *
+     * @param turns The conversation as it stands after the exchange.
+     * @param conversationId Which conversation's rolling summary to extend.
      */
-    private suspend fun summarizeTurns(turns: List<ConversationTurn>): String {
+    fun onExchangeComplete(
+        turns: List<ConversationTurn>,
+        conversationId: String,
+        maxContextTokens: Int = 4096
+    ) {
+        if (!updating) pendingUpdate?.cancel()
+        pendingUpdate = scope.launch {
+            delay(SUMMARY_UPDATE_DELAY_MS)
+            updating = true
+            try {
+                updateSummary(turns, maxContextTokens, conversationId)
+            } finally {
+                updating = false
+            }
+        }
+    }
+
+    /**
+     * Extend the rolling summary with the middle turns it does not cover yet.
+     */
+    private suspend fun updateSummary(
+        turns: List<ConversationTurn>,
+        maxContextTokens: Int,
+        conversationId: String
+    ) {
+        if (!engine.isLoaded) return
+        if (estimateTokens(turns) < (maxContextTokens * SUMMARY_UPDATE_THRESHOLD).toInt()) return
+
+        val middleTurns = turns.filter { it.role != "system" }.dropLast(PROTECTED_TAIL_TURNS)
+        val keys = middleTurns.map(SummaryStore::turnKey)
+        val match = summaryStore.lookup(conversationId, keys)
+        val covered = match?.coveredTurns ?: 0
+        if (covered >= middleTurns.size) return
+
+        val newTurns = middleTurns.drop(covered)
+        val summary = summarizeTurns(match?.summary?.summary, newTurns) ?: return
+        summaryStore.put(
+            RollingSummary(
+                conversationId = conversationId,
+                coveredKeys = (match?.summary?.coveredKeys ?: emptyList()) + keys.drop(covered),
+                summary = summary,
+                updatedAt = System.currentTimeMillis()
+            )
+        )
+        Log.d(TAG, "Rolling summary extended by ${newTurns.size} turns")
+    }
+
+    /**
+     * Summarize [turns] on top of [previous], or return null if the LLM fails or
+     * a user request preempted it (the next exchange schedules it again).
+     */
+    private suspend fun summarizeTurns(previous: String?, turns: List<ConversationTurn>): String? {
         val turnText = turns.joinToString("\n") { turn ->
             "${turn.role}: ${turn.content.take(300)}"
         }
+        val prompt = if (previous != null) {
+            "Summary so far:\n$previous\n\nNew turns:\n$turnText"
+        } else {
+            turnText
+        }
 
         return try {
-            if (engine.isLoaded) {
-                engine.generate(
-                    prompt = turnText,
-                    systemPrompt = SUMMARY_SYSTEM_PROMPT,
-                    maxTokens = SUMMARY_MAX_TOKENS,
-                    temperature = 0.3f
-                ).trim()
-            } else {
-                // Fallback: simple truncation summary
-                truncateSummary(turns)
-            }
+            val summary = engine.generateBackground(
+                prompt = prompt,
+                systemPrompt = SUMMARY_SYSTEM_PROMPT,
+                maxTokens = SUMMARY_MAX_TOKENS,
+                temperature = 0.3f
+            )
+            if (summary == null) Log.d(TAG, "Rolling summary update skipped: preempted or no room")
+            summary?.trim()?.takeIf { it.isNotEmpty() }
         } catch (e: Exception) {
-            Log.w(TAG, "LLM summarization failed, falling back to truncation: ${e.message}")
-            truncateSummary(turns)
+            Log.w(TAG, "Rolling summary update failed: ${e.message}")
+            null
         }
     }
 
@@ -0,0 +1,143 @@
+package com.castor.core.inference.context
+
+import android.content.Context
+import android.util.Log
+import com.castor.core.inference.prompt.ConversationTurn
+import dagger.hilt.android.qualifiers.ApplicationContext
+import org.json.JSONArray
+import org.json.JSONObject
+import java.io.File
+import java.security.MessageDigest
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * A rolling summary of a conversation, keyed by the turns it covers.
+ *
+ * @param conversationId The conversation the summary belongs to
+ * @param coveredKeys [SummaryStore.turnKey] of each covered turn, oldest first
+ * @param summary The summary text
+ * @param updatedAt Epoch millis of the last update
+ */
+data class RollingSummary(
+    val conversationId: String,
+    val coveredKeys: List<String>,
+    val summary: String,
+    val updatedAt: Long
+)
+
+/**
+ * Persists [RollingSummary]s in `filesDir/context_summaries.json` so a summary
+ * survives across agent runs and app restarts, and is only extended with the
+ * turns added since it was written.
+ *
+ * Turns are identified by a hash of their role and content, so a summary can be
+ * matched against a conversation whose oldest turns have already been dropped.
+ */
+@Singleton
+class SummaryStore @Inject constructor(
+    @ApplicationContext private val context: Context
+) {
+    companion object {
+        private const val TAG = "SummaryStore"
+        private const val MAX_CONVERSATIONS = 16
+
+        /** Covered keys kept per summary; older turns can no longer reappear in context. */
+        private const val MAX_COVERED_KEYS = 64
+
+        fun turnKey(turn: ConversationTurn): String {
+            val digest = MessageDigest.getInstance("SHA-256")
+                .digest("${turn.role}\u0000${turn.content}".toByteArray())
+            return digest.take(8).joinToString("") { "%02x".format(it) }
+        }
+    }
+
+    /** Summary the match was found in, and how many leading turns of the query it covers. */
+    data class Match(val summary: RollingSummary, val coveredTurns: Int)
+
+    private val file: File get() = File(context.filesDir, "context_summaries.json")
+
+    @Volatile private var cache: MutableMap<String, RollingSummary>? = null
+
+    /**
+     * Find how much of [keys] the summary for [conversationId] covers: the
+     * longest prefix of [keys] that appears as a contiguous run of its covered
+     * turns. The run may start anywhere in the summary, since the oldest
+     * covered turns may already have been dropped from the conversation, but
+     * it must start at the first of [keys].
+     */
+    @Synchronized
+    fun lookup(conversationId: String, keys: List<String>): Match? {
+        val summary = load()[conversationId] ?: return null
+        val covered = summary.coveredKeys
+        var best = 0
+        for (start in covered.indices) {
+            var n = 0
+            while (n < keys.size && start + n < covered.size && covered[start + n] == keys[n]) n++
+            best = maxOf(best, n)
+        }
+        return if (best > 0) Match(summary, best) else null
+    }
+
+    @Synchronized
+    fun put(summary: RollingSummary) {
+        val all = load()
+        all[summary.conversationId] = summary.copy(coveredKeys = summary.coveredKeys.takeLast(MAX_COVERED_KEYS))
+        if (all.size > MAX_CONVERSATIONS) {
+            all.values.sortedBy { it.updatedAt }.take(all.size - MAX_CONVERSATIONS)
+                .forEach { all.remove(it.conversationId) }
+        }
+        save(all)
+    }
+
+    @Synchronized
+    fun clear(conversationId: String) {
+        val all = load()
+        if (all.remove(conversationId) != null) save(all)
+    }
+
+    private fun load(): MutableMap<String, RollingSummary> {
+        cache?.let { return it }
+        val loaded = mutableMapOf<String, RollingSummary>()
+        try {
+            if (file.exists()) {
+                val array = JSONArray(file.readText())
+                for (i in 0 until array.length()) {
+                    val json = array.getJSONObject(i)
+                    val keys = json.getJSONArray("coveredKeys")
+                    val summary = RollingSummary(
+                        conversationId = json.getString("conversationId"),
+                        coveredKeys = List(keys.length()) { keys.getString(it) },
+                        summary = json.getString("summary"),
+                        updatedAt = json.getLong("updatedAt")
+                    )
+                    loaded[summary.conversationId] = summary
+                }
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to read summaries, starting fresh: ${e.message}")
+        }
+        cache = loaded
+        return loaded
+    }
+
+    private fun save(all: Map<String, RollingSummary>) {
+        val array = JSONArray()
+        for (summary in all.values) {
+            array.put(
+                JSONObject()
+                    .put("conversationId", summary.conversationId)
+                    .put("coveredKeys", JSONArray(summary.coveredKeys))
+                    .put("summary", summary.summary)
+                    .put("updatedAt", summary.updatedAt)
+            )
+        }
+        try {
+            val tmp = File(file.parentFile, file.name + ".tmp")
+            tmp.writeText(array.toString())
+            tmp.renameTo(file)
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to write summaries: ${e.message}")
+        }
+    }
+}
@@ -13,10 +13,7 @@ import kotlinx.coroutines.flow.asStateFlow
 import kotlinx.coroutines.flow.update
 import kotlinx.coroutines.withContext
 import okhttp3.OkHttpClient
-import okhttp3.Request
 import java.io.File
-import java.io.FileOutputStream
-import java.security.MessageDigest
 import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.TimeUnit
 import javax.inject.Inject
@@ -73,8 +70,8 @@ sealed class DownloadState {
  *
  * Features:
  * - Per-model progress tracking via [StateFlow]
- * - Resume support for interrupted downloads (HTTP Range header)
- * - SHA-256 integrity verification after download
+ * - Parallel ranged connections with per-chunk resume ([RangedDownloader])
+ * - SHA-256 integrity verification, hashed while downloading
  * - Downloads to `.part` file then renames to final path on success
  * - Thread-safe state management with [ConcurrentHashMap]
  * - Cancellation support for in-progress downloads
@@ -90,8 +87,8 @@ class ModelDownloadManager @Inject constructor(
 
     companion object {
         private const val TAG = "ModelDownloadManager"
-        private const val BUFFER_SIZE = 8192
         private const val PART_SUFFIX = ".part"
+        private const val MANIFEST_SUFFIX = ".part.chunks"
         private const val CONNECT_TIMEOUT_SECONDS = 30L
         private const val READ_TIMEOUT_SECONDS = 300L
     }
@@ -104,6 +101,8 @@ class ModelDownloadManager @Inject constructor(
             .build()
     }
 
+    private val downloader: RangedDownloader by lazy { RangedDownloader(httpClient) }
+
     /**
      * Per-model download states, keyed by [ModelCatalogEntry.id].
      *
@@ -134,8 +133,9 @@ class ModelDownloadManager @Inject constructor(
      * Download a model from the catalog to [ModelManager.modelsDir].
      *
      * This is a long-running suspending operation. Progress updates are
-     * emitted to [downloadState]. Supports resume: if a `.part` file
-     * exists, the download continues from where it left off.
+     * emitted to [downloadState]. The file is fetched over several ranged
+     * connections by [RangedDownloader], which checkpoints finished chunks
+     * so an interrupted download resumes with only the missing ones.
      *
      * @param entry The catalog entry describing the model to download
      */
@@ -143,6 +143,7 @@ class ModelDownloadManager @Inject constructor(
         val stateFlow = getOrCreateStateFlow(entry.id)
         val targetFile = File(modelManager.modelsDir, entry.filename)
         val partFile = File(modelManager.modelsDir, entry.filename + PART_SUFFIX)
+        val manifestFile = File(modelManager.modelsDir, entry.filename + MANIFEST_SUFFIX)
 
         // Already downloaded -- nothing to do
         if (targetFile.exists() && targetFile.length() > 0) {
@@ -152,103 +153,40 @@ class ModelDownloadManager @Inject constructor(
         }
 
         try {
-            // Determine resume offset from partial file
-            val resumeOffset = if (partFile.exists()) partFile.length() else 0L
-
             stateFlow.value = DownloadState.Downloading(
-                progress = if (entry.fileSizeBytes > 0) {
-                    resumeOffset.toFloat() / entry.fileSizeBytes
-                } else 0f,
-                bytesDownloaded = resumeOffset,
+                progress = 0f,
+                bytesDownloaded = 0L,
                 totalBytes = entry.fileSizeBytes
             )
             syncMapState()
 
-            Log.d(TAG, "Downloading ${entry.displayName} (resume from $resumeOffset bytes)")
-
-            // Build request with optional Range header for resume
-            val requestBuilder = Request.Builder().url(entry.downloadUrl)
-            if (resumeOffset > 0) {
-                requestBuilder.addHeader("Range", "bytes=$resumeOffset-")
-            }
+            Log.d(TAG, "Downloading ${entry.displayName}")
 
-            val response = httpClient.newCall(requestBuilder.build()).execute()
+            val actualHash = downloader.download(entry.downloadUrl, partFile, manifestFile) { bytesDownloaded, total ->
+                val totalBytes = if (total > 0) total else entry.fileSizeBytes
+                val progress = if (totalBytes > 0) {
+                    bytesDownloaded.toFloat() / totalBytes
+                } else 0f
 
-            if (!response.isSuccessful && response.code != 206) {
-                stateFlow.value = DownloadState.Error(
-                    "HTTP ${response.code}: ${response.message}"
+                stateFlow.value = DownloadState.Downloading(
+                    progress = progress.coerceIn(0f, 1f),
+                    bytesDownloaded = bytesDownloaded,
+                    totalBytes = totalBytes
                 )
                 syncMapState()
-                response.close()
-                return@withContext
-            }
-
-            val body = response.body ?: run {
-                stateFlow.value = DownloadState.Error("Empty response body")
-                syncMapState()
-                response.close()
-                return@withContext
-            }
-
-            // If we requested a Range but got 200 (full response), the server
-            // doesn't support resume. Start from scratch to avoid corruption.
-            val effectiveResumeOffset = if (resumeOffset > 0 && response.code == 200) {
-                Log.d(TAG, "Server returned 200 instead of 206; restarting download from scratch")
-                partFile.delete()
-                0L
-            } else {
-                resumeOffset
-            }
-
-            // Determine total size from Content-Length or Content-Range
-            val contentLength = body.contentLength()
-            val totalBytes = if (effectiveResumeOffset > 0 && response.code == 206) {
-                val rangeHeader = response.header("Content-Range")
-                rangeHeader?.substringAfter("/")?.toLongOrNull()
-                    ?: (effectiveResumeOffset + contentLength)
-            } else {
-                if (contentLength > 0) contentLength else entry.fileSizeBytes
-            }
-
-            // Write to .part file (append if resuming)
-            val outputStream = FileOutputStream(partFile, effectiveResumeOffset > 0)
-            val buffer = ByteArray(BUFFER_SIZE)
-            var bytesDownloaded = effectiveResumeOffset
-
-            body.byteStream().use { input ->
-                outputStream.use { output ->
-                    var bytesRead: Int
-                    while (input.read(buffer).also { bytesRead = it } != -1) {
-                        output.write(buffer, 0, bytesRead)
-                        bytesDownloaded += bytesRead
-
-                        val progress = if (totalBytes > 0) {
-                            bytesDownloaded.toFloat() / totalBytes
-                        } else 0f
-
-                        stateFlow.value = DownloadState.Downloading(
-                            progress = progress.coerceIn(0f, 1f),
-                            bytesDownloaded = bytesDownloaded,
-                            totalBytes = totalBytes
-                        )
-                        syncMapState()
-                    }
-                }
             }
 
-            response.close()
-
-            // Verify integrity if checksum is not a placeholder
+            // Verify integrity if checksum is not a placeholder. The hash was
+            // computed while downloading, so this is only a comparison.
             stateFlow.value = DownloadState.Verifying
             syncMapState()
 
             if (entry.sha256.isNotBlank() &&
                 !entry.sha256.startsWith("placeholder")
             ) {
-                Log.d(TAG, "Verifying SHA-256 for ${entry.displayName}...")
-                val actualHash = computeSha256(partFile)
                 if (!actualHash.equals(entry.sha256, ignoreCase = true)) {
                     partFile.delete()
+                    manifestFile.delete()
                     stateFlow.value = DownloadState.Error(
                         "Checksum mismatch. Expected: ${entry.sha256}, " +
                             "got: $actualHash"
@@ -269,7 +207,6 @@ class ModelDownloadManager @Inject constructor(
                 )
             }
             syncMapState()
-
         } catch (e: CancellationException) {
             Log.d(TAG, "Download cancelled: ${entry.displayName}")
             stateFlow.value = DownloadState.Idle
@@ -340,6 +277,7 @@ class ModelDownloadManager @Inject constructor(
         val partFile = File(modelManager.modelsDir, entry.filename + PART_SUFFIX)
 
         partFile.delete()
+        File(modelManager.modelsDir, entry.filename + MANIFEST_SUFFIX).delete()
         val deleted = !targetFile.exists() || targetFile.delete()
 
         if (deleted) {
@@ -440,21 +378,4 @@ class ModelDownloadManager @Inject constructor(
             _perModelStates.mapValues { (_, flow) -> flow.value }
         }
     }
-
-    /**
-     * Compute SHA-256 hash of a file for integrity verification.
-     */
-    private fun computeSha256(file: File): String {
-        val digest = MessageDigest.getInstance("SHA-256")
-        val buffer = ByteArray(BUFFER_SIZE)
-
-        file.inputStream().use { input ->
-            var bytesRead: Int
-            while (input.read(buffer).also { bytesRead = it } != -1) {
-                digest.update(buffer, 0, bytesRead)
-            }
-        }
-
-        return digest.digest().joinToString("") { "%02x".format(it) }
-    }
 }
@@ -0,0 +1,344 @@
+package com.castor.core.inference.download
+
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.joinAll
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import okhttp3.OkHttpClient
+import okhttp3.Request
+import okhttp3.Response
+import java.io.File
+import java.io.FileOutputStream
+import java.io.IOException
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.channels.FileChannel
+import java.security.MessageDigest
+import java.util.BitSet
+import java.util.Properties
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Downloads one file over several HTTP connections at once.
+ *
+ * The file is split into fixed-size chunks that [connections] workers fetch
+ * with `Range` requests and write with positional writes into a `.part` file
+ * sized up front. Each finished chunk is flushed and recorded in a manifest
+ * next to the part file, so an interrupted download resumes with only the
+ * missing chunks.
+ *
+ * The SHA-256 is computed while downloading: chunks are hashed in file order
+ * as soon as every chunk before them has landed, reading back data that was
+ * just written and is still in the page cache. The digest is ready when the
+ * last chunk is, instead of after a second pass over the whole file. After a
+ * resume the already-downloaded prefix is hashed once from disk.
+ *
+ * Servers that do not answer a `bytes=0-0` probe with 206 are downloaded
+ * over a single connection, hashing the stream inline.
+ *
+ * Has no Android dependencies, so it can be driven by a plain JVM test
+ * against a local HTTP server that supports ranges.
+ */
+class RangedDownloader(
+    private val client: OkHttpClient,
+    private val connections: Int = DEFAULT_CONNECTIONS,
+    private val chunkSize: Long = DEFAULT_CHUNK_SIZE
+) {
+    companion object {
+        const val DEFAULT_CONNECTIONS = 4
+        const val DEFAULT_CHUNK_SIZE = 8L * 1024 * 1024
+        private const val BUFFER_SIZE = 64 * 1024
+        private const val MAX_ATTEMPTS = 3
+        private const val MANIFEST_VERSION = "1"
+    }
+
+    /**
+     * Receives the bytes on disk so far; called from the download threads,
+     * one call at a time and never with fewer bytes than the call before.
+     */
+    fun interface ProgressListener {
+        fun onProgress(bytesDownloaded: Long, totalBytes: Long)
+    }
+
+    /**
+     * Forwards only progress beyond what was already reported: workers add
+     * to the shared count in one order but may report in another.
+     */
+    private class MonotonicProgress(private val listener: ProgressListener) : ProgressListener {
+        private var reported = -1L
+
+        @Synchronized
+        override fun onProgress(bytesDownloaded: Long, totalBytes: Long) {
+            if (bytesDownloaded <= reported) return
+            reported = bytesDownloaded
+            listener.onProgress(bytesDownloaded, totalBytes)
+        }
+    }
+
+    private class Probe(val url: String, val size: Long, val acceptsRanges: Boolean, val validator: String)
+
+    /**
+     * Download [url] into [partFile], checkpointing to [manifestFile].
+     *
+     * On success the part file holds the complete content and the manifest is
+     * deleted; renaming the part file is left to the caller.
+     *
+     * @return Lowercase hex SHA-256 of the downloaded content
+     * @throws IOException on HTTP errors, truncated responses or lack of space
+     */
+    suspend fun download(
+        url: String,
+        partFile: File,
+        manifestFile: File,
+        listener: ProgressListener
+    ): String = withContext(Dispatchers.IO) {
+        val progress = MonotonicProgress(listener)
+        val probe = probe(url)
+        if (!probe.acceptsRanges || probe.size <= 0) {
+            manifestFile.delete()
+            return@withContext downloadSingle(probe.url, partFile, progress)
+        }
+
+        val total = probe.size
+        val chunkCount = ((total + chunkSize - 1) / chunkSize).toInt()
+        val done = loadManifest(manifestFile, url, probe, partFile)
+        val needed = total - (if (partFile.exists()) partFile.length() else 0L)
+        if (needed > 0 && (partFile.absoluteFile.parentFile?.usableSpace ?: Long.MAX_VALUE) < needed) {
+            throw IOException("Not enough free storage: ${needed / 1_048_576} MB needed")
+        }
+
+        // The manifest must exist before the part file is grown to full length:
+        // a full-length part file without one would be taken as complete.
+        synchronized(done) { saveManifest(manifestFile, url, probe, done) }
+        RandomAccessFile(partFile, "rw").use { raf ->
+            raf.setLength(total)
+            val channel = raf.channel
+            val downloaded = AtomicLong((0 until chunkCount).filter { done[it] }.sumOf { chunkLength(it, total) })
+            progress.onProgress(downloaded.get(), total)
+
+            coroutineScope {
+                val completed = Channel<Int>(Channel.UNLIMITED)
+                val hashing = async { hashInOrder(channel, total, chunkCount, completed) }
+                for (i in 0 until chunkCount) if (done[i]) completed.send(i)
+
+                val pending = (0 until chunkCount).filter { !done[it] }
+                val next = AtomicInteger(0)
+                val workers = List(minOf(connections, pending.size)) {
+                    launch {
+                        while (true) {
+                            val chunk = pending.getOrNull(next.getAndIncrement()) ?: break
+                            fetchChunk(probe.url, channel, chunk, total, downloaded, progress)
+                            channel.force(false)
+                            synchronized(done) {
+                                done.set(chunk)
+                                saveManifest(manifestFile, url, probe, done)
+                            }
+                            completed.send(chunk)
+                        }
+                    }
+                }
+                workers.joinAll()
+                completed.close()
+                val sha256 = hashing.await()
+                manifestFile.delete()
+                sha256
+            }
+        }
+    }
+
+    /** Size, range support and validator of [url], following redirects once. */
+    private fun probe(url: String): Probe {
+        val request = Request.Builder().url(url).header("Range", "bytes=0-0").build()
+        client.newCall(request).execute().use { response ->
+            if (!response.isSuccessful) throw IOException("HTTP ${response.code}: ${response.message}")
+            val finalUrl = response.request.url.toString()
+            val validator = response.header("ETag") ?: response.header("Last-Modified").orEmpty()
+            if (response.code == 206) {
+                val size = response.header("Content-Range")?.substringAfter('/')?.toLongOrNull() ?: -1L
+                return Probe(finalUrl, size, size > 0, validator)
+            }
+            return Probe(finalUrl, response.body?.contentLength() ?: -1L, false, validator)
+        }
+    }
+
+    private fun chunkLength(chunk: Int, total: Long): Long =
+        minOf(chunkSize, total - chunk * chunkSize)
+
+    /** Fetch one chunk, resuming within it after a failed attempt. */
+    private suspend fun fetchChunk(
+        url: String,
+        channel: FileChannel,
+        chunk: Int,
+        total: Long,
+        downloaded: AtomicLong,
+        listener: ProgressListener
+    ) {
+        val start = chunk * chunkSize
+        val end = start + chunkLength(chunk, total) // exclusive
+        val position = AtomicLong(start)
+        var attempt = 0
+        while (position.get() < end) {
+            try {
+                fetchRange(url, channel, position, end, total, downloaded, listener)
+            } catch (e: IOException) {
+                if (++attempt >= MAX_ATTEMPTS) throw e
+            }
+        }
+    }
+
+    /**
+     * Write bytes [position, end) of [url] at their offsets, advancing
+     * [position] as they land so a retry continues where this one stopped.
+     */
+    private suspend fun fetchRange(
+        url: String,
+        channel: FileChannel,
+        position: AtomicLong,
+        end: Long,
+        total: Long,
+        downloaded: AtomicLong,
+        listener: ProgressListener
+    ) {
+        val from = position.get()
+        val request = Request.Builder().url(url).header("Range", "bytes=$from-${end - 1}").build()
+        client.newCall(request).execute().use { response ->
+            checkRangeResponse(response, from)
+            val input = response.body?.byteStream() ?: throw IOException("Empty response body")
+            val buffer = ByteArray(BUFFER_SIZE)
+            var offset = from
+            while (offset < end) {
+                currentCoroutineContext().ensureActive()
+                val read = input.read(buffer, 0, minOf(BUFFER_SIZE.toLong(), end - offset).toInt())
+                if (read == -1) throw IOException("Connection closed at byte $offset of range ending at $end")
+                val bytes = ByteBuffer.wrap(buffer, 0, read)
+                while (bytes.hasRemaining()) offset += channel.write(bytes, offset)
+                position.set(offset)
+                listener.onProgress(downloaded.addAndGet(read.toLong()), total)
+            }
+        }
+    }
+
+    private fun checkRangeResponse(response: Response, from: Long) {
+        if (response.code != 206) {
+            throw IOException(
+                if (response.isSuccessful) "Server ignored the Range request" else "HTTP ${response.code}: ${response.message}"
+            )
+        }
+        val range = response.header("Content-Range").orEmpty()
+        if (!range.startsWith("bytes $from-")) throw IOException("Unexpected Content-Range: $range")
+    }
+
+    /** Digest chunks in file order as they are reported complete on [completed]. */
+    private suspend fun hashInOrder(
+        channel: FileChannel,
+        total: Long,
+        chunkCount: Int,
+        completed: Channel<Int>
+    ): String {
+        val digest = MessageDigest.getInstance("SHA-256")
+        val buffer = ByteBuffer.allocate(BUFFER_SIZE)
+        val ready = BitSet(chunkCount)
+        var frontier = 0
+        for (chunk in completed) {
+            ready.set(chunk)
+            while (frontier < chunkCount && ready[frontier]) {
+                var position = frontier * chunkSize
+                val end = position + chunkLength(frontier, total)
+                while (position < end) {
+                    buffer.clear()
+                    buffer.limit(minOf(BUFFER_SIZE.toLong(), end - position).toInt())
+                    val read = channel.read(buffer, position)
+                    if (read <= 0) throw IOException("Short read while hashing at byte $position")
+                    digest.update(buffer.array(), 0, read)
+                    position += read
+                }
+                frontier++
+            }
+        }
+        if (frontier < chunkCount) throw IOException("Download incomplete: ${chunkCount - frontier} chunks missing")
+        return digest.digest().joinToString("") { "%02x".format(it) }
+    }
+
+    /** Plain streaming download for servers without range support. */
+    private suspend fun downloadSingle(url: String, partFile: File, listener: ProgressListener): String {
+        val request = Request.Builder().url(url).build()
+        client.newCall(request).execute().use { response ->
+            if (!response.isSuccessful) throw IOException("HTTP ${response.code}: ${response.message}")
+            val body = response.body ?: throw IOException("Empty response body")
+            val total = body.contentLength()
+            val digest = MessageDigest.getInstance("SHA-256")
+            val buffer = ByteArray(BUFFER_SIZE)
+            var downloaded = 0L
+            body.byteStream().use { input ->
+                FileOutputStream(partFile).use { output ->
+                    while (true) {
+                        currentCoroutineContext().ensureActive()
+                        val read = input.read(buffer)
+                        if (read == -1) break
+                        output.write(buffer, 0, read)
+                        digest.update(buffer, 0, read)
+                        downloaded += read
+                        listener.onProgress(downloaded, total)
+                    }
+                }
+            }
+            return digest.digest().joinToString("") { "%02x".format(it) }
+        }
+    }
+
+    /**
+     * Chunks already on disk. A manifest for a different URL, size, chunk size
+     * or server validator, or without its part file, is discarded together
+     * with the part file. A part file without a manifest that is shorter than
+     * the content was written sequentially, so its whole chunks are kept; one
+     * of full length or more was preallocated and is not trusted.
+     */
+    private fun loadManifest(manifestFile: File, url: String, probe: Probe, partFile: File): BitSet {
+        val done = BitSet()
+        if (!manifestFile.exists()) {
+            if (partFile.exists() && partFile.length() < probe.size) {
+                done.set(0, (partFile.length() / chunkSize).toInt())
+            } else {
+                partFile.delete()
+            }
+            return done
+        }
+        val props = Properties()
+        try {
+            manifestFile.inputStream().use { props.load(it) }
+        } catch (e: IOException) {
+            props.clear()
+        }
+        val matches = props.getProperty("version") == MANIFEST_VERSION &&
+            props.getProperty("url") == url &&
+            props.getProperty("size") == probe.size.toString() &&
+            props.getProperty("chunkSize") == chunkSize.toString() &&
+            props.getProperty("validator") == probe.validator
+        if (!matches || !partFile.exists()) {
+            partFile.delete()
+            manifestFile.delete()
+            return done
+        }
+        props.getProperty("done").orEmpty().split(',').mapNotNull { it.toIntOrNull() }.forEach { done.set(it) }
+        return done
+    }
+
+    private fun saveManifest(manifestFile: File, url: String, probe: Probe, done: BitSet) {
+        val props = Properties()
+        props.setProperty("version", MANIFEST_VERSION)
+        props.setProperty("url", url)
+        props.setProperty("size", probe.size.toString())
+        props.setProperty("chunkSize", chunkSize.toString())
+        props.setProperty("validator", probe.validator)
+        props.setProperty("done", done.stream().toArray().joinToString(","))
+        val tmp = File(manifestFile.parentFile, manifestFile.name + ".tmp")
+        tmp.outputStream().use { props.store(it, null) }
+        tmp.renameTo(manifestFile)
+    }
+}
@@ -0,0 +1,154 @@
+package com.castor.core.inference.gguf
+
+import com.castor.core.inference.prompt.ModelFamily
+import com.castor.core.inference.prompt.PromptFormat
+import java.io.File
+
+/**
+ * Facts about a model read from its GGUF header, as opposed to guessed from
+ * its filename.
+ *
+ * @param architecture `general.architecture`, e.g. "qwen2", "llama", "phi3"
+ * @param name `general.name`, or null if absent
+ * @param sizeLabel `general.size_label` (e.g. "3.1B"), or null if absent
+ * @param fileType Quantization of the file as a whole (e.g. "Q4_K_M"), or null if unknown
+ * @param parameterCount Exact number of weights, summed over all tensors
+ * @param tensorTypes Number of tensors per ggml type (e.g. "Q4_K" to 144)
+ * @param contextLength Context length the model was trained with, 0 if absent
+ * @param embeddingLength Embedding width, 0 if absent
+ * @param blockCount Number of transformer layers, 0 if absent
+ * @param headCount Attention heads per layer, 0 if absent
+ * @param headCountKv Key/value heads per layer (fewer than [headCount] with GQA), 0 if absent
+ * @param keyLength Width of one key head, 0 if absent (then `embeddingLength / headCount`)
+ * @param valueLength Width of one value head, 0 if absent (then `embeddingLength / headCount`)
+ * @param vocabSize Number of tokens in the vocabulary, 0 if absent
+ * @param tokenizer `tokenizer.ggml.model`, e.g. "gpt2" or "llama"
+ * @param chatTemplate The Jinja chat template embedded in the file, or null
+ */
+data class GgufInfo(
+    val architecture: String,
+    val name: String?,
+    val sizeLabel: String?,
+    val fileType: String?,
+    val parameterCount: Long,
+    val tensorTypes: Map<String, Int>,
+    val contextLength: Int,
+    val embeddingLength: Int,
+    val blockCount: Int,
+    val headCount: Int = 0,
+    val headCountKv: Int = 0,
+    val keyLength: Int = 0,
+    val valueLength: Int = 0,
+    val vocabSize: Int = 0,
+    val tokenizer: String?,
+    val chatTemplate: String?
+) {
+    /** Model family implied by the architecture and, for Llama, the chat template. */
+    val family: ModelFamily
+        get() = when {
+            architecture == "qwen2" -> ModelFamily.QWEN25
+            architecture == "phi3" -> ModelFamily.PHI3
+            architecture == "llama" && chatTemplate?.contains("<|start_header_id|>") == true -> ModelFamily.LLAMA3
+            architecture.startsWith("gemma") -> ModelFamily.GEMMA
+            else -> ModelFamily.GENERIC
+        }
+
+    /**
+     * Prompt format the embedded chat template uses, falling back to the
+     * family default. Null when neither says anything.
+     */
+    val promptFormat: PromptFormat?
+        get() {
+            val template = chatTemplate.orEmpty()
+            return when {
+                "<|im_start|>" in template -> PromptFormat.CHATML
+                "<|start_header_id|>" in template -> PromptFormat.LLAMA3
+                "<|user|>" in template && "<|end|>" in template -> PromptFormat.PHI3
+                "<start_of_turn>" in template -> PromptFormat.GEMMA
+                family != ModelFamily.GENERIC -> family.defaultPromptFormat
+                else -> null
+            }
+        }
+
+    /**
+     * Bytes of F16 KV cache per token of context: keys and values for every
+     * layer, narrowed by grouped-query attention when the head counts are
+     * known. Head widths come from [keyLength] and [valueLength] when the
+     * header has them. 0 if the header lacks the shape.
+     */
+    val kvBytesPerToken: Long
+        get() = blockCount.toLong() * (kvWidth(keyLength) + kvWidth(valueLength)) * 2
+
+    /** Width of one layer's keys or values for one token, given the head width if known. */
+    private fun kvWidth(headLength: Int): Long {
+        val kvHeads = if (headCountKv > 0) headCountKv else headCount
+        return when {
+            headLength > 0 && kvHeads > 0 -> headLength.toLong() * kvHeads
+            headCount > 0 && headCountKv > 0 -> embeddingLength.toLong() / headCount * headCountKv
+            else -> embeddingLength.toLong()
+        }
+    }
+
+    /** [parameterCount] in the usual short form, e.g. "3.1B" or "494M". */
+    val parameterLabel: String
+        get() = when {
+            parameterCount >= 10_000_000_000L -> "%.0fB".format(parameterCount / 1e9)
+            parameterCount >= 1_000_000_000L -> "%.1fB".format(parameterCount / 1e9)
+            else -> "%.0fM".format(parameterCount / 1e6)
+        }
+}
+
+/**
+ * Reads [GgufInfo] from a GGUF file without loading the model: only the
+ * header, the metadata section and the tensor shapes are read (`gguf_reader.h`),
+ * which takes milliseconds even for multi-GB files.
+ */
+object GgufReader {
+
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-llama")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    /** Whether [read] can read files at all; without it callers fall back to filename heuristics. */
+    val isAvailable: Boolean get() = nativeAvailable
+
+    /** Metadata of [file], or null if it is not a readable GGUF file or the native reader is unavailable. */
+    fun read(file: File): GgufInfo? {
+        if (!nativeAvailable) return null
+        val raw = nativeReadInfo(file.absolutePath) ?: return null
+        val fields = HashMap<String, String>(raw.size)
+        for (i in 0 until raw.size / 2) fields[raw[2 * i]] = raw[2 * i + 1]
+
+        return GgufInfo(
+            architecture = fields["architecture"].orEmpty(),
+            name = fields["name"]?.ifEmpty { null },
+            sizeLabel = fields["size_label"]?.ifEmpty { null },
+            fileType = fields["file_type"]?.ifEmpty { null },
+            parameterCount = fields["parameters"]?.toLongOrNull() ?: 0L,
+            tensorTypes = parseTensorTypes(fields["tensor_types"].orEmpty()),
+            contextLength = fields["context_length"]?.toIntOrNull() ?: 0,
+            embeddingLength = fields["embedding_length"]?.toIntOrNull() ?: 0,
+            blockCount = fields["block_count"]?.toIntOrNull() ?: 0,
+            headCount = fields["head_count"]?.toIntOrNull() ?: 0,
+            headCountKv = fields["head_count_kv"]?.toIntOrNull() ?: 0,
+            keyLength = fields["key_length"]?.toIntOrNull() ?: 0,
+            valueLength = fields["value_length"]?.toIntOrNull() ?: 0,
+            vocabSize = fields["vocab_size"]?.toIntOrNull() ?: 0,
+            tokenizer = fields["tokenizer"]?.ifEmpty { null },
+            chatTemplate = fields["chat_template"]?.ifEmpty { null }
+        )
+    }
+
+    /** "Q4_K:144,F32:121" -> {Q4_K=144, F32=121} */
+    private fun parseTensorTypes(text: String): Map<String, Int> {
+        if (text.isEmpty()) return emptyMap()
+        return text.split(',').associate { entry ->
+            entry.substringBefore(':') to (entry.substringAfter(':').toIntOrNull() ?: 0)
+        }
+    }
+
+    private external fun nativeReadInfo(path: String): Array<String>?
+}
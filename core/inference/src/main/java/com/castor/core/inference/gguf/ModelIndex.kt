@@ -0,0 +1,157 @@
+package com.castor.core.inference.gguf
+
+import android.content.Context
+import android.util.Log
+import dagger.hilt.android.qualifiers.ApplicationContext
+import org.json.JSONObject
+import java.io.File
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * Cache of [GgufInfo] per model file in `filesDir/model_index.json`, keyed by
+ * path and validated against the file's size and modification time.
+ *
+ * A hit costs one `stat` of the model file, so listing a folder of multi-GB
+ * models does not touch their contents. Files that are not valid GGUF are
+ * remembered as such until they change.
+ */
+@Singleton
+class ModelIndex @Inject constructor(
+    @ApplicationContext private val context: Context
+) {
+    companion object {
+        private const val TAG = "ModelIndex"
+    }
+
+    private class Entry(val size: Long, val modified: Long, val info: GgufInfo?)
+
+    private val file: File get() = File(context.filesDir, "model_index.json")
+
+    @Volatile private var cache: MutableMap<String, Entry>? = null
+
+    /** Header facts for [model], read and indexed on first use or after the file changed. */
+    fun info(model: File): GgufInfo? = infoFor(listOf(model))[model]
+
+    /**
+     * Header facts for each of [models]; misses are read and the index is
+     * written once. Entries for files that no longer exist are dropped.
+     */
+    @Synchronized
+    fun infoFor(models: List<File>): Map<File, GgufInfo?> {
+        val all = load()
+        var changed = all.keys.removeAll { !File(it).exists() }
+        val result = LinkedHashMap<File, GgufInfo?>(models.size)
+
+        for (model in models) {
+            val path = model.absolutePath
+            val size = model.length()
+            val modified = model.lastModified()
+            val cached = all[path]
+            if (cached != null && cached.size == size && cached.modified == modified) {
+                result[model] = cached.info
+                continue
+            }
+            val info = GgufReader.read(model)
+            result[model] = info
+            // Without the native reader a miss says nothing about the file
+            if (GgufReader.isAvailable) {
+                all[path] = Entry(size, modified, info)
+                changed = true
+            }
+        }
+
+        if (changed) save(all)
+        return result
+    }
+
+    private fun load(): MutableMap<String, Entry> {
+        cache?.let { return it }
+        val loaded = mutableMapOf<String, Entry>()
+        try {
+            if (file.exists()) {
+                val json = JSONObject(file.readText())
+                for (path in json.keys()) {
+                    val entry = json.getJSONObject(path)
+                    val info = entry.optJSONObject("info")
+                    // Indexed before head widths were read: read the header again
+                    if (info != null && !info.has("keyLength")) continue
+                    loaded[path] = Entry(
+                        size = entry.getLong("size"),
+                        modified = entry.getLong("modified"),
+                        info = info?.let(::infoFromJson)
+                    )
+                }
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to read model index, starting fresh: ${e.message}")
+        }
+        cache = loaded
+        return loaded
+    }
+
+    private fun save(all: Map<String, Entry>) {
+        val json = JSONObject()
+        for ((path, entry) in all) {
+            json.put(
+                path,
+                JSONObject()
+                    .put("size", entry.size)
+                    .put("modified", entry.modified)
+                    .put("info", entry.info?.let(::infoToJson) ?: JSONObject.NULL)
+            )
+        }
+        try {
+            val tmp = File(file.parentFile, file.name + ".tmp")
+            tmp.writeText(json.toString())
+            tmp.renameTo(file)
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to write model index: ${e.message}")
+        }
+    }
+
+    private fun infoToJson(info: GgufInfo): JSONObject =
+        JSONObject()
+            .put("architecture", info.architecture)
+            .put("name", info.name)
+            .put("sizeLabel", info.sizeLabel)
+            .put("fileType", info.fileType)
+            .put("parameterCount", info.parameterCount)
+            .put("tensorTypes", JSONObject(info.tensorTypes))
+            .put("contextLength", info.contextLength)
+            .put("embeddingLength", info.embeddingLength)
+            .put("blockCount", info.blockCount)
+            .put("headCount", info.headCount)
+            .put("headCountKv", info.headCountKv)
+            .put("keyLength", info.keyLength)
+            .put("valueLength", info.valueLength)
+            .put("vocabSize", info.vocabSize)
+            .put("tokenizer", info.tokenizer)
+            .put("chatTemplate", info.chatTemplate)
+
+    private fun infoFromJson(json: JSONObject): GgufInfo {
+        val types = json.getJSONObject("tensorTypes")
+        return GgufInfo(
+            architecture = json.getString("architecture"),
+            name = json.optStringOrNull("name"),
+            sizeLabel = json.optStringOrNull("sizeLabel"),
+            fileType = json.optStringOrNull("fileType"),
+            parameterCount = json.getLong("parameterCount"),
+            tensorTypes = types.keys().asSequence().associateWith { types.getInt(it) },
+            contextLength = json.getInt("contextLength"),
+            embeddingLength = json.getInt("embeddingLength"),
+            blockCount = json.getInt("blockCount"),
+            headCount = json.optInt("headCount"),
+            headCountKv = json.optInt("headCountKv"),
+            keyLength = json.optInt("keyLength"),
+            valueLength = json.optInt("valueLength"),
+            vocabSize = json.optInt("vocabSize"),
+            tokenizer = json.optStringOrNull("tokenizer"),
+            chatTemplate = json.optStringOrNull("chatTemplate")
+        )
+    }
+
+    /** JSONObject.put drops null values, so absent keys read back as null. */
+    private fun JSONObject.optStringOrNull(key: String): String? =
+        if (has(key) && !isNull(key)) getString(key) else null
+}
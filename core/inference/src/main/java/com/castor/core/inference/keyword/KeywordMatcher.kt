@@ -0,0 +1,167 @@
+package com.castor.core.inference.keyword
+
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * A keyword in a [KeywordMatcher] dictionary.
+ *
+ * @param pattern Text to find; matched case-insensitively (ASCII)
+ * @param category What the keyword signals, e.g. an intent or complexity label
+ * @param weight Priority of [category] within its dictionary (see [KeywordMatches.best])
+ */
+data class KeywordEntry(
+    val pattern: String,
+    val category: String,
+    val weight: Float = 1f
+)
+
+/**
+ * One occurrence of a [KeywordEntry] in the input.
+ *
+ * @param start Char offset of the first matched character
+ * @param end Char offset just past the match
+ * @param atWordStart Whether the match does not continue a preceding word
+ * @param atWordEnd Whether the match is not followed by more of the same word
+ */
+data class KeywordMatch(
+    val dictionary: String,
+    val entry: KeywordEntry,
+    val start: Int,
+    val end: Int,
+    val atWordStart: Boolean,
+    val atWordEnd: Boolean
+) {
+    val category: String get() = entry.category
+    val weight: Float get() = entry.weight
+    val isWholeWord: Boolean get() = atWordStart && atWordEnd
+}
+
+/** All keyword matches in one input, across every registered dictionary, ordered by [KeywordMatch.end]. */
+class KeywordMatches(val text: String, val all: List<KeywordMatch>) {
+
+    fun of(dictionary: String): List<KeywordMatch> = all.filter { it.dictionary == dictionary }
+
+    /**
+     * The highest-weighted match in [dictionary] accepted by [accept], the
+     * earliest one on ties, or null.
+     */
+    fun best(dictionary: String, accept: (KeywordMatch) -> Boolean = { true }): KeywordMatch? {
+        var best: KeywordMatch? = null
+        for (m in all) {
+            if (m.dictionary != dictionary || !accept(m)) continue
+            if (best == null || m.weight > best.weight || (m.weight == best.weight && m.start < best.start)) best = m
+        }
+        return best
+    }
+}
+
+/**
+ * Multi-pattern keyword matcher shared by the routing components
+ * (`TieredModelRouter`, `AgentOrchestrator`, `TaskPipeline`).
+ *
+ * Each component registers its dictionary once; all dictionaries are compiled
+ * into a single native Aho-Corasick automaton, so [match] is one linear pass
+ * over the input regardless of how many keywords there are. Matches report
+ * word boundaries and leave it to the caller whether a keyword must be a whole
+ * word, a word prefix, or may appear anywhere.
+ *
+ * The last result is cached, so the components routing the same input share
+ * one scan. Without the native library a plain Kotlin scan is used instead.
+ */
+@Singleton
+class KeywordMatcher @Inject constructor() {
+
+    private val dictionaries = mutableMapOf<String, List<KeywordEntry>>()
+
+    /** Dictionary names by native id. */
+    private val nativeIds = mutableMapOf<Int, String>()
+
+    private var version = 0
+    private var cached: KeywordMatches? = null
+    private var cachedVersion = -1
+
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-llama")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    /** Add [dictionary], replacing an earlier registration under the same name. */
+    @Synchronized
+    fun register(dictionary: String, entries: List<KeywordEntry>) {
+        dictionaries[dictionary] = entries.toList()
+        if (nativeAvailable) {
+            val id = nativeRegister(dictionary, entries.map { it.pattern }.toTypedArray())
+            nativeIds[id] = dictionary
+        }
+        version++
+    }
+
+    @Synchronized
+    fun isRegistered(dictionary: String): Boolean = dictionary in dictionaries
+
+    /** Every match of every registered dictionary in [text]. */
+    @Synchronized
+    fun match(text: String): KeywordMatches {
+        cached?.let { if (cachedVersion == version && it.text == text) return it }
+
+        val matches = if (nativeAvailable) matchNative(text) else matchKotlin(text)
+        return KeywordMatches(text, matches).also {
+            cached = it
+            cachedVersion = version
+        }
+    }
+
+    private fun matchNative(text: String): List<KeywordMatch> {
+        val raw = nativeMatch(text)
+        val matches = ArrayList<KeywordMatch>(raw.size / 5)
+        for (i in raw.indices step 5) {
+            val dictionary = nativeIds[raw[i]] ?: continue
+            val entry = dictionaries[dictionary]?.getOrNull(raw[i + 1]) ?: continue
+            val flags = raw[i + 4]
+            matches += KeywordMatch(
+                dictionary = dictionary,
+                entry = entry,
+                start = raw[i + 2],
+                end = raw[i + 3],
+                atWordStart = flags and FLAG_WORD_START != 0,
+                atWordEnd = flags and FLAG_WORD_END != 0
+            )
+        }
+        return matches
+    }
+
+    private fun matchKotlin(text: String): List<KeywordMatch> {
+        val matches = ArrayList<KeywordMatch>()
+        for ((dictionary, entries) in dictionaries) {
+            for (entry in entries) {
+                if (entry.pattern.isEmpty()) continue
+                var start = text.indexOf(entry.pattern, ignoreCase = true)
+                while (start >= 0) {
+                    val end = start + entry.pattern.length
+                    matches += KeywordMatch(
+                        dictionary = dictionary,
+                        entry = entry,
+                        start = start,
+                        end = end,
+                        atWordStart = start == 0 || !text[start - 1].isLetterOrDigit(),
+                        atWordEnd = end == text.length || !text[end].isLetterOrDigit()
+                    )
+                    start = text.indexOf(entry.pattern, start + 1, ignoreCase = true)
+                }
+            }
+        }
+        matches.sortBy { it.end }
+        return matches
+    }
+
+    private companion object {
+        const val FLAG_WORD_START = 1
+        const val FLAG_WORD_END = 2
+    }
+
+    private external fun nativeRegister(dictionary: String, patterns: Array<String>): Int
+    private external fun nativeMatch(text: String): IntArray
+}
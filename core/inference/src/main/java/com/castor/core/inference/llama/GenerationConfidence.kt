@@ -0,0 +1,44 @@
+package com.castor.core.inference.llama
+
+import kotlin.math.exp
+
+/**
+ * Per-token confidence of the most recent native generation: the
+ * log-probability of each sampled token and the entropy (in nats) of the
+ * distribution it was sampled from, both under the model's unmodified logits.
+ */
+data class GenerationConfidence(
+    val logprobs: List<Float> = emptyList(),
+    val entropies: List<Float> = emptyList()
+) {
+    val tokenCount: Int get() = logprobs.size
+
+    /**
+     * Geometric mean of the sampled tokens' probabilities, in [0, 1]. An empty
+     * generation scores 0.
+     */
+    val score: Float
+        get() = if (logprobs.isEmpty()) 0f else exp(logprobs.average()).toFloat()
+
+    /** Mean entropy over the generated tokens; high when the model hesitated. */
+    val meanEntropy: Float
+        get() = if (entropies.isEmpty()) 0f else entropies.average().toFloat()
+
+    companion object {
+        /** Decode the array returned by `nativeGetTokenConfidence`. */
+        internal fun fromNative(values: FloatArray): GenerationConfidence {
+            val n = values.size / 2
+            return GenerationConfidence(
+                logprobs = List(n) { values[2 * it] },
+                entropies = List(n) { values[2 * it + 1] }
+            )
+        }
+    }
+}
+
+/** A generated text together with how it was decoded. */
+data class ScoredGeneration(
+    val text: String,
+    val confidence: GenerationConfidence,
+    val stats: GenerationStats
+)
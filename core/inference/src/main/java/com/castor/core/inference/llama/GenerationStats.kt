@@ -0,0 +1,84 @@
+package com.castor.core.inference.llama
+
+/**
+ * Decode statistics and timings of the most recent native generation.
+ *
+ * Generations without tool calls are speculative: tokens are drafted by the
+ * draft model ([LlamaCppEngine.loadDraftModel]) or, without one, copied from
+ * matching spans earlier in the context. [draftedTokens] and [acceptedTokens]
+ * describe how well the drafts predicted the main model and [draftLength] is
+ * the draft size the engine has adapted to.
+ *
+ * Timings are in milliseconds. [durationMs] is the decode phase after the
+ * prompt and includes [samplerMs] and [callbackMs]; [evalPromptMs] and
+ * [evalMs] are llama.cpp's own compute time for prompt and generation
+ * batches, so the difference to [prefillMs] and [durationMs] is overhead
+ * outside the model.
+ *
+ * @param promptTokens Prompt tokens decoded, excluding [reusedTokens]
+ * @param reusedTokens Prompt tokens kept from the KV cache of the previous request
+ * @param queueWaitMs Time the request waited for the engine before it started
+ * @param firstTextMs From the start of the request to the first output text
+ * @param callbackMs Time spent in the Kotlin stream or tool call callbacks
+ * @param contextShifts Times the context was full and older turns were discarded
+ * @param evalCalls Generation batches decoded; below [tokens] when drafts are accepted
+ */
+data class GenerationStats(
+    val tokens: Int = 0,
+    val durationMs: Float = 0f,
+    val draftedTokens: Int = 0,
+    val acceptedTokens: Int = 0,
+    val draftLength: Int = 0,
+    val promptTokens: Int = 0,
+    val prefillMs: Float = 0f,
+    val reusedTokens: Int = 0,
+    val queueWaitMs: Float = 0f,
+    val firstTextMs: Float = 0f,
+    val tokenizeMs: Float = 0f,
+    val samplerMs: Float = 0f,
+    val callbackMs: Float = 0f,
+    val contextShifts: Int = 0,
+    val evalPromptMs: Float = 0f,
+    val evalCalls: Int = 0,
+    val evalMs: Float = 0f
+) {
+    /** Effective decode throughput, including any speculative speed-up. */
+    val tokensPerSecond: Float
+        get() = if (durationMs > 0f) tokens * 1000f / durationMs else 0f
+
+    /** Prompt processing throughput. */
+    val prefillTokensPerSecond: Float
+        get() = if (prefillMs > 0f) promptTokens * 1000f / prefillMs else 0f
+
+    /** Fraction of drafted tokens the main model accepted, or 0 without drafting. */
+    val acceptanceRate: Float
+        get() = if (draftedTokens > 0) acceptedTokens.toFloat() / draftedTokens else 0f
+
+    val speculative: Boolean get() = draftedTokens > 0
+
+    /** Queue wait plus everything the engine did for the request. */
+    val totalMs: Float get() = queueWaitMs + tokenizeMs + prefillMs + durationMs
+
+    companion object {
+        /** Decode the array returned by `nativeGetGenerationStats`. */
+        internal fun fromNative(values: FloatArray, queueWaitMs: Float = 0f): GenerationStats = GenerationStats(
+            tokens = values[0].toInt(),
+            durationMs = values[1],
+            draftedTokens = values[2].toInt(),
+            acceptedTokens = values[3].toInt(),
+            draftLength = values[4].toInt(),
+            promptTokens = values[5].toInt(),
+            prefillMs = values[6],
+            reusedTokens = values[7].toInt(),
+            queueWaitMs = queueWaitMs,
+            firstTextMs = values[8],
+            tokenizeMs = values[9],
+            samplerMs = values[10],
+            callbackMs = values[11],
+            contextShifts = values[12].toInt(),
+            evalPromptMs = values[14],
+            evalCalls = values[15].toInt(),
+            evalMs = values[16]
+        )
+    }
+}
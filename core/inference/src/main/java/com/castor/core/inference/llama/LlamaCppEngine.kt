@@ -1,20 +1,36 @@
 package com.castor.core.inference.llama
 
 import android.content.Context
+import com.castor.core.inference.GenerationBatch
+import com.castor.core.inference.GenerationRequest
 import com.castor.core.inference.InferenceConfig
 import com.castor.core.inference.InferenceEngine
+import com.castor.core.inference.gguf.ModelIndex
+import com.castor.core.inference.prompt.ConversationTurn
 import com.castor.core.inference.prompt.ModelFamily
 import com.castor.core.inference.prompt.PromptFormat
 import com.castor.core.inference.prompt.PromptFormatter
+import com.castor.core.inference.tool.ToolCall
+import com.castor.core.inference.tool.ToolCallGrammar
+import com.castor.core.inference.tool.ToolCallParser
 import dagger.hilt.android.qualifiers.ApplicationContext
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.channels.awaitClose
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.channels.BufferOverflow
 import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.MutableSharedFlow
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.SharedFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asSharedFlow
+import kotlinx.coroutines.flow.asStateFlow
 import kotlinx.coroutines.flow.callbackFlow
 import kotlinx.coroutines.flow.flowOn
 import kotlinx.coroutines.sync.Mutex
 import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
+import java.io.File
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -29,7 +45,8 @@ import javax.inject.Singleton
  */
 @Singleton
 class LlamaCppEngine @Inject constructor(
-    @ApplicationContext private val context: Context
+    @ApplicationContext private val context: Context,
+    private val modelIndex: ModelIndex
 ) : InferenceEngine {
 
     @Volatile private var nativeHandle: Long = 0L
@@ -40,6 +57,30 @@ class LlamaCppEngine @Inject constructor(
     /** Mutex to serialize native JNI calls (only one load/unload/generate at a time). */
     private val nativeMutex = Mutex()
 
+    /** How long the request now holding [nativeMutex] waited for it. */
+    private var queueWaitMs = 0f
+
+    @Volatile private var draftModelPath: String? = null
+
+    private val _generationStats = MutableStateFlow(GenerationStats())
+
+    /** Decode statistics of the last generation (throughput, speculative acceptance). */
+    val generationStats: StateFlow<GenerationStats> = _generationStats.asStateFlow()
+
+    private val _requestStats = MutableSharedFlow<GenerationStats>(
+        extraBufferCapacity = 64,
+        onBufferOverflow = BufferOverflow.DROP_OLDEST
+    )
+
+    /** Statistics of every native generation as it completes, for aggregation (ModelManager). */
+    val requestStats: SharedFlow<GenerationStats> = _requestStats.asSharedFlow()
+
+    /** File name of the loaded draft model, or null when decoding is not speculative. */
+    val draftModelName: String? get() = draftModelPath?.substringAfterLast("/")
+
+    /** Context size of the loaded model (a draft gets the same), or 0 without one. */
+    val contextSize: Int get() = if (_isLoaded) config?.contextSize ?: 0 else 0
+
     override val isLoaded: Boolean get() = _isLoaded
     override val modelName: String get() = config?.modelPath?.substringAfterLast("/") ?: "none"
 
@@ -57,35 +98,28 @@ class LlamaCppEngine @Inject constructor(
         }
     }
 
-    override suspend fun loadModel(modelPath: String) = withContext(Dispatchers.IO) {
-        nativeMutex.withLock {
-            if (_isLoaded) unloadModelInternal()
-
-            val detectedFormat = PromptFormatter.detectFromFilename(modelPath)
-            val detectedFamily = PromptFormatter.detectFamilyFromFilename(modelPath)
+    override suspend fun loadModel(modelPath: String) = loadModelWithConfig(defaultConfigFor(modelPath))
 
-            config = InferenceConfig(
-                modelPath = modelPath,
-                promptFormat = detectedFormat,
-                modelFamily = detectedFamily,
-                contextSize = detectedFamily.defaultContextLength.coerceAtMost(4096),
-                flashAttention = detectedFamily == ModelFamily.QWEN25
-            )
+    /**
+     * Prompt format, family and attention settings detected for [modelPath],
+     * with the trained context capped at 4096. Callers that plan memory
+     * (ModelManager) replace the context size and KV cache type.
+     */
+    fun defaultConfigFor(modelPath: String): InferenceConfig {
+        // Header facts when the file has them, filename guesses otherwise
+        val gguf = modelIndex.info(File(modelPath))
+        val detectedFormat = gguf?.promptFormat ?: PromptFormatter.detectFromFilename(modelPath)
+        val detectedFamily = gguf?.family?.takeIf { it != ModelFamily.GENERIC }
+            ?: PromptFormatter.detectFamilyFromFilename(modelPath)
+        val trainedContext = gguf?.contextLength?.takeIf { it > 0 } ?: detectedFamily.defaultContextLength
 
-            if (nativeAvailable) {
-                val cfg = config!!
-                nativeHandle = nativeLoadModel(
-                    cfg.modelPath, cfg.contextSize, cfg.threads,
-                    cfg.gpuLayers, cfg.useMmap, cfg.flashAttention
-                )
-                _isLoaded = nativeHandle != 0L
-                if (!_isLoaded) {
-                    throw RuntimeException("Failed to load model: $modelPath")
-                }
-            } else {
-                _isLoaded = true // Mock mode
-            }
-        }
+        return InferenceConfig(
+            modelPath = modelPath,
+            promptFormat = detectedFormat,
+            modelFamily = detectedFamily,
+            contextSize = trainedContext.coerceAtMost(4096),
+            flashAttention = detectedFamily == ModelFamily.QWEN25
+        )
     }
 
     suspend fun loadModelWithConfig(inferenceConfig: InferenceConfig) = withContext(Dispatchers.IO) {
@@ -97,11 +131,15 @@ class LlamaCppEngine @Inject constructor(
                 nativeHandle = nativeLoadModel(
                     inferenceConfig.modelPath, inferenceConfig.contextSize,
                     inferenceConfig.threads, inferenceConfig.gpuLayers,
-                    inferenceConfig.useMmap, inferenceConfig.flashAttention
+                    inferenceConfig.useMmap, inferenceConfig.flashAttention,
+                    inferenceConfig.kvCacheType.ggmlType
                 )
                 _isLoaded = nativeHandle != 0L
+                if (!_isLoaded) {
+                    throw RuntimeException("Failed to load model: ${inferenceConfig.modelPath}")
+                }
             } else {
-                _isLoaded = true
+                _isLoaded = true // Mock mode
             }
         }
     }
@@ -118,46 +156,273 @@ class LlamaCppEngine @Inject constructor(
             nativeFreeModel(nativeHandle)
         }
         nativeHandle = 0L
+        draftModelPath = null
         _isLoaded = false
     }
 
+    /**
+     * Load a smaller model to draft tokens for the loaded model (speculative
+     * decoding). The draft proposes a few tokens at a time, the main model
+     * verifies them in a single batched decode, and the draft length adapts to
+     * how often drafts are accepted. Tool-calling generations stay non-speculative.
+     *
+     * The draft is released with the main model. Returns false when the draft
+     * cannot be used, e.g. because its vocabulary differs from the main model's;
+     * decoding then continues normally.
+     */
+    suspend fun loadDraftModel(modelPath: String): Boolean = withContext(Dispatchers.IO) {
+        nativeMutex.withLock {
+            if (!nativeAvailable || nativeHandle == 0L) return@withLock false
+            if (draftModelPath == modelPath) return@withLock true
+
+            val loaded = nativeLoadDraftModel(nativeHandle, modelPath, config?.threads ?: 4)
+            draftModelPath = if (loaded) modelPath else null
+            loaded
+        }
+    }
+
+    /** Release the draft model; decoding continues without speculation. */
+    suspend fun unloadDraftModel() = withContext(Dispatchers.IO) {
+        nativeMutex.withLock {
+            if (nativeAvailable && nativeHandle != 0L && draftModelPath != null) {
+                nativeFreeDraftModel(nativeHandle)
+            }
+            draftModelPath = null
+        }
+    }
+
+    /**
+     * [nativeMutex].withLock for a generation, recording how long the caller
+     * waited for the engine as the request's queue wait.
+     */
+    private suspend inline fun <T> withRequestLock(block: () -> T): T {
+        val requestedAt = System.nanoTime()
+        return withForegroundLock {
+            queueWaitMs = (System.nanoTime() - requestedAt) / 1_000_000f
+            block()
+        }
+    }
+
+    /**
+     * [nativeMutex].withLock for a request a caller is waiting on. While it
+     * waits for the lock, a running [generateBackground] stops at its next
+     * token and one that has not started yet is skipped.
+     */
+    private suspend inline fun <T> withForegroundLock(block: () -> T): T {
+        val native = nativeAvailable
+        if (native) nativeSetRequestWaiting(true)
+        try {
+            nativeMutex.lock()
+        } finally {
+            if (native) nativeSetRequestWaiting(false)
+        }
+        try {
+            return block()
+        } finally {
+            nativeMutex.unlock()
+        }
+    }
+
+    /**
+     * Memory breakdown of the loaded model, or null without one. Reads the
+     * model file's page cache residency, which takes a few milliseconds on a
+     * large model, so call it between requests rather than per token.
+     */
+    suspend fun memoryStats(): NativeMemoryStats? = withContext(Dispatchers.IO) {
+        nativeMutex.withLock {
+            if (!nativeAvailable || nativeHandle == 0L) return@withLock null
+            NativeMemoryStats.fromNative(nativeMemoryStats(nativeHandle))
+        }
+    }
+
+    /** Read back decode statistics after a native generation (caller holds the mutex). */
+    private fun publishGenerationStats() {
+        val stats = GenerationStats.fromNative(nativeGetGenerationStats(nativeHandle), queueWaitMs)
+        _generationStats.value = stats
+        _requestStats.tryEmit(stats)
+    }
+
+    /**
+     * One-shot generation. Inside a [GenerationBatch] a call without stop
+     * strings joins the batch and runs through [generateBatch] with the other
+     * participants' generations.
+     */
     override suspend fun generate(
         prompt: String,
         systemPrompt: String,
         maxTokens: Int,
-        temperature: Float
-    ): String = withContext(Dispatchers.IO) {
+        temperature: Float,
+        stop: List<String>
+    ): String {
+        val batch = currentCoroutineContext()[GenerationBatch]
+        if (batch != null && stop.isEmpty()) {
+            return batch.generate(GenerationRequest(prompt, systemPrompt, maxTokens, temperature))
+        }
+        return generateScored(prompt, systemPrompt, maxTokens, temperature, stop).text
+    }
+
+    /**
+     * Runs up to [MAX_BATCH] requests at a time as one native batch: every
+     * decode step advances all of them. Requests that do not fit in the context
+     * together fall back to one at a time.
+     */
+    override suspend fun generateBatch(requests: List<GenerationRequest>): List<String> {
+        if (!nativeAvailable || nativeHandle == 0L) {
+            return requests.map { generateScored(it.prompt, it.systemPrompt, it.maxTokens, it.temperature).text }
+        }
+        return withContext(Dispatchers.IO) {
+            check(_isLoaded) { "Model not loaded. Call loadModel() first." }
+            val prompts = requests.map { buildPrompt(it.systemPrompt, it.prompt) }
+            withRequestLock {
+                val cfg = config!!
+                requests.indices.chunked(MAX_BATCH).flatMap { chunk ->
+                    runBatch(chunk.map { prompts[it] }, chunk.map { requests[it] }, cfg)
+                }
+            }
+        }
+    }
+
+    /** One native batch, or one generation at a time when it does not fit (caller holds the mutex). */
+    private fun runBatch(prompts: List<String>, requests: List<GenerationRequest>, cfg: InferenceConfig): List<String> {
+        val outputs = if (requests.size > 1) {
+            nativeGenerateBatch(
+                nativeHandle,
+                prompts.toTypedArray(),
+                requests.map { it.maxTokens }.toIntArray(),
+                requests.map { it.temperature }.toFloatArray(),
+                cfg.topP, cfg.topK, cfg.repeatPenalty
+            )
+        } else {
+            null
+        }
+        if (outputs != null) {
+            publishGenerationStats()
+            return outputs.toList()
+        }
+
+        return requests.mapIndexed { i, request ->
+            nativeGenerate(
+                nativeHandle, prompts[i], request.maxTokens, request.temperature,
+                cfg.topP, cfg.topK, cfg.repeatPenalty, emptyArray()
+            ).also { publishGenerationStats() }
+        }
+    }
+
+    /**
+     * Like [generate], but also returns the per-token confidence of the
+     * generated text (see [GenerationConfidence]) and its decode statistics.
+     * In mock mode the confidence is empty.
+     */
+    suspend fun generateScored(
+        prompt: String,
+        systemPrompt: String = "",
+        maxTokens: Int = 512,
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
+    ): ScoredGeneration = withContext(Dispatchers.IO) {
         check(_isLoaded) { "Model not loaded. Call loadModel() first." }
 
         val fullPrompt = buildPrompt(systemPrompt, prompt)
 
         if (nativeAvailable && nativeHandle != 0L) {
-            nativeMutex.withLock {
+            withRequestLock {
                 val cfg = config!!
-                nativeGenerate(
+                val text = nativeGenerate(
                     nativeHandle, fullPrompt, maxTokens, temperature,
-                    cfg.topP, cfg.topK, cfg.repeatPenalty
+                    cfg.topP, cfg.topK, cfg.repeatPenalty, stop.toTypedArray()
+                )
+                publishGenerationStats()
+                ScoredGeneration(
+                    text = text,
+                    confidence = GenerationConfidence.fromNative(nativeGetTokenConfidence(nativeHandle)),
+                    stats = _generationStats.value
                 )
             }
         } else {
             val modelInfo = config?.let { "${it.modelFamily.displayName} (${it.promptFormat.name})" } ?: "unknown"
-            "[Un-Dios AI | $modelInfo] I received your message: \"$prompt\". " +
+            val text = "[Un-Dios AI | $modelInfo] I received your message: \"$prompt\". " +
                 "Native library not available — running in mock mode."
+            ScoredGeneration(text, GenerationConfidence(), GenerationStats())
         }
     }
 
-    override fun generateStream(
+    /**
+     * Like [generateScored], but generated by the draft model alone
+     * ([loadDraftModel]), e.g. as the cheap first attempt of a cascade. The
+     * prompt and answer stay in the draft's KV cache, so a following
+     * [generate] of the same prompt on the main model does not decode the
+     * prompt in the draft again and starts from the answer as its draft.
+     *
+     * @return null without a draft model or when generation fails
+     */
+    suspend fun generateDraftScored(
+        prompt: String,
+        systemPrompt: String = "",
+        maxTokens: Int = 512,
+        temperature: Float = 0.7f,
+        stop: List<String> = emptyList()
+    ): ScoredGeneration? = withContext(Dispatchers.IO) {
+        if (!nativeAvailable || nativeHandle == 0L || draftModelPath == null) return@withContext null
+
+        val fullPrompt = buildPrompt(systemPrompt, prompt)
+        withRequestLock {
+            if (nativeHandle == 0L || draftModelPath == null) return@withRequestLock null
+            val cfg = config!!
+            val text = nativeGenerateDraft(
+                nativeHandle, fullPrompt, maxTokens, temperature,
+                cfg.topP, cfg.topK, cfg.repeatPenalty, stop.toTypedArray()
+            ) ?: return@withRequestLock null
+            publishGenerationStats()
+            ScoredGeneration(
+                text = text,
+                confidence = GenerationConfidence.fromNative(nativeGetTokenConfidence(nativeHandle)),
+                stats = _generationStats.value
+            )
+        }
+    }
+
+    /**
+     * Generate for background work such as the rolling conversation summary,
+     * without disturbing the conversation kept in the KV cache: the native
+     * layer decodes the prompt in a KV sequence of its own and drops it
+     * afterwards, so the next chat turn still reuses its prefix. Any other
+     * request preempts it (see [withForegroundLock]).
+     *
+     * @return null when preempted, when the prompt does not fit in the context
+     *   next to the conversation, or without a native model
+     */
+    override suspend fun generateBackground(
         prompt: String,
         systemPrompt: String,
         maxTokens: Int,
         temperature: Float
+    ): String? = withContext(Dispatchers.IO) {
+        if (!nativeAvailable || nativeHandle == 0L) return@withContext null
+
+        val fullPrompt = buildPrompt(systemPrompt, prompt)
+        nativeMutex.withLock {
+            val cfg = config
+            if (!_isLoaded || nativeHandle == 0L || cfg == null) return@withLock null
+            nativeGenerateBackground(
+                nativeHandle, fullPrompt, maxTokens, temperature,
+                cfg.topP, cfg.topK, cfg.repeatPenalty
+            )
+        }
+    }
+
+    override fun generateStream(
+        prompt: String,
+        systemPrompt: String,
+        maxTokens: Int,
+        temperature: Float,
+        stop: List<String>
     ): Flow<String> = callbackFlow {
         check(_isLoaded) { "Model not loaded. Call loadModel() first." }
 
         val fullPrompt = buildPrompt(systemPrompt, prompt)
 
         if (nativeAvailable && nativeHandle != 0L) {
-            nativeMutex.withLock {
+            withRequestLock {
                 val cfg = config!!
                 val callback = object : LlamaStreamCallback {
                     override fun onToken(token: String) {
@@ -166,8 +431,9 @@ class LlamaCppEngine @Inject constructor(
                 }
                 nativeGenerateStream(
                     nativeHandle, fullPrompt, maxTokens, temperature,
-                    cfg.topP, cfg.topK, cfg.repeatPenalty, callback
+                    cfg.topP, cfg.topK, cfg.repeatPenalty, stop.toTypedArray(), callback
                 )
+                publishGenerationStats()
             }
         } else {
             val response = "[Un-Dios | mock] Processing locally..."
@@ -183,17 +449,18 @@ class LlamaCppEngine @Inject constructor(
     override suspend fun generateRaw(
         formattedPrompt: String,
         maxTokens: Int,
-        temperature: Float
+        temperature: Float,
+        stop: List<String>
     ): String = withContext(Dispatchers.IO) {
         check(_isLoaded) { "Model not loaded. Call loadModel() first." }
 
         if (nativeAvailable && nativeHandle != 0L) {
-            nativeMutex.withLock {
+            withRequestLock {
                 val cfg = config!!
                 nativeGenerate(
                     nativeHandle, formattedPrompt, maxTokens, temperature,
-                    cfg.topP, cfg.topK, cfg.repeatPenalty
-                )
+                    cfg.topP, cfg.topK, cfg.repeatPenalty, stop.toTypedArray()
+                ).also { publishGenerationStats() }
             }
         } else {
             val modelInfo = config?.let { "${it.modelFamily.displayName} (${it.promptFormat.name})" } ?: "unknown"
@@ -202,6 +469,80 @@ class LlamaCppEngine @Inject constructor(
         }
     }
 
+    /**
+     * Generate from structured turns. The native layer renders them with the
+     * model's own chat template (read from the GGUF) and tokenizes each message
+     * separately, reusing cached tokens for turns unchanged since the last call.
+     *
+     * The turns are synced against the native chat session: the longest prefix
+     * still in the KV cache (including the assistant's own sampled tokens) is
+     * kept, so a call that only appends a tool result decodes just that turn.
+     * In mock mode the turns are formatted with [PromptFormatter] instead.
+     *
+     * With [onToolCall], the native decode loop parses `<tool_call>` blocks as
+     * tokens arrive, reports each call the moment its JSON object closes, and
+     * stops once the model moves on from tool calls.
+     * [toolGrammar] is compiled natively once per distinct grammar and applied
+     * lazily from the first `<tool_call>`; text the grammar fully determines is
+     * decoded as a batch rather than sampled.
+     */
+    override suspend fun generateChat(
+        turns: List<ConversationTurn>,
+        maxTokens: Int,
+        temperature: Float,
+        onToolCall: ((ToolCall) -> Unit)?,
+        toolGrammar: ToolCallGrammar?
+    ): String = withContext(Dispatchers.IO) {
+        check(_isLoaded) { "Model not loaded. Call loadModel() first." }
+
+        if (nativeAvailable && nativeHandle != 0L) {
+            withRequestLock {
+                val cfg = config!!
+                val callback = onToolCall?.let { handler ->
+                    object : LlamaToolCallCallback {
+                        override fun onToolCall(name: String, arguments: String) {
+                            ToolCallParser.parseCall(name, arguments)?.let(handler)
+                        }
+                    }
+                }
+                nativeGenerateChat(
+                    nativeHandle,
+                    turns.map { it.role }.toTypedArray(),
+                    turns.map { it.content }.toTypedArray(),
+                    maxTokens, temperature, cfg.topP, cfg.topK, cfg.repeatPenalty,
+                    callback, toolGrammar?.gbnf, toolGrammar?.scaffold
+                ).also { publishGenerationStats() }
+            }
+        } else {
+            generateRaw(PromptFormatter.formatMultiTurn(promptFormat, turns), maxTokens, temperature)
+        }
+    }
+
+    /**
+     * Score [labels] as continuations of the formatted prompt. The native layer
+     * keeps the prompt in the KV cache, so repeated classification with the same
+     * system prompt only decodes the new user input. In mock mode every label
+     * gets the same probability.
+     */
+    override suspend fun scoreCandidates(
+        prompt: String,
+        labels: List<String>,
+        systemPrompt: String
+    ): List<Float> = withContext(Dispatchers.IO) {
+        check(_isLoaded) { "Model not loaded. Call loadModel() first." }
+        if (labels.isEmpty()) return@withContext emptyList()
+
+        if (nativeAvailable && nativeHandle != 0L) {
+            val fullPrompt = buildPrompt(systemPrompt, prompt)
+            val probs = withForegroundLock {
+                nativeScoreCandidates(nativeHandle, fullPrompt, labels.toTypedArray())
+            }
+            checkNotNull(probs) { "Label scoring failed" }.toList()
+        } else {
+            List(labels.size) { 1f / labels.size }
+        }
+    }
+
     override suspend fun tokenize(text: String): List<Int> = withContext(Dispatchers.IO) {
         if (nativeAvailable && nativeHandle != 0L) {
             nativeTokenize(nativeHandle, text).toList()
@@ -221,20 +562,50 @@ class LlamaCppEngine @Inject constructor(
     private external fun nativeInit(nativeLibDir: String)
     private external fun nativeLoadModel(
         path: String, contextSize: Int, threads: Int,
-        gpuLayers: Int, useMmap: Boolean, flashAttention: Boolean
+        gpuLayers: Int, useMmap: Boolean, flashAttention: Boolean, kvType: Int
     ): Long
     private external fun nativeFreeModel(handle: Long)
     private external fun nativeGenerate(
         handle: Long, prompt: String, maxTokens: Int, temperature: Float,
+        topP: Float, topK: Int, repeatPenalty: Float, stop: Array<String>
+    ): String
+    private external fun nativeGenerateDraft(
+        handle: Long, prompt: String, maxTokens: Int, temperature: Float,
+        topP: Float, topK: Int, repeatPenalty: Float, stop: Array<String>
+    ): String?
+    private external fun nativeGenerateBackground(
+        handle: Long, prompt: String, maxTokens: Int, temperature: Float,
+        topP: Float, topK: Int, repeatPenalty: Float
+    ): String?
+    private external fun nativeSetRequestWaiting(waiting: Boolean)
+    private external fun nativeGenerateBatch(
+        handle: Long, prompts: Array<String>, maxTokens: IntArray, temperatures: FloatArray,
         topP: Float, topK: Int, repeatPenalty: Float
+    ): Array<String>?
+    private external fun nativeGenerateChat(
+        handle: Long, roles: Array<String>, contents: Array<String>, maxTokens: Int,
+        temperature: Float, topP: Float, topK: Int, repeatPenalty: Float,
+        toolCallback: LlamaToolCallCallback?, toolGrammar: String?, toolScaffold: String?
     ): String
+    private external fun nativeLoadDraftModel(handle: Long, path: String, threads: Int): Boolean
+    private external fun nativeFreeDraftModel(handle: Long)
+    private external fun nativeGetGenerationStats(handle: Long): FloatArray
+    private external fun nativeGetTokenConfidence(handle: Long): FloatArray
+    private external fun nativeMemoryStats(handle: Long): LongArray
+    private external fun nativeScoreCandidates(handle: Long, prompt: String, labels: Array<String>): FloatArray?
     private external fun nativeGenerateStream(
         handle: Long, prompt: String, maxTokens: Int, temperature: Float,
-        topP: Float, topK: Int, repeatPenalty: Float, callback: LlamaStreamCallback
+        topP: Float, topK: Int, repeatPenalty: Float, stop: Array<String>,
+        callback: LlamaStreamCallback
     )
     private external fun nativeTokenize(handle: Long, text: String): IntArray
     private external fun nativeShutdown()
 
+    private companion object {
+        /** Most generations run in one native batch (the context holds 16 sequences). */
+        const val MAX_BATCH = 8
+    }
+
     /**
      * Shut down the llama.cpp backend. Call once at application exit.
      * After this call, no further native operations are valid.
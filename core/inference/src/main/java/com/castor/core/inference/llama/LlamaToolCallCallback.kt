@@ -0,0 +1,10 @@
+package com.castor.core.inference.llama
+
+/**
+ * Callback interface for tool calls detected while native llama.cpp is decoding.
+ * Called from JNI with the name and raw `arguments` JSON of each `<tool_call>`
+ * block as soon as its JSON object closes.
+ */
+interface LlamaToolCallCallback {
+    fun onToolCall(name: String, arguments: String)
+}
@@ -0,0 +1,64 @@
+package com.castor.core.inference.llama
+
+/**
+ * Native memory of the loaded model, from the buffers llama.cpp allocated.
+ *
+ * [modelMappedBytes] are weights read straight from the memory-mapped GGUF:
+ * file-backed pages the kernel may evict under pressure, of which
+ * [modelResidentBytes] are in the page cache right now. Everything else
+ * (weights repacked for the CPU in [modelAnonBytes], the KV cache, compute
+ * buffers, batches and a draft model) is anonymous memory held until the
+ * model is unloaded. Sizes are 0 when llama.cpp did not report them.
+ *
+ * @param kvCellsUsed KV cache positions in use, counted per sequence
+ * @param computeBytes Compute graph buffers and the logits output buffer
+ * @param batchBytes Host arrays of the engine's `llama_batch` allocations
+ * @param draftBytes All buffers of the draft model and its context
+ * @param anonRssBytes Anonymous resident memory of the whole process
+ * @param requestPeakAnonBytes Highest [anonRssBytes] sampled during the last
+ *   request (at its start, after the prompt and at its end)
+ */
+data class NativeMemoryStats(
+    val modelMappedBytes: Long = 0,
+    val modelAnonBytes: Long = 0,
+    val modelFileBytes: Long = 0,
+    val modelResidentBytes: Long = 0,
+    val kvBytes: Long = 0,
+    val kvCellsUsed: Int = 0,
+    val kvCells: Int = 0,
+    val computeBytes: Long = 0,
+    val batchBytes: Long = 0,
+    val draftBytes: Long = 0,
+    val anonRssBytes: Long = 0,
+    val requestPeakAnonBytes: Long = 0
+) {
+    val modelBytes: Long get() = modelMappedBytes + modelAnonBytes
+
+    /** Native memory of the model that the kernel cannot reclaim. */
+    val anonBytes: Long get() = modelAnonBytes + kvBytes + computeBytes + batchBytes + draftBytes
+
+    /** Share of [modelMappedBytes] currently in the page cache. */
+    val residentFraction: Float
+        get() = if (modelFileBytes > 0) modelResidentBytes.toFloat() / modelFileBytes else 0f
+
+    /** Share of the KV cache in use. */
+    val kvFill: Float get() = if (kvCells > 0) kvCellsUsed.toFloat() / kvCells else 0f
+
+    companion object {
+        /** Decode the array returned by `nativeMemoryStats`. */
+        internal fun fromNative(values: LongArray): NativeMemoryStats = NativeMemoryStats(
+            modelMappedBytes = values[0],
+            modelAnonBytes = values[1],
+            modelFileBytes = values[2],
+            modelResidentBytes = values[3],
+            kvBytes = values[4],
+            kvCellsUsed = values[5].toInt(),
+            kvCells = values[6].toInt(),
+            computeBytes = values[7],
+            batchBytes = values[8],
+            draftBytes = values[9],
+            anonRssBytes = values[10],
+            requestPeakAnonBytes = values[11]
+        )
+    }
+}
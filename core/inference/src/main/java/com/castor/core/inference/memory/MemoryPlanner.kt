@@ -0,0 +1,299 @@
+package com.castor.core.inference.memory
+
+import android.app.ActivityManager
+import android.content.Context
+import android.util.Log
+import com.castor.core.inference.KvCacheType
+import com.castor.core.inference.gguf.GgufInfo
+import com.castor.core.inference.gguf.ModelIndex
+import com.castor.core.inference.llama.NativeMemoryStats
+import dagger.hilt.android.qualifiers.ApplicationContext
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
+import java.io.File
+import java.util.concurrent.ConcurrentHashMap
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * What a model is predicted to cost once loaded, and the context and KV
+ * cache type chosen to make it fit.
+ *
+ * @param fits Whether the prediction is within [budgetBytes]; when false the
+ *   plan is the smallest configuration and loading may still fail
+ * @param weightBytes Model weights (the GGUF file, memory-mapped)
+ * @param kvBytes KV cache for [contextSize] tokens of [kvCacheType]
+ * @param computeBytes Compute buffers for one micro-batch
+ * @param fixedBytes Vocabulary and other per-load allocations
+ * @param budgetBytes Share of available memory the model may use
+ * @param draftBytes Draft model reserved for next to it (weights, KV cache
+ *   and compute buffers), 0 when none was planned for
+ */
+data class MemoryPlan(
+    val contextSize: Int,
+    val kvCacheType: KvCacheType,
+    val fits: Boolean,
+    val weightBytes: Long,
+    val kvBytes: Long,
+    val computeBytes: Long,
+    val fixedBytes: Long,
+    val budgetBytes: Long,
+    val draftBytes: Long = 0
+) {
+    /** Everything the model (and its draft) is predicted to keep resident. */
+    val predictedBytes: Long get() = weightBytes + kvBytes + computeBytes + fixedBytes + draftBytes
+
+    /**
+     * The part of [predictedBytes] that is anonymous memory rather than mapped
+     * file pages, without the draft (loaded after the model is measured).
+     */
+    val predictedAnonBytes: Long get() = kvBytes + computeBytes + fixedBytes
+}
+
+/**
+ * Resident set of this process split as the kernel reports it: anonymous
+ * memory (KV cache, compute buffers) and file-backed pages (mapped weights).
+ */
+data class ResidentSet(val anonBytes: Long, val fileBytes: Long)
+
+/**
+ * Predicted versus measured memory of the last load.
+ *
+ * Weights are memory-mapped, so [actualFileBytes] covers only the pages
+ * touched during load and grows toward [MemoryPlan.weightBytes] as the model
+ * runs; [actualAnonBytes] is directly comparable to [MemoryPlan.predictedAnonBytes].
+ *
+ * @param native The engine's own breakdown (buffer sizes, residency, peak
+ *   of the last request), refreshed as requests complete
+ */
+data class MemoryReport(
+    val modelName: String,
+    val plan: MemoryPlan,
+    val actualAnonBytes: Long,
+    val actualFileBytes: Long,
+    val native: NativeMemoryStats? = null
+)
+
+/**
+ * Picks the context size and KV cache type a model is loaded with so that it
+ * fits in the memory available right now, instead of a fixed context for
+ * every model and device.
+ *
+ * The prediction (`memory_plan.h`) uses the GGUF shape from [ModelIndex],
+ * the model file size and [ActivityManager.MemoryInfo]: the largest context
+ * up to [maxContextSize] (and the trained context) whose weights, KV cache,
+ * compute buffers and fixed allocations fit in [headroom] of available
+ * memory, keeping an F16 cache when that already reaches the ceiling.
+ *
+ * Once a model has been loaded, the KV cache and compute buffers llama.cpp
+ * actually allocated ([NativeMemoryStats]) calibrate the next plan for it,
+ * so architectures the arithmetic gets wrong (sliding-window attention,
+ * larger graphs) are planned from measured sizes.
+ */
+@Singleton
+class MemoryPlanner @Inject constructor(
+    @ApplicationContext private val context: Context,
+    private val modelIndex: ModelIndex
+) {
+    companion object {
+        private const val TAG = "MemoryPlanner"
+
+        /** Smallest context worth loading a model with. */
+        const val MIN_CONTEXT_SIZE = 512
+
+        /** Micro-batch and parallel sequences of the native context (llama_engine.h). */
+        private const val MICRO_BATCH = 512
+        private const val SEQUENCES = 16
+
+        /** Bounds of a measured-over-predicted calibration, against bad reports. */
+        private const val MIN_SCALE = 0.25
+        private const val MAX_SCALE = 4.0
+    }
+
+    /** Measured over predicted KV and compute buffers of a model's last load. */
+    private data class Calibration(val kvScale: Double = 1.0, val computeScale: Double = 1.0)
+
+    /** Keyed by model file name. */
+    private val calibrations = ConcurrentHashMap<String, Calibration>()
+
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-llama")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    /** Share of available memory a loaded model may use. */
+    @Volatile var headroom: Double = 0.8
+
+    /** Largest context planned for, whatever memory allows. */
+    @Volatile var maxContextSize: Int = 8192
+
+    private val _lastReport = MutableStateFlow<MemoryReport?>(null)
+
+    /** Predicted versus measured memory of the most recent planned load. */
+    val lastReport: StateFlow<MemoryReport?> = _lastReport.asStateFlow()
+
+    /**
+     * Plan for loading [model], or null when its header cannot be read (the
+     * engine then falls back to its default context).
+     *
+     * @param flashAttention Whether the model is loaded with flash attention;
+     *   quantized KV caches are only considered with it
+     * @param draft Model that will be attached as a speculative draft with a
+     *   context of the same size; its footprint is reserved in the plan
+     */
+    fun plan(model: File, flashAttention: Boolean, draft: File? = null): MemoryPlan? {
+        if (!nativeAvailable) return null
+        val info = modelIndex.info(model)?.takeIf(::hasShape) ?: return null
+        val draftInfo = draft?.let { modelIndex.info(it) }?.takeIf(::hasShape)
+
+        val calibration = calibrations[model.name] ?: Calibration()
+        val raw = nativePlan(
+            model.length(), info.blockCount, info.embeddingLength, info.headCount, info.headCountKv,
+            info.keyLength, info.valueLength, info.vocabSize, info.contextLength,
+            availableMemoryBytes(), headroom, MIN_CONTEXT_SIZE, maxContextSize, MICRO_BATCH, SEQUENCES,
+            flashAttention, calibration.kvScale, calibration.computeScale,
+            if (draftInfo != null) draft.length() else 0L, draftInfo?.blockCount ?: 0,
+            draftInfo?.embeddingLength ?: 0, draftInfo?.headCount ?: 0, draftInfo?.headCountKv ?: 0,
+            draftInfo?.keyLength ?: 0, draftInfo?.valueLength ?: 0, draftInfo?.vocabSize ?: 0
+        )
+        val plan = MemoryPlan(
+            contextSize = raw[1].toInt(),
+            kvCacheType = KvCacheType.fromGgmlType(raw[2].toInt()),
+            fits = raw[0] != 0L,
+            weightBytes = raw[3],
+            kvBytes = raw[4],
+            computeBytes = raw[5],
+            fixedBytes = raw[6],
+            budgetBytes = raw[7],
+            draftBytes = raw[8]
+        )
+        if (!plan.fits) {
+            Log.w(TAG, "${model.name} is predicted to need ${plan.predictedBytes shr 20} MB, " +
+                "over the ${plan.budgetBytes shr 20} MB budget; loading with the smallest configuration")
+        }
+        return plan
+    }
+
+    /**
+     * Whether [draft] fits next to the model that is already loaded, with a
+     * context of [contextSize] tokens, in [headroom] of the memory available
+     * now. True when its header cannot be read, as nothing can be predicted.
+     */
+    fun draftFits(draft: File, contextSize: Int): Boolean {
+        if (!nativeAvailable || contextSize <= 0) return true
+        val info = modelIndex.info(draft)?.takeIf(::hasShape) ?: return true
+        val raw = nativePlan(
+            draft.length(), info.blockCount, info.embeddingLength, info.headCount, info.headCountKv,
+            info.keyLength, info.valueLength, info.vocabSize, 0,
+            availableMemoryBytes(), headroom, contextSize, contextSize, MICRO_BATCH, 1,
+            false, 1.0, 1.0,
+            0L, 0, 0, 0, 0, 0, 0, 0
+        )
+        if (raw[0] == 0L) {
+            Log.w(TAG, "Draft ${draft.name} needs ${(raw[3] + raw[4] + raw[5] + raw[6]) shr 20} MB, " +
+                "over the ${raw[7] shr 20} MB left")
+        }
+        return raw[0] != 0L
+    }
+
+    private fun hasShape(info: GgufInfo): Boolean = info.blockCount > 0 && info.embeddingLength > 0
+
+    /** Current resident set of this process, from `/proc/self/status`. */
+    fun residentSet(): ResidentSet {
+        var anon = 0L
+        var file = 0L
+        try {
+            File("/proc/self/status").forEachLine { line ->
+                when {
+                    line.startsWith("RssAnon:") -> anon = parseKb(line)
+                    line.startsWith("RssFile:") -> file = parseKb(line)
+                }
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to read resident set: ${e.message}")
+        }
+        return ResidentSet(anon, file)
+    }
+
+    /**
+     * Record the resident set growth of loading [modelName] against its
+     * [plan], and calibrate the next plan for the model with the buffer sizes
+     * in [native].
+     */
+    fun report(
+        modelName: String,
+        plan: MemoryPlan,
+        before: ResidentSet,
+        after: ResidentSet,
+        native: NativeMemoryStats? = null
+    ): MemoryReport {
+        val report = MemoryReport(
+            modelName = modelName,
+            plan = plan,
+            actualAnonBytes = (after.anonBytes - before.anonBytes).coerceAtLeast(0),
+            actualFileBytes = (after.fileBytes - before.fileBytes).coerceAtLeast(0),
+            native = native
+        )
+        Log.i(
+            TAG,
+            "$modelName: ctx=${plan.contextSize} kv=${plan.kvCacheType} | " +
+                "anon predicted ${plan.predictedAnonBytes shr 20} MB, actual ${report.actualAnonBytes shr 20} MB | " +
+                "weights ${plan.weightBytes shr 20} MB, resident ${report.actualFileBytes shr 20} MB"
+        )
+        if (native != null) {
+            Log.i(
+                TAG,
+                "$modelName: kv predicted ${plan.kvBytes shr 20} MB, allocated ${native.kvBytes shr 20} MB | " +
+                    "compute predicted ${plan.computeBytes shr 20} MB, allocated ${native.computeBytes shr 20} MB | " +
+                    "weights mapped ${native.modelMappedBytes shr 20} MB, anonymous ${native.modelAnonBytes shr 20} MB"
+            )
+            calibrate(modelName, plan, native)
+        }
+        _lastReport.value = report
+        return report
+    }
+
+    /** Update the last report with fresh [native] figures, e.g. after a request. */
+    fun observe(native: NativeMemoryStats) {
+        _lastReport.value = _lastReport.value?.copy(native = native)
+    }
+
+    /**
+     * Ratio of the allocated to the uncalibrated predicted size of the KV
+     * cache and compute buffers, kept for the next plan of [modelName].
+     */
+    private fun calibrate(modelName: String, plan: MemoryPlan, native: NativeMemoryStats) {
+        val previous = calibrations[modelName] ?: Calibration()
+        fun scale(allocated: Long, predicted: Long, previousScale: Double): Double {
+            if (allocated <= 0 || predicted <= 0) return previousScale
+            return (allocated * previousScale / predicted).coerceIn(MIN_SCALE, MAX_SCALE)
+        }
+        calibrations[modelName] = Calibration(
+            kvScale = scale(native.kvBytes, plan.kvBytes, previous.kvScale),
+            computeScale = scale(native.computeBytes, plan.computeBytes, previous.computeScale)
+        )
+    }
+
+    private fun availableMemoryBytes(): Long {
+        val activityManager = context.getSystemService(Context.ACTIVITY_SERVICE) as ActivityManager
+        val info = ActivityManager.MemoryInfo()
+        activityManager.getMemoryInfo(info)
+        return info.availMem
+    }
+
+    /** "RssAnon:	  123456 kB" -> bytes */
+    private fun parseKb(line: String): Long =
+        (line.substringAfter(':').trim().substringBefore(' ').toLongOrNull() ?: 0L) * 1024
+
+    private external fun nativePlan(
+        weightBytes: Long, layers: Int, embedding: Int, heads: Int, headsKv: Int, keyLength: Int, valueLength: Int,
+        vocab: Int, trainedContext: Int,
+        availableBytes: Long, headroom: Double, minContext: Int, maxContext: Int, microBatch: Int, sequences: Int,
+        flashAttention: Boolean, kvScale: Double, computeScale: Double,
+        draftWeightBytes: Long, draftLayers: Int, draftEmbedding: Int, draftHeads: Int, draftHeadsKv: Int,
+        draftKeyLength: Int, draftValueLength: Int, draftVocab: Int
+    ): LongArray
+}
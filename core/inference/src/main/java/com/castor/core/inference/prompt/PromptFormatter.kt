@@ -87,18 +87,7 @@ object PromptFormatter {
         turns: List<ConversationTurn>,
         toolsBlock: String? = null
     ): String {
-        // Inject tools block into system prompt if present
-        val augmentedTurns = if (!toolsBlock.isNullOrBlank()) {
-            turns.map { turn ->
-                if (turn.role == "system") {
-                    turn.copy(content = turn.content + "\n" + toolsBlock)
-                } else {
-                    turn
-                }
-            }
-        } else {
-            turns
-        }
+        val augmentedTurns = injectToolsBlock(turns, toolsBlock)
 
         return when (format) {
             PromptFormat.CHATML -> formatMultiTurnChatML(augmentedTurns)
@@ -110,6 +99,30 @@ object PromptFormatter {
         }
     }
 
+    /**
+     * Append the tools block to the system turn(s), leaving other turns untouched.
+     *
+     * Used directly when the turns are rendered by the model's own chat template
+     * (see [InferenceEngine.generateChat]) rather than by this formatter.
+     *
+     * @param turns The ordered list of conversation turns
+     * @param toolsBlock The `<tools>` XML block to inject, or null/blank to skip
+     * @return The turns with the tools block appended to the system prompt
+     */
+    fun injectToolsBlock(
+        turns: List<ConversationTurn>,
+        toolsBlock: String?
+    ): List<ConversationTurn> {
+        if (toolsBlock.isNullOrBlank()) return turns
+        return turns.map { turn ->
+            if (turn.role == "system") {
+                turn.copy(content = turn.content + "\n" + toolsBlock)
+            } else {
+                turn
+            }
+        }
+    }
+
     /**
      * Detect the likely prompt format from a model filename.
      *
@@ -179,7 +192,9 @@ object PromptFormatter {
             if (turn.role == "tool") {
                 // Tool responses use the Qwen2.5 <tool_response> format
                 // injected directly without ChatML role wrapper
+                append("<tool_response>\n")
                 append(turn.content)
+                append("\n</tool_response>\n")
             } else {
                 append("<|im_start|>${turn.role}\n")
                 append(turn.content)
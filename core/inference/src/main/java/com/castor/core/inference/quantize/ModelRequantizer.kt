@@ -0,0 +1,248 @@
+package com.castor.core.inference.quantize
+
+import android.app.ActivityManager
+import android.content.Context
+import android.util.Log
+import androidx.work.WorkInfo
+import com.castor.core.inference.gguf.ModelIndex
+import com.castor.core.inference.llama.LlamaCppEngine
+import dagger.hilt.android.qualifiers.ApplicationContext
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.withContext
+import org.json.JSONArray
+import org.json.JSONObject
+import java.io.File
+import java.io.IOException
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * A quantization a model can be converted to.
+ *
+ * @param type llama.cpp name of the type, e.g. "Q4_K_M"
+ * @param ftype The matching `llama_ftype` value
+ * @param bitsPerWeight Average storage cost, used to predict the output size
+ */
+data class QuantTarget(val type: String, val ftype: Int, val bitsPerWeight: Double)
+
+/**
+ * Outcome of a finished requantization, shown next to the model it produced.
+ *
+ * @param perplexityBefore Perplexity of the source on the bundled sample (NaN if it could not be measured)
+ * @param perplexityAfter Perplexity of the output on the same sample
+ */
+data class RequantizeResult(
+    val sourceName: String,
+    val outputName: String,
+    val type: String,
+    val sourceBytes: Long,
+    val outputBytes: Long,
+    val perplexityBefore: Float,
+    val perplexityAfter: Float,
+    val createdAt: Long
+)
+
+/**
+ * Converts a downloaded model to a smaller quantization that fits the
+ * device's memory, and measures what that costs in quality.
+ *
+ * The target type is the highest-quality one in [TARGETS] that is smaller
+ * than the source and whose weights, plus the KV cache for the target
+ * context and a fixed runtime overhead, fit in the device's memory less a
+ * fixed reserve ([modelMemoryBytes]). Quality is measured as perplexity on a bundled text
+ * sample (`assets/perplexity_sample.txt`) before and after.
+ *
+ * Runs in the background through [RequantizeWorker]; results are kept in
+ * `filesDir/requantize_results.json`.
+ */
+@Singleton
+class ModelRequantizer @Inject constructor(
+    @ApplicationContext private val context: Context,
+    // Constructed first so the llama backend is initialized before native calls
+    @Suppress("unused") private val engine: LlamaCppEngine,
+    private val modelIndex: ModelIndex
+) {
+    companion object {
+        private const val TAG = "ModelRequantizer"
+        private const val SAMPLE_ASSET = "perplexity_sample.txt"
+
+        /** Context the engine loads models with (see LlamaCppEngine.loadModel). */
+        const val DEFAULT_CONTEXT_SIZE = 4096
+
+        /** Memory left to the system, other apps and the app itself. */
+        private const val SYSTEM_RESERVE_BYTES = 2L * 1024 * 1024 * 1024
+
+        /** Compute buffers, tokenizer and other per-load allocations. */
+        private const val RUNTIME_OVERHEAD_BYTES = 300L * 1024 * 1024
+
+        private const val PERPLEXITY_CONTEXT = 256
+        private const val PERPLEXITY_WINDOWS = 8
+
+        /** Candidate types, best quality first. IQ2/IQ1 types need an importance matrix and are left out. */
+        val TARGETS = listOf(
+            QuantTarget("Q6_K", 18, 6.56),
+            QuantTarget("Q5_K_M", 17, 5.69),
+            QuantTarget("Q4_K_M", 15, 4.85),
+            QuantTarget("IQ4_XS", 30, 4.46),
+            QuantTarget("Q3_K_M", 12, 3.91),
+            QuantTarget("Q3_K_S", 11, 3.50),
+            QuantTarget("Q2_K", 10, 3.35)
+        )
+    }
+
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-llama")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    private val resultsFile: File get() = File(context.filesDir, "requantize_results.json")
+
+    /**
+     * Memory a loaded model may occupy: total RAM minus a fixed reserve.
+     * Unlike the currently available memory it does not shrink while a model
+     * is loaded, so a model is not judged too large because of itself.
+     */
+    fun modelMemoryBytes(): Long {
+        val activityManager = context.getSystemService(Context.ACTIVITY_SERVICE) as ActivityManager
+        val info = ActivityManager.MemoryInfo()
+        activityManager.getMemoryInfo(info)
+        return (info.totalMem - SYSTEM_RESERVE_BYTES).coerceAtLeast(0L)
+    }
+
+    /**
+     * The best [QuantTarget] for [model] that is smaller than its current
+     * quantization and fits [availableBytes] at [contextSize], or null if the
+     * model already fits, its header cannot be read, or nothing smaller fits.
+     * Reads the model's header on a miss of the index, so call it off the main thread.
+     */
+    fun chooseTarget(
+        model: File,
+        contextSize: Int = DEFAULT_CONTEXT_SIZE,
+        availableBytes: Long = modelMemoryBytes()
+    ): QuantTarget? {
+        if (!nativeAvailable) return null
+        val info = modelIndex.info(model) ?: return null
+        if (info.parameterCount <= 0) return null
+
+        val budget = availableBytes - RUNTIME_OVERHEAD_BYTES - info.kvBytesPerToken * contextSize
+        if (model.length() <= budget) return null
+
+        val sourceBits = model.length() * 8.0 / info.parameterCount
+        return TARGETS.firstOrNull { target ->
+            target.bitsPerWeight < sourceBits - 0.25 && predictedBytes(info.parameterCount, target) <= budget
+        }
+    }
+
+    /** Queue a background requantization of [model] ([RequantizeWorker]). */
+    fun schedule(model: File, contextSize: Int = DEFAULT_CONTEXT_SIZE) =
+        RequantizeWorker.enqueue(context, model, contextSize)
+
+    /** Progress of the queued requantization of [model], null until one is queued. */
+    fun observe(model: File): Flow<WorkInfo?> = RequantizeWorker.observe(context, model)
+
+    /** Where the output of converting [model] to [target] is written. */
+    fun outputFileFor(model: File, target: QuantTarget): File =
+        File(model.parentFile, "${model.nameWithoutExtension}.${target.type.lowercase()}.gguf")
+
+    /**
+     * Convert [model] to [target], reporting progress as the share of the
+     * predicted output size written so far.
+     *
+     * @throws IOException if the conversion fails
+     */
+    suspend fun requantize(model: File, target: QuantTarget, onProgress: suspend (Float) -> Unit): File =
+        withContext(Dispatchers.IO) {
+            val output = outputFileFor(model, target)
+            val tmp = File(output.path + ".tmp")
+            val info = modelIndex.info(model)
+            val expected = info?.let { predictedBytes(it.parameterCount, target) } ?: model.length()
+            Log.d(TAG, "Requantizing ${model.name} to ${target.type}")
+
+            val ok = coroutineScope {
+                val job = async { nativeRequantize(model.absolutePath, tmp.absolutePath, target.ftype, 0) }
+                while (!job.isCompleted) {
+                    onProgress((tmp.length().toFloat() / expected).coerceIn(0f, 0.99f))
+                    delay(500)
+                }
+                job.await()
+            }
+            if (!ok || !tmp.renameTo(output)) {
+                tmp.delete()
+                throw IOException("Requantizing ${model.name} to ${target.type} failed")
+            }
+            onProgress(1f)
+            output
+        }
+
+    /** Perplexity of [model] on the bundled sample; NaN if it cannot be measured. */
+    suspend fun perplexity(model: File): Float = withContext(Dispatchers.IO) {
+        if (!nativeAvailable) return@withContext Float.NaN
+        val sample = context.assets.open(SAMPLE_ASSET).bufferedReader().use { it.readText() }
+        nativePerplexity(model.absolutePath, sample, PERPLEXITY_CONTEXT, PERPLEXITY_WINDOWS, 0)
+    }
+
+    /** The result that produced [model], if it came out of a requantization. */
+    @Synchronized
+    fun resultFor(model: File): RequantizeResult? = loadResults().firstOrNull { it.outputName == model.name }
+
+    @Synchronized
+    fun saveResult(result: RequantizeResult) {
+        val all = loadResults().filter { it.outputName != result.outputName } + result
+        val array = JSONArray()
+        for (r in all) {
+            array.put(
+                JSONObject()
+                    .put("sourceName", r.sourceName)
+                    .put("outputName", r.outputName)
+                    .put("type", r.type)
+                    .put("sourceBytes", r.sourceBytes)
+                    .put("outputBytes", r.outputBytes)
+                    .put("perplexityBefore", r.perplexityBefore.toDouble().takeUnless { it.isNaN() } ?: JSONObject.NULL)
+                    .put("perplexityAfter", r.perplexityAfter.toDouble().takeUnless { it.isNaN() } ?: JSONObject.NULL)
+                    .put("createdAt", r.createdAt)
+            )
+        }
+        try {
+            val tmp = File(resultsFile.parentFile, resultsFile.name + ".tmp")
+            tmp.writeText(array.toString())
+            tmp.renameTo(resultsFile)
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to write requantize results: ${e.message}")
+        }
+    }
+
+    private fun loadResults(): List<RequantizeResult> {
+        if (!resultsFile.exists()) return emptyList()
+        return try {
+            val array = JSONArray(resultsFile.readText())
+            List(array.length()) { i ->
+                val json = array.getJSONObject(i)
+                RequantizeResult(
+                    sourceName = json.getString("sourceName"),
+                    outputName = json.getString("outputName"),
+                    type = json.getString("type"),
+                    sourceBytes = json.getLong("sourceBytes"),
+                    outputBytes = json.getLong("outputBytes"),
+                    perplexityBefore = json.optDouble("perplexityBefore").toFloat(),
+                    perplexityAfter = json.optDouble("perplexityAfter").toFloat(),
+                    createdAt = json.getLong("createdAt")
+                )
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to read requantize results: ${e.message}")
+            emptyList()
+        }
+    }
+
+    private fun predictedBytes(parameterCount: Long, target: QuantTarget): Long =
+        (parameterCount * target.bitsPerWeight / 8).toLong()
+
+    private external fun nativeRequantize(src: String, dst: String, ftype: Int, threads: Int): Boolean
+    private external fun nativePerplexity(path: String, text: String, contextSize: Int, maxWindows: Int, threads: Int): Float
+}
@@ -0,0 +1,125 @@
+package com.castor.core.inference.quantize
+
+import android.content.Context
+import android.util.Log
+import androidx.hilt.work.HiltWorker
+import androidx.work.Constraints
+import androidx.work.CoroutineWorker
+import androidx.work.ExistingWorkPolicy
+import androidx.work.OneTimeWorkRequestBuilder
+import androidx.work.WorkInfo
+import androidx.work.WorkManager
+import androidx.work.WorkerParameters
+import androidx.work.workDataOf
+import dagger.assisted.Assisted
+import dagger.assisted.AssistedInject
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.map
+import java.io.File
+
+/**
+ * WorkManager worker that shrinks a downloaded model to fit the device's
+ * memory with [ModelRequantizer].
+ *
+ * Stages, reported through [setProgress] as [KEY_STAGE] and an overall
+ * [KEY_PROGRESS] fraction:
+ * 1. [STAGE_BASELINE] -- perplexity of the source on the bundled sample
+ * 2. [STAGE_QUANTIZE] -- conversion to the chosen type
+ * 3. [STAGE_EVALUATE] -- perplexity of the output
+ *
+ * The result is saved with [ModelRequantizer.saveResult] so the model
+ * manager can show the size/quality trade-off next to the new model.
+ */
+@HiltWorker
+class RequantizeWorker @AssistedInject constructor(
+    @Assisted appContext: Context,
+    @Assisted params: WorkerParameters,
+    private val requantizer: ModelRequantizer
+) : CoroutineWorker(appContext, params) {
+
+    companion object {
+        private const val TAG = "RequantizeWorker"
+        const val WORK_NAME = "model_requantize"
+
+        const val KEY_MODEL_PATH = "model_path"
+        const val KEY_CONTEXT_SIZE = "context_size"
+        const val KEY_STAGE = "stage"
+        const val KEY_PROGRESS = "progress"
+        const val KEY_TARGET = "target"
+        const val KEY_OUTPUT_PATH = "output_path"
+        const val KEY_ERROR = "error"
+
+        const val STAGE_BASELINE = "baseline"
+        const val STAGE_QUANTIZE = "quantize"
+        const val STAGE_EVALUATE = "evaluate"
+
+        private fun workName(model: File) = "${WORK_NAME}_${model.name}"
+
+        /** Queue a requantization of [model]; a run already queued for it is kept. */
+        fun enqueue(context: Context, model: File, contextSize: Int = ModelRequantizer.DEFAULT_CONTEXT_SIZE) {
+            val request = OneTimeWorkRequestBuilder<RequantizeWorker>()
+                .setInputData(workDataOf(KEY_MODEL_PATH to model.absolutePath, KEY_CONTEXT_SIZE to contextSize))
+                .setConstraints(
+                    Constraints.Builder()
+                        .setRequiresBatteryNotLow(true)
+                        .setRequiresStorageNotLow(true)
+                        .build()
+                )
+                .addTag(WORK_NAME)
+                .build()
+            WorkManager.getInstance(context).enqueueUniqueWork(workName(model), ExistingWorkPolicy.KEEP, request)
+        }
+
+        /** Latest state of the requantization of [model], or null if none was queued. */
+        fun observe(context: Context, model: File): Flow<WorkInfo?> =
+            WorkManager.getInstance(context).getWorkInfosForUniqueWorkFlow(workName(model)).map { it.firstOrNull() }
+
+        fun cancel(context: Context, model: File) {
+            WorkManager.getInstance(context).cancelUniqueWork(workName(model))
+        }
+    }
+
+    override suspend fun doWork(): Result {
+        val model = File(inputData.getString(KEY_MODEL_PATH) ?: return Result.failure())
+        val contextSize = inputData.getInt(KEY_CONTEXT_SIZE, ModelRequantizer.DEFAULT_CONTEXT_SIZE)
+
+        return try {
+            val target = requantizer.chooseTarget(model, contextSize)
+                ?: return Result.failure(workDataOf(KEY_ERROR to "No smaller quantization is needed or fits in memory"))
+            Log.d(TAG, "Shrinking ${model.name} to ${target.type} for a $contextSize-token context")
+
+            report(STAGE_BASELINE, target, 0f)
+            val before = requantizer.perplexity(model)
+
+            report(STAGE_QUANTIZE, target, 0.15f)
+            val output = requantizer.requantize(model, target) { fraction ->
+                report(STAGE_QUANTIZE, target, 0.15f + 0.7f * fraction)
+            }
+
+            report(STAGE_EVALUATE, target, 0.85f)
+            val after = requantizer.perplexity(output)
+
+            requantizer.saveResult(
+                RequantizeResult(
+                    sourceName = model.name,
+                    outputName = output.name,
+                    type = target.type,
+                    sourceBytes = model.length(),
+                    outputBytes = output.length(),
+                    perplexityBefore = before,
+                    perplexityAfter = after,
+                    createdAt = System.currentTimeMillis()
+                )
+            )
+            Log.d(TAG, "Shrunk ${model.name} to ${output.name}: perplexity $before -> $after")
+            Result.success(workDataOf(KEY_OUTPUT_PATH to output.absolutePath, KEY_TARGET to target.type))
+        } catch (e: Exception) {
+            Log.e(TAG, "Requantizing ${model.name} failed", e)
+            Result.failure(workDataOf(KEY_ERROR to (e.message ?: "Requantization failed")))
+        }
+    }
+
+    private suspend fun report(stage: String, target: QuantTarget, progress: Float) {
+        setProgress(workDataOf(KEY_STAGE to stage, KEY_TARGET to target.type, KEY_PROGRESS to progress))
+    }
+}
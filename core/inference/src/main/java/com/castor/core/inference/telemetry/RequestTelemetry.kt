@@ -0,0 +1,162 @@
+package com.castor.core.inference.telemetry
+
+import com.castor.core.inference.llama.GenerationStats
+
+/**
+ * Distribution of one metric over the recent requests.
+ *
+ * @param buckets Counts of the window's values in [BUCKETS] equal-width
+ *   buckets from 0 to [max], for a compact histogram
+ */
+data class HistogramSnapshot(
+    val count: Int = 0,
+    val p50: Float = 0f,
+    val p95: Float = 0f,
+    val max: Float = 0f,
+    val buckets: List<Int> = emptyList()
+) {
+    companion object {
+        const val BUCKETS = 8
+    }
+}
+
+/** The last [capacity] values of a metric; older values roll out. */
+class RollingHistogram(private val capacity: Int) {
+    private val values = FloatArray(capacity)
+    private var next = 0
+    private var size = 0
+
+    fun add(value: Float) {
+        if (value.isNaN()) return
+        values[next] = value
+        next = (next + 1) % capacity
+        if (size < capacity) size++
+    }
+
+    fun clear() {
+        next = 0
+        size = 0
+    }
+
+    fun snapshot(): HistogramSnapshot {
+        if (size == 0) return HistogramSnapshot()
+        val sorted = values.copyOf(size).apply { sort() }
+        val max = sorted.last()
+        val buckets = IntArray(HistogramSnapshot.BUCKETS)
+        if (max > 0f) {
+            for (v in sorted) {
+                buckets[((v / max) * HistogramSnapshot.BUCKETS).toInt().coerceIn(0, HistogramSnapshot.BUCKETS - 1)]++
+            }
+        } else {
+            buckets[0] = size
+        }
+        return HistogramSnapshot(
+            count = size,
+            p50 = percentile(sorted, 0.50),
+            p95 = percentile(sorted, 0.95),
+            max = max,
+            buckets = buckets.toList()
+        )
+    }
+
+    /** Nearest-rank percentile of an ascending array. */
+    private fun percentile(sorted: FloatArray, p: Double): Float =
+        sorted[(Math.ceil(p * sorted.size).toInt() - 1).coerceIn(0, sorted.size - 1)]
+}
+
+/** Per-request metrics aggregated by [RequestTelemetry]. */
+enum class RequestMetric(val label: String, val unit: String) {
+    QUEUE_WAIT("queue", "ms"),
+    FIRST_TEXT("ttft", "ms"),
+    TOKENIZE("tokenize", "ms"),
+    PREFILL("prefill", "ms"),
+    PREFILL_RATE("prefill", "tok/s"),
+    DECODE_RATE("decode", "tok/s"),
+    SAMPLER("sampler", "ms"),
+    CALLBACK("callback", "ms"),
+    OVERHEAD("overhead", "ms")
+}
+
+/**
+ * Rolling telemetry of the native requests since [modelName] was loaded.
+ *
+ * @param histograms Distribution of each [RequestMetric] over the window
+ * @param reusedTokens Prompt tokens served from the KV cache, over the window
+ * @param promptTokens Prompt tokens decoded, over the window
+ * @param contextShifts Context shifts since the model was loaded
+ */
+data class TelemetrySnapshot(
+    val modelName: String? = null,
+    val requests: Int = 0,
+    val histograms: Map<RequestMetric, HistogramSnapshot> = emptyMap(),
+    val reusedTokens: Long = 0,
+    val promptTokens: Long = 0,
+    val contextShifts: Int = 0
+) {
+    /** Share of prompt tokens that did not have to be decoded. */
+    val reuseRate: Float
+        get() = if (reusedTokens + promptTokens > 0) reusedTokens.toFloat() / (reusedTokens + promptTokens) else 0f
+}
+
+/**
+ * Aggregates [GenerationStats] of each native request into rolling
+ * histograms over the last [window] requests, so latency and throughput can
+ * be read as distributions (p50/p95) instead of the last value only.
+ *
+ * [RequestMetric.OVERHEAD] is prefill and decode time not spent in
+ * llama.cpp's own compute: tokenization between batches, sampling, KV
+ * bookkeeping and callbacks.
+ */
+class RequestTelemetry(private val window: Int = 200) {
+    private val histograms = RequestMetric.entries.associateWith { RollingHistogram(window) }
+    private val reused = ArrayDeque<Pair<Int, Int>>()
+    private var modelName: String? = null
+    private var requests = 0
+    private var contextShifts = 0
+
+    @Synchronized
+    fun reset(modelName: String?) {
+        histograms.values.forEach { it.clear() }
+        reused.clear()
+        this.modelName = modelName
+        requests = 0
+        contextShifts = 0
+    }
+
+    @Synchronized
+    fun record(stats: GenerationStats): TelemetrySnapshot {
+        requests++
+        contextShifts += stats.contextShifts
+        reused.addLast(stats.reusedTokens to stats.promptTokens)
+        if (reused.size > window) reused.removeFirst()
+
+        add(RequestMetric.QUEUE_WAIT, stats.queueWaitMs)
+        if (stats.firstTextMs > 0f) add(RequestMetric.FIRST_TEXT, stats.firstTextMs)
+        add(RequestMetric.TOKENIZE, stats.tokenizeMs)
+        if (stats.promptTokens > 0) {
+            add(RequestMetric.PREFILL, stats.prefillMs)
+            add(RequestMetric.PREFILL_RATE, stats.prefillTokensPerSecond)
+        }
+        if (stats.tokens > 0) add(RequestMetric.DECODE_RATE, stats.tokensPerSecond)
+        add(RequestMetric.SAMPLER, stats.samplerMs)
+        add(RequestMetric.CALLBACK, stats.callbackMs)
+        if (stats.evalPromptMs + stats.evalMs > 0f) {
+            add(RequestMetric.OVERHEAD, (stats.prefillMs + stats.durationMs - stats.evalPromptMs - stats.evalMs).coerceAtLeast(0f))
+        }
+        return snapshot()
+    }
+
+    @Synchronized
+    fun snapshot(): TelemetrySnapshot = TelemetrySnapshot(
+        modelName = modelName,
+        requests = requests,
+        histograms = histograms.mapValues { it.value.snapshot() },
+        reusedTokens = reused.sumOf { it.first.toLong() },
+        promptTokens = reused.sumOf { it.second.toLong() },
+        contextShifts = contextShifts
+    )
+
+    private fun add(metric: RequestMetric, value: Float) {
+        histograms.getValue(metric).add(value)
+    }
+}
@@ -0,0 +1,133 @@
+package com.castor.core.inference.tool
+
+/**
+ * GBNF grammar constraining `<tool_call>` blocks to the registered tool schemas.
+ *
+ * The grammar is applied lazily by the native sampler: free text is sampled
+ * normally until the model emits `<tool_call>`, after which every token must
+ * keep the block a valid call of one of the tools, e.g.
+ * ```
+ * <tool_call>
+ * {"name": "play_media", "arguments": {"query": "jazz", "source": "spotify"}}
+ * </tool_call>
+ * ```
+ *
+ * [scaffold] lists each tool's name and required argument keys (one line per
+ * tool: `name<TAB>key1,key2<TAB>open`, where `open` is 1 when optional keys
+ * follow). The native side uses it to insert the text the grammar leaves no
+ * choice about — the rest of a unique tool name, the fixed JSON keys — as one
+ * batch instead of sampling it token by token.
+ */
+data class ToolCallGrammar(
+    val gbnf: String,
+    val scaffold: String
+) {
+    companion object {
+        /**
+         * Build the grammar for [definitions]. Returns null when there are no
+         * tools, in which case generation is left unconstrained.
+         */
+        fun build(definitions: List<ToolDefinition>): ToolCallGrammar? {
+            if (definitions.isEmpty()) return null
+            val tools = definitions.sortedBy { it.name }
+
+            val gbnf = buildString {
+                appendLine("root ::= call ( \"\\n\" call )* \"\\n\"?")
+                appendLine(
+                    "call ::= ${literal("<tool_call>\n{\"name\": \"")} ( " +
+                        tools.indices.joinToString(" | ") { "tool-$it" } + " )"
+                )
+                tools.forEachIndexed { i, def ->
+                    appendLine(
+                        "tool-$i ::= ${literal("${def.name}\", \"arguments\": {")} " +
+                            "${argumentsRule(def.parameters)} ${literal("}}\n</tool_call>")}"
+                    )
+                }
+                append(JSON_RULES)
+            }
+
+            val scaffold = tools.joinToString("\n") { def ->
+                val required = requiredKeys(def.parameters)
+                val open = def.parameters.properties.keys.any { it !in required }
+                "${def.name}\t${required.joinToString(",")}\t${if (open) 1 else 0}"
+            }
+
+            return ToolCallGrammar(gbnf, scaffold)
+        }
+
+        /** Required keys in schema order; the grammar emits them first and in this order. */
+        private fun requiredKeys(params: ToolParameters): List<String> =
+            params.required.filter { it in params.properties }
+
+        /**
+         * Required arguments come first in a fixed order, optional ones follow
+         * in schema order and may each be omitted.
+         */
+        private fun argumentsRule(params: ToolParameters): String {
+            val required = requiredKeys(params)
+            val optional = params.properties.keys.filter { it !in required }
+            val pair = { key: String -> "${literal("\"$key\": ")} ${valueRule(params.properties.getValue(key))}" }
+
+            if (required.isNotEmpty()) {
+                return buildString {
+                    append(required.joinToString(" ${literal(", ")} ") { pair(it) })
+                    optional.forEach { append(" ( ${literal(", ")} ${pair(it)} )?") }
+                }
+            }
+            if (optional.isEmpty()) return ""
+
+            // No required keys: any ordered subset of the optional ones
+            val alternatives = optional.indices.map { start ->
+                buildString {
+                    append(pair(optional[start]))
+                    for (j in start + 1 until optional.size) {
+                        append(" ( ${literal(", ")} ${pair(optional[j])} )?")
+                    }
+                }
+            }
+            return "( " + alternatives.joinToString(" | ") { "( $it )" } + " )?"
+        }
+
+        private fun valueRule(prop: ToolProperty): String {
+            if (!prop.enum.isNullOrEmpty()) {
+                return "( " + prop.enum.joinToString(" | ") { literal("\"$it\"") } + " )"
+            }
+            return when (prop.type) {
+                "string" -> "string"
+                "integer" -> "integer"
+                "number" -> "number"
+                "boolean" -> "boolean"
+                "array" -> "array"
+                "object" -> "object"
+                else -> "value"
+            }
+        }
+
+        /** Quote [text] as a GBNF string literal. */
+        private fun literal(text: String): String = buildString {
+            append('"')
+            for (c in text) {
+                when (c) {
+                    '"' -> append("\\\"")
+                    '\\' -> append("\\\\")
+                    '\n' -> append("\\n")
+                    '\r' -> append("\\r")
+                    '\t' -> append("\\t")
+                    else -> append(c)
+                }
+            }
+            append('"')
+        }
+
+        private val JSON_RULES = """
+            |value ::= object | array | string | number | boolean | "null"
+            |object ::= "{" ws ( string ":" ws value ( "," ws string ":" ws value )* )? ws "}"
+            |array ::= "[" ws ( value ( "," ws value )* )? ws "]"
+            |string ::= "\"" ( [^"\\\x7F\x00-\x1F] | "\\" ( ["\\/bfnrt] | "u" [0-9a-fA-F] [0-9a-fA-F] [0-9a-fA-F] [0-9a-fA-F] ) )* "\""
+            |integer ::= "-"? ( "0" | [1-9] [0-9]* )
+            |number ::= integer ( "." [0-9]+ )? ( [eE] [-+]? [0-9]+ )?
+            |boolean ::= "true" | "false"
+            |ws ::= [ ]?
+            |""".trimMargin()
+    }
+}
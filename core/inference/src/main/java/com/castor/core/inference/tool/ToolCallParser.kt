@@ -17,6 +17,12 @@ import kotlinx.serialization.json.jsonObject
  *
  * This parser extracts all such blocks from a response and converts them
  * into [ToolCall] objects for dispatch via the [ToolRegistry].
+ *
+ * During native generation the blocks are parsed incrementally as tokens are
+ * decoded (`tool_call_parser.h`) and reported through [parseCall]. For a
+ * finished output, [parse], [hasToolCalls] and [stripToolCalls] share one
+ * native pass over the text; without the native library they fall back to a
+ * regex.
  */
 object ToolCallParser {
 
@@ -29,43 +35,99 @@ object ToolCallParser {
 
     private val json = Json { ignoreUnknownKeys = true; isLenient = true }
 
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-llama")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    /** Text outside tool call blocks and each call's name and raw arguments. */
+    private class Parsed(val output: String, val text: String, val calls: List<Pair<String, String>>)
+
+    /** The last output parsed, so parse + strip on one response scan it once. */
+    @Volatile private var lastParsed: Parsed? = null
+
     /**
      * Parse all `<tool_call>` blocks from the LLM output.
      *
      * @return List of parsed [ToolCall]s, or empty list if none found.
      */
     fun parse(llmOutput: String): List<ToolCall> {
-        val matches = TOOL_CALL_REGEX.findAll(llmOutput)
-        return matches.mapNotNull { match ->
-            try {
-                val jsonStr = match.groupValues[1].trim()
-                val obj = json.parseToJsonElement(jsonStr).jsonObject
-                val name = obj["name"]?.toString()?.removeSurrounding("\"")
-                    ?: return@mapNotNull null
-                val args = obj["arguments"]?.jsonObject ?: JsonObject(emptyMap())
-                ToolCall(
-                    id = "call_${System.nanoTime()}",
-                    name = name,
-                    arguments = args
-                )
-            } catch (e: Exception) {
-                Log.w(TAG, "Failed to parse tool call: ${e.message}")
-                null
-            }
-        }.toList()
+        if (!nativeAvailable) {
+            return TOOL_CALL_REGEX.findAll(llmOutput).mapNotNull { parseBlock(it.groupValues[1]) }.toList()
+        }
+        return parsed(llmOutput).calls.mapNotNull { (name, arguments) -> parseCall(name, arguments) }
+    }
+
+    /**
+     * Build a [ToolCall] from a name and the raw JSON of its `arguments`
+     * object, as reported by the native parser the moment the call's JSON
+     * object closes.
+     *
+     * @return The parsed [ToolCall], or null if the arguments are malformed.
+     */
+    fun parseCall(name: String, arguments: String): ToolCall? {
+        return try {
+            ToolCall(
+                id = "call_${System.nanoTime()}",
+                name = name,
+                arguments = json.parseToJsonElement(arguments).jsonObject
+            )
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to parse tool call arguments: ${e.message}")
+            null
+        }
     }
 
     /**
      * Quick check whether the output contains any tool calls.
      */
     fun hasToolCalls(llmOutput: String): Boolean =
-        TOOL_CALL_REGEX.containsMatchIn(llmOutput)
+        if (nativeAvailable) parsed(llmOutput).calls.isNotEmpty() else TOOL_CALL_REGEX.containsMatchIn(llmOutput)
 
     /**
      * Strip all `<tool_call>` blocks from the output, returning only plain text.
      */
     fun stripToolCalls(llmOutput: String): String =
-        TOOL_CALL_REGEX.replace(llmOutput, "").trim()
+        if (nativeAvailable) parsed(llmOutput).text.trim() else TOOL_CALL_REGEX.replace(llmOutput, "").trim()
+
+    private fun parsed(output: String): Parsed {
+        lastParsed?.let { if (it.output == output) return it }
+        val fields = nativeParse(output)
+        val calls = List((fields.size - 1) / 2) { fields[1 + 2 * it] to fields[2 + 2 * it] }
+        return Parsed(output, fields[0], calls).also { lastParsed = it }
+    }
+
+    /** Parse the JSON body of a `<tool_call>` block matched by [TOOL_CALL_REGEX]. */
+    private fun parseBlock(jsonBody: String): ToolCall? {
+        return try {
+            val obj = json.parseToJsonElement(jsonBody.trim()).jsonObject
+            val name = obj["name"]?.toString()?.removeSurrounding("\"")
+                ?: return null
+            val args = obj["arguments"]?.jsonObject ?: JsonObject(emptyMap())
+            ToolCall(
+                id = "call_${System.nanoTime()}",
+                name = name,
+                arguments = args
+            )
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to parse tool call: ${e.message}")
+            null
+        }
+    }
+
+    /**
+     * Format a tool result as the JSON payload of a `role = "tool"` turn:
+     * ```
+     * {"name": "play_media", "content": "Now playing jazz on Spotify."}
+     * ```
+     * The model's chat template (or [PromptFormatter]) wraps it in `<tool_response>`.
+     */
+    fun formatToolResult(call: ToolCall, result: ToolResult): String {
+        val content = if (result.success) result.output else (result.error ?: "Tool failed")
+        return "{\"name\": \"${call.name}\", \"content\": ${json.encodeToString(kotlinx.serialization.serializer<String>(), content)}}"
+    }
 
     /**
      * Format a tool result for injection back into the conversation.
@@ -78,11 +140,12 @@ object ToolCallParser {
      * ```
      */
     fun formatToolResponse(call: ToolCall, result: ToolResult): String {
-        val content = if (result.success) result.output else (result.error ?: "Tool failed")
         return buildString {
             appendLine("<tool_response>")
-            appendLine("{\"name\": \"${call.name}\", \"content\": ${json.encodeToString(kotlinx.serialization.serializer<String>(), content)}}")
+            appendLine(formatToolResult(call, result))
             appendLine("</tool_response>")
         }
     }
+
+    private external fun nativeParse(text: String): Array<String>
 }
@@ -6,13 +6,25 @@ import kotlinx.serialization.json.JsonObject
 /**
  * JSON schema describing a tool the LLM can invoke.
  * Follows the OpenAI/ChatML function calling format that Qwen2.5 was trained on.
+ *
+ * [parallelSafe] and [timeoutMs] are dispatch hints and are not shown to the model.
+ *
+ * @param parallelSafe True if the tool has no side effects, so calls to it may run
+ *   concurrently with other parallel-safe calls of the same turn
+ * @param timeoutMs Deadline for one execution; the call fails once it passes
  */
 @Serializable
 data class ToolDefinition(
     val name: String,
     val description: String,
-    val parameters: ToolParameters
-)
+    val parameters: ToolParameters,
+    val parallelSafe: Boolean = false,
+    val timeoutMs: Long = DEFAULT_TIMEOUT_MS
+) {
+    companion object {
+        const val DEFAULT_TIMEOUT_MS = 10_000L
+    }
+}
 
 @Serializable
 data class ToolParameters(
@@ -1,6 +1,10 @@
 package com.castor.core.inference.tool
 
 import android.util.Log
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.withTimeoutOrNull
 import kotlinx.serialization.encodeToString
 import kotlinx.serialization.json.Json
 import java.util.concurrent.ConcurrentHashMap
@@ -13,8 +17,10 @@ import javax.inject.Singleton
  * Inspired by Hermes Agent's `tools/registry.py`. Key responsibilities:
  * - Store tool handlers indexed by name
  * - Filter by availability at prompt-build time
- * - Dispatch tool calls by name
+ * - Dispatch tool calls by name, with per-tool deadlines; parallel-safe calls
+ *   run concurrently
  * - Generate the `<tools>` XML block for Qwen2.5 ChatML function calling
+ * - Build the [ToolCallGrammar] constraining `<tool_call>` output
  *
  * Thread-safe: uses [ConcurrentHashMap] for storage.
  */
@@ -28,11 +34,22 @@ class ToolRegistry @Inject constructor() {
     private val tools = ConcurrentHashMap<String, ToolHandler>()
     private val json = Json { prettyPrint = false; encodeDefaults = true }
 
+    /** Bumped on every register/unregister; invalidates [cachedGrammar]. */
+    @Volatile private var toolSetVersion = 0L
+    @Volatile private var cachedGrammar: CachedGrammar? = null
+
+    private data class CachedGrammar(
+        val version: Long,
+        val toolNames: List<String>,
+        val grammar: ToolCallGrammar?
+    )
+
     /**
      * Register a tool handler. Replaces any existing handler with the same name.
      */
     fun register(handler: ToolHandler) {
         tools[handler.name] = handler
+        toolSetVersion++
         Log.d(TAG, "Registered tool: ${handler.name} (toolset=${handler.toolset})")
     }
 
@@ -40,7 +57,7 @@ class ToolRegistry @Inject constructor() {
      * Unregister a tool by name.
      */
     fun unregister(name: String) {
-        tools.remove(name)
+        if (tools.remove(name) != null) toolSetVersion++
     }
 
     /**
@@ -73,7 +90,13 @@ class ToolRegistry @Inject constructor() {
     fun registeredCount(): Int = tools.size
 
     /**
-     * Dispatch a tool call to the appropriate handler.
+     * True if [name] is a registered tool declared [ToolDefinition.parallelSafe].
+     */
+    fun isParallelSafe(name: String): Boolean = tools[name]?.definition?.parallelSafe == true
+
+    /**
+     * Dispatch a tool call to the appropriate handler. The call fails if it
+     * runs past the tool's [ToolDefinition.timeoutMs].
      */
     suspend fun dispatch(call: ToolCall): ToolResult {
         val handler = tools[call.name]
@@ -104,9 +127,17 @@ class ToolRegistry @Inject constructor() {
             }
         }
 
+        val timeoutMs = handler.definition.timeoutMs
         return try {
             Log.d(TAG, "Dispatching tool: ${call.name} with args: $args")
-            handler.execute(args)
+            withTimeoutOrNull(timeoutMs) { handler.execute(args) }
+                ?: ToolResult(
+                    toolName = call.name,
+                    callId = call.id,
+                    success = false,
+                    output = "",
+                    error = "Tool '${call.name}' timed out after ${timeoutMs}ms"
+                )
         } catch (e: Exception) {
             Log.e(TAG, "Tool ${call.name} execution failed", e)
             ToolResult(
@@ -119,6 +150,27 @@ class ToolRegistry @Inject constructor() {
         }
     }
 
+    /**
+     * Dispatch several calls, returning their results in call order.
+     *
+     * Consecutive parallel-safe calls run concurrently; any other call waits for
+     * the calls before it and runs alone, so side effects keep their order.
+     */
+    suspend fun dispatchAll(calls: List<ToolCall>): List<ToolResult> = coroutineScope {
+        val results = ArrayList<ToolResult>(calls.size)
+        var i = 0
+        while (i < calls.size) {
+            if (!isParallelSafe(calls[i].name)) {
+                results += dispatch(calls[i++])
+                continue
+            }
+            val start = i
+            while (i < calls.size && isParallelSafe(calls[i].name)) i++
+            results += calls.subList(start, i).map { call -> async { dispatch(call) } }.awaitAll()
+        }
+        results
+    }
+
     /**
      * Generate the tools prompt block for Qwen2.5 ChatML function calling.
      *
@@ -184,4 +236,25 @@ class ToolRegistry @Inject constructor() {
             appendLine("</tool_call>")
         }
     }
+
+    /**
+     * Grammar constraining `<tool_call>` blocks to the currently available tools.
+     *
+     * Built once and reused until [register]/[unregister] changes the tool set
+     * (or a tool's availability flips), so the native sampler only recompiles
+     * it when the tools actually change. Returns null when no tools are available.
+     */
+    fun getToolCallGrammar(): ToolCallGrammar? {
+        val version = toolSetVersion
+        val available = getAvailableTools().map { it.definition }
+        val names = available.map { it.name }.sorted()
+
+        cachedGrammar?.let { cached ->
+            if (cached.version == version && cached.toolNames == names) return cached.grammar
+        }
+        val grammar = ToolCallGrammar.build(available)
+        cachedGrammar = CachedGrammar(version, names, grammar)
+        Log.d(TAG, "Built tool call grammar for ${names.size} tools")
+        return grammar
+    }
 }
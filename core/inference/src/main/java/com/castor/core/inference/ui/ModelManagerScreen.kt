@@ -51,6 +51,10 @@ import com.castor.core.inference.LocalModelInfo
 import com.castor.core.inference.ModelManager
 import com.castor.core.inference.download.DownloadState
 import com.castor.core.inference.download.ModelCatalogEntry
+import com.castor.core.inference.llama.NativeMemoryStats
+import com.castor.core.inference.quantize.RequantizeResult
+import com.castor.core.inference.telemetry.RequestMetric
+import com.castor.core.inference.telemetry.TelemetrySnapshot
 import com.castor.core.ui.theme.TerminalColors
 
 /**
@@ -58,6 +62,7 @@ import com.castor.core.ui.theme.TerminalColors
  *
  * Displays:
  * - Storage usage summary (`$ df -h /models`)
+ * - Request latency and throughput of the loaded model (`$ perf stat`)
  * - Installed models with metadata, load/unload/delete actions
  * - Available models catalog with download progress tracking
  *
@@ -66,7 +71,7 @@ import com.castor.core.ui.theme.TerminalColors
  * - Available: `$ apt search llm`
  *
  * All models run on-device. Downloads are the only network activity
- * (HTTPS GET to HuggingFace). No telemetry, no data sent anywhere.
+ * (HTTPS GET to HuggingFace). Request telemetry stays on device; no data is sent anywhere.
  */
 @Composable
 fun ModelManagerScreen(
@@ -112,6 +117,27 @@ fun ModelManagerScreen(
                 )
             }
 
+            // ---- Native Memory ----
+            uiState.memoryStats?.let { memoryStats ->
+                item {
+                    NativeMemorySummary(
+                        stats = memoryStats,
+                        modelName = uiState.currentModelName,
+                        mono = mono
+                    )
+                }
+            }
+
+            // ---- Request Telemetry ----
+            if (uiState.telemetry.requests > 0) {
+                item {
+                    RequestTelemetrySummary(
+                        telemetry = uiState.telemetry,
+                        mono = mono
+                    )
+                }
+            }
+
             item {
                 SectionDivider()
             }
@@ -185,6 +211,10 @@ fun ModelManagerScreen(
                                 onLoad = { viewModel.loadModel(modelInfo) },
                                 onDelete = { viewModel.deleteLocalModel(modelInfo) },
                                 onUnload = { viewModel.unloadModel() },
+                                shrinkTarget = uiState.shrinkTargets[modelInfo.file.name],
+                                requantizeStatus = uiState.requantizeStatus[modelInfo.file.name],
+                                requantizeResult = uiState.requantizeResults[modelInfo.file.name],
+                                onShrink = { viewModel.shrinkModel(modelInfo) },
                                 mono = mono
                             )
                         }
@@ -514,6 +544,10 @@ private fun InstalledModelCard(
     onLoad: () -> Unit,
     onDelete: () -> Unit,
     onUnload: () -> Unit,
+    shrinkTarget: String?,
+    requantizeStatus: RequantizeStatus?,
+    requantizeResult: RequantizeResult?,
+    onShrink: () -> Unit,
     mono: TextStyle
 ) {
     val borderColor = if (isCurrentModel) TerminalColors.Success else TerminalColors.Surface
@@ -641,6 +675,68 @@ private fun InstalledModelCard(
             )
         }
 
+        // Size/quality trade-off of a model produced by requantization
+        requantizeResult?.let { result ->
+            Spacer(modifier = Modifier.height(4.dp))
+            Text(
+                text = "  requant: ${result.sourceName} -> ${result.type}  |  " +
+                    "ppl ${formatPerplexity(result.perplexityBefore)} -> ${formatPerplexity(result.perplexityAfter)}  |  " +
+                    "${ModelManager.formatFileSize(result.sourceBytes)} -> ${ModelManager.formatFileSize(result.outputBytes)}",
+                style = mono.copy(
+                    color = TerminalColors.Info,
+                    fontSize = 10.sp
+                )
+            )
+        }
+
+        // Requantization progress, or the hint to start one when the model does not fit in memory
+        val requantizeError = requantizeStatus?.error
+        when {
+            requantizeError != null -> {
+                Spacer(modifier = Modifier.height(4.dp))
+                Text(
+                    text = "  E: $requantizeError",
+                    style = mono.copy(
+                        color = TerminalColors.Error,
+                        fontSize = 10.sp
+                    ),
+                    modifier = Modifier.clickable { onShrink() }
+                )
+            }
+            requantizeStatus != null -> {
+                Spacer(modifier = Modifier.height(8.dp))
+                Text(
+                    text = "  [${requantizeStatus.stage?.uppercase() ?: "QUEUED"}] " +
+                        "requant --to ${requantizeStatus.target ?: shrinkTarget ?: "?"}",
+                    style = mono.copy(
+                        color = TerminalColors.Warning,
+                        fontSize = 10.sp
+                    )
+                )
+                Spacer(modifier = Modifier.height(4.dp))
+                LinearProgressIndicator(
+                    progress = { requantizeStatus.progress },
+                    modifier = Modifier
+                        .fillMaxWidth()
+                        .height(3.dp)
+                        .clip(RoundedCornerShape(2.dp)),
+                    color = TerminalColors.Accent,
+                    trackColor = TerminalColors.Surface,
+                )
+            }
+            shrinkTarget != null -> {
+                Spacer(modifier = Modifier.height(4.dp))
+                Text(
+                    text = "  $ requant --to $shrinkTarget  # too large for free memory",
+                    style = mono.copy(
+                        color = TerminalColors.Warning,
+                        fontSize = 9.sp
+                    ),
+                    modifier = Modifier.clickable { onShrink() }
+                )
+            }
+        }
+
         // Delete hint styled as apt remove
         if (!isCurrentModel) {
             Spacer(modifier = Modifier.height(4.dp))
@@ -962,10 +1058,126 @@ private fun TerminalDownloadProgress(
     }
 }
 
+// ============================================================================
+// Native Memory
+// ============================================================================
+
+@Composable
+private fun NativeMemorySummary(
+    stats: NativeMemoryStats,
+    modelName: String?,
+    mono: TextStyle
+) {
+    Column(
+        modifier = Modifier
+            .fillMaxWidth()
+            .clip(RoundedCornerShape(6.dp))
+            .background(TerminalColors.Surface)
+            .padding(12.dp)
+    ) {
+        Text(
+            text = "$ free ${modelName.orEmpty()}".trimEnd(),
+            style = mono.copy(
+                color = TerminalColors.Prompt,
+                fontSize = 12.sp,
+                fontWeight = FontWeight.Bold
+            )
+        )
+        Spacer(modifier = Modifier.height(6.dp))
+
+        val rows = buildList {
+            add("weights" to "${ModelManager.formatFileSize(stats.modelMappedBytes)} mapped, " +
+                "${(stats.residentFraction * 100).toInt()}% resident")
+            if (stats.modelAnonBytes > 0) add("repacked" to ModelManager.formatFileSize(stats.modelAnonBytes))
+            add("kv cache" to "${ModelManager.formatFileSize(stats.kvBytes)}, " +
+                "${stats.kvCellsUsed}/${stats.kvCells} cells")
+            add("compute" to ModelManager.formatFileSize(stats.computeBytes))
+            add("batches" to ModelManager.formatFileSize(stats.batchBytes))
+            if (stats.draftBytes > 0) add("draft" to ModelManager.formatFileSize(stats.draftBytes))
+            add("anon rss" to "${ModelManager.formatFileSize(stats.anonRssBytes)}, " +
+                "peak ${ModelManager.formatFileSize(stats.requestPeakAnonBytes)} last request")
+        }
+        for ((label, value) in rows) {
+            Text(
+                text = "  %-9s %s".format(label, value),
+                style = mono.copy(color = TerminalColors.Output, fontSize = 10.sp)
+            )
+        }
+    }
+}
+
+// ============================================================================
+// Request Telemetry
+// ============================================================================
+
+@Composable
+private fun RequestTelemetrySummary(
+    telemetry: TelemetrySnapshot,
+    mono: TextStyle
+) {
+    Column(
+        modifier = Modifier
+            .fillMaxWidth()
+            .clip(RoundedCornerShape(6.dp))
+            .background(TerminalColors.Surface)
+            .padding(12.dp)
+    ) {
+        Text(
+            text = "$ perf stat ${telemetry.modelName.orEmpty()}".trimEnd(),
+            style = mono.copy(
+                color = TerminalColors.Prompt,
+                fontSize = 12.sp,
+                fontWeight = FontWeight.Bold
+            )
+        )
+        Spacer(modifier = Modifier.height(6.dp))
+
+        Text(
+            text = "  ${telemetry.requests} requests, ${(telemetry.reuseRate * 100).toInt()}% prompt reused, " +
+                "${telemetry.contextShifts} context shifts",
+            style = mono.copy(color = TerminalColors.Timestamp, fontSize = 11.sp)
+        )
+        Spacer(modifier = Modifier.height(4.dp))
+
+        Text(
+            text = "  %-9s %10s %10s".format("", "p50", "p95"),
+            style = mono.copy(color = TerminalColors.Timestamp, fontSize = 10.sp)
+        )
+        for (metric in RequestMetric.entries) {
+            val histogram = telemetry.histograms[metric] ?: continue
+            if (histogram.count == 0) continue
+            Text(
+                text = "  %-9s %10s %10s  %s".format(
+                    metric.label,
+                    formatMetric(histogram.p50, metric),
+                    formatMetric(histogram.p95, metric),
+                    sparkline(histogram.buckets)
+                ),
+                style = mono.copy(color = TerminalColors.Output, fontSize = 10.sp)
+            )
+        }
+    }
+}
+
 // ============================================================================
 // Helpers
 // ============================================================================
 
+private fun formatMetric(value: Float, metric: RequestMetric): String =
+    if (value >= 100f) "%.0f %s".format(value, metric.unit) else "%.1f %s".format(value, metric.unit)
+
+/** One block character per histogram bucket (0 to max), scaled to the fullest bucket. */
+private fun sparkline(buckets: List<Int>): String {
+    val blocks = "▁▂▃▄▅▆▇█"
+    val max = buckets.maxOrNull()?.takeIf { it > 0 } ?: return ""
+    return buckets.joinToString("") { count ->
+        if (count == 0) " " else blocks[(count * (blocks.length - 1) + max - 1) / max].toString()
+    }
+}
+
+private fun formatPerplexity(value: Float): String =
+    if (value.isNaN()) "n/a" else "%.2f".format(value)
+
 @Composable
 private fun SectionDivider() {
     Spacer(modifier = Modifier.height(4.dp))
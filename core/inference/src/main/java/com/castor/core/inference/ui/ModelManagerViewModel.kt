@@ -4,14 +4,21 @@ import android.os.Environment
 import android.os.StatFs
 import androidx.lifecycle.ViewModel
 import androidx.lifecycle.viewModelScope
+import androidx.work.WorkInfo
 import com.castor.core.inference.LocalModelInfo
 import com.castor.core.inference.ModelManager
 import com.castor.core.inference.download.DownloadState
 import com.castor.core.inference.download.ModelCatalogEntry
 import com.castor.core.inference.download.ModelCatalog
 import com.castor.core.inference.download.ModelDownloadManager
+import com.castor.core.inference.llama.NativeMemoryStats
+import com.castor.core.inference.quantize.ModelRequantizer
+import com.castor.core.inference.quantize.RequantizeResult
+import com.castor.core.inference.quantize.RequantizeWorker
+import com.castor.core.inference.telemetry.TelemetrySnapshot
 import java.io.File
 import dagger.hilt.android.lifecycle.HiltViewModel
+import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.SharingStarted
@@ -20,6 +27,7 @@ import kotlinx.coroutines.flow.combine
 import kotlinx.coroutines.flow.stateIn
 import kotlinx.coroutines.flow.update
 import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
 import javax.inject.Inject
 
 /**
@@ -33,6 +41,21 @@ data class StorageInfo(
     val availableBytes: Long = 0L
 )
 
+/**
+ * Progress of a background requantization ([RequantizeWorker]).
+ *
+ * @param stage One of the RequantizeWorker.STAGE_* values, or null before it starts
+ * @param target Quantization being produced, e.g. "Q4_K_M"
+ * @param progress Overall progress (0.0 to 1.0)
+ * @param error Failure message once the work has failed
+ */
+data class RequantizeStatus(
+    val stage: String? = null,
+    val target: String? = null,
+    val progress: Float = 0f,
+    val error: String? = null
+)
+
 /**
  * UI state for the model manager screen.
  *
@@ -44,6 +67,12 @@ data class StorageInfo(
  * @param isRefreshing Whether the model list is being refreshed
  * @param storageInfo Storage usage information for the models directory
  * @param selectedTab Currently selected tab index (0 = Installed, 1 = Available)
+ * @param shrinkTargets Smaller quantization each local model should be converted to
+ *   to fit in memory, keyed by file name; absent when the model fits
+ * @param requantizeStatus Running or failed requantizations, keyed by source file name
+ * @param requantizeResults Size and perplexity trade-off of requantized models, keyed by output file name
+ * @param telemetry Rolling request latency and throughput of the loaded model
+ * @param memoryStats Native memory breakdown of the loaded model, or null
  */
 data class ModelManagerUiState(
     val localModels: List<LocalModelInfo> = emptyList(),
@@ -53,7 +82,20 @@ data class ModelManagerUiState(
     val modelState: ModelManager.ModelState = ModelManager.ModelState.NotLoaded,
     val isRefreshing: Boolean = false,
     val storageInfo: StorageInfo = StorageInfo(),
-    val selectedTab: Int = 0
+    val selectedTab: Int = 0,
+    val shrinkTargets: Map<String, String> = emptyMap(),
+    val requantizeStatus: Map<String, RequantizeStatus> = emptyMap(),
+    val requantizeResults: Map<String, RequantizeResult> = emptyMap(),
+    val telemetry: TelemetrySnapshot = TelemetrySnapshot(),
+    val memoryStats: NativeMemoryStats? = null
+)
+
+/** State beyond the five flows [kotlinx.coroutines.flow.combine] takes at once. */
+private data class ScreenExtras(
+    val selectedTab: Int,
+    val requantizeStatus: Map<String, RequantizeStatus>,
+    val telemetry: TelemetrySnapshot,
+    val memoryStats: NativeMemoryStats?
 )
 
 /**
@@ -68,13 +110,22 @@ data class ModelManagerUiState(
 @HiltViewModel
 class ModelManagerViewModel @Inject constructor(
     private val modelManager: ModelManager,
-    private val downloadManager: ModelDownloadManager
+    private val downloadManager: ModelDownloadManager,
+    private val requantizer: ModelRequantizer
 ) : ViewModel() {
 
     private val _downloadStates = MutableStateFlow<Map<String, DownloadState>>(emptyMap())
     private val _isRefreshing = MutableStateFlow(false)
     private val _storageInfo = MutableStateFlow(StorageInfo())
     private val _selectedTab = MutableStateFlow(0)
+    private val _requantizeStatus = MutableStateFlow<Map<String, RequantizeStatus>>(emptyMap())
+
+    /** Requantizations being observed, keyed by source file name. */
+    private val requantizeJobs = mutableMapOf<String, Job>()
+
+    /** Shrink targets and requantize results, recomputed with the model list. */
+    private var shrinkTargets: Map<String, String> = emptyMap()
+    private var requantizeResults: Map<String, RequantizeResult> = emptyMap()
 
     /** Active download jobs, keyed by catalog entry ID. Used for cancellation. */
     private val downloadJobs = mutableMapOf<String, Job>()
@@ -87,8 +138,15 @@ class ModelManagerViewModel @Inject constructor(
         _downloadStates,
         _isRefreshing,
         _storageInfo,
-        _selectedTab
-    ) { modelState, downloadStates, isRefreshing, storageInfo, selectedTab ->
+        combine(
+            _selectedTab,
+            _requantizeStatus,
+            modelManager.requestTelemetry,
+            modelManager.memoryStats
+        ) { tab, status, telemetry, memoryStats ->
+            ScreenExtras(tab, status, telemetry, memoryStats)
+        }
+    ) { modelState, downloadStates, isRefreshing, storageInfo, (selectedTab, requantizeStatus, telemetry, memoryStats) ->
         val currentModelName = when (modelState) {
             is ModelManager.ModelState.Loaded -> modelState.modelName
             is ModelManager.ModelState.Loading -> modelState.modelName
@@ -103,7 +161,12 @@ class ModelManagerViewModel @Inject constructor(
             modelState = modelState,
             isRefreshing = isRefreshing,
             storageInfo = storageInfo,
-            selectedTab = selectedTab
+            selectedTab = selectedTab,
+            shrinkTargets = shrinkTargets,
+            requantizeStatus = requantizeStatus,
+            requantizeResults = requantizeResults,
+            telemetry = telemetry,
+            memoryStats = memoryStats
         )
     }.stateIn(
         scope = viewModelScope,
@@ -137,7 +200,16 @@ class ModelManagerViewModel @Inject constructor(
         _isRefreshing.value = true
         viewModelScope.launch {
             // Force re-read of model directory
-            _localModels.value = modelManager.getAvailableModelInfo()
+            val models = modelManager.getAvailableModelInfo()
+            shrinkTargets = withContext(Dispatchers.IO) {
+                models.mapNotNull { info ->
+                    requantizer.chooseTarget(info.file)?.let { info.file.name to it.type }
+                }.toMap()
+            }
+            requantizeResults = models.mapNotNull { info ->
+                requantizer.resultFor(info.file)?.let { info.file.name to it }
+            }.toMap()
+            _localModels.value = models
             val states = ModelCatalog.entries.associate { entry ->
                 entry.id to downloadManager.getDownloadState(entry.id).value
             }
@@ -221,6 +293,40 @@ class ModelManagerViewModel @Inject constructor(
         }
     }
 
+    /**
+     * Convert a local model to a smaller quantization in the background and
+     * follow its progress. The new model appears in the list when done.
+     */
+    fun shrinkModel(modelInfo: LocalModelInfo) {
+        val file = modelInfo.file
+        requantizer.schedule(file)
+        if (requantizeJobs[file.name]?.isActive == true) return
+
+        requantizeJobs[file.name] = viewModelScope.launch {
+            requantizer.observe(file).collect { info ->
+                info ?: return@collect
+                when (info.state) {
+                    WorkInfo.State.SUCCEEDED -> {
+                        _requantizeStatus.update { it - file.name }
+                        refreshModels()
+                    }
+                    WorkInfo.State.FAILED, WorkInfo.State.CANCELLED -> {
+                        val error = info.outputData.getString(RequantizeWorker.KEY_ERROR) ?: "Requantization stopped"
+                        _requantizeStatus.update { it + (file.name to RequantizeStatus(error = error)) }
+                    }
+                    else -> {
+                        val status = RequantizeStatus(
+                            stage = info.progress.getString(RequantizeWorker.KEY_STAGE),
+                            target = info.progress.getString(RequantizeWorker.KEY_TARGET),
+                            progress = info.progress.getFloat(RequantizeWorker.KEY_PROGRESS, 0f)
+                        )
+                        _requantizeStatus.update { it + (file.name to status) }
+                    }
+                }
+            }
+        }
+    }
+
     /**
      * Unload the current model.
      */
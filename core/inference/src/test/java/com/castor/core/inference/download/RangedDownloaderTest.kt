@@ -0,0 +1,185 @@
+package com.castor.core.inference.download
+
+import kotlinx.coroutines.runBlocking
+import okhttp3.OkHttpClient
+import okhttp3.mockwebserver.Dispatcher
+import okhttp3.mockwebserver.MockResponse
+import okhttp3.mockwebserver.MockWebServer
+import okhttp3.mockwebserver.RecordedRequest
+import okio.Buffer
+import org.junit.After
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Rule
+import org.junit.Test
+import org.junit.rules.TemporaryFolder
+import java.io.File
+import java.io.IOException
+import java.io.RandomAccessFile
+import java.security.MessageDigest
+import java.util.Collections
+import java.util.Properties
+import java.util.concurrent.TimeUnit
+import kotlin.random.Random
+
+class RangedDownloaderTest {
+
+    @get:Rule
+    val tmp = TemporaryFolder()
+
+    private val content = Random(42).nextBytes(8 * CHUNK + 100)
+    private val sha256 = MessageDigest.getInstance("SHA-256").digest(content).joinToString("") { "%02x".format(it) }
+    private val server = MockWebServer()
+    private val ranges: MutableList<String> = Collections.synchronizedList(mutableListOf())
+
+    /** Ranges starting at or after this offset fail with HTTP 500. */
+    @Volatile
+    private var failFrom = Long.MAX_VALUE
+
+    /** Milliseconds before the response to a range starting in chunk i, so chunks land out of order. */
+    @Volatile
+    private var delays: List<Long> = emptyList()
+
+    @Before
+    fun setUp() {
+        server.dispatcher = object : Dispatcher() {
+            override fun dispatch(request: RecordedRequest): MockResponse {
+                val range = request.getHeader("Range") ?: return MockResponse().setBody(Buffer().write(content))
+                ranges += range
+                val from = range.removePrefix("bytes=").substringBefore('-').toLong()
+                val to = range.substringAfter('-').toLong().coerceAtMost(content.size - 1L)
+                if (from >= failFrom) return MockResponse().setResponseCode(500)
+                return MockResponse()
+                    .setHeadersDelay(delays.getOrElse((from / CHUNK).toInt()) { 0L }, TimeUnit.MILLISECONDS)
+                    .setResponseCode(206)
+                    .setHeader("ETag", "\"v1\"")
+                    .setHeader("Content-Range", "bytes $from-$to/${content.size}")
+                    .setBody(Buffer().write(content, from.toInt(), (to - from + 1).toInt()))
+            }
+        }
+        server.start()
+    }
+
+    @After
+    fun tearDown() {
+        server.shutdown()
+    }
+
+    private fun download(
+        part: File,
+        manifest: File,
+        connections: Int = 1,
+        listener: RangedDownloader.ProgressListener = RangedDownloader.ProgressListener { _, _ -> }
+    ): String = runBlocking {
+        RangedDownloader(OkHttpClient(), connections = connections, chunkSize = CHUNK.toLong())
+            .download(server.url("/model.gguf").toString(), part, manifest, listener)
+    }
+
+    /** Chunk indices of the ranges requested after the probe. */
+    private fun fetchedChunks(): List<Long> =
+        ranges.drop(1).map { it.removePrefix("bytes=").substringBefore('-').toLong() / CHUNK }
+
+    /** A response delay per chunk in shuffled order, up to 9 * 15 ms. */
+    private fun shuffledDelays(seed: Int): List<Long> =
+        (0L until CHUNKS).map { it * 15 }.shuffled(Random(seed))
+
+    @Test
+    fun resumesWithOnlyTheMissingChunks() {
+        val part = File(tmp.root, "model.gguf.part")
+        val manifest = File(tmp.root, "model.gguf.manifest")
+
+        failFrom = 3L * CHUNK
+        try {
+            download(part, manifest)
+            throw AssertionError("download should have failed")
+        } catch (e: IOException) {
+            // expected: chunk 3 is unavailable
+        }
+        assertTrue(manifest.exists())
+
+        failFrom = Long.MAX_VALUE
+        ranges.clear()
+        assertEquals(sha256, download(part, manifest))
+        assertArrayEquals(content, part.readBytes())
+        assertFalse(manifest.exists())
+
+        // Probe, then chunks 3..8 only
+        assertEquals((3L..8L).toList(), fetchedChunks())
+    }
+
+    @Test
+    fun preallocatedPartWithoutManifestIsNotTrusted() {
+        val part = File(tmp.root, "model.gguf.part")
+        val manifest = File(tmp.root, "model.gguf.manifest")
+        RandomAccessFile(part, "rw").use { it.setLength(content.size.toLong()) }
+
+        assertEquals(sha256, download(part, manifest))
+        assertArrayEquals(content, part.readBytes())
+    }
+
+    @Test
+    fun sequentialPartWithoutManifestKeepsWholeChunks() {
+        val part = File(tmp.root, "model.gguf.part")
+        val manifest = File(tmp.root, "model.gguf.manifest")
+        part.writeBytes(content.copyOf(2 * CHUNK + 10))
+
+        assertEquals(sha256, download(part, manifest))
+        assertArrayEquals(content, part.readBytes())
+        assertEquals((2L..8L).toList(), fetchedChunks())
+    }
+
+    @Test
+    fun parallelChunksLandingOutOfOrderHashInFileOrder() {
+        val part = File(tmp.root, "model.gguf.part")
+        val manifest = File(tmp.root, "model.gguf.manifest")
+        delays = shuffledDelays(seed = 7)
+        val progress = Collections.synchronizedList(mutableListOf<Long>())
+
+        val hash = download(part, manifest, connections = 4) { bytes, total ->
+            assertEquals(content.size.toLong(), total)
+            progress += bytes
+        }
+
+        assertEquals(sha256, hash)
+        assertArrayEquals(content, part.readBytes())
+        assertFalse(manifest.exists())
+        assertEquals((0L until CHUNKS).toList(), fetchedChunks().sorted())
+        assertEquals(progress.sorted(), progress)
+        assertEquals(content.size.toLong(), progress.last())
+    }
+
+    @Test
+    fun parallelResumeFetchesOnlyChunksMissingFromTheManifest() {
+        val part = File(tmp.root, "model.gguf.part")
+        val manifest = File(tmp.root, "model.gguf.manifest")
+        delays = shuffledDelays(seed = 11)
+
+        failFrom = 5L * CHUNK
+        try {
+            download(part, manifest, connections = 3)
+            throw AssertionError("download should have failed")
+        } catch (e: IOException) {
+            // expected: chunks 5..8 are unavailable
+        }
+        val props = Properties().apply { manifest.inputStream().use { load(it) } }
+        val done = props.getProperty("done").split(',').mapNotNull { it.toLongOrNull() }.toSet()
+        assertTrue(done.all { it < 5 })
+
+        failFrom = Long.MAX_VALUE
+        ranges.clear()
+        assertEquals(sha256, download(part, manifest, connections = 3))
+        assertArrayEquals(content, part.readBytes())
+        assertFalse(manifest.exists())
+        assertEquals((0L until CHUNKS).filter { it !in done }, fetchedChunks().sorted())
+    }
+
+    private companion object {
+        const val CHUNK = 1024
+
+        /** [content] spans 8 whole chunks and a partial ninth. */
+        const val CHUNKS = 9L
+    }
+}
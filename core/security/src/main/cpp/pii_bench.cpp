@@ -0,0 +1,126 @@
+// Host throughput benchmark for pii_scanner.h.
+//
+//   cmake -S core/security/src/main/cpp -B build-pii && cmake --build build-pii
+//   ./build-pii/pii_bench [megabytes] [iterations]
+//
+// Scans a synthetic corpus of notification-sized and long message bodies
+// and, for comparison, runs the seven patterns PrivacyClassifier.redact used
+// to apply one after another (std::regex, on a slice of the corpus).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "pii_scanner.h"
+
+namespace {
+
+const char *FILLER[] = {
+    "hey", "are", "we", "still", "on", "for", "tonight", "the", "meeting", "moved",
+    "to", "thursday", "can", "you", "send", "me", "notes", "thanks", "see", "you",
+    "later", "lunch", "ok", "running", "late", "new", "message", "reply", "call", "back",
+};
+
+const char *PII[] = {
+    "555-123-4567", "(555) 987-6543", "+44 7911123456", "jane.doe@example.com",
+    "123-45-6789", "4111 1111 1111 1111", "from Alice Smith", "1600 Pennsylvania Ave",
+};
+
+// Bodies between min_words and max_words long with about one PII item per 40 words
+std::vector<std::string> make_bodies(std::mt19937 &rng, size_t total_bytes, int min_words, int max_words) {
+    std::uniform_int_distribution<int> words(min_words, max_words);
+    std::uniform_int_distribution<int> filler(0, sizeof(FILLER) / sizeof(*FILLER) - 1);
+    std::uniform_int_distribution<int> pii(0, sizeof(PII) / sizeof(*PII) - 1);
+    std::uniform_int_distribution<int> roll(0, 39);
+
+    std::vector<std::string> bodies;
+    size_t bytes = 0;
+    while (bytes < total_bytes) {
+        std::string body;
+        for (int w = words(rng); w > 0; w--) {
+            if (!body.empty()) body += ' ';
+            body += roll(rng) == 0 ? PII[pii(rng)] : FILLER[filler(rng)];
+        }
+        bytes += body.size();
+        bodies.push_back(std::move(body));
+    }
+    return bodies;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Result {
+    double mb_per_s;
+    size_t spans;
+};
+
+Result bench_scanner(const std::vector<std::string> &bodies, size_t bytes, int iterations) {
+    size_t spans = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (const auto &body : bodies) spans += pii::scan(body).size();
+    }
+    double s = seconds_since(start);
+    return {bytes * (double)iterations / s / 1e6, spans / iterations};
+}
+
+Result bench_regex(const std::vector<std::string> &bodies, size_t bytes) {
+    const std::vector<std::regex> patterns = {
+        std::regex(R"([A-Za-z0-9._%+\-]+@[A-Za-z0-9.\-]+\.[A-Za-z]{2,})"),
+        std::regex(R"(\b\d{3}-\d{2}-\d{4}\b)"),
+        std::regex(R"(\b\d{4}[\s-]?\d{4}[\s-]?\d{4}[\s-]?\d{4}\b)"),
+        std::regex(R"(\+?1?[\s.-]?\(?\d{3}\)?[\s.-]?\d{3}[\s.-]?\d{4})"),
+        std::regex(R"(\+\d{1,4}[\s.-]?\d{4,14})"),
+        std::regex(R"((?:from|to|for|about)\s+([A-Z][a-z]+(?:\s+[A-Z][a-z]+)*))"),
+        std::regex(R"(\b\d{1,5}\s+[A-Z][a-z]+(?:\s+[A-Z][a-z]+)*\s+(?:St|Ave|Blvd|Dr|Ln|Rd|Way|Ct|Pl)\b)"),
+    };
+    size_t matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &body : bodies) {
+        for (const auto &re : patterns) {
+            matches += std::distance(std::sregex_iterator(body.begin(), body.end(), re), std::sregex_iterator());
+        }
+    }
+    double s = seconds_since(start);
+    return {bytes / s / 1e6, matches};
+}
+
+size_t total_size(const std::vector<std::string> &bodies) {
+    size_t n = 0;
+    for (const auto &b : bodies) n += b.size();
+    return n;
+}
+
+void run(const char *label, const std::vector<std::string> &bodies, int iterations) {
+    size_t bytes = total_size(bodies);
+    Result scanner = bench_scanner(bodies, bytes, iterations);
+
+    // std::regex is slow enough that a slice of the corpus suffices
+    std::vector<std::string> slice(bodies.begin(), bodies.begin() + std::max<size_t>(1, bodies.size() / 16));
+    Result regex = bench_regex(slice, total_size(slice));
+
+    std::printf("%-14s %6zu bodies %8.2f MB | scanner %8.1f MB/s (%zu spans) | regex x7 %6.1f MB/s | %.0fx\n",
+                label, bodies.size(), bytes / 1e6, scanner.mb_per_s, scanner.spans,
+                regex.mb_per_s, scanner.mb_per_s / regex.mb_per_s);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    double megabytes = argc > 1 ? std::atof(argv[1]) : 8.0;
+    int iterations   = argc > 2 ? std::atoi(argv[2]) : 5;
+    size_t bytes = (size_t)(megabytes * 1e6);
+
+    std::mt19937 rng(42);
+    run("notifications", make_bodies(rng, bytes, 5, 40), iterations);
+    run("messages", make_bodies(rng, bytes, 2000, 20000), iterations);
+    return 0;
+}
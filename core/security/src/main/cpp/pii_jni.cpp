@@ -0,0 +1,42 @@
+#include <jni.h>
+#include <string>
+#include <vector>
+
+#include "pii_scanner.h"
+
+extern "C" {
+
+// --- nativeScan(text): IntArray ---
+// PII spans flattened as [type, start, end] with offsets in UTF-16 chars.
+JNIEXPORT jintArray JNICALL
+Java_com_castor_core_security_PiiScanner_nativeScan(JNIEnv *env, jobject, jstring jtext) {
+    const char *chars = env->GetStringUTFChars(jtext, nullptr);
+    std::string text(chars);
+    env->ReleaseStringUTFChars(jtext, chars);
+
+    std::vector<pii::Span> spans = pii::scan(text);
+
+    // Modified UTF-8 from the JVM encodes each UTF-16 unit separately, so
+    // counting non-continuation bytes yields Java char offsets.
+    std::vector<jint> out;
+    out.reserve(spans.size() * 3);
+    size_t byte = 0;
+    jint units = 0;
+    auto advance_to = [&](size_t target) {
+        for (; byte < target; byte++) {
+            if (((unsigned char)text[byte] & 0xC0) != 0x80) units++;
+        }
+        return units;
+    };
+    for (const pii::Span &s : spans) {
+        out.push_back((jint)s.type);
+        out.push_back(advance_to(s.start));
+        out.push_back(advance_to(s.end));
+    }
+
+    jintArray result = env->NewIntArray((jsize)out.size());
+    if (!out.empty()) env->SetIntArrayRegion(result, 0, (jsize)out.size(), out.data());
+    return result;
+}
+
+} // extern "C"
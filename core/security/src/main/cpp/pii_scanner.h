@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Single-pass PII scanner behind PrivacyClassifier.
+//
+// One left-to-right walk over the bytes dispatches on a character class
+// table: digits, '+' and '(' start the number recognizers (SSN, card, US and
+// international phone, street address), '@' closes an email whose local part
+// was tracked while walking, and a cue word ("from", "to", "for", "about")
+// starts a name. Each recognizer reads a bounded window, so the whole scan
+// is linear in the input. Overlapping candidates are resolved by type
+// priority, the order in which PrivacyClassifier used to apply its regexes.
+namespace pii {
+
+// Values are shared with PiiType.kt; lower values win overlaps
+enum class Type : int {
+    EMAIL   = 0,
+    SSN     = 1,
+    CARD    = 2,
+    PHONE   = 3,
+    NAME    = 4,
+    ADDRESS = 5,
+};
+constexpr int TYPE_COUNT = 6;
+
+struct Span {
+    Type   type;
+    size_t start; // byte offsets, end exclusive
+    size_t end;
+};
+
+namespace detail {
+
+enum : uint8_t {
+    DIGIT        = 1 << 0,
+    UPPER        = 1 << 1,
+    LOWER        = 1 << 2,
+    SPACE        = 1 << 3, // \s
+    EMAIL_LOCAL  = 1 << 4, // [A-Za-z0-9._%+-]
+    EMAIL_DOMAIN = 1 << 5, // [A-Za-z0-9.-]
+    WORD         = 1 << 6, // \w, plus any non-ASCII byte
+};
+
+struct Classes {
+    uint8_t of[256] = {};
+
+    Classes() {
+        for (int c = 0; c < 256; c++) {
+            uint8_t m = 0;
+            if (c >= '0' && c <= '9') m |= DIGIT | WORD | EMAIL_LOCAL | EMAIL_DOMAIN;
+            if (c >= 'A' && c <= 'Z') m |= UPPER | WORD | EMAIL_LOCAL | EMAIL_DOMAIN;
+            if (c >= 'a' && c <= 'z') m |= LOWER | WORD | EMAIL_LOCAL | EMAIL_DOMAIN;
+            if (c == '_' || c >= 0x80) m |= WORD;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r') m |= SPACE;
+            if (c == '.' || c == '-') m |= EMAIL_LOCAL | EMAIL_DOMAIN;
+            if (c == '_' || c == '%' || c == '+') m |= EMAIL_LOCAL;
+            of[c] = m;
+        }
+    }
+};
+
+inline const Classes &classes() {
+    static const Classes table;
+    return table;
+}
+
+// One element of a fixed pattern: a byte accepted by class mask or by
+// literal set, repeated min..max times
+struct Elem {
+    uint8_t     mask;
+    const char *chars;
+    uint8_t     min;
+    uint8_t     max;
+};
+
+class Text {
+public:
+    Text(const unsigned char *s, size_t n) : s_(s), n_(n), cls_(classes()) {}
+
+    size_t size() const { return n_; }
+    const unsigned char *data() const { return s_; }
+    unsigned char at(size_t i) const { return s_[i]; }
+    bool is(size_t i, uint8_t mask) const { return i < n_ && (cls_.of[s_[i]] & mask); }
+
+    // \b at i
+    bool boundary(size_t i) const {
+        bool before = i > 0 && (cls_.of[s_[i - 1]] & WORD);
+        bool after  = i < n_ && (cls_.of[s_[i]] & WORD);
+        return before != after;
+    }
+
+    bool accepts(const Elem &e, size_t i) const {
+        if (i >= n_) return false;
+        unsigned char c = s_[i];
+        return (cls_.of[c] & e.mask) || (e.chars && c != 0 && std::strchr(e.chars, c));
+    }
+
+    // Greedy match with backtracking, like a regex of quantified classes.
+    // Returns the end of the match, or -1.
+    long match(size_t pos, const Elem *e, size_t n_elems) const {
+        if (n_elems == 0) return (long)pos;
+        size_t k = 0;
+        while (k < e->max && accepts(*e, pos + k)) k++;
+        for (size_t j = k + 1; j-- > e->min;) {
+            long end = match(pos + j, e + 1, n_elems - 1);
+            if (end >= 0) return end;
+        }
+        return -1;
+    }
+
+    // [A-Z][a-z]+ at i; returns its end or 0
+    size_t capitalized_word(size_t i) const {
+        if (!is(i, UPPER) || !is(i + 1, LOWER)) return 0;
+        size_t j = i + 2;
+        while (is(j, LOWER)) j++;
+        return j;
+    }
+
+    size_t skip_space(size_t i) const {
+        while (is(i, SPACE)) i++;
+        return i;
+    }
+
+    bool starts_with_ci(size_t i, const char *word) const {
+        size_t len = std::strlen(word);
+        if (i + len > n_) return false;
+        for (size_t k = 0; k < len; k++) {
+            unsigned char c = s_[i + k];
+            if (c >= 'A' && c <= 'Z') c = (unsigned char)(c - 'A' + 'a');
+            if (c != (unsigned char)word[k]) return false;
+        }
+        return true;
+    }
+
+private:
+    const unsigned char *s_;
+    size_t n_;
+    const Classes &cls_;
+};
+
+// \+?1?[\s.-]?\(?\d{3}\)?[\s.-]?\d{3}[\s.-]?\d{4}
+constexpr Elem US_PHONE[] = {
+    {0, "+", 0, 1}, {0, "1", 0, 1}, {SPACE, ".-", 0, 1}, {0, "(", 0, 1}, {DIGIT, nullptr, 3, 3},
+    {0, ")", 0, 1}, {SPACE, ".-", 0, 1}, {DIGIT, nullptr, 3, 3}, {SPACE, ".-", 0, 1}, {DIGIT, nullptr, 4, 4},
+};
+// \+\d{1,4}[\s.-]?\d{4,14}
+constexpr Elem INTL_PHONE[] = {
+    {0, "+", 1, 1}, {DIGIT, nullptr, 1, 4}, {SPACE, ".-", 0, 1}, {DIGIT, nullptr, 4, 14},
+};
+// \b\d{3}-\d{2}-\d{4}\b
+constexpr Elem SSN[] = {
+    {DIGIT, nullptr, 3, 3}, {0, "-", 1, 1}, {DIGIT, nullptr, 2, 2}, {0, "-", 1, 1}, {DIGIT, nullptr, 4, 4},
+};
+// \b\d{4}[\s-]?\d{4}[\s-]?\d{4}[\s-]?\d{4}\b
+constexpr Elem CARD[] = {
+    {DIGIT, nullptr, 4, 4}, {SPACE, "-", 0, 1}, {DIGIT, nullptr, 4, 4}, {SPACE, "-", 0, 1},
+    {DIGIT, nullptr, 4, 4}, {SPACE, "-", 0, 1}, {DIGIT, nullptr, 4, 4},
+};
+
+template <size_t N>
+long match(const Text &t, size_t pos, const Elem (&pattern)[N]) {
+    return t.match(pos, pattern, N);
+}
+
+constexpr const char *NAME_CUES[] = {"about", "from", "for", "to"};
+constexpr const char *STREET_SUFFIXES[] = {"Blvd", "Ave", "St", "Dr", "Ln", "Rd", "Way", "Ct", "Pl"};
+
+// (?:from|to|for|about)\s+([A-Z][a-z]+(?:\s+[A-Z][a-z]+)*), cue case-insensitive
+// and at a word start. The span covers the name only.
+inline bool match_name(const Text &t, size_t i, Span &out) {
+    for (const char *cue : NAME_CUES) {
+        if (!t.starts_with_ci(i, cue)) continue;
+        size_t p = i + std::strlen(cue);
+        if (!t.is(p, SPACE)) continue;
+        size_t start = t.skip_space(p);
+        size_t end = t.capitalized_word(start);
+        if (!end) continue;
+        for (;;) {
+            size_t next = t.skip_space(end);
+            size_t word_end = next > end ? t.capitalized_word(next) : 0;
+            if (!word_end) break;
+            end = word_end;
+        }
+        out = {Type::NAME, start, end};
+        return true;
+    }
+    return false;
+}
+
+// \b\d{1,5}\s+[A-Z][a-z]+(?:\s+[A-Z][a-z]+)*\s+(?:St|Ave|Blvd|Dr|Ln|Rd|Way|Ct|Pl)\b
+inline bool match_address(const Text &t, size_t i, Span &out) {
+    size_t p = i;
+    while (p - i < 5 && t.is(p, DIGIT)) p++;
+    if (t.is(p, DIGIT) || !t.is(p, SPACE)) return false;
+    p = t.skip_space(p);
+
+    // Greedy: the last suffix preceded by at least one capitalized word wins
+    long end = -1;
+    for (int words = 0;; words++) {
+        if (words > 0) {
+            for (const char *suffix : STREET_SUFFIXES) {
+                size_t len = std::strlen(suffix);
+                if (p + len <= t.size() && std::memcmp(t.data() + p, suffix, len) == 0 && t.boundary(p + len)) {
+                    end = (long)(p + len);
+                    break;
+                }
+            }
+        }
+        size_t word_end = t.capitalized_word(p);
+        if (!word_end || !t.is(word_end, SPACE)) break;
+        p = t.skip_space(word_end);
+    }
+    if (end < 0) return false;
+    out = {Type::ADDRESS, i, (size_t)end};
+    return true;
+}
+
+} // namespace detail
+
+// Every PII span in text, sorted by start and non-overlapping
+inline std::vector<Span> scan(const char *data, size_t n) {
+    using namespace detail;
+    const Text t(reinterpret_cast<const unsigned char *>(data), n);
+
+    std::vector<Span> candidates;
+    size_t next[TYPE_COUNT] = {}; // matches of one type do not overlap
+    size_t local_start = 0;       // start of the run of email local-part bytes
+
+    auto add = [&](Type type, size_t start, size_t end) {
+        candidates.push_back({type, start, end});
+        next[(int)type] = end;
+    };
+    auto ready = [&](Type type, size_t i) { return i >= next[(int)type]; };
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = t.at(i);
+        bool word_start = t.boundary(i);
+
+        if (t.is(i, DIGIT)) {
+            long end;
+            if (word_start && ready(Type::SSN, i) && (end = match(t, i, SSN)) >= 0 && t.boundary((size_t)end)) {
+                add(Type::SSN, i, (size_t)end);
+            }
+            if (word_start && ready(Type::CARD, i) && (end = match(t, i, CARD)) >= 0 && t.boundary((size_t)end)) {
+                add(Type::CARD, i, (size_t)end);
+            }
+            Span address;
+            if (word_start && ready(Type::ADDRESS, i) && match_address(t, i, address)) {
+                add(Type::ADDRESS, address.start, address.end);
+            }
+        }
+        if ((t.is(i, DIGIT) || c == '+' || c == '(') && ready(Type::PHONE, i)) {
+            long end = match(t, i, US_PHONE);
+            if (end < 0 && c == '+') end = match(t, i, INTL_PHONE);
+            if (end >= 0) add(Type::PHONE, i, (size_t)end);
+        }
+        if (word_start && t.is(i, UPPER | LOWER) && ready(Type::NAME, i)) {
+            Span name;
+            if (match_name(t, i, name)) add(Type::NAME, name.start, name.end);
+        }
+
+        if (c == '@') {
+            size_t start = local_start > next[(int)Type::EMAIL] ? local_start : next[(int)Type::EMAIL];
+            if (start < i) {
+                // [A-Za-z0-9.-]+\.[A-Za-z]{2,}: the last dot followed by two letters
+                size_t run = i + 1;
+                while (t.is(run, EMAIL_DOMAIN)) run++;
+                for (size_t d = run; d-- > i + 2;) {
+                    if (t.at(d) != '.') continue;
+                    size_t tld = d + 1;
+                    while (tld < run && t.is(tld, UPPER | LOWER)) tld++;
+                    if (tld - d - 1 >= 2) {
+                        add(Type::EMAIL, start, tld);
+                        break;
+                    }
+                }
+            }
+        }
+        if (!t.is(i, EMAIL_LOCAL)) local_start = i + 1;
+    }
+
+    // Higher-priority types claim their bytes first
+    std::vector<Span> spans;
+    std::vector<bool> taken(n, false);
+    for (int type = 0; type < TYPE_COUNT; type++) {
+        for (const Span &s : candidates) {
+            if ((int)s.type != type) continue;
+            bool free = true;
+            for (size_t k = s.start; k < s.end && free; k++) free = !taken[k];
+            if (!free) continue;
+            for (size_t k = s.start; k < s.end; k++) taken[k] = true;
+            spans.push_back(s);
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.start < b.start; });
+    return spans;
+}
+
+inline std::vector<Span> scan(const std::string &text) {
+    return scan(text.data(), text.size());
+}
+
+} // namespace pii
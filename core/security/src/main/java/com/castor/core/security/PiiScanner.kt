@@ -0,0 +1,82 @@
+package com.castor.core.security
+
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * Kinds of personal data found by [PiiScanner], in priority order: when two
+ * candidates overlap, the earlier type wins. Ordinals are shared with the
+ * native scanner (`pii_scanner.h`).
+ */
+enum class PiiType(val placeholder: String) {
+    EMAIL("[EMAIL]"),
+    SSN("[SSN]"),
+    CARD("[CARD]"),
+    PHONE("[PHONE]"),
+    NAME("[NAME]"),
+    ADDRESS("[ADDRESS]")
+}
+
+/** A run of personal data in a text: chars [start, end). */
+data class PiiSpan(val type: PiiType, val start: Int, val end: Int)
+
+/**
+ * Finds phone numbers, emails, SSNs, card numbers, street addresses and
+ * names after a cue word ("from", "to", "for", "about") in one pass over the
+ * text, returning typed, non-overlapping spans sorted by position.
+ *
+ * The scan runs natively (`libundios-security`); without the native library
+ * the same patterns are matched with [Regex]es compiled once.
+ */
+@Singleton
+class PiiScanner @Inject constructor() {
+
+    private val nativeAvailable: Boolean = try {
+        System.loadLibrary("undios-security")
+        true
+    } catch (e: UnsatisfiedLinkError) {
+        false
+    }
+
+    fun scan(text: String): List<PiiSpan> {
+        if (text.isEmpty()) return emptyList()
+        return if (nativeAvailable) scanNative(text) else scanKotlin(text)
+    }
+
+    fun containsPii(text: String): Boolean = scan(text).isNotEmpty()
+
+    private fun scanNative(text: String): List<PiiSpan> {
+        val raw = nativeScan(text)
+        val types = PiiType.entries
+        return List(raw.size / 3) { i -> PiiSpan(types[raw[3 * i]], raw[3 * i + 1], raw[3 * i + 2]) }
+    }
+
+    private fun scanKotlin(text: String): List<PiiSpan> {
+        val taken = BooleanArray(text.length)
+        val spans = ArrayList<PiiSpan>()
+        for ((type, regex) in FALLBACK_PATTERNS) {
+            for (match in regex.findAll(text)) {
+                // The name pattern captures the name after its cue word
+                val range = match.groups[1]?.range ?: match.range
+                if ((range.first..range.last).any { taken[it] }) continue
+                for (i in range) taken[i] = true
+                spans += PiiSpan(type, range.first, range.last + 1)
+            }
+        }
+        return spans.sortedBy { it.start }
+    }
+
+    private companion object {
+        val FALLBACK_PATTERNS = listOf(
+            PiiType.EMAIL to Regex("""[A-Za-z0-9._%+\-]+@[A-Za-z0-9.\-]+\.[A-Za-z]{2,}"""),
+            PiiType.SSN to Regex("""\b\d{3}-\d{2}-\d{4}\b"""),
+            PiiType.CARD to Regex("""\b\d{4}[\s-]?\d{4}[\s-]?\d{4}[\s-]?\d{4}\b"""),
+            // US numbers, then international ones starting with +<country code>
+            PiiType.PHONE to Regex("""(?=[+(\d])\+?1?[\s.-]?\(?\d{3}\)?[\s.-]?\d{3}[\s.-]?\d{4}|\+\d{1,4}[\s.-]?\d{4,14}"""),
+            PiiType.NAME to Regex("""\b(?i:from|to|for|about)\s+([A-Z][a-z]+(?:\s+[A-Z][a-z]+)*)"""),
+            PiiType.ADDRESS to Regex("""\b\d{1,5}\s+[A-Z][a-z]+(?:\s+[A-Z][a-z]+)*\s+(?:St|Ave|Blvd|Dr|Ln|Rd|Way|Ct|Pl)\b""")
+        )
+    }
+
+    private external fun nativeScan(text: String): IntArray
+}
@@ -9,11 +9,15 @@ import javax.inject.Singleton
  * capabilities. This is the gatekeeper that determines whether a query can
  * be processed locally, sent anonymized to the cloud, or sent as-is.
  *
- * Classification is keyword + pattern based. The classifier errs on the side
- * of caution: any ambiguous input defaults to LOCAL.
+ * Classification is keyword based, plus the inline PII (phone numbers, emails,
+ * names after "from" / "to", etc.) found by [PiiScanner] in a single pass; the
+ * same spans drive [redact] and [auditResponse]. The classifier errs on the
+ * side of caution: any ambiguous input defaults to LOCAL.
  */
 @Singleton
-class PrivacyClassifier @Inject constructor() {
+class PrivacyClassifier @Inject constructor(
+    private val piiScanner: PiiScanner
+) {
 
     // =========================================================================
     // Patterns that indicate personal / on-device data (must stay LOCAL)
@@ -42,25 +46,6 @@ class PrivacyClassifier @Inject constructor() {
         "credit card", "health", "medical"
     )
 
-    /** Regex patterns that match PII inline — phone numbers, emails, names
-     *  after "from" / "to", etc. */
-    private val localPatterns: List<Regex> = listOf(
-        // US phone numbers: (xxx) xxx-xxxx, xxx-xxx-xxxx, +1xxxxxxxxxx
-        Regex("""\+?1?[\s.-]?\(?\d{3}\)?[\s.-]?\d{3}[\s.-]?\d{4}"""),
-        // International phone numbers (generic): +<country code> followed by digits
-        Regex("""\+\d{1,4}[\s.-]?\d{4,14}"""),
-        // Email addresses
-        Regex("""[A-Za-z0-9._%+\-]+@[A-Za-z0-9.\-]+\.[A-Za-z]{2,}"""),
-        // Names after "from" or "to" (simple heuristic: capitalized words)
-        Regex("""(?:from|to|for|about)\s+([A-Z][a-z]+(?:\s+[A-Z][a-z]+)*)"""),
-        // Social security numbers: xxx-xx-xxxx
-        Regex("""\b\d{3}-\d{2}-\d{4}\b"""),
-        // Credit card numbers (basic: 4 groups of 4 digits)
-        Regex("""\b\d{4}[\s-]?\d{4}[\s-]?\d{4}[\s-]?\d{4}\b"""),
-        // Street addresses (number + street name pattern)
-        Regex("""\b\d{1,5}\s+[A-Z][a-z]+(?:\s+[A-Z][a-z]+)*\s+(?:St|Ave|Blvd|Dr|Ln|Rd|Way|Ct|Pl)\b""")
-    )
-
     // =========================================================================
     // Patterns that indicate cloud-suitable requests
     // =========================================================================
@@ -144,39 +129,16 @@ class PrivacyClassifier @Inject constructor() {
      * @return The input with PII replaced by placeholder tokens
      */
     fun redact(input: String): String {
-        var redacted = input
-
-        // Redact email addresses
-        redacted = Regex("""[A-Za-z0-9._%+\-]+@[A-Za-z0-9.\-]+\.[A-Za-z]{2,}""")
-            .replace(redacted, "[EMAIL]")
-
-        // Redact SSNs
-        redacted = Regex("""\b\d{3}-\d{2}-\d{4}\b""")
-            .replace(redacted, "[SSN]")
-
-        // Redact credit card numbers
-        redacted = Regex("""\b\d{4}[\s-]?\d{4}[\s-]?\d{4}[\s-]?\d{4}\b""")
-            .replace(redacted, "[CARD]")
-
-        // Redact phone numbers (US patterns)
-        redacted = Regex("""\+?1?[\s.-]?\(?\d{3}\)?[\s.-]?\d{3}[\s.-]?\d{4}""")
-            .replace(redacted, "[PHONE]")
-
-        // Redact international phone numbers
-        redacted = Regex("""\+\d{1,4}[\s.-]?\d{4,14}""")
-            .replace(redacted, "[PHONE]")
-
-        // Redact names after "from", "to", "for", "about" (capitalized words)
-        redacted = Regex("""(?i)(from|to|for|about)\s+([A-Z][a-z]+(?:\s+[A-Z][a-z]+)+)""")
-            .replace(redacted) { match ->
-                "${match.groupValues[1]} [NAME]"
-            }
-
-        // Redact street addresses
-        redacted = Regex("""\b\d{1,5}\s+[A-Z][a-z]+(?:\s+[A-Z][a-z]+)*\s+(?:St|Ave|Blvd|Dr|Ln|Rd|Way|Ct|Pl)\b""")
-            .replace(redacted, "[ADDRESS]")
-
-        return redacted
+        val spans = piiScanner.scan(input)
+        if (spans.isEmpty()) return input
+
+        val redacted = StringBuilder(input.length)
+        var last = 0
+        for (span in spans) {
+            redacted.append(input, last, span.start).append(span.type.placeholder)
+            last = span.end
+        }
+        return redacted.append(input, last, input.length).toString()
     }
 
     /**
@@ -202,11 +164,11 @@ class PrivacyClassifier @Inject constructor() {
      * Returns `true` if the text contains any PII pattern matches.
      */
     private fun containsPersonalData(text: String): Boolean {
-        return localPatterns.any { pattern -> pattern.containsMatchIn(text) }
+        return piiScanner.containsPii(text)
     }
 
     companion object {
         /** Placeholder tokens used during redaction */
-        val REDACTION_TOKENS = setOf("[EMAIL]", "[PHONE]", "[SSN]", "[CARD]", "[NAME]", "[ADDRESS]")
+        val REDACTION_TOKENS = PiiType.entries.map { it.placeholder }.toSet()
     }
 }
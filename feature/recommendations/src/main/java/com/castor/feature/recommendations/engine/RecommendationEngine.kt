@@ -44,9 +44,12 @@ Rules:
 - PLATFORM: Where to watch — one of: Netflix, Prime Video, YouTube.
 - REASON: A short sentence explaining why they would like it.
 
-Output ONLY the 5 lines. No numbering, no headers, no extra text."""
+Output ONLY the 5 lines, then a line containing only END. No numbering, no headers, no extra text."""
 
         private const val MAX_TOKENS = 1024
+
+        /** Generation ends at the END line instead of running on into commentary. */
+        private val STOP = listOf("\nEND")
         private const val TEMPERATURE = 0.7f
     }
 
@@ -81,7 +84,8 @@ Output ONLY the 5 lines. No numbering, no headers, no extra text."""
                 prompt = userPrompt,
                 systemPrompt = SYSTEM_PROMPT,
                 maxTokens = MAX_TOKENS,
-                temperature = TEMPERATURE
+                temperature = TEMPERATURE,
+                stop = STOP
             )
 
             Log.d(TAG, "LLM output:\n$rawOutput")